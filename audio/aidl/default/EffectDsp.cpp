@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+
+#include "effect-impl/EffectDsp.h"
+
+namespace aidl::android::hardware::audio::effect {
+
+namespace {
+
+static_assert(kDspLanes == 4, "splat() and the group dispatch assume 4 lanes");
+
+// Gain reduction floor, also used as the level of digital silence.
+constexpr float kMinLevelDb = -120.f;
+// Values below this are flushed to zero in the filter state to avoid denormals on silence.
+constexpr float kDenormalThreshold = 1e-20f;
+
+inline DspFloatVec splat(float value) {
+    return DspFloatVec{value, value, value, value};
+}
+
+// Load the first kWidth channels of a group, the unused lanes are zero.
+// Built lane by lane, a partial memcpy into a vector goes through the stack with most compilers.
+template <size_t kWidth>
+inline DspFloatVec loadLanes(const float* in) {
+    if constexpr (kWidth == 1) {
+        return DspFloatVec{in[0], 0.f, 0.f, 0.f};
+    } else if constexpr (kWidth == 2) {
+        return DspFloatVec{in[0], in[1], 0.f, 0.f};
+    } else if constexpr (kWidth == 3) {
+        return DspFloatVec{in[0], in[1], in[2], 0.f};
+    } else {
+        DspFloatVec value;
+        memcpy(&value, in, sizeof(value));
+        return value;
+    }
+}
+
+template <size_t kWidth>
+inline void storeLanes(float* out, const DspFloatVec& value) {
+    if constexpr (kWidth == kDspLanes) {
+        memcpy(out, &value, sizeof(value));
+    } else {
+        for (size_t lane = 0; lane < kWidth; lane++) {
+            out[lane] = value[lane];
+        }
+    }
+}
+
+inline DspFloatVec absLanes(const DspFloatVec& value) {
+    return (DspFloatVec)((DspIntVec)value & 0x7fffffff);
+}
+
+inline DspFloatVec selectLanes(const DspIntVec& mask, const DspFloatVec& a, const DspFloatVec& b) {
+    return (DspFloatVec)((mask & (DspIntVec)a) | (~mask & (DspIntVec)b));
+}
+
+inline DspFloatVec flushDenormals(const DspFloatVec& value) {
+    return selectLanes(absLanes(value) < splat(kDenormalThreshold), splat(0.f), value);
+}
+
+inline size_t getGroupCount(size_t channelCount) {
+    return (channelCount + kDspLanes - 1) / kDspLanes;
+}
+
+// Call f with the number of channels in the group as a std::integral_constant, so the inner
+// loops are compiled with a constant load/store width.
+template <class F>
+inline void dispatchGroupWidth(size_t channelCount, size_t group, F&& f) {
+    switch (std::min(kDspLanes, channelCount - group * kDspLanes)) {
+        case 1:
+            f(std::integral_constant<size_t, 1>());
+            break;
+        case 2:
+            f(std::integral_constant<size_t, 2>());
+            break;
+        case 3:
+            f(std::integral_constant<size_t, 3>());
+            break;
+        default:
+            f(std::integral_constant<size_t, kDspLanes>());
+            break;
+    }
+}
+
+struct CookbookParams {
+    double cosW0;
+    double alpha;
+    double a;
+};
+
+CookbookParams getCookbookParams(float sampleRate, float freqHz, float q, float gainDb) {
+    // Keep the design away from DC and Nyquist where it becomes unstable.
+    double freq = std::clamp<double>(freqHz, 1.0, sampleRate * 0.49);
+    double w0 = 2.0 * M_PI * freq / sampleRate;
+    return {.cosW0 = std::cos(w0),
+            .alpha = std::sin(w0) / (2.0 * std::max(q, 0.01f)),
+            .a = std::pow(10.0, gainDb / 40.0)};
+}
+
+BiquadCoefficients normalize(double b0, double b1, double b2, double a0, double a1, double a2) {
+    return {.b0 = static_cast<float>(b0 / a0),
+            .b1 = static_cast<float>(b1 / a0),
+            .b2 = static_cast<float>(b2 / a0),
+            .a1 = static_cast<float>(a1 / a0),
+            .a2 = static_cast<float>(a2 / a0)};
+}
+
+float getTimeCoefficient(float timeMs, float sampleRate) {
+    if (timeMs <= 0.f) {
+        return 0.f;
+    }
+    return std::exp(-1.f / (timeMs * 0.001f * sampleRate));
+}
+
+}  // namespace
+
+BiquadCoefficients BiquadCoefficients::lowPass(float sampleRate, float freqHz, float q) {
+    auto p = getCookbookParams(sampleRate, freqHz, q, 0.f);
+    return normalize((1 - p.cosW0) / 2, 1 - p.cosW0, (1 - p.cosW0) / 2, 1 + p.alpha, -2 * p.cosW0,
+                     1 - p.alpha);
+}
+
+BiquadCoefficients BiquadCoefficients::highPass(float sampleRate, float freqHz, float q) {
+    auto p = getCookbookParams(sampleRate, freqHz, q, 0.f);
+    return normalize((1 + p.cosW0) / 2, -(1 + p.cosW0), (1 + p.cosW0) / 2, 1 + p.alpha,
+                     -2 * p.cosW0, 1 - p.alpha);
+}
+
+BiquadCoefficients BiquadCoefficients::allPass(float sampleRate, float freqHz, float q) {
+    auto p = getCookbookParams(sampleRate, freqHz, q, 0.f);
+    return normalize(1 - p.alpha, -2 * p.cosW0, 1 + p.alpha, 1 + p.alpha, -2 * p.cosW0,
+                     1 - p.alpha);
+}
+
+BiquadCoefficients BiquadCoefficients::peaking(float sampleRate, float freqHz, float q,
+                                               float gainDb) {
+    auto p = getCookbookParams(sampleRate, freqHz, q, gainDb);
+    return normalize(1 + p.alpha * p.a, -2 * p.cosW0, 1 - p.alpha * p.a, 1 + p.alpha / p.a,
+                     -2 * p.cosW0, 1 - p.alpha / p.a);
+}
+
+BiquadCoefficients BiquadCoefficients::lowShelf(float sampleRate, float freqHz, float q,
+                                                float gainDb) {
+    auto p = getCookbookParams(sampleRate, freqHz, q, gainDb);
+    double a = p.a;
+    double k = 2 * std::sqrt(a) * p.alpha;
+    return normalize(a * ((a + 1) - (a - 1) * p.cosW0 + k), 2 * a * ((a - 1) - (a + 1) * p.cosW0),
+                     a * ((a + 1) - (a - 1) * p.cosW0 - k), (a + 1) + (a - 1) * p.cosW0 + k,
+                     -2 * ((a - 1) + (a + 1) * p.cosW0), (a + 1) + (a - 1) * p.cosW0 - k);
+}
+
+BiquadCoefficients BiquadCoefficients::highShelf(float sampleRate, float freqHz, float q,
+                                                 float gainDb) {
+    auto p = getCookbookParams(sampleRate, freqHz, q, gainDb);
+    double a = p.a;
+    double k = 2 * std::sqrt(a) * p.alpha;
+    return normalize(a * ((a + 1) + (a - 1) * p.cosW0 + k), -2 * a * ((a - 1) + (a + 1) * p.cosW0),
+                     a * ((a + 1) + (a - 1) * p.cosW0 - k), (a + 1) - (a - 1) * p.cosW0 + k,
+                     2 * ((a - 1) - (a + 1) * p.cosW0), (a + 1) - (a - 1) * p.cosW0 - k);
+}
+
+void BiquadFilter::configure(size_t channelCount, size_t stageCount) {
+    mChannelCount = channelCount;
+    mStageCount = stageCount;
+    size_t size = getGroupCount(channelCount) * stageCount;
+    mSections.assign(size, {.b0 = splat(1.f),
+                            .b1 = splat(0.f),
+                            .b2 = splat(0.f),
+                            .a1 = splat(0.f),
+                            .a2 = splat(0.f)});
+    mStates.assign(size, {.s1 = splat(0.f), .s2 = splat(0.f)});
+}
+
+void BiquadFilter::setCoefficients(size_t stage, const BiquadCoefficients& coefs) {
+    for (size_t group = 0; group < getGroupCount(mChannelCount); group++) {
+        mSections[group * mStageCount + stage] = {.b0 = splat(coefs.b0),
+                                                  .b1 = splat(coefs.b1),
+                                                  .b2 = splat(coefs.b2),
+                                                  .a1 = splat(coefs.a1),
+                                                  .a2 = splat(coefs.a2)};
+    }
+}
+
+void BiquadFilter::setCoefficients(size_t stage, size_t channel, const BiquadCoefficients& coefs) {
+    Section& section = mSections[channel / kDspLanes * mStageCount + stage];
+    size_t lane = channel % kDspLanes;
+    section.b0[lane] = coefs.b0;
+    section.b1[lane] = coefs.b1;
+    section.b2[lane] = coefs.b2;
+    section.a1[lane] = coefs.a1;
+    section.a2[lane] = coefs.a2;
+}
+
+void BiquadFilter::reset() {
+    std::fill(mStates.begin(), mStates.end(), State{.s1 = splat(0.f), .s2 = splat(0.f)});
+}
+
+void BiquadFilter::process(const float* in, float* out, size_t frameCount) {
+    if (mStageCount == 0) {
+        if (in != out) {
+            memmove(out, in, frameCount * mChannelCount * sizeof(float));
+        }
+        return;
+    }
+    for (size_t group = 0; group < getGroupCount(mChannelCount); group++) {
+        dispatchGroupWidth(mChannelCount, group, [&](auto width) {
+            processGroup<decltype(width)::value>(group, in, out, frameCount);
+        });
+    }
+}
+
+template <size_t kWidth>
+void BiquadFilter::processGroup(size_t group, const float* in, float* out, size_t frameCount) {
+    const size_t stride = mChannelCount;
+    const size_t offset = group * kDspLanes;
+    // Run the whole buffer through one section at a time, so the coefficients and the state stay
+    // in registers in the inner loop.
+    for (size_t stage = 0; stage < mStageCount; stage++) {
+        const Section& section = mSections[group * mStageCount + stage];
+        State& state = mStates[group * mStageCount + stage];
+        const DspFloatVec b0 = section.b0;
+        const DspFloatVec b1 = section.b1;
+        const DspFloatVec b2 = section.b2;
+        const DspFloatVec a1 = section.a1;
+        const DspFloatVec a2 = section.a2;
+        DspFloatVec s1 = state.s1;
+        DspFloatVec s2 = state.s2;
+        const float* src = (stage == 0 ? in : out) + offset;
+        float* dst = out + offset;
+        for (size_t i = 0; i < frameCount; i++, src += stride, dst += stride) {
+            DspFloatVec x = loadLanes<kWidth>(src);
+            DspFloatVec y = b0 * x + s1;
+            s1 = b1 * x - a1 * y + s2;
+            s2 = b2 * x - a2 * y;
+            storeLanes<kWidth>(dst, y);
+        }
+        state.s1 = flushDenormals(s1);
+        state.s2 = flushDenormals(s2);
+    }
+}
+
+void CrossoverFilter::configure(size_t channelCount, size_t bandCount) {
+    mChannelCount = channelCount;
+    mBandCount = std::max<size_t>(bandCount, 1);
+    size_t crossoverCount = mBandCount - 1;
+    // A Linkwitz-Riley 4th order filter is two identical 2nd order Butterworth sections.
+    mLowPass.resize(crossoverCount);
+    mHighPass.resize(crossoverCount);
+    for (size_t i = 0; i < crossoverCount; i++) {
+        mLowPass[i].configure(channelCount, 2);
+        mHighPass[i].configure(channelCount, 2);
+    }
+    mAllPass.resize(crossoverCount > 1 ? crossoverCount - 1 : 0);
+    for (size_t band = 0; band < mAllPass.size(); band++) {
+        mAllPass[band].configure(channelCount, crossoverCount - band - 1);
+    }
+}
+
+void CrossoverFilter::setCrossoverFrequency(size_t channel, size_t index, float sampleRate,
+                                            float freqHz) {
+    auto lowPass = BiquadCoefficients::lowPass(sampleRate, freqHz, M_SQRT1_2);
+    auto highPass = BiquadCoefficients::highPass(sampleRate, freqHz, M_SQRT1_2);
+    for (size_t stage = 0; stage < 2; stage++) {
+        mLowPass[index].setCoefficients(stage, channel, lowPass);
+        mHighPass[index].setCoefficients(stage, channel, highPass);
+    }
+    // The sum of the Linkwitz-Riley low and high pass is a 2nd order all-pass at the crossover
+    // frequency, apply it to the bands below so they stay in phase with the split bands.
+    auto allPass = BiquadCoefficients::allPass(sampleRate, freqHz, M_SQRT1_2);
+    for (size_t band = 0; band < index; band++) {
+        mAllPass[band].setCoefficients(index - band - 1, channel, allPass);
+    }
+}
+
+void CrossoverFilter::reset() {
+    for (auto& filters : {&mLowPass, &mHighPass, &mAllPass}) {
+        for (auto& filter : *filters) {
+            filter.reset();
+        }
+    }
+}
+
+void CrossoverFilter::process(const float* in, float* const* bands, size_t frameCount) {
+    float* highest = bands[mBandCount - 1];
+    const float* remaining = in;
+    for (size_t i = 0; i + 1 < mBandCount; i++) {
+        mLowPass[i].process(remaining, bands[i], frameCount);
+        mHighPass[i].process(remaining, highest, frameCount);
+        remaining = highest;
+    }
+    if (mBandCount == 1 && in != highest) {
+        memmove(highest, in, frameCount * mChannelCount * sizeof(float));
+    }
+    for (size_t band = 0; band < mAllPass.size(); band++) {
+        mAllPass[band].process(bands[band], bands[band], frameCount);
+    }
+}
+
+void Compressor::configure(size_t channelCount, float sampleRate) {
+    mChannelCount = channelCount;
+    mGroupCount = getGroupCount(channelCount);
+    mSampleRate = sampleRate;
+    mParams.assign(channelCount, {});
+    mAttack.assign(mGroupCount, splat(0.f));
+    mRelease.assign(mGroupCount, splat(0.f));
+    mPreGain.assign(mGroupCount, splat(1.f));
+    mEnvelope.assign(mGroupCount, splat(0.f));
+    mGain.assign(mGroupCount, splat(1.f));
+    mTargetGain.assign(mGroupCount, splat(1.f));
+    mGainDb.assign(channelCount, 0.f);
+    setParams(CompressorParams());
+    updateLinkLeaders();
+}
+
+void Compressor::setParams(const CompressorParams& params) {
+    for (size_t channel = 0; channel < mChannelCount; channel++) {
+        setParams(channel, params);
+    }
+}
+
+void Compressor::setParams(size_t channel, const CompressorParams& params) {
+    size_t group = channel / kDspLanes;
+    size_t lane = channel % kDspLanes;
+    mAttack[group][lane] = getTimeCoefficient(params.attackMs, mSampleRate);
+    mRelease[group][lane] = getTimeCoefficient(params.releaseMs, mSampleRate);
+    mPreGain[group][lane] = dbToLinear(params.preGainDb);
+
+    ChannelParams& channelParams = mParams[channel];
+    channelParams.ratio = std::max(params.ratio, 1.f);
+    channelParams.thresholdDb = params.thresholdDb;
+    channelParams.kneeWidthDb = std::fabs(params.kneeWidthDb);
+    channelParams.noiseGateThresholdDb = params.noiseGateThresholdDb;
+    channelParams.expanderRatio = std::max(params.expanderRatio, 1.f);
+    channelParams.postGainDb = params.postGainDb;
+}
+
+void Compressor::setLinkGroup(size_t channel, int linkGroup) {
+    mParams[channel].linkGroup = linkGroup;
+    updateLinkLeaders();
+}
+
+void Compressor::updateLinkLeaders() {
+    std::unordered_map<int, size_t> leaders;
+    mLinkLeader.resize(mChannelCount);
+    for (size_t channel = 0; channel < mChannelCount; channel++) {
+        int linkGroup = mParams[channel].linkGroup;
+        mLinkLeader[channel] =
+                linkGroup >= 0 ? leaders.try_emplace(linkGroup, channel).first->second : channel;
+    }
+}
+
+void Compressor::reset() {
+    std::fill(mEnvelope.begin(), mEnvelope.end(), splat(0.f));
+    std::fill(mGain.begin(), mGain.end(), splat(1.f));
+    std::fill(mTargetGain.begin(), mTargetGain.end(), splat(1.f));
+}
+
+float Compressor::computeGainDb(const ChannelParams& params, float envelope) const {
+    float levelDb = envelope > 0.f ? 20.f * std::log10(envelope) : kMinLevelDb;
+    float over = levelDb - params.thresholdDb;
+    float slope = 1.f / params.ratio - 1.f;
+    float gainDb = 0.f;
+    if (params.kneeWidthDb > 0.f && 2.f * std::fabs(over) <= params.kneeWidthDb) {
+        float x = over + params.kneeWidthDb / 2.f;
+        gainDb = slope * x * x / (2.f * params.kneeWidthDb);
+    } else if (over > 0.f) {
+        gainDb = slope * over;
+    }
+    if (levelDb < params.noiseGateThresholdDb) {
+        gainDb += (levelDb - params.noiseGateThresholdDb) * (params.expanderRatio - 1.f);
+    }
+    return std::max(gainDb, kMinLevelDb);
+}
+
+void Compressor::computeTargetGains() {
+    // The gain reduction of a link group is gathered on its first channel.
+    for (size_t channel = 0; channel < mChannelCount; channel++) {
+        mGainDb[channel] = computeGainDb(mParams[channel],
+                                         mEnvelope[channel / kDspLanes][channel % kDspLanes]);
+        size_t leader = mLinkLeader[channel];
+        mGainDb[leader] = std::min(mGainDb[leader], mGainDb[channel]);
+    }
+    for (size_t channel = 0; channel < mChannelCount; channel++) {
+        mTargetGain[channel / kDspLanes][channel % kDspLanes] =
+                dbToLinear(mGainDb[mLinkLeader[channel]] + mParams[channel].postGainDb);
+    }
+}
+
+void Compressor::process(const float* in, float* out, size_t frameCount) {
+    for (size_t offset = 0; offset < frameCount; offset += kGainBlockFrames) {
+        size_t blockFrames = std::min(kGainBlockFrames, frameCount - offset);
+        const float* blockIn = in + offset * mChannelCount;
+        float* blockOut = out + offset * mChannelCount;
+        for (size_t group = 0; group < mGroupCount; group++) {
+            dispatchGroupWidth(mChannelCount, group, [&](auto width) {
+                detectGroup<decltype(width)::value>(group, blockIn, blockFrames);
+            });
+        }
+        computeTargetGains();
+        for (size_t group = 0; group < mGroupCount; group++) {
+            dispatchGroupWidth(mChannelCount, group, [&](auto width) {
+                applyGroup<decltype(width)::value>(group, blockIn, blockOut, blockFrames);
+            });
+        }
+    }
+}
+
+template <size_t kWidth>
+void Compressor::detectGroup(size_t group, const float* in, size_t frameCount) {
+    const size_t stride = mChannelCount;
+    const DspFloatVec attack = mAttack[group];
+    const DspFloatVec release = mRelease[group];
+    const DspFloatVec preGain = mPreGain[group];
+    DspFloatVec envelope = mEnvelope[group];
+    in += group * kDspLanes;
+    for (size_t i = 0; i < frameCount; i++, in += stride) {
+        DspFloatVec level = absLanes(loadLanes<kWidth>(in) * preGain);
+        DspFloatVec coef = selectLanes(level > envelope, attack, release);
+        envelope = level + coef * (envelope - level);
+    }
+    mEnvelope[group] = flushDenormals(envelope);
+}
+
+template <size_t kWidth>
+void Compressor::applyGroup(size_t group, const float* in, float* out, size_t frameCount) {
+    const size_t stride = mChannelCount;
+    const DspFloatVec preGain = mPreGain[group];
+    const DspFloatVec target = mTargetGain[group];
+    const DspFloatVec step = (target - mGain[group]) / splat(static_cast<float>(frameCount));
+    DspFloatVec gain = mGain[group];
+    in += group * kDspLanes;
+    out += group * kDspLanes;
+    for (size_t i = 0; i < frameCount; i++, in += stride, out += stride) {
+        gain += step;
+        storeLanes<kWidth>(out, loadLanes<kWidth>(in) * preGain * gain);
+    }
+    mGain[group] = target;
+}
+
+void GainRamp::configure(size_t channelCount, size_t rampFrames) {
+    size_t groupCount = getGroupCount(channelCount);
+    mChannelCount = channelCount;
+    mRampFrames = rampFrames;
+    mRemainingFrames = 0;
+    mGain.assign(groupCount, splat(1.f));
+    mTarget.assign(groupCount, splat(1.f));
+    mStep.assign(groupCount, splat(0.f));
+}
+
+void GainRamp::setTarget(float gain) {
+    std::fill(mTarget.begin(), mTarget.end(), splat(gain));
+    startRamp();
+}
+
+void GainRamp::setTarget(size_t channel, float gain) {
+    mTarget[channel / kDspLanes][channel % kDspLanes] = gain;
+    startRamp();
+}
+
+void GainRamp::reset() {
+    mGain = mTarget;
+    mRemainingFrames = 0;
+}
+
+void GainRamp::startRamp() {
+    if (mRampFrames == 0) {
+        reset();
+        return;
+    }
+    mRemainingFrames = mRampFrames;
+    for (size_t group = 0; group < mGain.size(); group++) {
+        mStep[group] = (mTarget[group] - mGain[group]) / splat(static_cast<float>(mRampFrames));
+    }
+}
+
+void GainRamp::process(const float* in, float* out, size_t frameCount) {
+    size_t rampFrames = std::min(frameCount, mRemainingFrames);
+    for (size_t group = 0; group < mGain.size(); group++) {
+        dispatchGroupWidth(mChannelCount, group, [&](auto width) {
+            processGroup<decltype(width)::value>(group, in, out, frameCount, rampFrames);
+        });
+    }
+    mRemainingFrames -= rampFrames;
+}
+
+template <size_t kWidth>
+void GainRamp::processGroup(size_t group, const float* in, float* out, size_t frameCount,
+                            size_t rampFrames) {
+    const size_t stride = mChannelCount;
+    const DspFloatVec step = mStep[group];
+    DspFloatVec gain = mGain[group];
+    in += group * kDspLanes;
+    out += group * kDspLanes;
+    size_t i = 0;
+    for (; i < rampFrames; i++, in += stride, out += stride) {
+        gain += step;
+        storeLanes<kWidth>(out, loadLanes<kWidth>(in) * gain);
+    }
+    if (rampFrames == mRemainingFrames) {
+        // The ramp is done, snap to the target so rounding errors do not accumulate.
+        gain = mTarget[group];
+    }
+    for (; i < frameCount; i++, in += stride, out += stride) {
+        storeLanes<kWidth>(out, loadLanes<kWidth>(in) * gain);
+    }
+    mGain[group] = gain;
+}
+
+}  // namespace aidl::android::hardware::audio::effect
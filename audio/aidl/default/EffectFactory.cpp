@@ -151,7 +151,120 @@ ndk::ScopedAStatus Factory::createEffect(const AudioUuid& in_impl_uuid,
     return ndk::ScopedAStatus::ok();
 }
 
+struct effect_dl_interface_s* Factory::getDlInterface(const std::shared_ptr<IEffect>& effect) {
+    auto effectIt = mEffectMap.find(std::weak_ptr<IEffect>(effect));
+    RETURN_VALUE_IF(effectIt == mEffectMap.end(), nullptr, "effectNotExist");
+    auto libIt = mEffectLibMap.find(effectIt->second.first);
+    RETURN_VALUE_IF(libIt == mEffectLibMap.end(), nullptr, "libNotExist");
+    return std::get<kMapEntryInterfaceIndex>(libIt->second).get();
+}
+
+std::shared_ptr<IEffect> Factory::findChainHead(const std::shared_ptr<IEffect>& effect) {
+    for (const auto& [head, effects] : mEffectChainMap) {
+        auto spHead = head.lock();
+        if (spHead == effect ||
+            std::find(effects.begin(), effects.end(), effect) != effects.end()) {
+            return spHead;
+        }
+    }
+    return nullptr;
+}
+
+ndk::ScopedAStatus Factory::createEffectChain(
+        const std::vector<std::shared_ptr<IEffect>>& in_effects) {
+    RETURN_IF(in_effects.size() < 2, EX_ILLEGAL_ARGUMENT, "chainNeedsTwoEffects");
+
+    std::optional<Parameter::Common> headCommon;
+    for (const auto& effect : in_effects) {
+        RETURN_IF(!effect, EX_NULL_POINTER, "nullEffect");
+        RETURN_IF(findChainHead(effect), EX_ILLEGAL_STATE, "effectAlreadyChained");
+        RETURN_IF(std::count(in_effects.begin(), in_effects.end(), effect) > 1,
+                  EX_ILLEGAL_ARGUMENT, "duplicatedEffect");
+        auto interface = getDlInterface(effect);
+        RETURN_IF(!interface || !interface->setChainDownstreamFunc || !interface->setChainedFunc,
+                  EX_UNSUPPORTED_OPERATION, "chainNotSupportedByLib");
+
+        // All the effects process the same buffer in place, so the configurations must match.
+        Parameter param;
+        RETURN_IF_ASTATUS_NOT_OK(
+                effect->getParameter(Parameter::Id::make<Parameter::Id::commonTag>(
+                                             Parameter::common),
+                                     &param),
+                "getCommonFailed");
+        const auto& common = param.get<Parameter::common>();
+        RETURN_IF(common.input.base != common.output.base ||
+                          common.input.frameCount != common.output.frameCount,
+                  EX_ILLEGAL_ARGUMENT, "inputOutputMismatch");
+        if (!headCommon.has_value()) {
+            headCommon = common;
+        }
+        RETURN_IF(common.session != headCommon->session || common.input != headCommon->input,
+                  EX_ILLEGAL_ARGUMENT, "configMismatch");
+    }
+
+    std::shared_ptr<IEffect> head = in_effects.front();
+    std::vector<std::shared_ptr<IEffect>> effects(in_effects.begin() + 1, in_effects.end());
+    // Registered first so a partially set up chain is undone by destroyEffectChain().
+    mEffectChainMap[std::weak_ptr<IEffect>(head)] = effects;
+    std::vector<EffectChainProcess> processes;
+    for (const auto& effect : effects) {
+        EffectChainProcess process;
+        if (binder_exception_t exception =
+                    getDlInterface(effect)->setChainedFunc(effect, true, &process);
+            exception != EX_NONE) {
+            LOG(ERROR) << __func__ << ": failed to chain " << effect.get() << " error "
+                       << exception;
+            destroyEffectChain(head);
+            return ndk::ScopedAStatus::fromExceptionCode(exception);
+        }
+        processes.emplace_back(std::move(process));
+    }
+    EffectChainProcess downstream = [processes = std::move(processes)](float* buffer,
+                                                                       int samples) {
+        IEffect::Status status = {STATUS_OK, samples, samples};
+        for (const auto& process : processes) {
+            status = process(buffer, status.fmqProduced);
+            if (status.status != STATUS_OK) {
+                break;
+            }
+        }
+        return status;
+    };
+    if (binder_exception_t exception =
+                getDlInterface(head)->setChainDownstreamFunc(head, std::move(downstream));
+        exception != EX_NONE) {
+        LOG(ERROR) << __func__ << ": failed to set downstream of " << head.get() << " error "
+                   << exception;
+        destroyEffectChain(head);
+        return ndk::ScopedAStatus::fromExceptionCode(exception);
+    }
+    LOG(DEBUG) << __func__ << ": chain of " << in_effects.size() << " effects headed by "
+               << head.get() << " created for session " << headCommon->session;
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Factory::destroyEffectChain(const std::shared_ptr<IEffect>& in_head) {
+    auto chainIt = mEffectChainMap.find(std::weak_ptr<IEffect>(in_head));
+    RETURN_IF(chainIt == mEffectChainMap.end(), EX_ILLEGAL_ARGUMENT, "chainNotExist");
+
+    // Stop calling the other effects before they go back to serving their own FMQs.
+    if (auto interface = getDlInterface(in_head)) {
+        interface->setChainDownstreamFunc(in_head, nullptr);
+    }
+    for (const auto& effect : chainIt->second) {
+        if (auto interface = getDlInterface(effect)) {
+            interface->setChainedFunc(effect, false, nullptr);
+        }
+    }
+    mEffectChainMap.erase(chainIt);
+    LOG(DEBUG) << __func__ << ": chain headed by " << in_head.get() << " destroyed";
+    return ndk::ScopedAStatus::ok();
+}
+
 ndk::ScopedAStatus Factory::destroyEffectImpl(const std::shared_ptr<IEffect>& in_handle) {
+    if (auto head = findChainHead(in_handle)) {
+        destroyEffectChain(head);
+    }
     std::weak_ptr<IEffect> wpHandle(in_handle);
     // find the effect entry with key (std::weak_ptr<IEffect>)
     if (auto effectIt = mEffectMap.find(wpHandle); effectIt != mEffectMap.end()) {
@@ -209,7 +322,7 @@ bool Factory::openEffectLibrary(const AudioUuid& impl, const std::string& path)
 
     LOG(INFO) << __func__ << " dlopen lib:" << path << "\nimpl:" << impl.toString()
               << "\nhandle:" << libHandle;
-    auto interface = new effect_dl_interface_s{nullptr, nullptr, nullptr};
+    auto interface = new effect_dl_interface_s{nullptr, nullptr, nullptr, nullptr, nullptr};
     mEffectLibMap.insert(
             {impl,
              std::make_tuple(std::move(libHandle),
@@ -276,6 +389,14 @@ void Factory::getDlSyms(DlEntry& entry) {
         dlInterface->destroyEffectFunc =
                 (EffectDestroyFunctor)dlsym(dlHandle.get(), "destroyEffect");
     }
+    if (!dlInterface->setChainDownstreamFunc) {
+        dlInterface->setChainDownstreamFunc = (EffectSetChainDownstreamFunctor)dlsym(
+                dlHandle.get(), "setEffectChainDownstream");
+    }
+    if (!dlInterface->setChainedFunc) {
+        dlInterface->setChainedFunc =
+                (EffectSetChainedFunctor)dlsym(dlHandle.get(), "setEffectChained");
+    }
 
     if (!dlInterface->createEffectFunc || !dlInterface->destroyEffectFunc ||
         !dlInterface->queryEffectFunc) {
@@ -19,7 +19,9 @@
 #include "effect-impl/EffectTypes.h"
 #include "include/effect-impl/EffectTypes.h"
 
+using aidl::android::hardware::audio::effect::EffectImpl;
 using aidl::android::hardware::audio::effect::IEffect;
+using aidl::android::hardware::audio::effect::RetCode;
 using aidl::android::hardware::audio::effect::State;
 using aidl::android::media::audio::common::PcmType;
 
@@ -35,6 +37,31 @@ extern "C" binder_exception_t destroyEffect(const std::shared_ptr<IEffect>& inst
     return EX_NONE;
 }
 
+// The instance must have been created by this library, see Factory::createEffectChain().
+extern "C" binder_exception_t setEffectChainDownstream(const std::shared_ptr<IEffect>& instanceSp,
+                                                       EffectChainProcess downstream) {
+    auto effect = static_cast<EffectImpl*>(instanceSp.get());
+    if (!effect || effect->setChainDownstream(std::move(downstream)) != RetCode::SUCCESS) {
+        return EX_ILLEGAL_STATE;
+    }
+    return EX_NONE;
+}
+
+extern "C" binder_exception_t setEffectChained(const std::shared_ptr<IEffect>& instanceSp,
+                                               bool chained, EffectChainProcess* process) {
+    auto effect = static_cast<EffectImpl*>(instanceSp.get());
+    if (!effect || effect->setChained(chained) != RetCode::SUCCESS) {
+        return EX_ILLEGAL_STATE;
+    }
+    if (process) {
+        // The factory keeps the instance alive while it is part of a chain.
+        *process = [effect](float* buffer, int samples) {
+            return effect->processChained(buffer, samples);
+        };
+    }
+    return EX_NONE;
+}
+
 namespace aidl::android::hardware::audio::effect {
 
 ndk::ScopedAStatus EffectImpl::open(const Parameter::Common& common,
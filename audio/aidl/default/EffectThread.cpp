@@ -130,7 +130,9 @@ void EffectThread::threadLoop() {
                 LOG(INFO) << __func__ << " EXIT!";
                 return;
             }
-            process_l();
+            if (!mChained) {
+                process_l();
+            }
         }
     }
 }
@@ -147,6 +149,12 @@ void EffectThread::process_l() {
     if (processSamples) {
         inputMQ->read(buffer, processSamples);
         IEffect::Status status = effectProcessImpl(buffer, buffer, processSamples);
+        if (mChainDownstream && status.status == STATUS_OK) {
+            // The rest of the chain processes the produced samples in place.
+            IEffect::Status chainStatus = mChainDownstream(buffer, status.fmqProduced);
+            status.status = chainStatus.status;
+            status.fmqProduced = chainStatus.fmqProduced;
+        }
         outputMQ->write(buffer, status.fmqProduced);
         statusMQ->writeBlocking(&status, 1);
         LOG(DEBUG) << mName << __func__ << ": done processing, effect consumed "
@@ -154,4 +162,26 @@ void EffectThread::process_l() {
     }
 }
 
+RetCode EffectThread::setChainDownstream(EffectChainProcess downstream) {
+    std::lock_guard lg(mThreadMutex);
+    mChainDownstream = std::move(downstream);
+    LOG(DEBUG) << mName << __func__ << (mChainDownstream ? " set" : " cleared");
+    return RetCode::SUCCESS;
+}
+
+RetCode EffectThread::setChained(bool chained) {
+    std::lock_guard lg(mThreadMutex);
+    mChained = chained;
+    LOG(DEBUG) << mName << __func__ << " " << chained;
+    return RetCode::SUCCESS;
+}
+
+IEffect::Status EffectThread::processChained(float* buffer, int samples) {
+    std::lock_guard lg(mThreadMutex);
+    if (mStop || !mThreadContext) {
+        return {STATUS_OK, samples, samples};
+    }
+    return effectProcessImpl(buffer, buffer, samples);
+}
+
 }  // namespace aidl::android::hardware::audio::effect
@@ -29,6 +29,7 @@
 #include "core-impl/Module.h"
 #include "core-impl/ModuleUsb.h"
 #include "core-impl/SoundDose.h"
+#include "core-impl/StreamRemoteSubmix.h"
 #include "core-impl/StreamStub.h"
 #include "core-impl/StreamUsb.h"
 #include "core-impl/Telephony.h"
@@ -124,8 +125,9 @@ StreamIn::CreateInstance Module::getStreamInCreator(Type type) {
     switch (type) {
         case Type::USB:
             return StreamInUsb::createInstance;
-        case Type::DEFAULT:
         case Type::R_SUBMIX:
+            return StreamInRemoteSubmix::createInstance;
+        case Type::DEFAULT:
         default:
             return StreamInStub::createInstance;
     }
@@ -136,8 +138,9 @@ StreamOut::CreateInstance Module::getStreamOutCreator(Type type) {
     switch (type) {
         case Type::USB:
             return StreamOutUsb::createInstance;
-        case Type::DEFAULT:
         case Type::R_SUBMIX:
+            return StreamOutRemoteSubmix::createInstance;
+        case Type::DEFAULT:
         default:
             return StreamOutStub::createInstance;
     }
@@ -200,9 +203,11 @@ ndk::ScopedAStatus Module::createStreamContext(
         (flags.getTag() == AudioIoFlags::Tag::output &&
          !isBitPositionFlagSet(flags.get<AudioIoFlags::Tag::output>(),
                                AudioOutputFlags::MMAP_NOIRQ))) {
-        StreamContext::DebugParameters params{mDebug.streamTransientStateDelayMs,
-                                              mVendorDebug.forceTransientBurst,
-                                              mVendorDebug.forceSynchronousDrain};
+        StreamContext::DebugParameters params{
+                mDebug.streamTransientStateDelayMs, mVendorDebug.forceTransientBurst,
+                mVendorDebug.forceSynchronousDrain,
+                mVendorDebug.useVirtualClock ? StreamTiming::Mode::VIRTUAL
+                                             : StreamTiming::Mode::REAL_TIME};
         StreamContext temp(
                 std::make_unique<StreamContext::CommandMQ>(1, true /*configureEventFlagWord*/),
                 std::make_unique<StreamContext::ReplyMQ>(1, true /*configureEventFlagWord*/),
@@ -339,7 +344,8 @@ void Module::registerPatch(const AudioPatch& patch) {
     do_insert(patch.sinkPortConfigIds);
 }
 
-void Module::updateStreamsConnectedState(const AudioPatch& oldPatch, const AudioPatch& newPatch) {
+ndk::ScopedAStatus Module::updateStreamsConnectedState(const AudioPatch& oldPatch,
+                                                       const AudioPatch& newPatch) {
     // Streams from the old patch need to be disconnected, streams from the new
     // patch need to be connected. If the stream belongs to both patches, no need
     // to update it.
@@ -349,20 +355,26 @@ void Module::updateStreamsConnectedState(const AudioPatch& oldPatch, const Audio
     idsToDisconnect.insert(oldPatch.sinkPortConfigIds.begin(), oldPatch.sinkPortConfigIds.end());
     idsToConnect.insert(newPatch.sourcePortConfigIds.begin(), newPatch.sourcePortConfigIds.end());
     idsToConnect.insert(newPatch.sinkPortConfigIds.begin(), newPatch.sinkPortConfigIds.end());
-    std::for_each(idsToDisconnect.begin(), idsToDisconnect.end(), [&](const auto& portConfigId) {
+    for (const auto& portConfigId : idsToDisconnect) {
         if (idsToConnect.count(portConfigId) == 0) {
             LOG(DEBUG) << "The stream on port config id " << portConfigId << " is not connected";
             mStreams.setStreamIsConnected(portConfigId, {});
         }
-    });
-    std::for_each(idsToConnect.begin(), idsToConnect.end(), [&](const auto& portConfigId) {
+    }
+    for (const auto& portConfigId : idsToConnect) {
         if (idsToDisconnect.count(portConfigId) == 0) {
             const auto connectedDevices = findConnectedDevices(portConfigId);
             LOG(DEBUG) << "The stream on port config id " << portConfigId
                        << " is connected to: " << ::android::internal::ToString(connectedDevices);
-            mStreams.setStreamIsConnected(portConfigId, connectedDevices);
+            if (auto status = mStreams.setStreamIsConnected(portConfigId, connectedDevices);
+                !status.isOk()) {
+                LOG(ERROR) << "The stream on port config id " << portConfigId
+                           << " could not be connected";
+                return status;
+            }
         }
-    });
+    }
+    return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Module::setModuleDebug(
@@ -673,7 +685,14 @@ ndk::ScopedAStatus Module::openInputStream(const OpenInputStreamArguments& in_ar
                                    ANDROID_PRIORITY_AUDIO);
     auto patchIt = mPatches.find(in_args.portConfigId);
     if (patchIt != mPatches.end()) {
-        streamWrapper.setStreamIsConnected(findConnectedDevices(in_args.portConfigId));
+        if (auto status =
+                    streamWrapper.setStreamIsConnected(findConnectedDevices(in_args.portConfigId));
+            !status.isOk()) {
+            LOG(ERROR) << __func__ << ": port config id " << in_args.portConfigId
+                       << ": the stream could not be connected";
+            stream->close();
+            return status;
+        }
     }
     mStreams.insert(port->id, in_args.portConfigId, std::move(streamWrapper));
     _aidl_return->stream = std::move(stream);
@@ -727,7 +746,14 @@ ndk::ScopedAStatus Module::openOutputStream(const OpenOutputStreamArguments& in_
                                    ANDROID_PRIORITY_AUDIO);
     auto patchIt = mPatches.find(in_args.portConfigId);
     if (patchIt != mPatches.end()) {
-        streamWrapper.setStreamIsConnected(findConnectedDevices(in_args.portConfigId));
+        if (auto status =
+                    streamWrapper.setStreamIsConnected(findConnectedDevices(in_args.portConfigId));
+            !status.isOk()) {
+            LOG(ERROR) << __func__ << ": port config id " << in_args.portConfigId
+                       << ": the stream could not be connected";
+            stream->close();
+            return status;
+        }
     }
     mStreams.insert(port->id, in_args.portConfigId, std::move(streamWrapper));
     _aidl_return->stream = std::move(stream);
@@ -840,7 +866,18 @@ ndk::ScopedAStatus Module::setAudioPatch(const AudioPatch& in_requested, AudioPa
         *existing = *_aidl_return;
     }
     registerPatch(*existing);
-    updateStreamsConnectedState(oldPatch, *_aidl_return);
+    if (auto status = updateStreamsConnectedState(oldPatch, *_aidl_return); !status.isOk()) {
+        // Restore the previous patch and the connections of its streams.
+        updateStreamsConnectedState(*_aidl_return, oldPatch);
+        cleanUpPatch(existing->id);
+        if (oldPatch.id == 0) {
+            patches.erase(existing);
+        } else {
+            *existing = oldPatch;
+            registerPatch(*existing);
+        }
+        return status;
+    }
 
     LOG(DEBUG) << __func__ << ": " << (oldPatch.id == 0 ? "created" : "updated") << " patch "
                << _aidl_return->toString();
@@ -1133,6 +1170,7 @@ ndk::ScopedAStatus Module::generateHwAvSyncId(int32_t* _aidl_return) {
 
 const std::string Module::VendorDebug::kForceTransientBurstName = "aosp.forceTransientBurst";
 const std::string Module::VendorDebug::kForceSynchronousDrainName = "aosp.forceSynchronousDrain";
+const std::string Module::VendorDebug::kUseVirtualClockName = "aosp.useVirtualClock";
 
 ndk::ScopedAStatus Module::getVendorParameters(const std::vector<std::string>& in_ids,
                                                std::vector<VendorParameter>* _aidl_return) {
@@ -1147,6 +1185,10 @@ ndk::ScopedAStatus Module::getVendorParameters(const std::vector<std::string>& i
             VendorParameter forceSynchronousDrain{.id = id};
             forceSynchronousDrain.ext.setParcelable(Boolean{mVendorDebug.forceSynchronousDrain});
             _aidl_return->push_back(std::move(forceSynchronousDrain));
+        } else if (id == VendorDebug::kUseVirtualClockName) {
+            VendorParameter useVirtualClock{.id = id};
+            useVirtualClock.ext.setParcelable(Boolean{mVendorDebug.useVirtualClock});
+            _aidl_return->push_back(std::move(useVirtualClock));
         } else {
             allParametersKnown = false;
             LOG(ERROR) << __func__ << ": unrecognized parameter \"" << id << "\"";
@@ -1187,6 +1229,10 @@ ndk::ScopedAStatus Module::setVendorParameters(const std::vector<VendorParameter
             if (!extractParameter<Boolean>(p, &mVendorDebug.forceSynchronousDrain)) {
                 return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
             }
+        } else if (p.id == VendorDebug::kUseVirtualClockName) {
+            if (!extractParameter<Boolean>(p, &mVendorDebug.useVirtualClock)) {
+                return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+            }
         } else {
             allParametersKnown = false;
             LOG(ERROR) << __func__ << ": unrecognized parameter \"" << p.id << "\"";
@@ -17,7 +17,6 @@
 #define LOG_TAG "AHAL_Stream"
 #include <android-base/logging.h>
 #include <android/binder_ibinder_platform.h>
-#include <utils/SystemClock.h>
 
 #include <Utils.h>
 
@@ -109,7 +108,8 @@ void StreamWorkerCommonLogic::populateReply(StreamDescriptor::Reply* reply,
     reply->status = STATUS_OK;
     if (isConnected) {
         reply->observable.frames = mFrameCount;
-        reply->observable.timeNs = ::android::elapsedRealtimeNano();
+        reply->observable.timeNs = mTiming.getTimestampNs();
+        mDriver->refinePosition(&reply->observable);
     } else {
         reply->observable.frames = StreamDescriptor::Position::UNKNOWN;
         reply->observable.timeNs = StreamDescriptor::Position::UNKNOWN;
@@ -224,6 +224,7 @@ StreamInWorkerLogic::Status StreamInWorkerLogic::cycle() {
         case Tag::standby:
             if (mState == StreamDescriptor::State::IDLE) {
                 if (::android::status_t status = mDriver->standby(); status == ::android::OK) {
+                    mTiming.restart();
                     populateReply(&reply, mIsConnected);
                     mState = StreamDescriptor::State::STANDBY;
                 } else {
@@ -237,6 +238,7 @@ StreamInWorkerLogic::Status StreamInWorkerLogic::cycle() {
         case Tag::pause:
             if (mState == StreamDescriptor::State::ACTIVE) {
                 if (::android::status_t status = mDriver->pause(); status == ::android::OK) {
+                    mTiming.restart();
                     populateReply(&reply, mIsConnected);
                     mState = StreamDescriptor::State::PAUSED;
                 } else {
@@ -250,6 +252,7 @@ StreamInWorkerLogic::Status StreamInWorkerLogic::cycle() {
         case Tag::flush:
             if (mState == StreamDescriptor::State::PAUSED) {
                 if (::android::status_t status = mDriver->flush(); status == ::android::OK) {
+                    mTiming.restart();
                     populateReply(&reply, mIsConnected);
                     mState = StreamDescriptor::State::STANDBY;
                 } else {
@@ -284,10 +287,12 @@ bool StreamInWorkerLogic::read(size_t clientSize, StreamDescriptor::Reply* reply
             fatal = true;
             LOG(ERROR) << __func__ << ": read failed: " << status;
         }
+        mTiming.advance(actualFrameCount);
     } else {
-        usleep(3000);  // Simulate blocking transfer delay.
         for (size_t i = 0; i < byteCount; ++i) mDataBuffer[i] = 0;
         actualFrameCount = byteCount / mFrameSize;
+        mTiming.advance(actualFrameCount);
+        mTiming.wait();  // Simulate blocking transfer delay.
     }
     const size_t actualByteCount = actualFrameCount * mFrameSize;
     if (bool success =
@@ -463,6 +468,7 @@ StreamOutWorkerLogic::Status StreamOutWorkerLogic::cycle() {
         case Tag::standby:
             if (mState == StreamDescriptor::State::IDLE) {
                 if (::android::status_t status = mDriver->standby(); status == ::android::OK) {
+                    mTiming.restart();
                     populateReply(&reply, mIsConnected);
                     mState = StreamDescriptor::State::STANDBY;
                 } else {
@@ -490,6 +496,7 @@ StreamOutWorkerLogic::Status StreamOutWorkerLogic::cycle() {
             }
             if (nextState.has_value()) {
                 if (::android::status_t status = mDriver->pause(); status == ::android::OK) {
+                    mTiming.restart();
                     populateReply(&reply, mIsConnected);
                     mState = nextState.value();
                 } else {
@@ -503,6 +510,7 @@ StreamOutWorkerLogic::Status StreamOutWorkerLogic::cycle() {
                 mState == StreamDescriptor::State::DRAIN_PAUSED ||
                 mState == StreamDescriptor::State::TRANSFER_PAUSED) {
                 if (::android::status_t status = mDriver->flush(); status == ::android::OK) {
+                    mTiming.restart();
                     populateReply(&reply, mIsConnected);
                     mState = StreamDescriptor::State::IDLE;
                 } else {
@@ -547,11 +555,13 @@ bool StreamOutWorkerLogic::write(size_t clientSize, StreamDescriptor::Reply* rep
                 fatal = true;
                 LOG(ERROR) << __func__ << ": write failed: " << status;
             }
+            mTiming.advance(actualFrameCount);
         } else {
+            actualFrameCount = byteCount / mFrameSize;
+            mTiming.advance(actualFrameCount);
             if (mAsyncCallback == nullptr) {
-                usleep(3000);  // Simulate blocking transfer delay.
+                mTiming.wait();  // Simulate blocking transfer delay.
             }
-            actualFrameCount = byteCount / mFrameSize;
         }
         const size_t actualByteCount = actualFrameCount * mFrameSize;
         // Frames are consumed and counted regardless of the connection status.
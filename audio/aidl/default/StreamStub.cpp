@@ -14,11 +14,10 @@
  * limitations under the License.
  */
 
-#include <cmath>
+#include <unistd.h>
 
 #define LOG_TAG "AHAL_Stream"
 #include <android-base/logging.h>
-#include <audio_utils/clock.h>
 
 #include "core-impl/Module.h"
 #include "core-impl/StreamStub.h"
@@ -33,40 +32,39 @@ namespace aidl::android::hardware::audio::core {
 
 DriverStub::DriverStub(const StreamContext& context, bool isInput)
     : mFrameSizeBytes(context.getFrameSize()),
-      mSampleRate(context.getSampleRate()),
       mIsAsynchronous(!!context.getAsyncCallback()),
-      mIsInput(isInput) {}
+      mIsInput(isInput),
+      mTiming(context.getTimingMode(), context.getSampleRate()) {}
 
 ::android::status_t DriverStub::init() {
-    usleep(500);
+    simulateDelay(500);
     return ::android::OK;
 }
 
 ::android::status_t DriverStub::drain(StreamDescriptor::DrainMode) {
-    usleep(500);
+    simulateDelay(500);
     return ::android::OK;
 }
 
 ::android::status_t DriverStub::flush() {
-    usleep(500);
+    simulateDelay(500);
+    mTiming.restart();
     return ::android::OK;
 }
 
 ::android::status_t DriverStub::pause() {
-    usleep(500);
+    simulateDelay(500);
+    mTiming.restart();
     return ::android::OK;
 }
 
 ::android::status_t DriverStub::transfer(void* buffer, size_t frameCount, size_t* actualFrameCount,
                                          int32_t* latencyMs) {
-    static constexpr float kMicrosPerSecond = MICROS_PER_SECOND;
-    static constexpr float kScaleFactor = .8f;
+    mTiming.advance(frameCount);
     if (mIsAsynchronous) {
-        usleep(500);
+        simulateDelay(500);
     } else {
-        const size_t delayUs = static_cast<size_t>(
-                std::roundf(kScaleFactor * frameCount * kMicrosPerSecond / mSampleRate));
-        usleep(delayUs);
+        mTiming.wait();
     }
     if (mIsInput) {
         uint8_t* byteBuffer = static_cast<uint8_t*>(buffer);
@@ -80,16 +78,24 @@ DriverStub::DriverStub(const StreamContext& context, bool isInput)
 }
 
 ::android::status_t DriverStub::standby() {
-    usleep(500);
+    simulateDelay(500);
+    mTiming.restart();
     return ::android::OK;
 }
 
 ::android::status_t DriverStub::setConnectedDevices(
         const std::vector<AudioDevice>& connectedDevices __unused) {
-    usleep(500);
+    simulateDelay(500);
     return ::android::OK;
 }
 
+void DriverStub::simulateDelay(useconds_t delayUs) const {
+    // With the virtual clock, streams run as fast as possible.
+    if (!mTiming.isVirtual()) {
+        usleep(delayUs);
+    }
+}
+
 // static
 ndk::ScopedAStatus StreamInStub::createInstance(const SinkMetadata& sinkMetadata,
                                                 StreamContext&& context,
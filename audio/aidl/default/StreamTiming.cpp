@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <time.h>
+
+#include <audio_utils/clock.h>
+#include <utils/SystemClock.h>
+
+#include "core-impl/StreamTiming.h"
+
+namespace aidl::android::hardware::audio::core {
+
+namespace {
+
+// If the stream falls behind by more than this, e.g. after the worker thread has been
+// descheduled, restart the pacing instead of catching up with a burst of transfers.
+constexpr int64_t kMaxLagNs = 100 * NANOS_PER_MILLISECOND;
+
+int64_t getMonotonicTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return audio_utils_ns_from_timespec(&ts);
+}
+
+}  // namespace
+
+StreamTiming::StreamTiming(Mode mode, int sampleRate)
+    : mMode(mode),
+      mSampleRate(sampleRate > 0 ? sampleRate : 48000),
+      mVirtualStartTimeNs(::android::elapsedRealtimeNano()) {}
+
+void StreamTiming::advance(size_t frameCount) {
+    if (mMode == Mode::REAL_TIME && mStartTimeNs == 0) {
+        mStartTimeNs = getMonotonicTimeNs();
+        mFrames = 0;
+    }
+    mFrames += frameCount;
+}
+
+void StreamTiming::wait() {
+    if (mMode == Mode::VIRTUAL || mStartTimeNs == 0) {
+        return;
+    }
+    const int64_t nowNs = getMonotonicTimeNs();
+    const int64_t targetNs = mStartTimeNs + framesToNs(mFrames);
+    if (nowNs - targetNs > kMaxLagNs) {
+        mStartTimeNs = nowNs;
+        mFrames = 0;
+        return;
+    }
+    // Sleep until an absolute time, so the pacing does not drift with the processing time.
+    if (targetNs > nowNs) {
+        struct timespec ts;
+        ts.tv_sec = targetNs / NANOS_PER_SECOND;
+        ts.tv_nsec = targetNs % NANOS_PER_SECOND;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    }
+}
+
+void StreamTiming::restart() {
+    // The virtual time only moves with the frames, there is nothing to catch up with.
+    if (mMode == Mode::REAL_TIME) {
+        mStartTimeNs = 0;
+    }
+}
+
+int64_t StreamTiming::getTimestampNs() const {
+    return mMode == Mode::VIRTUAL ? mVirtualStartTimeNs + framesToNs(mFrames)
+                                  : ::android::elapsedRealtimeNano();
+}
+
+int64_t StreamTiming::framesToNs(uint64_t frames) const {
+    // Split the seconds out so that the product does not overflow in long virtual runs.
+    return static_cast<int64_t>(frames / mSampleRate * NANOS_PER_SECOND +
+                                frames % mSampleRate * NANOS_PER_SECOND / mSampleRate);
+}
+
+}  // namespace aidl::android::hardware::audio::core
@@ -164,17 +164,42 @@ RetCode BassBoostSw::releaseContext() {
 
 // Processing method running in EffectWorker thread.
 IEffect::Status BassBoostSw::effectProcessImpl(float* in, float* out, int samples) {
-    // TODO: get data buffer and process.
-    LOG(DEBUG) << __func__ << " in " << in << " out " << out << " samples " << samples;
-    for (int i = 0; i < samples; i++) {
-        *out++ = *in++;
-    }
-    return {STATUS_OK, samples, samples};
+    RETURN_VALUE_IF(!mContext, (IEffect::Status{EX_NULL_POINTER, 0, 0}), "nullContext");
+    return mContext->process(in, out, samples);
+}
+
+RetCode BassBoostSwContext::setCommon(const Parameter::Common& common) {
+    std::lock_guard lg(mMutex);
+    mParamsUpdate.markChanged();
+    return EffectContext::setCommon(common);
 }
 
 RetCode BassBoostSwContext::setBbStrengthPm(int strength) {
+    std::lock_guard lg(mMutex);
     mStrength = strength;
+    mParamsUpdate.markChanged();
     return RetCode::SUCCESS;
 }
 
+IEffect::Status BassBoostSwContext::process(float* in, float* out, int samples) {
+    mParamsUpdate.applyIfChanged(mMutex, [this]() NO_THREAD_SAFETY_ANALYSIS { updateFilter_l(); });
+
+    size_t frameCount = mChannelCount ? samples / mChannelCount : 0;
+    mFilter.process(in, out, frameCount);
+    copyPartialFrame(in, out, samples, mChannelCount);
+    return {STATUS_OK, samples, samples};
+}
+
+void BassBoostSwContext::updateFilter_l() {
+    size_t channelCount = ::aidl::android::hardware::audio::common::getChannelCount(
+            mCommon.input.base.channelMask);
+    if (channelCount != mFilter.getChannelCount()) {
+        mFilter.configure(channelCount, 1);
+    }
+    mFilter.setCoefficients(0, BiquadCoefficients::lowShelf(mCommon.input.base.sampleRate,
+                                                            kShelfFrequencyHz, M_SQRT1_2,
+                                                            kMaxBoostDb * mStrength / 1000.f));
+    mChannelCount = channelCount;
+}
+
 }  // namespace aidl::android::hardware::audio::effect
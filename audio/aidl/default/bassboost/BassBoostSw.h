@@ -17,10 +17,13 @@
 #pragma once
 
 #include <aidl/android/hardware/audio/effect/BnEffect.h>
+#include <android-base/thread_annotations.h>
 #include <fmq/AidlMessageQueue.h>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 
+#include "effect-impl/EffectDsp.h"
 #include "effect-impl/EffectImpl.h"
 
 namespace aidl::android::hardware::audio::effect {
@@ -30,13 +33,33 @@ class BassBoostSwContext final : public EffectContext {
     BassBoostSwContext(int statusDepth, const Parameter::Common& common)
         : EffectContext(statusDepth, common) {
         LOG(DEBUG) << __func__;
+        std::lock_guard lg(mMutex);
+        updateFilter_l();
     }
 
+    RetCode setCommon(const Parameter::Common& common) override;
     RetCode setBbStrengthPm(int strength);
-    int getBbStrengthPm() const { return mStrength; }
+    int getBbStrengthPm() {
+        std::lock_guard lg(mMutex);
+        return mStrength;
+    }
+
+    // Run the bass boost on interleaved samples, called in the EffectWorker thread.
+    IEffect::Status process(float* in, float* out, int samples);
 
   private:
-    int mStrength = 0;
+    // Boost applied below the shelf frequency at full strength.
+    static constexpr float kMaxBoostDb = 15.f;
+    static constexpr float kShelfFrequencyHz = 120.f;
+
+    std::mutex mMutex;
+    int mStrength GUARDED_BY(mMutex) = 0;
+    DspParamsUpdate mParamsUpdate;
+
+    size_t mChannelCount = 0;
+    BiquadFilter mFilter;
+
+    void updateFilter_l() REQUIRES(mMutex);
 };
 
 class BassBoostSw final : public EffectImpl {
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <time.h>
+#include <memory>
+#include <vector>
+
+#define LOG_TAG "EffectChainBenchmark"
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <system/audio_config.h>
+#include <system/audio_effects/effect_uuid.h>
+
+#include "EffectTestHelper.h"
+#include "effectFactory-impl/EffectFactory.h"
+
+using namespace aidl::android::hardware::audio::effect;
+using aidl::android::media::audio::common::AudioChannelLayout;
+
+/**
+ * Compares running a chain of effects of one session with one worker thread per effect, where
+ * the client moves every buffer through the FMQs of each effect, and with the effects chained by
+ * Factory::createEffectChain() on the worker thread of the first one. The effects are software
+ * equalizers loaded by the effect factory from the device configuration. Run with:
+ *
+ *   atest EffectChainBenchmark
+ *
+ * The real time of an iteration is the latency of one 10ms stereo buffer through the whole chain,
+ * and the "cpu_ns" counter is the CPU time of all the threads of the process for one buffer.
+ */
+
+namespace {
+
+constexpr const char* kConfigName = "audio_effects_config.xml";
+constexpr int kSession = 1;
+constexpr long kFrameCount = 480;
+constexpr size_t kChannelCount = 2;
+constexpr size_t kSampleCount = kFrameCount * kChannelCount;
+
+int64_t getProcessCpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Started effect instances created by the effect factory, destroyed with the factory.
+class EffectSet {
+  public:
+    explicit EffectSet(size_t count) {
+        auto configFile = android::audio_find_readable_configuration_file(kConfigName);
+        if (configFile.empty()) {
+            return;
+        }
+        mFactory = ndk::SharedRefBase::make<Factory>(configFile);
+        for (size_t i = 0; i < count; i++) {
+            std::shared_ptr<IEffect> effect;
+            IEffect::OpenEffectReturn ret;
+            if (!mFactory->createEffect(getEffectImplUuidEqualizerSw(), &effect).isOk()) {
+                return;
+            }
+            mEffects.push_back(effect);
+            if (!effect->open(createParamCommon(kSession, AudioChannelLayout::LAYOUT_STEREO,
+                                                kFrameCount),
+                              std::nullopt, &ret)
+                         .isOk() ||
+                !effect->command(CommandId::START).isOk()) {
+                return;
+            }
+            mClients.push_back(std::make_unique<EffectClient>(ret));
+        }
+    }
+
+    ~EffectSet() {
+        for (const auto& effect : mEffects) {
+            effect->command(CommandId::STOP);
+            effect->close();
+            mFactory->destroyEffect(effect);
+        }
+    }
+
+    bool isValid() const { return mFactory && mClients.size() == mEffects.size(); }
+
+    bool chain() { return mFactory->createEffectChain(mEffects).isOk(); }
+
+    const std::vector<std::unique_ptr<EffectClient>>& clients() const { return mClients; }
+
+  private:
+    std::shared_ptr<Factory> mFactory;
+    std::vector<std::shared_ptr<IEffect>> mEffects;
+    std::vector<std::unique_ptr<EffectClient>> mClients;
+};
+
+template <typename F>
+void runBenchmark(benchmark::State& state, F&& process) {
+    std::vector<float> buffer(kSampleCount, 0.5f);
+    int64_t cpuTimeNs = 0;
+    for (auto _ : state) {
+        int64_t start = getProcessCpuTimeNs();
+        if (!process(buffer.data())) {
+            state.SkipWithError("effect processing failed");
+            break;
+        }
+        cpuTimeNs += getProcessCpuTimeNs() - start;
+    }
+    state.counters["cpu_ns"] =
+            benchmark::Counter(cpuTimeNs, benchmark::Counter::kAvgIterations);
+}
+
+}  // namespace
+
+static void BM_PerInstance(benchmark::State& state) {
+    EffectSet effects(state.range(0));
+    if (!effects.isValid()) {
+        state.SkipWithError("failed to create the effects");
+        return;
+    }
+    runBenchmark(state, [&](float* buffer) {
+        for (const auto& client : effects.clients()) {
+            if (!client->process(buffer, kSampleCount)) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+static void BM_Chained(benchmark::State& state) {
+    EffectSet effects(state.range(0));
+    if (!effects.isValid() || !effects.chain()) {
+        state.SkipWithError("failed to chain the effects");
+        return;
+    }
+    // Only the head of the chain is fed.
+    const auto& client = effects.clients()[0];
+    runBenchmark(state, [&](float* buffer) { return client->process(buffer, kSampleCount); });
+}
+
+BENCHMARK(BM_PerInstance)->Arg(2)->Arg(5)->UseRealTime();
+BENCHMARK(BM_Chained)->Arg(2)->Arg(5)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dlfcn.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#define LOG_TAG "EffectDspBenchmark"
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <system/audio_effects/effect_uuid.h>
+
+#include "EffectTestHelper.h"
+#include "effect-impl/EffectImpl.h"
+
+using namespace aidl::android::hardware::audio::effect;
+using aidl::android::media::audio::common::AudioChannelLayout;
+using aidl::android::media::audio::common::AudioUuid;
+
+/**
+ * Measures the processing of the software effects at 48kHz, with typical parameters. Each
+ * effect is created by its library installed on the device and opened but not started, the
+ * benchmark thread calls its processing like the EffectWorker thread would. Run with:
+ *
+ *   atest EffectDspBenchmark
+ *
+ * The "ns_per_frame" counter is the processing cost of one frame of all the channels, a 48kHz
+ * stream has a budget of about 20833 ns per frame. The binder and FMQ path is not measured.
+ */
+
+namespace {
+
+constexpr long kFrameCount = 960;  // 20ms
+
+#ifdef __LP64__
+constexpr const char* kEffectLibDir = "/vendor/lib64/soundfx/";
+#else
+constexpr const char* kEffectLibDir = "/vendor/lib/soundfx/";
+#endif
+
+using CreateEffectFunc = binder_exception_t (*)(const AudioUuid*, std::shared_ptr<IEffect>*);
+
+// An opened effect instance of a software effect library.
+class SwEffect {
+  public:
+    SwEffect(const std::string& library, const AudioUuid& uuid, int32_t layout) {
+        std::string path = kEffectLibDir + library;
+        mHandle = dlopen(path.c_str(), RTLD_NOW);
+        if (!mHandle) {
+            LOG(ERROR) << __func__ << ": dlopen failed, err: " << dlerror();
+            return;
+        }
+        auto createEffect = reinterpret_cast<CreateEffectFunc>(dlsym(mHandle, "createEffect"));
+        IEffect::OpenEffectReturn ret;
+        if (!createEffect || createEffect(&uuid, &mEffect) != EX_NONE || !mEffect ||
+            !mEffect->open(createParamCommon(1 /* session */, layout, kFrameCount), std::nullopt,
+                           &ret)
+                     .isOk()) {
+            mEffect.reset();
+        }
+    }
+
+    ~SwEffect() {
+        if (mEffect) {
+            mEffect->close();
+            mEffect.reset();
+        }
+        if (mHandle) {
+            dlclose(mHandle);
+        }
+    }
+
+    bool isValid() const { return mEffect != nullptr; }
+
+    bool setParameter(const Parameter::Specific& specific) {
+        return mEffect->setParameter(Parameter::make<Parameter::specific>(specific)).isOk();
+    }
+
+    // The libraries only create EffectImpl instances.
+    IEffect::Status process(float* in, float* out, int samples) {
+        return static_cast<EffectImpl*>(mEffect.get())->effectProcessImpl(in, out, samples);
+    }
+
+  private:
+    void* mHandle = nullptr;
+    std::shared_ptr<IEffect> mEffect;
+};
+
+size_t getChannelCount(int32_t layout) {
+    return __builtin_popcount(layout);
+}
+
+void runBenchmark(benchmark::State& state, const std::string& library, const AudioUuid& uuid,
+                  const Parameter::Specific& specific) {
+    const int32_t layout = state.range(0);
+    SwEffect effect(library, uuid, layout);
+    if (!effect.isValid() || !effect.setParameter(specific)) {
+        state.SkipWithError("failed to create the effect");
+        return;
+    }
+
+    const size_t samples = kFrameCount * getChannelCount(layout);
+    std::vector<float> input(samples);
+    std::minstd_rand gen(samples);
+    std::uniform_real_distribution<float> dis(-1.f, 1.f);
+    for (auto& sample : input) {
+        sample = dis(gen);
+    }
+    std::vector<float> output(samples);
+    for (auto _ : state) {
+        IEffect::Status status =
+                effect.process(input.data(), output.data(), static_cast<int>(samples));
+        if (status.status != STATUS_OK) {
+            state.SkipWithError("effect processing failed");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * kFrameCount);
+    state.counters["ns_per_frame"] =
+            benchmark::Counter(state.iterations() * kFrameCount,
+                               benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+}  // namespace
+
+static void BM_EqualizerSw(benchmark::State& state) {
+    std::vector<Equalizer::BandLevel> levels = {{0, 3}, {1, 0}, {2, -2}, {3, 1}, {4, 4}};
+    runBenchmark(state, "libequalizersw.so", getEffectImplUuidEqualizerSw(),
+                 Parameter::Specific::make<Parameter::Specific::equalizer>(
+                         Equalizer::make<Equalizer::bandLevels>(levels)));
+}
+
+static void BM_BassBoostSw(benchmark::State& state) {
+    runBenchmark(state, "libbassboostsw.so", getEffectImplUuidBassBoostSw(),
+                 Parameter::Specific::make<Parameter::Specific::bassBoost>(
+                         BassBoost::make<BassBoost::strengthPm>(666)));
+}
+
+static void BM_VirtualizerSw(benchmark::State& state) {
+    runBenchmark(state, "libvirtualizersw.so", getEffectImplUuidVirtualizerSw(),
+                 Parameter::Specific::make<Parameter::Specific::virtualizer>(
+                         Virtualizer::make<Virtualizer::strengthPm>(500)));
+}
+
+static void BM_LoudnessEnhancerSw(benchmark::State& state) {
+    runBenchmark(state, "libloudnessenhancersw.so", getEffectImplUuidLoudnessEnhancerSw(),
+                 Parameter::Specific::make<Parameter::Specific::loudnessEnhancer>(
+                         LoudnessEnhancer::make<LoudnessEnhancer::gainMb>(1000)));
+}
+
+// All the stages in use with 4 EQ bands and 3 MBC bands. The cost does not depend on the band
+// settings, so they are left to their defaults.
+static void BM_DynamicsProcessingSw(benchmark::State& state) {
+    DynamicsProcessing::EngineArchitecture engine = {
+            .preferredProcessingDurationMs = 10,
+            .preEqStage = {.inUse = true, .bandCount = 4},
+            .postEqStage = {.inUse = true, .bandCount = 4},
+            .mbcStage = {.inUse = true, .bandCount = 3},
+            .limiterInUse = true,
+    };
+    runBenchmark(state, "libdynamicsprocessingsw.so", getEffectImplUuidDynamicsProcessingSw(),
+                 Parameter::Specific::make<Parameter::Specific::dynamicsProcessing>(
+                         DynamicsProcessing::make<DynamicsProcessing::engineArchitecture>(engine)));
+}
+
+// Stereo and 7.1.
+#define EFFECT_DSP_BENCHMARK(name) \
+    BENCHMARK(name)->Arg(AudioChannelLayout::LAYOUT_STEREO)->Arg(AudioChannelLayout::LAYOUT_7POINT1)
+
+EFFECT_DSP_BENCHMARK(BM_EqualizerSw);
+EFFECT_DSP_BENCHMARK(BM_BassBoostSw);
+EFFECT_DSP_BENCHMARK(BM_VirtualizerSw);
+EFFECT_DSP_BENCHMARK(BM_LoudnessEnhancerSw);
+EFFECT_DSP_BENCHMARK(BM_DynamicsProcessingSw);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define LOG_TAG "StreamWorkerBenchmark"
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+
+#include "core-impl/Stream.h"
+#include "core-impl/StreamStub.h"
+
+using aidl::android::hardware::audio::core::DriverStub;
+using aidl::android::hardware::audio::core::StreamContext;
+using aidl::android::hardware::audio::core::StreamDescriptor;
+using aidl::android::hardware::audio::core::StreamOutWorker;
+using aidl::android::hardware::audio::core::StreamTiming;
+using aidl::android::media::audio::common::AudioChannelLayout;
+using aidl::android::media::audio::common::AudioFormatDescription;
+using aidl::android::media::audio::common::AudioFormatType;
+using aidl::android::media::audio::common::PcmType;
+
+/**
+ * Drives the command, reply and data FMQs of output streams from client threads, one per stream,
+ * the way the framework does. The stub driver uses the virtual clock, so the round trips are not
+ * paced and the numbers only reflect the transport and the worker. Run with:
+ *
+ *   atest StreamWorkerBenchmark
+ *
+ * range(0) is the number of concurrent streams. The "p50_ns", "p90_ns" and "p99_ns" counters are
+ * the percentiles of the time from writing a 'burst' command to reading its reply.
+ * BM_FmqEcho replies from a bare loop instead of StreamOutWorker, the difference between the two
+ * is the overhead of the worker state machine and the driver.
+ */
+
+namespace {
+
+constexpr int kSampleRate = 48000;
+constexpr size_t kBufferFrames = 960;
+constexpr size_t kBurstFrames = 240;
+constexpr size_t kBurstsPerIteration = 100;
+
+std::unique_ptr<StreamContext> createContext() {
+    AudioFormatDescription format;
+    format.type = AudioFormatType::PCM;
+    format.pcm = PcmType::INT_16_BIT;
+    const auto channelLayout = AudioChannelLayout::make<AudioChannelLayout::layoutMask>(
+            AudioChannelLayout::LAYOUT_STEREO);
+    const size_t frameSize = 2 * sizeof(int16_t);
+    StreamContext::DebugParameters params;
+    params.timingMode = StreamTiming::Mode::VIRTUAL;
+    return std::make_unique<StreamContext>(
+            std::make_unique<StreamContext::CommandMQ>(1, true /*configureEventFlagWord*/),
+            std::make_unique<StreamContext::ReplyMQ>(1, true /*configureEventFlagWord*/), format,
+            channelLayout, kSampleRate,
+            std::make_unique<StreamContext::DataMQ>(frameSize * kBufferFrames), nullptr, nullptr,
+            params);
+}
+
+// The framework side of a stream.
+class StreamClient {
+  public:
+    explicit StreamClient(const StreamContext& context)
+        : mContext(context), mBuffer(kBurstFrames * context.getFrameSize()) {}
+
+    bool sendCommand(const StreamDescriptor::Command& command, StreamDescriptor::Reply* reply) {
+        return mContext.getCommandMQ()->writeBlocking(&command, 1) &&
+               mContext.getReplyMQ()->readBlocking(reply, 1) && reply->status == STATUS_OK;
+    }
+
+    // Runs 'count' bursts and appends their round trip times to 'latencies'.
+    bool runBursts(size_t count, std::vector<int64_t>* latencies) {
+        const auto burst = StreamDescriptor::Command::make<StreamDescriptor::Command::Tag::burst>(
+                mBuffer.size());
+        StreamDescriptor::Reply reply{};
+        for (size_t i = 0; i < count; i++) {
+            const auto start = std::chrono::steady_clock::now();
+            if (!mContext.getDataMQ()->write(mBuffer.data(), mBuffer.size()) ||
+                !sendCommand(burst, &reply) || reply.fmqByteCount != (int)mBuffer.size()) {
+                return false;
+            }
+            latencies->push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now() - start)
+                                         .count());
+        }
+        return true;
+    }
+
+    void exit() {
+        const auto exit =
+                StreamDescriptor::Command::make<StreamDescriptor::Command::Tag::halReservedExit>(
+                        mContext.getInternalCommandCookie());
+        mContext.getCommandMQ()->writeBlocking(&exit, 1);
+    }
+
+  private:
+    const StreamContext& mContext;
+    std::vector<int8_t> mBuffer;
+};
+
+// The HAL side of a stream without the worker: consumes the data and replies to every command.
+void runEchoLoop(const StreamContext& context) {
+    std::vector<int8_t> buffer(kBufferFrames * context.getFrameSize());
+    StreamDescriptor::Command command;
+    while (context.getCommandMQ()->readBlocking(&command, 1)) {
+        if (command.getTag() == StreamDescriptor::Command::Tag::halReservedExit) {
+            return;
+        }
+        StreamDescriptor::Reply reply{};
+        reply.status = STATUS_OK;
+        if (command.getTag() == StreamDescriptor::Command::Tag::burst) {
+            const size_t byteCount =
+                    std::min<size_t>(command.get<StreamDescriptor::Command::Tag::burst>(),
+                                     context.getDataMQ()->availableToRead());
+            context.getDataMQ()->read(buffer.data(), byteCount);
+            reply.fmqByteCount = byteCount;
+        }
+        context.getReplyMQ()->writeBlocking(&reply, 1);
+    }
+}
+
+// Runs kBurstsPerIteration bursts on every client concurrently for each iteration.
+void runClients(benchmark::State& state, std::vector<std::unique_ptr<StreamClient>>& clients) {
+    std::vector<std::vector<int64_t>> latencies(clients.size());
+    for (auto _ : state) {
+        std::vector<std::thread> threads;
+        std::atomic<bool> failed = false;
+        for (size_t i = 0; i < clients.size(); i++) {
+            threads.emplace_back([&, i]() {
+                if (!clients[i]->runBursts(kBurstsPerIteration, &latencies[i])) {
+                    failed = true;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (failed) {
+            state.SkipWithError("stream round trip failed");
+            break;
+        }
+    }
+    std::vector<int64_t> all;
+    for (const auto& l : latencies) {
+        all.insert(all.end(), l.begin(), l.end());
+    }
+    if (all.empty()) {
+        return;
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&all](size_t p) { return all[(all.size() - 1) * p / 100]; };
+    state.counters["p50_ns"] = percentile(50);
+    state.counters["p90_ns"] = percentile(90);
+    state.counters["p99_ns"] = percentile(99);
+    state.SetItemsProcessed(all.size());
+}
+
+}  // namespace
+
+static void BM_StreamWorker(benchmark::State& state) {
+    std::vector<std::unique_ptr<StreamContext>> contexts;
+    std::vector<std::unique_ptr<DriverStub>> drivers;
+    std::vector<std::unique_ptr<StreamOutWorker>> workers;
+    std::vector<std::unique_ptr<StreamClient>> clients;
+    bool started = true;
+    for (int i = 0; i < state.range(0) && started; i++) {
+        auto& context = *contexts.emplace_back(createContext());
+        auto driver = drivers.emplace_back(std::make_unique<DriverStub>(context, false)).get();
+        auto& worker = *workers.emplace_back(std::make_unique<StreamOutWorker>(context, driver));
+        auto& client = *clients.emplace_back(std::make_unique<StreamClient>(context));
+        worker.setIsConnected(true);
+        StreamDescriptor::Reply reply;
+        started = worker.start() &&
+                  client.sendCommand(
+                          StreamDescriptor::Command::make<StreamDescriptor::Command::Tag::start>(),
+                          &reply);
+    }
+    if (started) {
+        runClients(state, clients);
+    } else {
+        state.SkipWithError("failed to start the stream");
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        clients[i]->exit();
+        workers[i]->stop();
+    }
+}
+
+static void BM_FmqEcho(benchmark::State& state) {
+    std::vector<std::unique_ptr<StreamContext>> contexts;
+    std::vector<std::thread> loops;
+    std::vector<std::unique_ptr<StreamClient>> clients;
+    for (int i = 0; i < state.range(0); i++) {
+        contexts.push_back(createContext());
+        loops.emplace_back(runEchoLoop, std::cref(*contexts.back()));
+        clients.push_back(std::make_unique<StreamClient>(*contexts.back()));
+    }
+    runClients(state, clients);
+    for (size_t i = 0; i < loops.size(); i++) {
+        clients[i]->exit();
+        loops[i].join();
+    }
+}
+
+BENCHMARK(BM_StreamWorker)->Arg(1)->Arg(4)->Arg(16)->UseRealTime();
+BENCHMARK(BM_FmqEcho)->Arg(1)->Arg(4)->Arg(16)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <time.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "SubmixPipe.h"
+
+using aidl::android::hardware::audio::core::r_submix::SubmixPipe;
+
+/**
+ * Measures the pipe of the remote submix streams with a writer and a reader thread, without any
+ * real time pacing, so it runs on any Linux host:
+ *
+ *   atest SubmixPipeBenchmark
+ *   out/host/linux-x86/benchmarktest/SubmixPipeBenchmark/SubmixPipeBenchmark
+ *
+ * BM_Throughput moves stereo 16-bit frames in bursts of range(0) frames, items/s is frames/s.
+ * BM_Latency stamps the first frame of every burst with the time it is written, the "latency_ns"
+ * counters are the time until the reader gets it, with the pipe kept half full as the streams do.
+ */
+
+namespace {
+
+constexpr size_t kFrameSize = 4;
+constexpr size_t kPipeFrames = 4096;
+constexpr size_t kFramesPerIteration = 48000;
+
+int64_t getMonotonicTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Writes 'frames' frames in bursts, yielding while the pipe is full.
+void writeAll(SubmixPipe* pipe, size_t frames, size_t burst, bool stamp) {
+    std::vector<uint8_t> buffer(burst * kFrameSize);
+    for (size_t written = 0; written < frames;) {
+        const size_t count = std::min(burst, frames - written);
+        if (pipe->availableToWrite() < count) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (stamp) {
+            // Stamp every burst in its first frames, the bursts are never split by the reader.
+            const int64_t now = getMonotonicTimeNs();
+            memcpy(buffer.data(), &now, sizeof(now));
+        }
+        written += pipe->write(buffer.data(), count);
+    }
+}
+
+}  // namespace
+
+static void BM_Throughput(benchmark::State& state) {
+    const size_t burst = state.range(0);
+    SubmixPipe pipe(kFrameSize, kPipeFrames);
+    std::vector<uint8_t> buffer(burst * kFrameSize);
+    for (auto _ : state) {
+        std::thread writer(writeAll, &pipe, kFramesPerIteration, burst, false);
+        for (size_t read = 0; read < kFramesPerIteration;) {
+            const size_t count =
+                    pipe.read(buffer.data(), std::min(burst, kFramesPerIteration - read));
+            if (count == 0) {
+                std::this_thread::yield();
+            }
+            read += count;
+        }
+        writer.join();
+    }
+    state.SetItemsProcessed(state.iterations() * kFramesPerIteration);
+    state.SetBytesProcessed(state.iterations() * kFramesPerIteration * kFrameSize);
+}
+
+static void BM_Latency(benchmark::State& state) {
+    const size_t burst = state.range(0);
+    SubmixPipe pipe(kFrameSize, kPipeFrames);
+    std::vector<uint8_t> buffer(burst * kFrameSize);
+    int64_t totalLatencyNs = 0;
+    int64_t maxLatencyNs = 0;
+    int64_t bursts = 0;
+    for (auto _ : state) {
+        std::thread writer(writeAll, &pipe, kFramesPerIteration, burst, true);
+        for (size_t read = 0; read < kFramesPerIteration;) {
+            const size_t count = std::min(burst, kFramesPerIteration - read);
+            // Let the pipe fill up to half of its size before reading, like a paced input end.
+            if (pipe.availableToRead() < std::min(kPipeFrames / 2, kFramesPerIteration - read)) {
+                std::this_thread::yield();
+                continue;
+            }
+            if (pipe.read(buffer.data(), count) != count) {
+                state.SkipWithError("short read");
+                break;
+            }
+            int64_t stamp;
+            memcpy(&stamp, buffer.data(), sizeof(stamp));
+            const int64_t latencyNs = getMonotonicTimeNs() - stamp;
+            totalLatencyNs += latencyNs;
+            maxLatencyNs = std::max(maxLatencyNs, latencyNs);
+            bursts++;
+            read += count;
+        }
+        writer.join();
+    }
+    state.SetItemsProcessed(state.iterations() * kFramesPerIteration);
+    state.counters["latency_ns"] = bursts > 0 ? totalLatencyNs / bursts : 0;
+    state.counters["max_latency_ns"] = maxLatencyNs;
+}
+
+BENCHMARK(BM_Throughput)->Arg(48)->Arg(240)->Arg(960)->UseRealTime();
+BENCHMARK(BM_Latency)->Arg(48)->Arg(240)->Arg(960)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "UsbPcmConverter.h"
+
+using aidl::android::hardware::audio::core::usb::UsbPcmConverter;
+using SampleFormat = UsbPcmConverter::SampleFormat;
+
+/**
+ * Measures the conversion kernels of the USB streams on bursts of 20 ms, on any Linux host:
+ *
+ *   atest UsbPcmConverterBenchmark
+ *   out/host/linux-x86/benchmarktest/UsbPcmConverterBenchmark/UsbPcmConverterBenchmark
+ *
+ * Each benchmark converts from the stream configuration to the device configuration, items/s is
+ * stream frames/s. BM_Format only changes the sample format, BM_Channels only the channels,
+ * BM_Resample only the sample rate, and BM_Stream serves a 16-bit stereo client from a device
+ * which only supports 24-bit 5.1 at 96kHz.
+ */
+
+namespace {
+
+constexpr size_t kBurstMs = 20;
+
+constexpr uint32_t kStereo = 0x3;
+constexpr uint32_t k5Point1 = 0x3f;
+constexpr uint32_t k7Point1 = 0x63f;
+
+void runConversion(benchmark::State& state, const UsbPcmConverter::Config& from,
+                   const UsbPcmConverter::Config& to) {
+    auto converter = UsbPcmConverter::create(from, to);
+    if (converter == nullptr) {
+        state.SkipWithError("unsupported conversion");
+        return;
+    }
+    const size_t frameCount = from.sampleRate * kBurstMs / 1000;
+    std::vector<float> signal(frameCount * from.channelCount);
+    for (size_t i = 0; i < signal.size(); i++) {
+        signal[i] = 0.5f * std::sin(i * 0.01f);
+    }
+    // Encode the signal in the stream format.
+    std::vector<uint8_t> in(UsbPcmConverter::getFrameSize(from) * frameCount);
+    UsbPcmConverter::create({SampleFormat::FLOAT, from.channelCount, from.channelPositionMask,
+                             from.sampleRate},
+                            from)
+            ->convert(signal.data(), frameCount, in.data(), frameCount);
+    const size_t maxOutFrames = converter->getMaxOutputFrames(frameCount) + frameCount;
+    std::vector<uint8_t> out(UsbPcmConverter::getFrameSize(to) * maxOutFrames);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+                converter->convert(in.data(), frameCount, out.data(), maxOutFrames));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * frameCount);
+}
+
+}  // namespace
+
+static void BM_Format(benchmark::State& state) {
+    const auto from = static_cast<SampleFormat>(state.range(0));
+    const auto to = static_cast<SampleFormat>(state.range(1));
+    runConversion(state, {from, 2, kStereo, 48000}, {to, 2, kStereo, 48000});
+}
+
+static void BM_Channels(benchmark::State& state) {
+    const uint32_t from = state.range(0);
+    const uint32_t to = state.range(1);
+    runConversion(state, {SampleFormat::FLOAT, (size_t)__builtin_popcount(from), from, 48000},
+                  {SampleFormat::FLOAT, (size_t)__builtin_popcount(to), to, 48000});
+}
+
+static void BM_Resample(benchmark::State& state) {
+    runConversion(state, {SampleFormat::FLOAT, 2, kStereo, (uint32_t)state.range(0)},
+                  {SampleFormat::FLOAT, 2, kStereo, (uint32_t)state.range(1)});
+}
+
+static void BM_Stream(benchmark::State& state) {
+    runConversion(state, {SampleFormat::I16, 2, kStereo, 48000},
+                  {SampleFormat::I24_PACKED, 6, k5Point1, 96000});
+}
+
+BENCHMARK(BM_Format)
+        ->Args({(int)SampleFormat::I16, (int)SampleFormat::FLOAT})
+        ->Args({(int)SampleFormat::FLOAT, (int)SampleFormat::I16})
+        ->Args({(int)SampleFormat::I16, (int)SampleFormat::I24_PACKED})
+        ->Args({(int)SampleFormat::I24_PACKED, (int)SampleFormat::I16})
+        ->Args({(int)SampleFormat::FLOAT, (int)SampleFormat::Q8_24})
+        ->Args({(int)SampleFormat::FLOAT, (int)SampleFormat::I32});
+BENCHMARK(BM_Channels)
+        ->Args({kStereo, k5Point1})
+        ->Args({k5Point1, kStereo})
+        ->Args({k7Point1, kStereo});
+BENCHMARK(BM_Resample)->Args({44100, 48000})->Args({48000, 44100})->Args({48000, 96000});
+BENCHMARK(BM_Stream);
+
+BENCHMARK_MAIN();
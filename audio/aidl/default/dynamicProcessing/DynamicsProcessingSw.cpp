@@ -15,6 +15,7 @@
  */
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <set>
 #include <unordered_set>
@@ -273,15 +274,13 @@ RetCode DynamicsProcessingSw::releaseContext() {
 
 // Processing method running in EffectWorker thread.
 IEffect::Status DynamicsProcessingSw::effectProcessImpl(float* in, float* out, int samples) {
-    // TODO: get data buffer and process.
-    LOG(DEBUG) << __func__ << " in " << in << " out " << out << " samples " << samples;
-    for (int i = 0; i < samples; i++) {
-        *out++ = *in++;
-    }
-    return {STATUS_OK, samples, samples};
+    RETURN_VALUE_IF(!mContext, (IEffect::Status{EX_NULL_POINTER, 0, 0}), "nullContext");
+    return mContext->process(in, out, samples);
 }
 
 RetCode DynamicsProcessingSwContext::setCommon(const Parameter::Common& common) {
+    std::lock_guard lg(mMutex);
+    mParamsUpdate.markChanged();
     mCommon = common;
     mChannelCount = ::aidl::android::hardware::audio::common::getChannelCount(
             common.input.base.channelMask);
@@ -293,6 +292,7 @@ RetCode DynamicsProcessingSwContext::setCommon(const Parameter::Common& common)
 
 RetCode DynamicsProcessingSwContext::setEngineArchitecture(
         const DynamicsProcessing::EngineArchitecture& cfg) {
+    std::lock_guard lg(mMutex);
     RETURN_VALUE_IF(!validateEngineConfig(cfg), RetCode::ERROR_ILLEGAL_PARAMETER,
                     "illegalEngineConfig");
 
@@ -301,6 +301,7 @@ RetCode DynamicsProcessingSwContext::setEngineArchitecture(
         return RetCode::SUCCESS;
     }
     mEngineSettings = cfg;
+    mParamsUpdate.markChanged();
     resizeBands();
     return RetCode::SUCCESS;
 }
@@ -332,16 +333,22 @@ RetCode DynamicsProcessingSwContext::setChannelCfgs(
 
 RetCode DynamicsProcessingSwContext::setPreEqChannelCfgs(
         const std::vector<DynamicsProcessing::ChannelConfig>& cfgs) {
+    std::lock_guard lg(mMutex);
+    mParamsUpdate.markChanged();
     return setChannelCfgs(cfgs, mPreEqChCfgs, mEngineSettings.preEqStage);
 }
 
 RetCode DynamicsProcessingSwContext::setPostEqChannelCfgs(
         const std::vector<DynamicsProcessing::ChannelConfig>& cfgs) {
+    std::lock_guard lg(mMutex);
+    mParamsUpdate.markChanged();
     return setChannelCfgs(cfgs, mPostEqChCfgs, mEngineSettings.postEqStage);
 }
 
 RetCode DynamicsProcessingSwContext::setMbcChannelCfgs(
         const std::vector<DynamicsProcessing::ChannelConfig>& cfgs) {
+    std::lock_guard lg(mMutex);
+    mParamsUpdate.markChanged();
     return setChannelCfgs(cfgs, mMbcChCfgs, mEngineSettings.mbcStage);
 }
 
@@ -374,16 +381,21 @@ RetCode DynamicsProcessingSwContext::setEqBandCfgs(
 
 RetCode DynamicsProcessingSwContext::setPreEqBandCfgs(
         const std::vector<DynamicsProcessing::EqBandConfig>& cfgs) {
+    std::lock_guard lg(mMutex);
+    mParamsUpdate.markChanged();
     return setEqBandCfgs(cfgs, mPreEqChBands, mEngineSettings.preEqStage, mPreEqChCfgs);
 }
 
 RetCode DynamicsProcessingSwContext::setPostEqBandCfgs(
         const std::vector<DynamicsProcessing::EqBandConfig>& cfgs) {
+    std::lock_guard lg(mMutex);
+    mParamsUpdate.markChanged();
     return setEqBandCfgs(cfgs, mPostEqChBands, mEngineSettings.postEqStage, mPostEqChCfgs);
 }
 
 RetCode DynamicsProcessingSwContext::setMbcBandCfgs(
         const std::vector<DynamicsProcessing::MbcBandConfig>& cfgs) {
+    std::lock_guard lg(mMutex);
     RETURN_VALUE_IF(!mEngineSettings.mbcStage.inUse, RetCode::ERROR_ILLEGAL_PARAMETER,
                     "mbcNotInUse");
 
@@ -406,12 +418,14 @@ RetCode DynamicsProcessingSwContext::setMbcBandCfgs(
             continue;
         }
         mMbcChBands[it.channel * bandCount + it.band] = it;
+        mParamsUpdate.markChanged();
     }
     return ret;
 }
 
 RetCode DynamicsProcessingSwContext::setLimiterCfgs(
         const std::vector<DynamicsProcessing::LimiterConfig>& cfgs) {
+    std::lock_guard lg(mMutex);
     RETURN_VALUE_IF(!mEngineSettings.limiterInUse, RetCode::ERROR_ILLEGAL_PARAMETER,
                     "limiterNotInUse");
 
@@ -431,6 +445,7 @@ RetCode DynamicsProcessingSwContext::setLimiterCfgs(
             continue;
         }
         mLimiterCfgs[it.channel] = it;
+        mParamsUpdate.markChanged();
     }
     return ret;
 }
@@ -470,15 +485,18 @@ void DynamicsProcessingSwContext::resizeBands() {
 
 RetCode DynamicsProcessingSwContext::setInputGainCfgs(
         const std::vector<DynamicsProcessing::InputGain>& cfgs) {
+    std::lock_guard lg(mMutex);
     for (const auto& cfg : cfgs) {
         RETURN_VALUE_IF(cfg.channel < 0 || (size_t)cfg.channel >= mChannelCount,
                         RetCode::ERROR_ILLEGAL_PARAMETER, "invalidChannel");
         mInputGainCfgs[cfg.channel] = cfg;
+        mParamsUpdate.markChanged();
     }
     return RetCode::SUCCESS;
 }
 
 std::vector<DynamicsProcessing::InputGain> DynamicsProcessingSwContext::getInputGainCfgs() {
+    std::lock_guard lg(mMutex);
     std::vector<DynamicsProcessing::InputGain> ret;
     std::copy_if(mInputGainCfgs.begin(), mInputGainCfgs.end(), std::back_inserter(ret),
                  [&](const auto& gain) { return gain.channel != kInvalidChannelId; });
@@ -521,4 +539,198 @@ bool DynamicsProcessingSwContext::validateLimiterConfig(
            limiter.releaseTimeMs >= 0 && limiter.ratio >= 0 && limiter.thresholdDb <= 0;
 }
 
+IEffect::Status DynamicsProcessingSwContext::process(float* in, float* out, int samples) {
+    mParamsUpdate.applyIfChanged(mMutex,
+                                 [this]() NO_THREAD_SAFETY_ANALYSIS { updateProcessing_l(); });
+
+    size_t frameCount = mProcessingChannelCount ? samples / mProcessingChannelCount : 0;
+    mInputGain.process(in, out, frameCount);
+    if (mPreEqInUse) {
+        mPreEq.process(out, out, frameCount);
+    }
+    if (mMbcInUse) {
+        processMbc(out, frameCount);
+    }
+    if (mPostEqInUse) {
+        mPostEq.process(out, out, frameCount);
+    }
+    if (mLimiterInUse) {
+        mLimiter.process(out, out, frameCount);
+    }
+    copyPartialFrame(in, out, samples, mProcessingChannelCount);
+    return {STATUS_OK, samples, samples};
+}
+
+void DynamicsProcessingSwContext::processMbc(float* buffer, size_t frameCount) {
+    size_t bandCount = mMbcBands.size();
+    for (size_t offset = 0; offset < frameCount; offset += kMbcBlockFrames) {
+        size_t blockFrames = std::min(kMbcBlockFrames, frameCount - offset);
+        size_t blockSamples = blockFrames * mProcessingChannelCount;
+        float* block = buffer + offset * mProcessingChannelCount;
+        mMbcCrossover.process(block, mMbcBands.data(), blockFrames);
+        for (size_t band = 0; band < bandCount; band++) {
+            mMbcCompressors[band].process(mMbcBands[band], mMbcBands[band], blockFrames);
+        }
+        std::copy(mMbcBands[0], mMbcBands[0] + blockSamples, block);
+        for (size_t band = 1; band < bandCount; band++) {
+            const float* bandSamples = mMbcBands[band];
+            for (size_t i = 0; i < blockSamples; i++) {
+                block[i] += bandSamples[i];
+            }
+        }
+    }
+}
+
+void DynamicsProcessingSwContext::updateProcessing_l() {
+    float sampleRate = mCommon.input.base.sampleRate;
+    bool reconfigure = mChannelCount != mProcessingChannelCount || sampleRate != mSampleRate;
+    if (reconfigure) {
+        mInputGain.configure(mChannelCount,
+                             static_cast<size_t>(sampleRate * kGainRampMs / 1000.f));
+        mProcessingChannelCount = mChannelCount;
+        mSampleRate = sampleRate;
+    }
+    for (size_t channel = 0; channel < mChannelCount; channel++) {
+        const auto& cfg = mInputGainCfgs[channel];
+        mInputGain.setTarget(channel,
+                             cfg.channel == kInvalidChannelId ? 1.f : dbToLinear(cfg.gainDb));
+    }
+
+    mPreEqInUse = mEngineSettings.preEqStage.inUse;
+    if (mPreEqInUse) {
+        updateEq_l(mPreEq, mEngineSettings.preEqStage.bandCount, mPreEqChCfgs, mPreEqChBands);
+    }
+    mPostEqInUse = mEngineSettings.postEqStage.inUse;
+    if (mPostEqInUse) {
+        updateEq_l(mPostEq, mEngineSettings.postEqStage.bandCount, mPostEqChCfgs, mPostEqChBands);
+    }
+    // Start the dynamics stages from a clean state when they are turned on.
+    bool wasMbcInUse = mMbcInUse;
+    mMbcInUse = mEngineSettings.mbcStage.inUse;
+    if (mMbcInUse) {
+        updateMbc_l(reconfigure || !wasMbcInUse);
+    }
+    bool wasLimiterInUse = mLimiterInUse;
+    mLimiterInUse = mEngineSettings.limiterInUse;
+    if (mLimiterInUse) {
+        updateLimiter_l(reconfigure || !wasLimiterInUse);
+    }
+}
+
+namespace {
+
+// Band 0 boosts or cuts below its cutoff frequency, the last band above the cutoff frequency of
+// the band before it, and the bands in between are peaking filters spanning their own range.
+BiquadCoefficients designEqBand(float sampleRate, size_t band, size_t bandCount, float lowHz,
+                                float highHz, float gainDb) {
+    constexpr float kShelfQ = M_SQRT1_2;
+    if (band == 0) {
+        return BiquadCoefficients::lowShelf(sampleRate, highHz, kShelfQ, gainDb);
+    }
+    if (band == bandCount - 1) {
+        return BiquadCoefficients::highShelf(sampleRate, lowHz, kShelfQ, gainDb);
+    }
+    float centerHz = std::sqrt(lowHz * highHz);
+    float q = centerHz / std::max(highHz - lowHz, 1.f);
+    return BiquadCoefficients::peaking(sampleRate, centerHz, q, gainDb);
+}
+
+// Crossover frequency used when the cutoff of an MBC band is not set, so the bands are spread
+// evenly on a log scale between 20 Hz and 20 kHz.
+float getDefaultMbcCutoff(size_t band, size_t bandCount) {
+    return 20.f * std::pow(1000.f, static_cast<float>(band + 1) / bandCount);
+}
+
+}  // namespace
+
+void DynamicsProcessingSwContext::updateEq_l(
+        BiquadFilter& filter, size_t bandCount,
+        const std::vector<DynamicsProcessing::ChannelConfig>& channelCfgs,
+        const std::vector<DynamicsProcessing::EqBandConfig>& bandCfgs) {
+    if (filter.getChannelCount() != mChannelCount || filter.getStageCount() != bandCount) {
+        filter.configure(mChannelCount, bandCount);
+    }
+    for (size_t channel = 0; channel < mChannelCount; channel++) {
+        bool channelEnabled =
+                channelCfgs[channel].channel != kInvalidChannelId && channelCfgs[channel].enable;
+        float lowHz = 0;
+        for (size_t band = 0; band < bandCount; band++) {
+            const auto& cfg = bandCfgs[channel * bandCount + band];
+            bool bandEnabled = channelEnabled && cfg.channel != kInvalidChannelId && cfg.enable;
+            filter.setCoefficients(band, channel,
+                                   bandEnabled ? designEqBand(mSampleRate, band, bandCount, lowHz,
+                                                              cfg.cutoffFrequencyHz, cfg.gainDb)
+                                               : BiquadCoefficients());
+            lowHz = cfg.cutoffFrequencyHz;
+        }
+    }
+}
+
+void DynamicsProcessingSwContext::updateMbc_l(bool reconfigure) {
+    size_t bandCount = mEngineSettings.mbcStage.bandCount;
+    if (reconfigure || mMbcCompressors.size() != bandCount) {
+        mMbcCrossover.configure(mChannelCount, bandCount);
+        mMbcCompressors.resize(bandCount);
+        for (auto& compressor : mMbcCompressors) {
+            compressor.configure(mChannelCount, mSampleRate);
+        }
+        mMbcBandBuffers.assign(bandCount, std::vector<float>(kMbcBlockFrames * mChannelCount));
+        mMbcBands.resize(bandCount);
+        for (size_t band = 0; band < bandCount; band++) {
+            mMbcBands[band] = mMbcBandBuffers[band].data();
+        }
+    }
+    for (size_t channel = 0; channel < mChannelCount; channel++) {
+        bool channelEnabled =
+                mMbcChCfgs[channel].channel != kInvalidChannelId && mMbcChCfgs[channel].enable;
+        float lowHz = 0;
+        for (size_t band = 0; band < bandCount; band++) {
+            const auto& cfg = mMbcChBands[channel * bandCount + band];
+            // A disabled band is still split, a compressor with the default params is unity gain.
+            CompressorParams params;
+            if (channelEnabled && cfg.channel != kInvalidChannelId && cfg.enable) {
+                params.attackMs = cfg.attackTimeMs;
+                params.releaseMs = cfg.releaseTimeMs;
+                params.ratio = cfg.ratio;
+                params.thresholdDb = cfg.thresholdDb;
+                params.kneeWidthDb = cfg.kneeWidthDb;
+                params.noiseGateThresholdDb = cfg.noiseGateThresholdDb;
+                params.expanderRatio = cfg.expanderRatio;
+                params.preGainDb = cfg.preGainDb;
+                params.postGainDb = cfg.postGainDb;
+            }
+            mMbcCompressors[band].setParams(channel, params);
+            if (band + 1 < bandCount) {
+                float cutoffHz = cfg.channel != kInvalidChannelId
+                                         ? cfg.cutoffFrequencyHz
+                                         : getDefaultMbcCutoff(band, bandCount);
+                // The crossovers must be in increasing order.
+                lowHz = std::max(cutoffHz, lowHz);
+                mMbcCrossover.setCrossoverFrequency(channel, band, mSampleRate, lowHz);
+            }
+        }
+    }
+}
+
+void DynamicsProcessingSwContext::updateLimiter_l(bool reconfigure) {
+    if (reconfigure) {
+        mLimiter.configure(mChannelCount, mSampleRate);
+    }
+    for (size_t channel = 0; channel < mChannelCount; channel++) {
+        const auto& cfg = mLimiterCfgs[channel];
+        CompressorParams params;
+        int linkGroup = -1;
+        if (cfg.channel != kInvalidChannelId && cfg.enable) {
+            params.attackMs = cfg.attackTimeMs;
+            params.releaseMs = cfg.releaseTimeMs;
+            params.ratio = cfg.ratio;
+            params.thresholdDb = cfg.thresholdDb;
+            params.postGainDb = cfg.postGainDb;
+            linkGroup = cfg.linkGroup;
+        }
+        mLimiter.setParams(channel, params);
+        mLimiter.setLinkGroup(channel, linkGroup);
+    }
+}
+
 }  // namespace aidl::android::hardware::audio::effect
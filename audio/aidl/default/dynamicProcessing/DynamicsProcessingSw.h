@@ -18,12 +18,15 @@
 
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <Utils.h>
 #include <aidl/android/hardware/audio/effect/BnEffect.h>
+#include <android-base/thread_annotations.h>
 #include <fmq/AidlMessageQueue.h>
 
+#include "effect-impl/EffectDsp.h"
 #include "effect-impl/EffectImpl.h"
 
 namespace aidl::android::hardware::audio::effect {
@@ -39,17 +42,22 @@ class DynamicsProcessingSwContext final : public EffectContext {
           mMbcChCfgs(mChannelCount, {.channel = kInvalidChannelId}),
           mLimiterCfgs(mChannelCount, {.channel = kInvalidChannelId}) {
         LOG(DEBUG) << __func__;
+        std::lock_guard lg(mMutex);
+        resizeChannels();
+        updateProcessing_l();
     }
 
     // utils
     RetCode setChannelCfgs(const std::vector<DynamicsProcessing::ChannelConfig>& cfgs,
                            std::vector<DynamicsProcessing::ChannelConfig>& targetCfgs,
-                           const DynamicsProcessing::StageEnablement& engineSetting);
+                           const DynamicsProcessing::StageEnablement& engineSetting)
+            REQUIRES(mMutex);
 
     RetCode setEqBandCfgs(const std::vector<DynamicsProcessing::EqBandConfig>& cfgs,
                           std::vector<DynamicsProcessing::EqBandConfig>& targetCfgs,
                           const DynamicsProcessing::StageEnablement& stage,
-                          const std::vector<DynamicsProcessing::ChannelConfig>& channelConfig);
+                          const std::vector<DynamicsProcessing::ChannelConfig>& channelConfig)
+            REQUIRES(mMutex);
 
     // set params
     RetCode setCommon(const Parameter::Common& common) override;
@@ -64,30 +72,81 @@ class DynamicsProcessingSwContext final : public EffectContext {
     RetCode setInputGainCfgs(const std::vector<DynamicsProcessing::InputGain>& cfgs);
 
     // get params
-    DynamicsProcessing::EngineArchitecture getEngineArchitecture() { return mEngineSettings; }
-    std::vector<DynamicsProcessing::ChannelConfig> getPreEqChannelCfgs() { return mPreEqChCfgs; }
-    std::vector<DynamicsProcessing::ChannelConfig> getPostEqChannelCfgs() { return mPostEqChCfgs; }
-    std::vector<DynamicsProcessing::ChannelConfig> getMbcChannelCfgs() { return mMbcChCfgs; }
-    std::vector<DynamicsProcessing::EqBandConfig> getPreEqBandCfgs() { return mPreEqChBands; }
-    std::vector<DynamicsProcessing::EqBandConfig> getPostEqBandCfgs() { return mPostEqChBands; }
-    std::vector<DynamicsProcessing::MbcBandConfig> getMbcBandCfgs() { return mMbcChBands; }
-    std::vector<DynamicsProcessing::LimiterConfig> getLimiterCfgs() { return mLimiterCfgs; }
+    DynamicsProcessing::EngineArchitecture getEngineArchitecture() {
+        std::lock_guard lg(mMutex);
+        return mEngineSettings;
+    }
+    std::vector<DynamicsProcessing::ChannelConfig> getPreEqChannelCfgs() {
+        std::lock_guard lg(mMutex);
+        return mPreEqChCfgs;
+    }
+    std::vector<DynamicsProcessing::ChannelConfig> getPostEqChannelCfgs() {
+        std::lock_guard lg(mMutex);
+        return mPostEqChCfgs;
+    }
+    std::vector<DynamicsProcessing::ChannelConfig> getMbcChannelCfgs() {
+        std::lock_guard lg(mMutex);
+        return mMbcChCfgs;
+    }
+    std::vector<DynamicsProcessing::EqBandConfig> getPreEqBandCfgs() {
+        std::lock_guard lg(mMutex);
+        return mPreEqChBands;
+    }
+    std::vector<DynamicsProcessing::EqBandConfig> getPostEqBandCfgs() {
+        std::lock_guard lg(mMutex);
+        return mPostEqChBands;
+    }
+    std::vector<DynamicsProcessing::MbcBandConfig> getMbcBandCfgs() {
+        std::lock_guard lg(mMutex);
+        return mMbcChBands;
+    }
+    std::vector<DynamicsProcessing::LimiterConfig> getLimiterCfgs() {
+        std::lock_guard lg(mMutex);
+        return mLimiterCfgs;
+    }
     std::vector<DynamicsProcessing::InputGain> getInputGainCfgs();
 
+    // Run the enabled stages on interleaved samples, called in the EffectWorker thread.
+    IEffect::Status process(float* in, float* out, int samples);
+
   private:
     static constexpr int32_t kInvalidChannelId = -1;
-    size_t mChannelCount = 0;
-    DynamicsProcessing::EngineArchitecture mEngineSettings;
+    // The MBC bands are split and compressed in blocks of this many frames.
+    static constexpr size_t kMbcBlockFrames = 256;
+    static constexpr float kGainRampMs = 10.f;
+
+    std::mutex mMutex;
+    size_t mChannelCount GUARDED_BY(mMutex) = 0;
+    DynamicsProcessing::EngineArchitecture mEngineSettings GUARDED_BY(mMutex);
     // Channel config vector with size of mChannelCount
-    std::vector<DynamicsProcessing::ChannelConfig> mPreEqChCfgs;
-    std::vector<DynamicsProcessing::ChannelConfig> mPostEqChCfgs;
-    std::vector<DynamicsProcessing::ChannelConfig> mMbcChCfgs;
-    std::vector<DynamicsProcessing::LimiterConfig> mLimiterCfgs;
-    std::vector<DynamicsProcessing::InputGain> mInputGainCfgs;
+    std::vector<DynamicsProcessing::ChannelConfig> mPreEqChCfgs GUARDED_BY(mMutex);
+    std::vector<DynamicsProcessing::ChannelConfig> mPostEqChCfgs GUARDED_BY(mMutex);
+    std::vector<DynamicsProcessing::ChannelConfig> mMbcChCfgs GUARDED_BY(mMutex);
+    std::vector<DynamicsProcessing::LimiterConfig> mLimiterCfgs GUARDED_BY(mMutex);
+    std::vector<DynamicsProcessing::InputGain> mInputGainCfgs GUARDED_BY(mMutex);
     // Band config vector with size of mChannelCount * bandCount
-    std::vector<DynamicsProcessing::EqBandConfig> mPreEqChBands;
-    std::vector<DynamicsProcessing::EqBandConfig> mPostEqChBands;
-    std::vector<DynamicsProcessing::MbcBandConfig> mMbcChBands;
+    std::vector<DynamicsProcessing::EqBandConfig> mPreEqChBands GUARDED_BY(mMutex);
+    std::vector<DynamicsProcessing::EqBandConfig> mPostEqChBands GUARDED_BY(mMutex);
+    std::vector<DynamicsProcessing::MbcBandConfig> mMbcChBands GUARDED_BY(mMutex);
+    DspParamsUpdate mParamsUpdate;
+
+    // A stage is skipped when it is not in use, and a disabled channel or band is a pass-through.
+    size_t mProcessingChannelCount = 0;
+    float mSampleRate = 0;
+    bool mPreEqInUse = false;
+    bool mMbcInUse = false;
+    bool mPostEqInUse = false;
+    bool mLimiterInUse = false;
+    GainRamp mInputGain;
+    BiquadFilter mPreEq;
+    CrossoverFilter mMbcCrossover;
+    // One compressor per MBC band, and the band buffers holding kMbcBlockFrames frames.
+    std::vector<Compressor> mMbcCompressors;
+    std::vector<std::vector<float>> mMbcBandBuffers;
+    std::vector<float*> mMbcBands;
+    BiquadFilter mPostEq;
+    Compressor mLimiter;
+
     bool validateStageEnablement(const DynamicsProcessing::StageEnablement& enablement);
     bool validateEngineConfig(const DynamicsProcessing::EngineArchitecture& engine);
     bool validateEqBandConfig(const DynamicsProcessing::EqBandConfig& band, int maxChannel,
@@ -97,8 +156,16 @@ class DynamicsProcessingSwContext final : public EffectContext {
                                int maxBand,
                                const std::vector<DynamicsProcessing::ChannelConfig>& channelConfig);
     bool validateLimiterConfig(const DynamicsProcessing::LimiterConfig& limiter, int maxChannel);
-    void resizeChannels();
-    void resizeBands();
+    void resizeChannels() REQUIRES(mMutex);
+    void resizeBands() REQUIRES(mMutex);
+    void updateProcessing_l() REQUIRES(mMutex);
+    void updateEq_l(BiquadFilter& filter, size_t bandCount,
+                    const std::vector<DynamicsProcessing::ChannelConfig>& channelCfgs,
+                    const std::vector<DynamicsProcessing::EqBandConfig>& bandCfgs)
+            REQUIRES(mMutex);
+    void updateMbc_l(bool reconfigure) REQUIRES(mMutex);
+    void updateLimiter_l(bool reconfigure) REQUIRES(mMutex);
+    void processMbc(float* buffer, size_t frameCount);
 };  // DynamicsProcessingSwContext
 
 class DynamicsProcessingSw final : public EffectImpl {
@@ -211,12 +211,34 @@ RetCode EqualizerSw::releaseContext() {
 
 // Processing method running in EffectWorker thread.
 IEffect::Status EqualizerSw::effectProcessImpl(float* in, float* out, int samples) {
-    // TODO: get data buffer and process.
-    LOG(DEBUG) << __func__ << " in " << in << " out " << out << " samples " << samples;
-    for (int i = 0; i < samples; i++) {
-        *out++ = *in++;
-    }
+    RETURN_VALUE_IF(!mContext, (IEffect::Status{EX_NULL_POINTER, 0, 0}), "nullContext");
+    return mContext->process(in, out, samples);
+}
+
+IEffect::Status EqualizerSwContext::process(float* in, float* out, int samples) {
+    mParamsUpdate.applyIfChanged(mMutex, [this]() NO_THREAD_SAFETY_ANALYSIS { updateFilter_l(); });
+
+    size_t frameCount = mChannelCount ? samples / mChannelCount : 0;
+    mFilter.process(in, out, frameCount);
+    copyPartialFrame(in, out, samples, mChannelCount);
     return {STATUS_OK, samples, samples};
 }
 
+void EqualizerSwContext::updateFilter_l() {
+    float sampleRate = mCommon.input.base.sampleRate;
+    size_t channelCount = ::aidl::android::hardware::audio::common::getChannelCount(
+            mCommon.input.base.channelMask);
+    if (channelCount != mFilter.getChannelCount()) {
+        mFilter.configure(channelCount, kMaxBandNumber);
+    }
+    const int32_t* levels = mUseBandLevels || mPreset == kCustomPreset
+                                    ? mBandLevels
+                                    : kPresetBandLevels[mPreset].data();
+    for (int i = 0; i < kMaxBandNumber; i++) {
+        mFilter.setCoefficients(i, BiquadCoefficients::peaking(sampleRate, kPresetsFrequencies[i],
+                                                               kBandQ, levels[i]));
+    }
+    mChannelCount = channelCount;
+}
+
 }  // namespace aidl::android::hardware::audio::effect
@@ -17,10 +17,13 @@
 #pragma once
 
 #include <aidl/android/hardware/audio/effect/BnEffect.h>
+#include <android-base/thread_annotations.h>
 #include <fmq/AidlMessageQueue.h>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 
+#include "effect-impl/EffectDsp.h"
 #include "effect-impl/EffectImpl.h"
 
 namespace aidl::android::hardware::audio::effect {
@@ -30,22 +33,37 @@ class EqualizerSwContext final : public EffectContext {
     EqualizerSwContext(int statusDepth, const Parameter::Common& common)
         : EffectContext(statusDepth, common) {
         LOG(DEBUG) << __func__;
+        std::lock_guard lg(mMutex);
+        updateFilter_l();
+    }
+
+    RetCode setCommon(const Parameter::Common& common) override {
+        std::lock_guard lg(mMutex);
+        mParamsUpdate.markChanged();
+        return EffectContext::setCommon(common);
     }
 
     RetCode setEqPreset(const int& presetIdx) {
         if (presetIdx < 0 || presetIdx >= kMaxPresetNumber) {
             return RetCode::ERROR_ILLEGAL_PARAMETER;
         }
+        std::lock_guard lg(mMutex);
         mPreset = presetIdx;
+        mUseBandLevels = false;
+        mParamsUpdate.markChanged();
         return RetCode::SUCCESS;
     }
-    int getEqPreset() { return mPreset; }
+    int getEqPreset() {
+        std::lock_guard lg(mMutex);
+        return mPreset;
+    }
 
     RetCode setEqBandLevels(const std::vector<Equalizer::BandLevel>& bandLevels) {
         if (bandLevels.size() > kMaxBandNumber) {
             LOG(ERROR) << __func__ << " return because size exceed " << kMaxBandNumber;
             return RetCode::ERROR_ILLEGAL_PARAMETER;
         }
+        std::lock_guard lg(mMutex);
         RetCode ret = RetCode::SUCCESS;
         for (auto& it : bandLevels) {
             if (it.index >= kMaxBandNumber || it.index < 0) {
@@ -56,10 +74,13 @@ class EqualizerSwContext final : public EffectContext {
                 mBandLevels[it.index] = it.levelMb;
             }
         }
+        mUseBandLevels = true;
+        mParamsUpdate.markChanged();
         return ret;
     }
 
     std::vector<Equalizer::BandLevel> getEqBandLevels() {
+        std::lock_guard lg(mMutex);
         std::vector<Equalizer::BandLevel> bandLevels;
         for (int i = 0; i < kMaxBandNumber; i++) {
             bandLevels.push_back({i, mBandLevels[i]});
@@ -70,6 +91,10 @@ class EqualizerSwContext final : public EffectContext {
     std::vector<int> getCenterFreqs() {
         return {std::begin(kPresetsFrequencies), std::end(kPresetsFrequencies)};
     }
+
+    // Run the equalizer on interleaved samples, called in the EffectWorker thread.
+    IEffect::Status process(float* in, float* out, int samples);
+
     static const int kMaxBandNumber = 5;
     static const int kMaxPresetNumber = 10;
     static const int kCustomPreset = -1;
@@ -77,11 +102,38 @@ class EqualizerSwContext final : public EffectContext {
   private:
     static constexpr std::array<uint16_t, kMaxBandNumber> kPresetsFrequencies = {60, 230, 910, 3600,
                                                                                  14000};
+    // Band levels of each preset in EqualizerSw::kPresets, in the same unit as mBandLevels.
+    static constexpr std::array<std::array<int32_t, kMaxBandNumber>, kMaxPresetNumber>
+            kPresetBandLevels = {{{3, 0, 0, 0, 3},
+                                  {5, 3, -2, 4, 4},
+                                  {6, 0, 2, 4, 1},
+                                  {0, 0, 0, 0, 0},
+                                  {3, 0, 0, 2, -1},
+                                  {4, 1, 9, 3, 0},
+                                  {5, 3, 0, 1, 3},
+                                  {4, 2, -2, 2, 5},
+                                  {-1, 2, 5, 1, -2},
+                                  {5, 3, -1, 3, 5}}};
+    // The center frequencies are about two octaves apart.
+    static constexpr float kBandQ = 0.667f;
+
+    // Parameters set by the binder thread, they are applied to the filter by the EffectWorker
+    // thread when it could take the lock without blocking.
+    std::mutex mMutex;
     // preset band level
-    int mPreset = kCustomPreset;
-    int32_t mBandLevels[kMaxBandNumber] = {3, 0, 0, 0, 3};
-
-    // Add equalizer specific context for processing here
+    int mPreset GUARDED_BY(mMutex) = kCustomPreset;
+    // Despite Equalizer::BandLevel::levelMb, this effect has always taken the band levels in dB,
+    // as its range of -15 to 15 and the default levels show. They are applied as dB.
+    int32_t mBandLevels[kMaxBandNumber] GUARDED_BY(mMutex) = {3, 0, 0, 0, 3};
+    // The filter follows the preset or the band levels, whichever was set last. Setting one does
+    // not change the other, the getters return what was set.
+    bool mUseBandLevels GUARDED_BY(mMutex) = true;
+    DspParamsUpdate mParamsUpdate;
+
+    size_t mChannelCount = 0;
+    BiquadFilter mFilter;
+
+    void updateFilter_l() REQUIRES(mMutex);
 };
 
 class EqualizerSw final : public EffectImpl {
@@ -43,8 +43,11 @@ class Module : public BnModule {
     struct VendorDebug {
         static const std::string kForceTransientBurstName;
         static const std::string kForceSynchronousDrainName;
+        static const std::string kUseVirtualClockName;
         bool forceTransientBurst = false;
         bool forceSynchronousDrain = false;
+        // Streams opened afterwards run as fast as possible, see StreamTiming.
+        bool useVirtualClock = false;
     };
     // Helper used for interfaces that require a persistent instance. We hold them via a strong
     // pointer. The binder token is retained for a call to 'setMinSchedulerPolicy'.
@@ -161,7 +164,8 @@ class Module : public BnModule {
     template <typename C>
     std::set<int32_t> portIdsFromPortConfigIds(C portConfigIds);
     void registerPatch(const AudioPatch& patch);
-    void updateStreamsConnectedState(const AudioPatch& oldPatch, const AudioPatch& newPatch);
+    ndk::ScopedAStatus updateStreamsConnectedState(const AudioPatch& oldPatch,
+                                                   const AudioPatch& newPatch);
     bool isMmapSupported();
 
     // This value is used for all AudioPatches.
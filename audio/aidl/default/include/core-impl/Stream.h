@@ -40,6 +40,7 @@
 #include <system/thread_defs.h>
 #include <utils/Errors.h>
 
+#include "core-impl/StreamTiming.h"
 #include "core-impl/utils.h"
 
 namespace aidl::android::hardware::audio::core {
@@ -71,6 +72,8 @@ class StreamContext {
         bool forceTransientBurst = false;
         // Force the "drain" command to be synchronous, going directly to the IDLE state.
         bool forceSynchronousDrain = false;
+        // How streams without audio hardware pace their transfers and timestamp their positions.
+        StreamTiming::Mode timingMode = StreamTiming::Mode::REAL_TIME;
     };
 
     StreamContext() = default;
@@ -135,6 +138,7 @@ class StreamContext {
     }
     ReplyMQ* getReplyMQ() const { return mReplyMQ.get(); }
     int getTransientStateDelayMs() const { return mDebugParameters.transientStateDelayMs; }
+    StreamTiming::Mode getTimingMode() const { return mDebugParameters.timingMode; }
     int getSampleRate() const { return mSampleRate; }
     bool isValid() const;
     void reset();
@@ -169,6 +173,11 @@ struct DriverInterface {
     virtual ::android::status_t transfer(void* buffer, size_t frameCount, size_t* actualFrameCount,
                                          int32_t* latencyMs) = 0;
     virtual ::android::status_t standby() = 0;
+    // Called when replying to a command while the stream is connected. Allows the driver to
+    // adjust the observable position, which by default counts all the transferred frames.
+    virtual ::android::status_t refinePosition(StreamDescriptor::Position* /*position*/) {
+        return ::android::OK;
+    }
 };
 
 class StreamWorkerCommonLogic : public ::android::hardware::audio::common::StreamLogic {
@@ -192,7 +201,8 @@ class StreamWorkerCommonLogic : public ::android::hardware::audio::common::Strea
           mAsyncCallback(context.getAsyncCallback()),
           mTransientStateDelayMs(context.getTransientStateDelayMs()),
           mForceTransientBurst(context.getForceTransientBurst()),
-          mForceSynchronousDrain(context.getForceSynchronousDrain()) {}
+          mForceSynchronousDrain(context.getForceSynchronousDrain()),
+          mTiming(context.getTimingMode(), context.getSampleRate()) {}
     std::string init() override;
     void populateReply(StreamDescriptor::Reply* reply, bool isConnected) const;
     void populateReplyWrongState(StreamDescriptor::Reply* reply,
@@ -223,6 +233,8 @@ class StreamWorkerCommonLogic : public ::android::hardware::audio::common::Strea
     std::unique_ptr<DataBufferElement[]> mDataBuffer;
     size_t mDataBufferSize;
     long mFrameCount = 0;
+    // Paces the transfers while disconnected, and timestamps the positions.
+    StreamTiming mTiming;
 };
 
 // This interface is used to decouple stream implementations from a concrete StreamWorker
@@ -384,11 +396,14 @@ class StreamCommonImpl : public StreamCommonInterface {
                                 : ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
     bool isClosed() const { return mWorker->isClosed(); }
-    void setIsConnected(
+    ndk::ScopedAStatus setIsConnected(
             const std::vector<::aidl::android::media::audio::common::AudioDevice>& devices) {
+        if (mDriver->setConnectedDevices(devices) != ::android::OK) {
+            return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+        }
         mWorker->setIsConnected(!devices.empty());
         mConnectedDevices = devices;
-        mDriver->setConnectedDevices(devices);
+        return ndk::ScopedAStatus::ok();
     }
     ndk::ScopedAStatus updateMetadata(const Metadata& metadata);
 
@@ -536,12 +551,13 @@ class StreamWrapper {
                 },
                 mStream);
     }
-    void setStreamIsConnected(
+    ndk::ScopedAStatus setStreamIsConnected(
             const std::vector<::aidl::android::media::audio::common::AudioDevice>& devices) {
-        std::visit(
-                [&](auto&& ws) {
+        return std::visit(
+                [&](auto&& ws) -> ndk::ScopedAStatus {
                     auto s = ws.lock();
-                    if (s) s->setIsConnected(devices);
+                    if (s) return s->setIsConnected(devices);
+                    return ndk::ScopedAStatus::ok();
                 },
                 mStream);
     }
@@ -565,12 +581,13 @@ class Streams {
         mStreams.insert(std::pair{portConfigId, sw});
         mStreams.insert(std::pair{portId, std::move(sw)});
     }
-    void setStreamIsConnected(
+    ndk::ScopedAStatus setStreamIsConnected(
             int32_t portConfigId,
             const std::vector<::aidl::android::media::audio::common::AudioDevice>& devices) {
         if (auto it = mStreams.find(portConfigId); it != mStreams.end()) {
-            it->second.setStreamIsConnected(devices);
+            return it->second.setStreamIsConnected(devices);
         }
+        return ndk::ScopedAStatus::ok();
     }
 
   private:
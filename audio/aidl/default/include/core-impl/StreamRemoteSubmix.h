@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <android-base/thread_annotations.h>
+
+#include "core-impl/Stream.h"
+
+namespace aidl::android::hardware::audio::core {
+
+namespace r_submix {
+class SubmixRoute;
+}
+
+// Remote submix streams exchange audio through an in-process pipe per device address: whatever
+// an output stream plays is captured by the input stream connected to the same address. Both
+// ends are paced in real time, without any audio hardware.
+class DriverRemoteSubmix : public DriverInterface {
+  public:
+    DriverRemoteSubmix(const StreamContext& context, bool isInput);
+    ~DriverRemoteSubmix();
+
+    ::android::status_t init() override;
+    ::android::status_t setConnectedDevices(
+            const std::vector<::aidl::android::media::audio::common::AudioDevice>& connectedDevices)
+            override;
+    ::android::status_t drain(StreamDescriptor::DrainMode) override;
+    ::android::status_t flush() override;
+    ::android::status_t pause() override;
+    ::android::status_t transfer(void* buffer, size_t frameCount, size_t* actualFrameCount,
+                                 int32_t* latencyMs) override;
+    ::android::status_t standby() override;
+    ::android::status_t refinePosition(StreamDescriptor::Position* position) override;
+
+  private:
+    void releaseRouteLocked() REQUIRES(mLock);
+    int32_t getPipeLatencyMsLocked() const REQUIRES(mLock);
+
+    const size_t mFrameSizeBytes;
+    const int mSampleRate;
+    const bool mIsInput;
+
+    // The route is switched on the binder thread connecting the stream, and used by the worker
+    // thread for each transfer. The lock is never held while the worker sleeps.
+    mutable std::mutex mLock;
+    std::shared_ptr<r_submix::SubmixRoute> mRoute GUARDED_BY(mLock);
+
+    // All fields below are only used on the worker thread.
+    bool mIsStandby = true;
+    StreamTiming mTiming;
+};
+
+class StreamInRemoteSubmix final : public StreamIn {
+  public:
+    static ndk::ScopedAStatus createInstance(
+            const ::aidl::android::hardware::audio::common::SinkMetadata& sinkMetadata,
+            StreamContext&& context,
+            const std::vector<::aidl::android::media::audio::common::MicrophoneInfo>& microphones,
+            std::shared_ptr<StreamIn>* result);
+
+  private:
+    friend class ndk::SharedRefBase;
+    StreamInRemoteSubmix(
+            const ::aidl::android::hardware::audio::common::SinkMetadata& sinkMetadata,
+            StreamContext&& context,
+            const std::vector<::aidl::android::media::audio::common::MicrophoneInfo>& microphones);
+};
+
+class StreamOutRemoteSubmix final : public StreamOut {
+  public:
+    static ndk::ScopedAStatus createInstance(
+            const ::aidl::android::hardware::audio::common::SourceMetadata& sourceMetadata,
+            StreamContext&& context,
+            const std::optional<::aidl::android::media::audio::common::AudioOffloadInfo>&
+                    offloadInfo,
+            std::shared_ptr<StreamOut>* result);
+
+  private:
+    friend class ndk::SharedRefBase;
+    StreamOutRemoteSubmix(
+            const ::aidl::android::hardware::audio::common::SourceMetadata& sourceMetadata,
+            StreamContext&& context,
+            const std::optional<::aidl::android::media::audio::common::AudioOffloadInfo>&
+                    offloadInfo);
+};
+
+}  // namespace aidl::android::hardware::audio::core
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <unistd.h>
+
 #include "core-impl/Stream.h"
 
 namespace aidl::android::hardware::audio::core {
@@ -35,10 +37,14 @@ class DriverStub : public DriverInterface {
     ::android::status_t standby() override;
 
   private:
+    // Sleep for the fixed delay of an operation, unless the virtual clock is used.
+    void simulateDelay(useconds_t delayUs) const;
+
     const size_t mFrameSizeBytes;
-    const int mSampleRate;
     const bool mIsAsynchronous;
     const bool mIsInput;
+    // Paces the transfers of synchronous streams to the sample rate.
+    StreamTiming mTiming;
 };
 
 class StreamInStub final : public StreamIn {
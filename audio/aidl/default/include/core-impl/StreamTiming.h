@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace aidl::android::hardware::audio::core {
+
+// Timing model of the streams which do not have audio hardware to block on.
+//
+// In the REAL_TIME mode, transfers are paced so that the frames move at the sample rate of the
+// stream. In the VIRTUAL mode, transfers never block and the stream time is derived from the
+// frames transferred, so the positions stay consistent while running as fast as possible.
+//
+// All the methods must be called on the same thread, normally the stream worker thread.
+class StreamTiming {
+  public:
+    enum class Mode { REAL_TIME, VIRTUAL };
+
+    StreamTiming(Mode mode, int sampleRate);
+
+    // Accounts for frames which have been transferred.
+    void advance(size_t frameCount);
+    // In the REAL_TIME mode, sleeps until the frames accounted for since the last restart would
+    // have been played or captured. Returns immediately in the VIRTUAL mode.
+    void wait();
+    // Must be called when the transfers stop, e.g. on standby, pause or flush, so that the time
+    // spent without transferring is not caught up with.
+    void restart();
+    // The time of the current position, in the elapsedRealtime base.
+    int64_t getTimestampNs() const;
+
+    Mode getMode() const { return mMode; }
+    bool isVirtual() const { return mMode == Mode::VIRTUAL; }
+
+  private:
+    int64_t framesToNs(uint64_t frames) const;
+
+    const Mode mMode;
+    const int mSampleRate;
+    // REAL_TIME: the start of the pacing on the monotonic clock, 0 when restarted.
+    int64_t mStartTimeNs = 0;
+    // Frames since the start of the pacing, or since creation in the VIRTUAL mode.
+    uint64_t mFrames = 0;
+    // VIRTUAL: the time of the first frame.
+    const int64_t mVirtualStartTimeNs;
+};
+
+}  // namespace aidl::android::hardware::audio::core
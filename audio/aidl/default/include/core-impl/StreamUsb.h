@@ -30,6 +30,10 @@ extern "C" {
 
 namespace aidl::android::hardware::audio::core {
 
+namespace usb {
+class UsbPcmConverter;
+}  // namespace usb
+
 class DriverUsb : public DriverInterface {
   public:
     DriverUsb(const StreamContext& context, bool isInput);
@@ -45,18 +49,30 @@ class DriverUsb : public DriverInterface {
     ::android::status_t standby() override;
 
   private:
+    struct AlsaDevice {
+        std::shared_ptr<alsa_device_proxy> proxy;
+        // Null when the device supports the configuration of the stream.
+        std::shared_ptr<usb::UsbPcmConverter> converter;
+        size_t frameSizeBytes;
+    };
+
     ::android::status_t exitStandby();
+    std::vector<AlsaDevice> getAlsaDevices();
 
     std::mutex mLock;
 
     const size_t mFrameSizeBytes;
     std::optional<struct pcm_config> mConfig;
+    // The channel positions of the stream, 0 for an index mask.
+    uint32_t mChannelPositionMask = 0;
     const bool mIsInput;
     // Cached device addresses for connected devices.
     std::vector<::aidl::android::media::audio::common::AudioDeviceAddress> mConnectedDevices
             GUARDED_BY(mLock);
-    std::vector<std::shared_ptr<alsa_device_proxy>> mAlsaDeviceProxies GUARDED_BY(mLock);
+    std::vector<AlsaDevice> mAlsaDevices GUARDED_BY(mLock);
     bool mIsStandby = true;
+    // The device side buffer of the conversions, only used by the worker thread.
+    std::vector<uint8_t> mConversionBuffer;
 };
 
 class StreamInUsb final : public StreamIn {
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace aidl::android::hardware::audio::effect {
+
+/**
+ * Float DSP building blocks shared by the software effects.
+ *
+ * All blocks process interleaved float buffers, in place or out of place. Channels are processed
+ * in groups of kDspLanes with the compiler vector extensions, which map to NEON or SSE registers
+ * without any platform specific code. When the channel count is not a multiple of kDspLanes, the
+ * lanes past the last channel in the last group are left unused.
+ *
+ * None of the blocks allocate or lock in process(), configure() must be called before processing
+ * and whenever the channel count changes.
+ */
+
+constexpr size_t kDspLanes = 4;
+typedef float DspFloatVec __attribute__((vector_size(kDspLanes * sizeof(float))));
+typedef int32_t DspIntVec __attribute__((vector_size(kDspLanes * sizeof(int32_t))));
+
+inline float dbToLinear(float db) {
+    return std::pow(10.f, db / 20.f);
+}
+
+/**
+ * Hands parameter updates over from the binder threads to the EffectWorker thread. Setters
+ * change the parameters with the context mutex held and call markChanged(), process() calls
+ * applyIfChanged() at the start of each buffer to rebuild its processing state.
+ *
+ * The worker thread never blocks on a parameter update: if a setter holds the mutex, the update
+ * is picked up in the next buffer instead.
+ *
+ * The processing state rebuilt in applyIfChanged() (filters, gains, channel count...) is only
+ * accessed in the EffectWorker thread once the context is created, so it is not guarded by the
+ * mutex.
+ */
+class DspParamsUpdate {
+  public:
+    // Must be called with the mutex passed to applyIfChanged() held.
+    void markChanged() { mChanged.store(true, std::memory_order_relaxed); }
+
+    // Calls update() with the mutex held if the parameters changed since the last update.
+    template <typename F>
+    void applyIfChanged(std::mutex& mutex, F&& update) {
+        if (!mChanged.load(std::memory_order_relaxed) || !mutex.try_lock()) {
+            return;
+        }
+        std::lock_guard lg(mutex, std::adopt_lock);
+        if (mChanged.exchange(false, std::memory_order_relaxed)) {
+            update();
+        }
+    }
+
+  private:
+    std::atomic<bool> mChanged = false;
+};
+
+/**
+ * The DSP blocks only process whole frames. Copies the trailing partial frame of 'samples'
+ * interleaved samples, if any, so that it is passed through when processing out of place.
+ */
+inline void copyPartialFrame(const float* in, float* out, size_t samples, size_t channelCount) {
+    size_t processed = channelCount ? samples / channelCount * channelCount : 0;
+    if (in != out) {
+        std::copy(in + processed, in + samples, out + processed);
+    }
+}
+
+/**
+ * Coefficients of a second order section, normalized so that a0 is 1. The designs follow the
+ * RBJ audio EQ cookbook, frequencies are in Hz and gains in dB.
+ */
+struct BiquadCoefficients {
+    float b0 = 1.f;
+    float b1 = 0.f;
+    float b2 = 0.f;
+    float a1 = 0.f;
+    float a2 = 0.f;
+
+    static BiquadCoefficients lowPass(float sampleRate, float freqHz, float q);
+    static BiquadCoefficients highPass(float sampleRate, float freqHz, float q);
+    static BiquadCoefficients allPass(float sampleRate, float freqHz, float q);
+    static BiquadCoefficients peaking(float sampleRate, float freqHz, float q, float gainDb);
+    static BiquadCoefficients lowShelf(float sampleRate, float freqHz, float q, float gainDb);
+    static BiquadCoefficients highShelf(float sampleRate, float freqHz, float q, float gainDb);
+};
+
+/**
+ * A cascade of biquad sections (transposed direct form II) applied to every channel. Each
+ * channel could have its own coefficients, a new section is a pass-through until its
+ * coefficients are set.
+ */
+class BiquadFilter {
+  public:
+    void configure(size_t channelCount, size_t stageCount);
+    void setCoefficients(size_t stage, const BiquadCoefficients& coefs);
+    void setCoefficients(size_t stage, size_t channel, const BiquadCoefficients& coefs);
+    // Clear the filter history without touching the coefficients.
+    void reset();
+    void process(const float* in, float* out, size_t frameCount);
+
+    size_t getChannelCount() const { return mChannelCount; }
+    size_t getStageCount() const { return mStageCount; }
+
+  private:
+    struct Section {
+        DspFloatVec b0, b1, b2, a1, a2;
+    };
+    struct State {
+        DspFloatVec s1, s2;
+    };
+
+    size_t mChannelCount = 0;
+    size_t mStageCount = 0;
+    // Indexed by group * mStageCount + stage.
+    std::vector<Section> mSections;
+    std::vector<State> mStates;
+
+    template <size_t kWidth>
+    void processGroup(size_t group, const float* in, float* out, size_t frameCount);
+};
+
+/**
+ * Splits a signal into bands with Linkwitz-Riley 4th order crossovers. The lower bands are
+ * delayed through all-pass sections matching the phase of the higher crossovers, so summing all
+ * the bands gives back the input with an all-pass phase response and a flat magnitude.
+ */
+class CrossoverFilter {
+  public:
+    void configure(size_t channelCount, size_t bandCount);
+    // Set the frequency between band 'index' and band 'index + 1' for one channel.
+    void setCrossoverFrequency(size_t channel, size_t index, float sampleRate, float freqHz);
+    void reset();
+    // 'bands' has getBandCount() buffers, each holding frameCount interleaved frames.
+    void process(const float* in, float* const* bands, size_t frameCount);
+
+    size_t getBandCount() const { return mBandCount; }
+
+  private:
+    size_t mChannelCount = 0;
+    size_t mBandCount = 0;
+    std::vector<BiquadFilter> mLowPass;
+    std::vector<BiquadFilter> mHighPass;
+    // mAllPass[band] holds one section for every crossover above band + 1.
+    std::vector<BiquadFilter> mAllPass;
+};
+
+struct CompressorParams {
+    float attackMs = 1.f;
+    float releaseMs = 60.f;
+    // A ratio of 1 disables compression, a very large ratio makes a limiter.
+    float ratio = 1.f;
+    float thresholdDb = 0.f;
+    float kneeWidthDb = 0.f;
+    // Signals below the noise gate threshold are attenuated with expanderRatio, 1 disables it.
+    float noiseGateThresholdDb = -INFINITY;
+    float expanderRatio = 1.f;
+    float preGainDb = 0.f;
+    float postGainDb = 0.f;
+};
+
+/**
+ * A feed-forward compressor with a peak envelope follower per channel.
+ *
+ * The gain computer runs once every kGainBlockFrames frames on the envelope at the end of the
+ * block, and the gain is ramped linearly across the block. This keeps the log/exp math out of
+ * the per-sample loop and lets the gain react to a transient before it is output.
+ *
+ * Channels in the same link group (>= 0) share the largest gain reduction of the group, so a
+ * limiter does not shift the stereo image.
+ */
+class Compressor {
+  public:
+    static constexpr size_t kGainBlockFrames = 16;
+
+    void configure(size_t channelCount, float sampleRate);
+    void setParams(const CompressorParams& params);
+    void setParams(size_t channel, const CompressorParams& params);
+    void setLinkGroup(size_t channel, int linkGroup);
+    void reset();
+    void process(const float* in, float* out, size_t frameCount);
+
+  private:
+    struct ChannelParams {
+        float ratio = 1.f;
+        float thresholdDb = 0.f;
+        float kneeWidthDb = 0.f;
+        float noiseGateThresholdDb = -INFINITY;
+        float expanderRatio = 1.f;
+        float postGainDb = 0.f;
+        int linkGroup = -1;
+    };
+
+    size_t mChannelCount = 0;
+    size_t mGroupCount = 0;
+    float mSampleRate = 48000.f;
+    std::vector<ChannelParams> mParams;
+    // Per lane, indexed by group.
+    std::vector<DspFloatVec> mAttack;
+    std::vector<DspFloatVec> mRelease;
+    std::vector<DspFloatVec> mPreGain;
+    std::vector<DspFloatVec> mEnvelope;
+    std::vector<DspFloatVec> mGain;
+    std::vector<DspFloatVec> mTargetGain;
+    // The first channel of the link group of each channel, the channel itself when not linked.
+    std::vector<size_t> mLinkLeader;
+    // Gain reduction of each channel, scratch buffer of computeTargetGains().
+    std::vector<float> mGainDb;
+
+    float computeGainDb(const ChannelParams& params, float envelope) const;
+    void updateLinkLeaders();
+    void computeTargetGains();
+    template <size_t kWidth>
+    void detectGroup(size_t group, const float* in, size_t frameCount);
+    template <size_t kWidth>
+    void applyGroup(size_t group, const float* in, float* out, size_t frameCount);
+};
+
+/**
+ * Applies a per-channel gain, new gains are reached with a linear ramp to avoid zipper noise.
+ */
+class GainRamp {
+  public:
+    void configure(size_t channelCount, size_t rampFrames);
+    // Set the target gain of every channel, or of one channel.
+    void setTarget(float gain);
+    void setTarget(size_t channel, float gain);
+    // Jump to the target gains without ramping.
+    void reset();
+    void process(const float* in, float* out, size_t frameCount);
+
+    bool isRamping() const { return mRemainingFrames > 0; }
+
+  private:
+    size_t mChannelCount = 0;
+    size_t mRampFrames = 0;
+    size_t mRemainingFrames = 0;
+    std::vector<DspFloatVec> mGain;
+    std::vector<DspFloatVec> mTarget;
+    std::vector<DspFloatVec> mStep;
+
+    void startRamp();
+    template <size_t kWidth>
+    void processGroup(size_t group, const float* in, float* out, size_t frameCount,
+                      size_t rampFrames);
+};
+
+}  // namespace aidl::android::hardware::audio::effect
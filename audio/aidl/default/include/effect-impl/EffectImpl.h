@@ -30,6 +30,12 @@
 
 extern "C" binder_exception_t destroyEffect(
         const std::shared_ptr<aidl::android::hardware::audio::effect::IEffect>& instanceSp);
+extern "C" binder_exception_t setEffectChainDownstream(
+        const std::shared_ptr<aidl::android::hardware::audio::effect::IEffect>& instanceSp,
+        EffectChainProcess downstream);
+extern "C" binder_exception_t setEffectChained(
+        const std::shared_ptr<aidl::android::hardware::audio::effect::IEffect>& instanceSp,
+        bool chained, EffectChainProcess* process);
 
 namespace aidl::android::hardware::audio::effect {
 
@@ -73,6 +73,26 @@ class EffectThread {
      */
     virtual void process_l() REQUIRES(mThreadMutex);
 
+    /**
+     * Chained execution, used by the effect factory to run the effects of one session back to
+     * back in a single worker thread and work buffer.
+     *
+     * The head of a chain keeps serving its FMQs, and runs downstream on the work buffer after its
+     * own processing and before writing the output and status FMQs. The other effects of the chain
+     * are set as chained, their worker thread stops touching the FMQs and they are only processed
+     * through processChained() from the worker thread of the head.
+     *
+     * Lock order: the head runs downstream from process_l() with its mThreadMutex held, and
+     * processChained() takes the mThreadMutex of each downstream effect in chain order. The effect
+     * factory never puts an effect in more than one chain, so the order has no cycle. The head
+     * must not call into a downstream effect otherwise, and setChainDownstream() must not be
+     * called from downstream.
+     */
+    RetCode setChainDownstream(EffectChainProcess downstream);
+    RetCode setChained(bool chained);
+    // Process the buffer in place, a chained effect not started is bypassed.
+    IEffect::Status processChained(float* buffer, int samples);
+
   private:
     static constexpr int kMaxTaskNameLen = 15;
 
@@ -81,6 +101,8 @@ class EffectThread {
     bool mStop GUARDED_BY(mThreadMutex) = true;
     bool mExit GUARDED_BY(mThreadMutex) = false;
     std::shared_ptr<EffectContext> mThreadContext GUARDED_BY(mThreadMutex);
+    bool mChained GUARDED_BY(mThreadMutex) = false;
+    EffectChainProcess mChainDownstream GUARDED_BY(mThreadMutex);
 
     struct EventFlagDeleter {
         void operator()(::android::hardware::EventFlag* flag) const {
@@ -15,6 +15,7 @@
  */
 
 #pragma once
+#include <functional>
 #include <string>
 
 #include <aidl/android/hardware/audio/effect/BnEffect.h>
@@ -31,10 +32,24 @@ typedef binder_exception_t (*EffectQueryFunctor)(
         const ::aidl::android::media::audio::common::AudioUuid*,
         ::aidl::android::hardware::audio::effect::Descriptor*);
 
+// Process a buffer in place with the effects after the head of an effect chain.
+typedef std::function<::aidl::android::hardware::audio::effect::IEffect::Status(float* buffer,
+                                                                              int samples)>
+        EffectChainProcess;
+typedef binder_exception_t (*EffectSetChainDownstreamFunctor)(
+        const std::shared_ptr<::aidl::android::hardware::audio::effect::IEffect>&,
+        EffectChainProcess);
+typedef binder_exception_t (*EffectSetChainedFunctor)(
+        const std::shared_ptr<::aidl::android::hardware::audio::effect::IEffect>&, bool,
+        EffectChainProcess*);
+
 struct effect_dl_interface_s {
     EffectCreateFunctor createEffectFunc;
     EffectDestroyFunctor destroyEffectFunc;
     EffectQueryFunctor queryEffectFunc;
+    // Optional, only needed for the effect to be part of an effect chain.
+    EffectSetChainDownstreamFunctor setChainDownstreamFunc;
+    EffectSetChainedFunctor setChainedFunc;
 };
 
 namespace aidl::android::hardware::audio::effect {
@@ -79,6 +79,36 @@ class Factory : public BnFactory {
             const std::shared_ptr<::aidl::android::hardware::audio::effect::IEffect>& in_handle)
             override;
 
+    /**
+     * @brief Run effect instances of the same session back to back, in the worker thread and on
+     * the work buffer of the first one. This is not part of IFactory and is only available to
+     * callers in the effect service process.
+     *
+     * The service never chains effects on its own: once chained, the other effects stop serving
+     * their FMQs, which only a client that knows about the chain can handle. The framework feeds
+     * every effect it opens, so until IFactory can express a chain this is only used by the
+     * tests and benchmarks of the example implementation.
+     *
+     * Only the endpoints of the chain touch FMQs: the client writes the input to and reads the
+     * output and status from the FMQs of the first effect, which must be started for the chain
+     * to run. Each effect is still controlled with its own IEffect interface, the other effects
+     * are bypassed when not started. All the effects must be opened with the same input and
+     * output configuration.
+     *
+     * @param in_effects Effect instances created by this factory, in processing order.
+     * @return ndk::ScopedAStatus
+     */
+    ndk::ScopedAStatus createEffectChain(const std::vector<std::shared_ptr<IEffect>>& in_effects);
+
+    /**
+     * @brief Return the effects of a chain to per-instance execution. Destroying any effect of a
+     * chain destroys the chain first.
+     *
+     * @param in_head First effect instance of the chain.
+     * @return ndk::ScopedAStatus
+     */
+    ndk::ScopedAStatus destroyEffectChain(const std::shared_ptr<IEffect>& in_head);
+
   private:
     const EffectConfig mConfig;
     ~Factory();
@@ -99,7 +129,14 @@ class Factory : public BnFactory {
     typedef std::pair<aidl::android::media::audio::common::AudioUuid, ndk::SpAIBinder> EffectEntry;
     std::map<std::weak_ptr<IEffect>, EffectEntry, std::owner_less<>> mEffectMap;
 
+    // Effect chains, the first effect of a chain to the other effects in processing order.
+    std::map<std::weak_ptr<IEffect>, std::vector<std::shared_ptr<IEffect>>, std::owner_less<>>
+            mEffectChainMap;
+
     ndk::ScopedAStatus destroyEffectImpl(const std::shared_ptr<IEffect>& in_handle);
+    struct effect_dl_interface_s* getDlInterface(const std::shared_ptr<IEffect>& effect);
+    // Returns the first effect of the chain the effect is part of, or nullptr.
+    std::shared_ptr<IEffect> findChainHead(const std::shared_ptr<IEffect>& effect);
     void cleanupEffectMap();
     bool openEffectLibrary(const ::aidl::android::media::audio::common::AudioUuid& impl,
                            const std::string& path);
@@ -160,12 +160,55 @@ RetCode LoudnessEnhancerSw::releaseContext() {
 
 // Processing method running in EffectWorker thread.
 IEffect::Status LoudnessEnhancerSw::effectProcessImpl(float* in, float* out, int samples) {
-    // TODO: get data buffer and process.
-    LOG(DEBUG) << __func__ << " in " << in << " out " << out << " samples " << samples;
-    for (int i = 0; i < samples; i++) {
-        *out++ = *in++;
-    }
+    RETURN_VALUE_IF(!mContext, (IEffect::Status{EX_NULL_POINTER, 0, 0}), "nullContext");
+    return mContext->process(in, out, samples);
+}
+
+RetCode LoudnessEnhancerSwContext::setCommon(const Parameter::Common& common) {
+    std::lock_guard lg(mMutex);
+    mParamsUpdate.markChanged();
+    return EffectContext::setCommon(common);
+}
+
+RetCode LoudnessEnhancerSwContext::setLeGainMb(int gainMb) {
+    std::lock_guard lg(mMutex);
+    mGainMb = gainMb;
+    mParamsUpdate.markChanged();
+    return RetCode::SUCCESS;
+}
+
+IEffect::Status LoudnessEnhancerSwContext::process(float* in, float* out, int samples) {
+    mParamsUpdate.applyIfChanged(mMutex,
+                                 [this]() NO_THREAD_SAFETY_ANALYSIS { updateProcessing_l(); });
+
+    size_t frameCount = mChannelCount ? samples / mChannelCount : 0;
+    mGain.process(in, out, frameCount);
+    mLimiter.process(out, out, frameCount);
+    copyPartialFrame(in, out, samples, mChannelCount);
     return {STATUS_OK, samples, samples};
 }
 
+void LoudnessEnhancerSwContext::updateProcessing_l() {
+    size_t channelCount = ::aidl::android::hardware::audio::common::getChannelCount(
+            mCommon.input.base.channelMask);
+    float sampleRate = mCommon.input.base.sampleRate;
+    if (channelCount != mChannelCount || sampleRate != mSampleRate) {
+        mGain.configure(channelCount, static_cast<size_t>(sampleRate * kGainRampMs / 1000.f));
+        mLimiter.configure(channelCount, sampleRate);
+        CompressorParams limiterParams;
+        limiterParams.attackMs = kLimiterAttackMs;
+        limiterParams.releaseMs = kLimiterReleaseMs;
+        limiterParams.ratio = kLimiterRatio;
+        limiterParams.thresholdDb = kLimiterThresholdDb;
+        mLimiter.setParams(limiterParams);
+        // Limit all the channels together to keep the balance between them.
+        for (size_t channel = 0; channel < channelCount; channel++) {
+            mLimiter.setLinkGroup(channel, 0);
+        }
+        mChannelCount = channelCount;
+        mSampleRate = sampleRate;
+    }
+    mGain.setTarget(dbToLinear(mGainMb / 100.f));
+}
+
 }  // namespace aidl::android::hardware::audio::effect
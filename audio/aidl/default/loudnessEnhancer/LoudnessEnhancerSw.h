@@ -17,10 +17,13 @@
 #pragma once
 
 #include <aidl/android/hardware/audio/effect/BnEffect.h>
+#include <android-base/thread_annotations.h>
 #include <fmq/AidlMessageQueue.h>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 
+#include "effect-impl/EffectDsp.h"
 #include "effect-impl/EffectImpl.h"
 
 namespace aidl::android::hardware::audio::effect {
@@ -30,17 +33,38 @@ class LoudnessEnhancerSwContext final : public EffectContext {
     LoudnessEnhancerSwContext(int statusDepth, const Parameter::Common& common)
         : EffectContext(statusDepth, common) {
         LOG(DEBUG) << __func__;
+        std::lock_guard lg(mMutex);
+        updateProcessing_l();
     }
 
-    RetCode setLeGainMb(int gainMb) {
-        // TODO : Add implementation to apply new gain
-        mGainMb = gainMb;
-        return RetCode::SUCCESS;
+    RetCode setCommon(const Parameter::Common& common) override;
+    RetCode setLeGainMb(int gainMb);
+    int getLeGainMb() {
+        std::lock_guard lg(mMutex);
+        return mGainMb;
     }
-    int getLeGainMb() const { return mGainMb; }
+
+    // Apply the gain and the limiter on interleaved samples, called in the EffectWorker thread.
+    IEffect::Status process(float* in, float* out, int samples);
 
   private:
-    int mGainMb = 0;  // Default Gain
+    // The limiter keeps the boosted signal just below full scale.
+    static constexpr float kLimiterThresholdDb = -1.f;
+    static constexpr float kLimiterRatio = 1000.f;
+    static constexpr float kLimiterAttackMs = 1.f;
+    static constexpr float kLimiterReleaseMs = 100.f;
+    static constexpr float kGainRampMs = 10.f;
+
+    std::mutex mMutex;
+    int mGainMb GUARDED_BY(mMutex) = 0;  // Default Gain
+    DspParamsUpdate mParamsUpdate;
+
+    size_t mChannelCount = 0;
+    float mSampleRate = 0;
+    GainRamp mGain;
+    Compressor mLimiter;
+
+    void updateProcessing_l() REQUIRES(mMutex);
 };
 
 class LoudnessEnhancerSw final : public EffectImpl {
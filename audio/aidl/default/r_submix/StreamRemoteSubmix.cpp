@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+#define LOG_TAG "AHAL_StreamRemoteSubmix"
+#include <android-base/logging.h>
+#include <audio_utils/clock.h>
+
+#include "SubmixRoute.h"
+#include "core-impl/StreamRemoteSubmix.h"
+
+using aidl::android::hardware::audio::common::SinkMetadata;
+using aidl::android::hardware::audio::common::SourceMetadata;
+using aidl::android::hardware::audio::core::r_submix::SubmixRoute;
+using aidl::android::media::audio::common::AudioDevice;
+using aidl::android::media::audio::common::AudioDeviceAddress;
+using aidl::android::media::audio::common::AudioOffloadInfo;
+using aidl::android::media::audio::common::MicrophoneInfo;
+
+namespace aidl::android::hardware::audio::core {
+
+DriverRemoteSubmix::DriverRemoteSubmix(const StreamContext& context, bool isInput)
+    : mFrameSizeBytes(context.getFrameSize()),
+      mSampleRate(context.getSampleRate()),
+      mIsInput(isInput),
+      mTiming(context.getTimingMode(), context.getSampleRate()) {}
+
+DriverRemoteSubmix::~DriverRemoteSubmix() {
+    std::lock_guard guard(mLock);
+    releaseRouteLocked();
+}
+
+::android::status_t DriverRemoteSubmix::init() {
+    return mFrameSizeBytes > 0 && mSampleRate > 0 ? ::android::OK : ::android::NO_INIT;
+}
+
+::android::status_t DriverRemoteSubmix::setConnectedDevices(
+        const std::vector<AudioDevice>& connectedDevices) {
+    if (connectedDevices.size() > 1) {
+        LOG(ERROR) << __func__ << ": wrong device size(" << connectedDevices.size()
+                   << "), a remote submix stream uses a single route";
+        return ::android::BAD_VALUE;
+    }
+    std::lock_guard guard(mLock);
+    if (connectedDevices.empty()) {
+        releaseRouteLocked();
+        return ::android::OK;
+    }
+    const AudioDeviceAddress& address = connectedDevices[0].address;
+    if (mRoute && address == mRoute->getAddress()) {
+        return ::android::OK;
+    }
+    auto route = SubmixRoute::findOrCreate(address, mFrameSizeBytes, mSampleRate);
+    if (!route) {
+        return ::android::BAD_VALUE;
+    }
+    // A second stream on the same end of a route would race on the pipe, reject it.
+    if (!(mIsInput ? route->openInput() : route->openOutput())) {
+        LOG(ERROR) << __func__ << ": the " << (mIsInput ? "input" : "output") << " of route "
+                   << address.toString() << " is already open";
+        return ::android::INVALID_OPERATION;
+    }
+    releaseRouteLocked();
+    if (mIsInput) {
+        route->getPipe().flush();
+    }
+    mRoute = std::move(route);
+    LOG(DEBUG) << __func__ << ": " << (mIsInput ? "input" : "output") << " connected to "
+               << mRoute->toString();
+    return ::android::OK;
+}
+
+::android::status_t DriverRemoteSubmix::drain(StreamDescriptor::DrainMode) {
+    // Wait for the input end to consume what has been written, if anything consumes it.
+    int32_t pipeLatencyMs = 0;
+    {
+        std::lock_guard guard(mLock);
+        if (!mIsInput && mRoute && mRoute->hasInput()) {
+            pipeLatencyMs = getPipeLatencyMsLocked();
+        }
+    }
+    if (pipeLatencyMs > 0 && !mTiming.isVirtual()) {
+        usleep(pipeLatencyMs * MICROS_PER_MILLISECOND);
+    }
+    return ::android::OK;
+}
+
+::android::status_t DriverRemoteSubmix::flush() {
+    mTiming.restart();
+    return ::android::OK;
+}
+
+::android::status_t DriverRemoteSubmix::pause() {
+    mTiming.restart();
+    return ::android::OK;
+}
+
+::android::status_t DriverRemoteSubmix::transfer(void* buffer, size_t frameCount,
+                                                 size_t* actualFrameCount, int32_t* latencyMs) {
+    if (mIsStandby) {
+        // Do not capture what has been played while the input was not reading.
+        if (mIsInput) {
+            std::lock_guard guard(mLock);
+            if (mRoute) {
+                mRoute->getPipe().flush();
+            }
+        }
+        mIsStandby = false;
+        mTiming.restart();
+    }
+    // Both ends are paced in real time, the pipe only absorbs the scheduling jitter.
+    mTiming.advance(frameCount);
+    if (mIsInput) {
+        mTiming.wait();
+        std::lock_guard guard(mLock);
+        const size_t readFrames = mRoute ? mRoute->getPipe().read(buffer, frameCount) : 0;
+        if (readFrames < frameCount) {
+            memset(static_cast<uint8_t*>(buffer) + readFrames * mFrameSizeBytes, 0,
+                   (frameCount - readFrames) * mFrameSizeBytes);
+            // Only an output falling behind is an underrun, there is nothing to capture otherwise.
+            if (mRoute && mRoute->hasOutput()) {
+                mRoute->addUnderrunFrames(frameCount - readFrames);
+            }
+        }
+        *latencyMs = getPipeLatencyMsLocked();
+    } else {
+        {
+            std::lock_guard guard(mLock);
+            // Without a route, or when the pipe is full, the frames are dropped as a real device
+            // would play them without anyone listening.
+            const size_t writtenFrames =
+                    mRoute ? mRoute->getPipe().write(buffer, frameCount) : frameCount;
+            if (writtenFrames < frameCount && mRoute->hasInput()) {
+                mRoute->addOverrunFrames(frameCount - writtenFrames);
+            }
+            *latencyMs = getPipeLatencyMsLocked();
+        }
+        mTiming.wait();
+    }
+    *actualFrameCount = frameCount;
+    return ::android::OK;
+}
+
+::android::status_t DriverRemoteSubmix::standby() {
+    mIsStandby = true;
+    mTiming.restart();
+    return ::android::OK;
+}
+
+::android::status_t DriverRemoteSubmix::refinePosition(StreamDescriptor::Position* position) {
+    // The frames still in the pipe have not been observed by the input end yet. Without an
+    // input nothing observes them, the output then reports the frames written like a device
+    // playing to nobody.
+    std::lock_guard guard(mLock);
+    if (!mIsInput && mRoute && mRoute->hasInput()) {
+        position->frames =
+                std::max<int64_t>(0, position->frames - mRoute->getPipe().availableToRead());
+    }
+    return ::android::OK;
+}
+
+void DriverRemoteSubmix::releaseRouteLocked() {
+    if (!mRoute) {
+        return;
+    }
+    LOG(DEBUG) << __func__ << ": " << (mIsInput ? "input" : "output") << " disconnected from "
+               << mRoute->toString();
+    if (mIsInput) {
+        mRoute->closeInput();
+    } else {
+        mRoute->closeOutput();
+    }
+    mRoute.reset();
+}
+
+int32_t DriverRemoteSubmix::getPipeLatencyMsLocked() const {
+    if (!mRoute) {
+        return 0;
+    }
+    return static_cast<int32_t>(mRoute->getPipe().availableToRead() * MILLIS_PER_SECOND /
+                                mSampleRate);
+}
+
+// static
+ndk::ScopedAStatus StreamInRemoteSubmix::createInstance(
+        const SinkMetadata& sinkMetadata, StreamContext&& context,
+        const std::vector<MicrophoneInfo>& microphones, std::shared_ptr<StreamIn>* result) {
+    std::shared_ptr<StreamIn> stream = ndk::SharedRefBase::make<StreamInRemoteSubmix>(
+            sinkMetadata, std::move(context), microphones);
+    if (auto status = initInstance(stream); !status.isOk()) {
+        return status;
+    }
+    *result = std::move(stream);
+    return ndk::ScopedAStatus::ok();
+}
+
+StreamInRemoteSubmix::StreamInRemoteSubmix(const SinkMetadata& sinkMetadata,
+                                           StreamContext&& context,
+                                           const std::vector<MicrophoneInfo>& microphones)
+    : StreamIn(
+              sinkMetadata, std::move(context),
+              [](const StreamContext& ctx) -> DriverInterface* {
+                  return new DriverRemoteSubmix(ctx, true /*isInput*/);
+              },
+              [](const StreamContext& ctx, DriverInterface* driver) -> StreamWorkerInterface* {
+                  // The default worker implementation is used.
+                  return new StreamInWorker(ctx, driver);
+              },
+              microphones) {}
+
+// static
+ndk::ScopedAStatus StreamOutRemoteSubmix::createInstance(
+        const SourceMetadata& sourceMetadata, StreamContext&& context,
+        const std::optional<AudioOffloadInfo>& offloadInfo, std::shared_ptr<StreamOut>* result) {
+    std::shared_ptr<StreamOut> stream = ndk::SharedRefBase::make<StreamOutRemoteSubmix>(
+            sourceMetadata, std::move(context), offloadInfo);
+    if (auto status = initInstance(stream); !status.isOk()) {
+        return status;
+    }
+    *result = std::move(stream);
+    return ndk::ScopedAStatus::ok();
+}
+
+StreamOutRemoteSubmix::StreamOutRemoteSubmix(const SourceMetadata& sourceMetadata,
+                                             StreamContext&& context,
+                                             const std::optional<AudioOffloadInfo>& offloadInfo)
+    : StreamOut(
+              sourceMetadata, std::move(context),
+              [](const StreamContext& ctx) -> DriverInterface* {
+                  return new DriverRemoteSubmix(ctx, false /*isInput*/);
+              },
+              [](const StreamContext& ctx, DriverInterface* driver) -> StreamWorkerInterface* {
+                  // The default worker implementation is used.
+                  return new StreamOutWorker(ctx, driver);
+              },
+              offloadInfo) {}
+
+}  // namespace aidl::android::hardware::audio::core
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "SubmixPipe.h"
+
+namespace aidl::android::hardware::audio::core::r_submix {
+
+namespace {
+
+size_t roundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}  // namespace
+
+SubmixPipe::SubmixPipe(size_t frameSize, size_t capacityFrames)
+    : mFrameSize(frameSize),
+      mCapacityFrames(roundUpToPowerOfTwo(capacityFrames)),
+      mBuffer(new uint8_t[mCapacityFrames * mFrameSize]) {}
+
+size_t SubmixPipe::write(const void* buffer, size_t frameCount) {
+    // The reader position is only read to know the free space, the frames past it may still be
+    // being copied out until the reader publishes a new position.
+    const uint64_t readPosition = mReadPosition.load(std::memory_order_acquire);
+    const uint64_t writePosition = mWritePosition.load(std::memory_order_relaxed);
+    const size_t available = mCapacityFrames - static_cast<size_t>(writePosition - readPosition);
+    const size_t frames = std::min(frameCount, available);
+    const size_t offset = static_cast<size_t>(writePosition & (mCapacityFrames - 1));
+    const size_t firstPart = std::min(frames, mCapacityFrames - offset);
+    const uint8_t* src = static_cast<const uint8_t*>(buffer);
+    memcpy(&mBuffer[offset * mFrameSize], src, firstPart * mFrameSize);
+    memcpy(&mBuffer[0], src + firstPart * mFrameSize, (frames - firstPart) * mFrameSize);
+    mWritePosition.store(writePosition + frames, std::memory_order_release);
+    return frames;
+}
+
+size_t SubmixPipe::read(void* buffer, size_t frameCount) {
+    const uint64_t writePosition = mWritePosition.load(std::memory_order_acquire);
+    const uint64_t readPosition = mReadPosition.load(std::memory_order_relaxed);
+    const size_t frames =
+            std::min(frameCount, static_cast<size_t>(writePosition - readPosition));
+    const size_t offset = static_cast<size_t>(readPosition & (mCapacityFrames - 1));
+    const size_t firstPart = std::min(frames, mCapacityFrames - offset);
+    uint8_t* dst = static_cast<uint8_t*>(buffer);
+    memcpy(dst, &mBuffer[offset * mFrameSize], firstPart * mFrameSize);
+    memcpy(dst + firstPart * mFrameSize, &mBuffer[0], (frames - firstPart) * mFrameSize);
+    mReadPosition.store(readPosition + frames, std::memory_order_release);
+    return frames;
+}
+
+size_t SubmixPipe::flush() {
+    const uint64_t writePosition = mWritePosition.load(std::memory_order_acquire);
+    const uint64_t readPosition = mReadPosition.load(std::memory_order_relaxed);
+    mReadPosition.store(writePosition, std::memory_order_release);
+    return static_cast<size_t>(writePosition - readPosition);
+}
+
+size_t SubmixPipe::availableToRead() const {
+    // Load the reader position first so the difference is never negative. Both ends may move in
+    // between when called from a third thread, hence the clamping.
+    const uint64_t readPosition = mReadPosition.load(std::memory_order_acquire);
+    const uint64_t writePosition = mWritePosition.load(std::memory_order_acquire);
+    return std::min(static_cast<size_t>(writePosition - readPosition), mCapacityFrames);
+}
+
+}  // namespace aidl::android::hardware::audio::core::r_submix
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace aidl::android::hardware::audio::core::r_submix {
+
+// A single producer, single consumer pipe of audio frames, which is wait-free on both ends.
+//
+// Only one thread may call write() and only one thread may call read() and flush() at a time.
+// The positions are monotonic frame counters, so the fill level is the difference between them
+// and they double as the observable positions of both ends.
+class SubmixPipe {
+  public:
+    // The capacity is rounded up to a power of two.
+    SubmixPipe(size_t frameSize, size_t capacityFrames);
+
+    // Writer end. Returns the number of frames written, which is less than frameCount when the
+    // pipe is full (overrun). The frames which do not fit are not written.
+    size_t write(const void* buffer, size_t frameCount);
+    // Reader end. Returns the number of frames read, which is less than frameCount when the
+    // pipe does not hold enough frames (underrun).
+    size_t read(void* buffer, size_t frameCount);
+    // Reader end. Drop all the frames in the pipe, returns the number of frames dropped.
+    size_t flush();
+
+    size_t availableToRead() const;
+    size_t availableToWrite() const { return mCapacityFrames - availableToRead(); }
+    size_t getFrameSize() const { return mFrameSize; }
+    size_t getCapacityFrames() const { return mCapacityFrames; }
+    uint64_t getWritePosition() const { return mWritePosition.load(std::memory_order_acquire); }
+    uint64_t getReadPosition() const { return mReadPosition.load(std::memory_order_acquire); }
+
+  private:
+    // Keep the positions on their own cache lines, they are written by different threads.
+    static constexpr size_t kCacheLineSize = 64;
+
+    const size_t mFrameSize;
+    const size_t mCapacityFrames;
+    std::unique_ptr<uint8_t[]> mBuffer;
+    alignas(kCacheLineSize) std::atomic<uint64_t> mWritePosition = 0;
+    alignas(kCacheLineSize) std::atomic<uint64_t> mReadPosition = 0;
+};
+
+}  // namespace aidl::android::hardware::audio::core::r_submix
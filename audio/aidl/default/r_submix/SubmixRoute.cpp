@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <map>
+#include <mutex>
+
+#define LOG_TAG "AHAL_SubmixRoute"
+#include <android-base/logging.h>
+
+#include "SubmixRoute.h"
+
+using aidl::android::media::audio::common::AudioDeviceAddress;
+
+namespace aidl::android::hardware::audio::core::r_submix {
+
+namespace {
+
+std::mutex gRoutesLock;
+std::map<AudioDeviceAddress, std::weak_ptr<SubmixRoute>> gRoutes;
+
+}  // namespace
+
+// static
+std::shared_ptr<SubmixRoute> SubmixRoute::findOrCreate(const AudioDeviceAddress& address,
+                                                       size_t frameSize, int sampleRate) {
+    std::lock_guard guard(gRoutesLock);
+    // Forget the routes no stream holds any more.
+    for (auto it = gRoutes.begin(); it != gRoutes.end();) {
+        it = it->second.expired() ? gRoutes.erase(it) : std::next(it);
+    }
+    if (auto it = gRoutes.find(address); it != gRoutes.end()) {
+        if (auto route = it->second.lock(); route) {
+            if (route->mPipe.getFrameSize() != frameSize || route->mSampleRate != sampleRate) {
+                LOG(ERROR) << __func__ << ": route " << address.toString()
+                           << " exists with frame size " << route->mPipe.getFrameSize()
+                           << " and sample rate " << route->mSampleRate;
+                return nullptr;
+            }
+            return route;
+        }
+    }
+    // The constructor is private, std::make_shared could not be used.
+    std::shared_ptr<SubmixRoute> route(new SubmixRoute(address, frameSize, sampleRate));
+    gRoutes[address] = route;
+    LOG(DEBUG) << __func__ << ": created route " << address.toString();
+    return route;
+}
+
+SubmixRoute::SubmixRoute(const AudioDeviceAddress& address, size_t frameSize, int sampleRate)
+    : mAddress(address), mSampleRate(sampleRate), mPipe(frameSize, kPipeSizeFrames) {}
+
+std::string SubmixRoute::toString() const {
+    return mAddress.toString() + ": written " + std::to_string(mPipe.getWritePosition()) +
+           ", read " + std::to_string(mPipe.getReadPosition()) + ", overrun " +
+           std::to_string(mOverrunFrames) + ", underrun " + std::to_string(mUnderrunFrames) +
+           " frames";
+}
+
+}  // namespace aidl::android::hardware::audio::core::r_submix
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <aidl/android/media/audio/common/AudioDeviceAddress.h>
+
+#include "SubmixPipe.h"
+
+namespace aidl::android::hardware::audio::core::r_submix {
+
+// Connects the output stream and the input stream of a remote submix device address.
+//
+// Routes are created by the first stream connecting to an address and are shared by the streams
+// connected to the same address. A route lives as long as a stream holds it.
+class SubmixRoute {
+  public:
+    // Same size as the legacy remote submix pipe.
+    static constexpr size_t kPipeSizeFrames = 4096;
+
+    // Returns the route for the address, or nullptr if it exists with another audio format.
+    static std::shared_ptr<SubmixRoute> findOrCreate(
+            const ::aidl::android::media::audio::common::AudioDeviceAddress& address,
+            size_t frameSize, int sampleRate);
+
+    // Each end of the route could only be opened by one stream at a time.
+    bool openOutput() { return !mOutputOpen.exchange(true); }
+    void closeOutput() { mOutputOpen = false; }
+    bool openInput() { return !mInputOpen.exchange(true); }
+    void closeInput() { mInputOpen = false; }
+    bool hasOutput() const { return mOutputOpen; }
+    bool hasInput() const { return mInputOpen; }
+
+    SubmixPipe& getPipe() { return mPipe; }
+    const ::aidl::android::media::audio::common::AudioDeviceAddress& getAddress() const {
+        return mAddress;
+    }
+
+    // Frames dropped by the output end because the pipe was full.
+    void addOverrunFrames(size_t frames) { mOverrunFrames += frames; }
+    // Frames of silence read by the input end because the pipe was empty.
+    void addUnderrunFrames(size_t frames) { mUnderrunFrames += frames; }
+    std::string toString() const;
+
+  private:
+    SubmixRoute(const ::aidl::android::media::audio::common::AudioDeviceAddress& address,
+                size_t frameSize, int sampleRate);
+
+    const ::aidl::android::media::audio::common::AudioDeviceAddress mAddress;
+    const int mSampleRate;
+    SubmixPipe mPipe;
+    std::atomic<bool> mOutputOpen = false;
+    std::atomic<bool> mInputOpen = false;
+    std::atomic<uint64_t> mOverrunFrames = 0;
+    std::atomic<uint64_t> mUnderrunFrames = 0;
+};
+
+}  // namespace aidl::android::hardware::audio::core::r_submix
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <memory>
+#include <numbers>
+#include <vector>
+
+#define LOG_TAG "EffectFactoryChainTest"
+#include <android-base/logging.h>
+#include <gtest/gtest.h>
+#include <system/audio_config.h>
+#include <system/audio_effects/effect_uuid.h>
+
+#include "EffectTestHelper.h"
+#include "effectFactory-impl/EffectFactory.h"
+
+using namespace aidl::android::hardware::audio::effect;
+using aidl::android::media::audio::common::AudioChannelLayout;
+
+namespace {
+
+constexpr int kSession = 1;
+constexpr long kFrameCount = 480;
+constexpr size_t kChannelCount = 2;
+constexpr size_t kSampleCount = kFrameCount * kChannelCount;
+
+// A different band setting per effect of a chain, so that each one changes the signal.
+const std::vector<std::vector<Equalizer::BandLevel>> kBandLevels = {
+        {{0, 6}, {1, 0}, {2, -3}, {3, 0}, {4, 2}},
+        {{0, -4}, {1, 3}, {2, 0}, {3, 5}, {4, 0}},
+        {{0, 0}, {1, -6}, {2, 4}, {3, 0}, {4, -2}},
+};
+
+// A few buffers of a stereo sine sweep with a different phase per channel.
+std::vector<float> createInput(size_t buffers) {
+    std::vector<float> input(buffers * kSampleCount);
+    for (size_t i = 0; i < input.size(); i++) {
+        const size_t frame = i / kChannelCount;
+        const double phase = 2 * std::numbers::pi * (20.0 + frame * 0.5) * frame / 48000;
+        input[i] = 0.5f * std::sin(phase + i % kChannelCount);
+    }
+    return input;
+}
+
+}  // namespace
+
+// Runs on a device with the example effect libraries installed.
+class EffectFactoryChainTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        auto configFile = android::audio_find_readable_configuration_file(kConfigName);
+        if (configFile.empty()) {
+            GTEST_SKIP() << kConfigName << " not found";
+        }
+        mFactory = ndk::SharedRefBase::make<Factory>(configFile);
+        std::vector<Descriptor> descs;
+        ASSERT_TRUE(mFactory->queryEffects(getEffectTypeUuidEqualizer(),
+                                           getEffectImplUuidEqualizerSw(), std::nullopt, &descs)
+                            .isOk());
+        if (descs.empty()) {
+            GTEST_SKIP() << "no software equalizer in " << configFile;
+        }
+    }
+
+    void TearDown() override {
+        for (const auto& effect : mEffects) {
+            effect->command(CommandId::STOP);
+            effect->close();
+            EXPECT_TRUE(mFactory->destroyEffect(effect).isOk());
+        }
+    }
+
+    // Creates and starts an effect instance, returns its FMQs in ret.
+    std::shared_ptr<IEffect> createEffect(int session, IEffect::OpenEffectReturn* ret) {
+        std::shared_ptr<IEffect> effect;
+        if (!mFactory->createEffect(getEffectImplUuidEqualizerSw(), &effect).isOk()) {
+            return nullptr;
+        }
+        mEffects.push_back(effect);
+        if (!effect->open(createParamCommon(session, AudioChannelLayout::LAYOUT_STEREO,
+                                            kFrameCount),
+                          std::nullopt, ret)
+                     .isOk() ||
+            !effect->command(CommandId::START).isOk()) {
+            return nullptr;
+        }
+        return effect;
+    }
+
+    static bool setBandLevels(const std::shared_ptr<IEffect>& effect,
+                              const std::vector<Equalizer::BandLevel>& levels) {
+        return effect
+                ->setParameter(Parameter::make<Parameter::specific>(
+                        Parameter::Specific::make<Parameter::Specific::equalizer>(
+                                Equalizer::make<Equalizer::bandLevels>(levels))))
+                .isOk();
+    }
+
+    static constexpr const char* kConfigName = "audio_effects_config.xml";
+    std::shared_ptr<Factory> mFactory;
+    std::vector<std::shared_ptr<IEffect>> mEffects;
+};
+
+TEST_F(EffectFactoryChainTest, ProcessThroughChain) {
+    constexpr size_t kBufferCount = 4;
+    const std::vector<float> input = createInput(kBufferCount);
+
+    // The reference: the same effects as separate instances, run one after another.
+    std::vector<float> expected = input;
+    {
+        std::vector<std::unique_ptr<EffectClient>> clients;
+        for (const auto& levels : kBandLevels) {
+            IEffect::OpenEffectReturn ret;
+            auto effect = createEffect(kSession, &ret);
+            ASSERT_NE(nullptr, effect);
+            ASSERT_TRUE(setBandLevels(effect, levels));
+            clients.push_back(std::make_unique<EffectClient>(ret));
+            ASSERT_TRUE(clients.back()->isValid());
+        }
+        for (size_t offset = 0; offset < expected.size(); offset += kSampleCount) {
+            for (const auto& client : clients) {
+                ASSERT_TRUE(client->process(&expected[offset], kSampleCount));
+            }
+        }
+    }
+
+    IEffect::OpenEffectReturn headRet, ret;
+    std::vector<std::shared_ptr<IEffect>> chain;
+    for (const auto& levels : kBandLevels) {
+        auto effect = createEffect(kSession, chain.empty() ? &headRet : &ret);
+        ASSERT_NE(nullptr, effect);
+        ASSERT_TRUE(setBandLevels(effect, levels));
+        chain.push_back(effect);
+    }
+    ASSERT_TRUE(mFactory->createEffectChain(chain).isOk());
+
+    // The client only talks to the head of the chain.
+    EffectClient client(headRet);
+    ASSERT_TRUE(client.isValid());
+    std::vector<float> output = input;
+    for (size_t offset = 0; offset < output.size(); offset += kSampleCount) {
+        IEffect::Status status;
+        ASSERT_TRUE(client.process(&output[offset], kSampleCount, &status));
+        EXPECT_EQ(STATUS_OK, status.status);
+        EXPECT_EQ(static_cast<int>(kSampleCount), status.fmqConsumed);
+        EXPECT_EQ(static_cast<int>(kSampleCount), status.fmqProduced);
+    }
+    ASSERT_NE(input, expected);
+    for (size_t i = 0; i < output.size(); i++) {
+        ASSERT_FLOAT_EQ(expected[i], output[i]) << "sample " << i;
+    }
+
+    ASSERT_TRUE(mFactory->destroyEffectChain(chain.front()).isOk());
+
+    // Back to per-instance execution, the last effect serves its own FMQs again.
+    EffectClient lastClient(ret);
+    ASSERT_TRUE(lastClient.isValid());
+    IEffect::Status status;
+    ASSERT_TRUE(lastClient.process(output.data(), kSampleCount, &status));
+    EXPECT_EQ(STATUS_OK, status.status);
+    EXPECT_EQ(static_cast<int>(kSampleCount), status.fmqProduced);
+}
+
+TEST_F(EffectFactoryChainTest, RejectInvalidChains) {
+    IEffect::OpenEffectReturn ret;
+    auto first = createEffect(kSession, &ret);
+    auto second = createEffect(kSession, &ret);
+    auto otherSession = createEffect(kSession + 1, &ret);
+    ASSERT_NE(nullptr, first);
+    ASSERT_NE(nullptr, second);
+    ASSERT_NE(nullptr, otherSession);
+
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT, mFactory->createEffectChain({first}).getExceptionCode());
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT,
+              mFactory->createEffectChain({first, first}).getExceptionCode());
+    EXPECT_EQ(EX_NULL_POINTER, mFactory->createEffectChain({first, nullptr}).getExceptionCode());
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT,
+              mFactory->createEffectChain({first, otherSession}).getExceptionCode());
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT, mFactory->destroyEffectChain(first).getExceptionCode());
+
+    ASSERT_TRUE(mFactory->createEffectChain({first, second}).isOk());
+    EXPECT_EQ(EX_ILLEGAL_STATE,
+              mFactory->createEffectChain({second, otherSession}).getExceptionCode());
+    // Only the head identifies a chain.
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT, mFactory->destroyEffectChain(second).getExceptionCode());
+    EXPECT_TRUE(mFactory->destroyEffectChain(first).isOk());
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT, mFactory->destroyEffectChain(first).getExceptionCode());
+}
+
+TEST_F(EffectFactoryChainTest, DestroyChainedEffect) {
+    IEffect::OpenEffectReturn headRet, ret;
+    auto head = createEffect(kSession, &headRet);
+    auto second = createEffect(kSession, &ret);
+    ASSERT_NE(nullptr, head);
+    ASSERT_NE(nullptr, second);
+    ASSERT_TRUE(mFactory->createEffectChain({head, second}).isOk());
+
+    // Destroying an effect of the chain destroys the chain first.
+    mEffects.pop_back();
+    second->command(CommandId::STOP);
+    second->close();
+    ASSERT_TRUE(mFactory->destroyEffect(second).isOk());
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT, mFactory->destroyEffectChain(head).getExceptionCode());
+
+    EffectClient client(headRet);
+    ASSERT_TRUE(client.isValid());
+    std::vector<float> buffer(kSampleCount, 0.25f);
+    IEffect::Status status;
+    ASSERT_TRUE(client.process(buffer.data(), kSampleCount, &status));
+    EXPECT_EQ(STATUS_OK, status.status);
+    EXPECT_EQ(static_cast<int>(kSampleCount), status.fmqProduced);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <fmq/EventFlag.h>
+
+#include "effect-impl/EffectContext.h"
+
+// Helpers shared by the tests and benchmarks of the example effects.
+namespace aidl::android::hardware::audio::effect {
+
+// Common parameters of a 48kHz float effect with the same input and output configuration.
+inline Parameter::Common createParamCommon(int session, int32_t layout, long frameCount) {
+    Parameter::Common common;
+    common.session = session;
+    common.ioHandle = -1;
+    ::aidl::android::media::audio::common::AudioFormatDescription format;
+    format.type = ::aidl::android::media::audio::common::AudioFormatType::PCM;
+    format.pcm = ::aidl::android::media::audio::common::PcmType::FLOAT_32_BIT;
+    for (auto config : {&common.input, &common.output}) {
+        config->base.sampleRate = 48000;
+        config->base.channelMask = ::aidl::android::media::audio::common::AudioChannelLayout::make<
+                ::aidl::android::media::audio::common::AudioChannelLayout::layoutMask>(layout);
+        config->base.format = format;
+        config->frameCount = frameCount;
+    }
+    return common;
+}
+
+// The client side of the FMQs of one effect instance.
+class EffectClient {
+  public:
+    explicit EffectClient(const IEffect::OpenEffectReturn& ret)
+        : mStatusMQ(std::make_unique<EffectContext::StatusMQ>(ret.statusMQ)),
+          mInputMQ(std::make_unique<EffectContext::DataMQ>(ret.inputDataMQ)),
+          mOutputMQ(std::make_unique<EffectContext::DataMQ>(ret.outputDataMQ)) {
+        ::android::hardware::EventFlag::createEventFlag(mStatusMQ->getEventFlagWord(), &mEfGroup);
+    }
+    ~EffectClient() { ::android::hardware::EventFlag::deleteEventFlag(&mEfGroup); }
+
+    bool isValid() const {
+        return mStatusMQ->isValid() && mInputMQ->isValid() && mOutputMQ->isValid() && mEfGroup;
+    }
+
+    // Writes samples to the effect and reads back the status and the output into the same
+    // buffer.
+    bool process(float* buffer, size_t samples, IEffect::Status* status) {
+        if (!mEfGroup || !mInputMQ->write(buffer, samples)) {
+            return false;
+        }
+        mEfGroup->wake(kEventFlagNotEmpty);
+        if (!mStatusMQ->readBlocking(status, 1)) {
+            return false;
+        }
+        return mOutputMQ->read(buffer, status->fmqProduced);
+    }
+
+    // Returns false unless the effect processed the whole buffer successfully.
+    bool process(float* buffer, size_t samples) {
+        IEffect::Status status;
+        return process(buffer, samples, &status) && status.status == STATUS_OK &&
+               status.fmqProduced == static_cast<int>(samples);
+    }
+
+  private:
+    std::unique_ptr<EffectContext::StatusMQ> mStatusMQ;
+    std::unique_ptr<EffectContext::DataMQ> mInputMQ;
+    std::unique_ptr<EffectContext::DataMQ> mOutputMQ;
+    ::android::hardware::EventFlag* mEfGroup = nullptr;
+};
+
+}  // namespace aidl::android::hardware::audio::effect
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "SubmixPipe.h"
+
+using aidl::android::hardware::audio::core::r_submix::SubmixPipe;
+
+namespace {
+
+// Stereo 16-bit frames.
+constexpr size_t kFrameSize = 4;
+constexpr size_t kCapacityFrames = 16;
+
+// Frames whose content is their index in the stream, so that misplaced frames are detected.
+std::vector<uint32_t> makeFrames(uint32_t first, size_t count) {
+    std::vector<uint32_t> frames(count);
+    std::iota(frames.begin(), frames.end(), first);
+    return frames;
+}
+
+}  // namespace
+
+TEST(SubmixPipeTest, RoundsCapacityUpToPowerOfTwo) {
+    SubmixPipe pipe(kFrameSize, 100);
+    EXPECT_EQ(128u, pipe.getCapacityFrames());
+    EXPECT_EQ(0u, pipe.availableToRead());
+    EXPECT_EQ(128u, pipe.availableToWrite());
+}
+
+TEST(SubmixPipeTest, WrapAround) {
+    SubmixPipe pipe(kFrameSize, kCapacityFrames);
+    uint32_t next = 0;
+    uint32_t expected = 0;
+    // Chunks of a size not dividing the capacity wrap at every possible offset.
+    for (int i = 0; i < 50; i++) {
+        const auto written = makeFrames(next, 5);
+        ASSERT_EQ(5u, pipe.write(written.data(), written.size()));
+        next += 5;
+        std::vector<uint32_t> read(5);
+        ASSERT_EQ(5u, pipe.read(read.data(), read.size()));
+        EXPECT_EQ(makeFrames(expected, 5), read) << "at chunk " << i;
+        expected += 5;
+    }
+    EXPECT_EQ(250u, pipe.getWritePosition());
+    EXPECT_EQ(250u, pipe.getReadPosition());
+    EXPECT_EQ(0u, pipe.availableToRead());
+}
+
+TEST(SubmixPipeTest, Overrun) {
+    SubmixPipe pipe(kFrameSize, kCapacityFrames);
+    const auto written = makeFrames(0, kCapacityFrames + 6);
+    // The frames which do not fit are dropped, not the ones already in the pipe.
+    EXPECT_EQ(kCapacityFrames, pipe.write(written.data(), written.size()));
+    EXPECT_EQ(kCapacityFrames, pipe.availableToRead());
+    EXPECT_EQ(0u, pipe.availableToWrite());
+    EXPECT_EQ(0u, pipe.write(written.data(), 1));
+
+    std::vector<uint32_t> read(kCapacityFrames);
+    ASSERT_EQ(kCapacityFrames, pipe.read(read.data(), read.size()));
+    EXPECT_EQ(makeFrames(0, kCapacityFrames), read);
+    EXPECT_EQ(kCapacityFrames, pipe.getWritePosition());
+}
+
+TEST(SubmixPipeTest, Underrun) {
+    SubmixPipe pipe(kFrameSize, kCapacityFrames);
+    std::vector<uint32_t> read(8, 0xdeadbeef);
+    EXPECT_EQ(0u, pipe.read(read.data(), read.size()));
+    EXPECT_EQ(std::vector<uint32_t>(8, 0xdeadbeef), read);
+
+    const auto written = makeFrames(0, 3);
+    ASSERT_EQ(3u, pipe.write(written.data(), written.size()));
+    // Only the frames in the pipe are read, the rest of the buffer is left untouched.
+    EXPECT_EQ(3u, pipe.read(read.data(), read.size()));
+    EXPECT_EQ(makeFrames(0, 3), std::vector<uint32_t>(read.begin(), read.begin() + 3));
+    EXPECT_EQ(0xdeadbeef, read[3]);
+    EXPECT_EQ(3u, pipe.getReadPosition());
+}
+
+TEST(SubmixPipeTest, Flush) {
+    SubmixPipe pipe(kFrameSize, kCapacityFrames);
+    const auto written = makeFrames(0, 10);
+    ASSERT_EQ(10u, pipe.write(written.data(), written.size()));
+    EXPECT_EQ(10u, pipe.flush());
+    EXPECT_EQ(0u, pipe.availableToRead());
+    EXPECT_EQ(10u, pipe.getReadPosition());
+
+    const auto next = makeFrames(10, 4);
+    ASSERT_EQ(4u, pipe.write(next.data(), next.size()));
+    std::vector<uint32_t> read(4);
+    ASSERT_EQ(4u, pipe.read(read.data(), read.size()));
+    EXPECT_EQ(next, read);
+}
+
+TEST(SubmixPipeTest, ConcurrentWriterAndReader) {
+    constexpr uint32_t kTotalFrames = 20000;
+    SubmixPipe pipe(kFrameSize, kCapacityFrames);
+    std::thread writer([&pipe] {
+        uint32_t next = 0;
+        while (next < kTotalFrames) {
+            const auto frames = makeFrames(next, std::min<uint32_t>(7, kTotalFrames - next));
+            const size_t written = pipe.write(frames.data(), frames.size());
+            if (written == 0) {
+                std::this_thread::yield();
+            }
+            next += written;
+        }
+    });
+    uint32_t expected = 0;
+    bool inOrder = true;
+    std::vector<uint32_t> read(5);
+    while (expected < kTotalFrames) {
+        const size_t count = pipe.read(read.data(), read.size());
+        if (count == 0) {
+            std::this_thread::yield();
+        }
+        for (size_t i = 0; i < count; i++) {
+            inOrder &= read[i] == expected++;
+        }
+    }
+    writer.join();
+    EXPECT_TRUE(inOrder);
+    EXPECT_EQ(kTotalFrames, pipe.getReadPosition());
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "UsbPcmConverter.h"
+
+using aidl::android::hardware::audio::core::usb::UsbPcmConverter;
+using Config = UsbPcmConverter::Config;
+using SampleFormat = UsbPcmConverter::SampleFormat;
+
+namespace {
+
+// AudioChannelLayout::LAYOUT_* values.
+constexpr uint32_t kMono = 0x1;
+constexpr uint32_t kStereo = 0x3;
+constexpr uint32_t k5Point1 = 0x3F;
+constexpr float kMinus3dB = 0.70710678f;
+
+Config makeConfig(SampleFormat format, uint32_t positions, uint32_t sampleRate = 48000) {
+    return {.format = format,
+            .channelCount = static_cast<size_t>(__builtin_popcount(positions)),
+            .channelPositionMask = positions,
+            .sampleRate = sampleRate};
+}
+
+// Converts the frames in one call, the output has room for all of them.
+template <typename In, typename Out>
+std::vector<Out> convert(const Config& from, const Config& to, const std::vector<In>& in) {
+    auto converter = UsbPcmConverter::create(from, to);
+    EXPECT_NE(nullptr, converter);
+    if (converter == nullptr) return {};
+    const size_t inFrames = in.size() * sizeof(In) / UsbPcmConverter::getFrameSize(from);
+    std::vector<Out> out(inFrames * UsbPcmConverter::getFrameSize(to) / sizeof(Out));
+    EXPECT_EQ(inFrames, converter->convert(in.data(), inFrames, out.data(), inFrames));
+    return out;
+}
+
+// Mono float samples, more than the four handled at once by the sample kernels.
+const std::vector<float> kFloatSamples = {0.f,  0.5f,       -0.5f, 0.25f, -1.f,
+                                          0.9f, -0.123456f, 1.f,   -0.75f};
+
+}  // namespace
+
+TEST(UsbPcmConverterTest, CreateRejectsInvalidConfigs) {
+    const Config valid = makeConfig(SampleFormat::FLOAT, kStereo);
+    EXPECT_EQ(nullptr, UsbPcmConverter::create(valid, makeConfig(SampleFormat::INVALID, kStereo)));
+    EXPECT_EQ(nullptr, UsbPcmConverter::create(valid, makeConfig(SampleFormat::I16, 0)));
+    EXPECT_EQ(nullptr, UsbPcmConverter::create(valid, makeConfig(SampleFormat::I16, kStereo, 0)));
+    // 44100:47999 needs 47999 filter phases.
+    EXPECT_FALSE(UsbPcmConverter::isSampleRateConversionSupported(44100, 47999));
+    EXPECT_EQ(nullptr, UsbPcmConverter::create(makeConfig(SampleFormat::FLOAT, kStereo, 44100),
+                                               makeConfig(SampleFormat::I16, kStereo, 47999)));
+    EXPECT_TRUE(UsbPcmConverter::isSampleRateConversionSupported(44100, 48000));
+}
+
+TEST(UsbPcmConverterTest, FormatRoundTrip) {
+    for (SampleFormat format :
+         {SampleFormat::I16, SampleFormat::I24_PACKED, SampleFormat::Q8_24, SampleFormat::I32}) {
+        const Config floatConfig = makeConfig(SampleFormat::FLOAT, kMono);
+        const Config intConfig = makeConfig(format, kMono);
+        const auto encoded = convert<float, uint8_t>(floatConfig, intConfig, kFloatSamples);
+        const auto decoded = convert<uint8_t, float>(intConfig, floatConfig, encoded);
+        ASSERT_EQ(kFloatSamples.size(), decoded.size());
+        // Full scale positive saturates to the largest integer, one step below 1.
+        const float step = format == SampleFormat::I16 ? 1.f / (1 << 15)
+                           : format == SampleFormat::I32 ? 1.f / (1u << 31)
+                                                         : 1.f / (1 << 23);
+        for (size_t i = 0; i < decoded.size(); i++) {
+            EXPECT_NEAR(kFloatSamples[i], decoded[i], std::max(step, 128.f / (1u << 31)))
+                    << "format " << static_cast<int>(format) << " sample " << i;
+        }
+    }
+}
+
+TEST(UsbPcmConverterTest, Encode16BitRoundsAndSaturates) {
+    const std::vector<float> in = {0.4f / 32768, 0.6f / 32768, -0.4f / 32768, -0.6f / 32768,
+                                   1.5f / 32768, -1.5f / 32768, 2.f,         -2.f,
+                                   1.f};
+    const auto out = convert<float, int16_t>(makeConfig(SampleFormat::FLOAT, kMono),
+                                             makeConfig(SampleFormat::I16, kMono), in);
+    // Half steps round away from zero.
+    EXPECT_EQ(std::vector<int16_t>({0, 1, 0, -1, 2, -2, 32767, -32768, 32767}), out);
+}
+
+TEST(UsbPcmConverterTest, Packed24BitSignExtension) {
+    // -1, the most negative and the largest positive values, little endian.
+    const std::vector<uint8_t> in = {0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x80, 0xFF, 0xFF, 0x7F};
+    const auto out = convert<uint8_t, int32_t>(makeConfig(SampleFormat::I24_PACKED, kMono),
+                                               makeConfig(SampleFormat::Q8_24, kMono), in);
+    EXPECT_EQ(std::vector<int32_t>({-1, -(1 << 23), (1 << 23) - 1}), out);
+    const auto packed = convert<int32_t, uint8_t>(makeConfig(SampleFormat::Q8_24, kMono),
+                                                  makeConfig(SampleFormat::I24_PACKED, kMono), out);
+    EXPECT_EQ(in, packed);
+}
+
+TEST(UsbPcmConverterTest, Q8_24IgnoresUpperByte) {
+    const std::vector<int32_t> in = {0x7F000001, static_cast<int32_t>(0x00FFFFFF)};
+    const auto out = convert<int32_t, float>(makeConfig(SampleFormat::Q8_24, kMono),
+                                             makeConfig(SampleFormat::FLOAT, kMono), in);
+    EXPECT_EQ(std::vector<float>({1.f / (1 << 23), -1.f / (1 << 23)}), out);
+}
+
+TEST(UsbPcmConverterTest, StereoToMonoAverages) {
+    const std::vector<float> in = {0.5f, 0.25f, -1.f, 1.f, 0.2f, 0.f, 0.f, 0.f, 1.f, 1.f};
+    const auto out = convert<float, float>(makeConfig(SampleFormat::FLOAT, kStereo),
+                                           makeConfig(SampleFormat::FLOAT, kMono), in);
+    EXPECT_EQ(std::vector<float>({0.375f, 0.f, 0.1f, 0.f, 1.f}), out);
+}
+
+TEST(UsbPcmConverterTest, MonoToStereoDuplicates) {
+    const std::vector<float> in = {0.5f, -0.25f, 1.f, 0.f, -1.f};
+    const auto out = convert<float, float>(makeConfig(SampleFormat::FLOAT, kMono),
+                                           makeConfig(SampleFormat::FLOAT, kStereo), in);
+    EXPECT_EQ(std::vector<float>({0.5f, 0.5f, -0.25f, -0.25f, 1.f, 1.f, 0.f, 0.f, -1.f, -1.f}),
+              out);
+}
+
+TEST(UsbPcmConverterTest, FivePointOneToStereo) {
+    // FL, FR, FC, LFE, BL, BR, one channel at a time.
+    std::vector<float> in(6 * 6, 0.f);
+    for (size_t channel = 0; channel < 6; channel++) in[channel * 6 + channel] = 1.f;
+    const auto out = convert<float, float>(makeConfig(SampleFormat::FLOAT, k5Point1),
+                                           makeConfig(SampleFormat::FLOAT, kStereo), in);
+    const std::vector<float> expected = {
+            1.f,       0.f,        // FL
+            0.f,       1.f,        // FR
+            kMinus3dB, kMinus3dB,  // FC to both sides
+            kMinus3dB, kMinus3dB,  // LFE to both sides
+            kMinus3dB, 0.f,        // BL to the left
+            0.f,       kMinus3dB,  // BR to the right
+    };
+    ASSERT_EQ(expected.size(), out.size());
+    for (size_t i = 0; i < out.size(); i++) {
+        EXPECT_FLOAT_EQ(expected[i], out[i]) << "sample " << i;
+    }
+}
+
+TEST(UsbPcmConverterTest, IndexMasksKeepChannelIndex) {
+    Config from = makeConfig(SampleFormat::FLOAT, 0);
+    from.channelCount = 4;
+    Config to = makeConfig(SampleFormat::FLOAT, 0);
+    to.channelCount = 2;
+    const std::vector<float> in = {1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f};
+    const auto out = convert<float, float>(from, to, in);
+    EXPECT_EQ(std::vector<float>({1.f, 2.f, 5.f, 6.f}), out);
+}
+
+namespace {
+
+const std::vector<std::pair<uint32_t, uint32_t>> kRates = {
+        {44100, 48000}, {48000, 44100}, {48000, 16000}, {16000, 48000}};
+
+std::unique_ptr<UsbPcmConverter> createResampler(uint32_t fromRate, uint32_t toRate) {
+    return UsbPcmConverter::create(makeConfig(SampleFormat::FLOAT, kStereo, fromRate),
+                                   makeConfig(SampleFormat::I16, kStereo, toRate));
+}
+
+}  // namespace
+
+TEST(UsbPcmConverterTest, ResamplerInputFramesFor) {
+    for (auto [fromRate, toRate] : kRates) {
+        auto converter = createResampler(fromRate, toRate);
+        ASSERT_NE(nullptr, converter);
+        // Chunk sizes which do not divide the rate ratio, so the filter phase carries over.
+        for (size_t outFrames : {1u, 7u, 160u, 441u, 480u, 13u}) {
+            SCOPED_TRACE(testing::Message() << fromRate << " to " << toRate << ", " << outFrames
+                                            << " frames");
+            const size_t inFrames = converter->getInputFramesFor(outFrames);
+            // The fewest input frames which produce outFrames.
+            EXPECT_GE(converter->getMaxOutputFrames(inFrames), outFrames);
+            if (inFrames > 0) {
+                EXPECT_LT(converter->getMaxOutputFrames(inFrames - 1), outFrames);
+            }
+            std::vector<float> in(inFrames * 2, 0.25f);
+            std::vector<int16_t> out(outFrames * 2);
+            ASSERT_EQ(outFrames, converter->convert(in.data(), inFrames, out.data(), outFrames));
+        }
+        // Once the filter is full, a DC input comes out at the same level.
+        const size_t inFrames = converter->getInputFramesFor(480);
+        std::vector<float> in(inFrames * 2, 0.25f);
+        std::vector<int16_t> out(480 * 2);
+        ASSERT_EQ(480u, converter->convert(in.data(), inFrames, out.data(), 480));
+        EXPECT_NEAR(0.25f * 32768, out.back(), 2.f);
+    }
+}
+
+TEST(UsbPcmConverterTest, ResamplerMaxOutputFrames) {
+    for (auto [fromRate, toRate] : kRates) {
+        auto converter = createResampler(fromRate, toRate);
+        ASSERT_NE(nullptr, converter);
+        for (size_t inFrames : {0u, 1u, 5u, 441u, 480u, 1000u, 3u}) {
+            SCOPED_TRACE(testing::Message() << fromRate << " to " << toRate << ", " << inFrames
+                                            << " frames");
+            const size_t maxOutFrames = converter->getMaxOutputFrames(inFrames);
+            std::vector<float> in(inFrames * 2, 0.25f);
+            // The room for more output must not change the frames produced.
+            std::vector<int16_t> out((maxOutFrames + 16) * 2);
+            EXPECT_EQ(maxOutFrames,
+                      converter->convert(in.data(), inFrames, out.data(), maxOutFrames + 16));
+        }
+        // The input kept for the filter is dropped, the first output needs half a filter again.
+        const size_t firstInFrames = converter->getInputFramesFor(1);
+        converter->reset();
+        EXPECT_GT(converter->getInputFramesFor(1), 0u);
+        EXPECT_LE(firstInFrames, converter->getInputFramesFor(1));
+    }
+}
+
+TEST(UsbPcmConverterTest, ConvertWithoutResamplerIsBoundByOutput) {
+    auto converter = UsbPcmConverter::create(makeConfig(SampleFormat::I16, kStereo),
+                                             makeConfig(SampleFormat::FLOAT, kStereo));
+    ASSERT_NE(nullptr, converter);
+    EXPECT_EQ(100u, converter->getInputFramesFor(100));
+    EXPECT_EQ(100u, converter->getMaxOutputFrames(100));
+    std::vector<int16_t> in(10 * 2, 16384);
+    std::vector<float> out(4 * 2);
+    EXPECT_EQ(4u, converter->convert(in.data(), 10, out.data(), 4));
+    EXPECT_EQ(std::vector<float>(4 * 2, 0.5f), out);
+}
@@ -16,6 +16,8 @@
 
 #define LOG_TAG "AHAL_ModuleUsb"
 
+#include <algorithm>
+#include <iterator>
 #include <vector>
 
 #include <Utils.h>
@@ -24,6 +26,7 @@
 
 #include "UsbAlsaMixerControl.h"
 #include "UsbAlsaUtils.h"
+#include "UsbPcmConverter.h"
 #include "core-impl/ModuleUsb.h"
 
 extern "C" {
@@ -41,6 +44,7 @@ using aidl::android::media::audio::common::AudioPort;
 using aidl::android::media::audio::common::AudioPortConfig;
 using aidl::android::media::audio::common::AudioPortExt;
 using aidl::android::media::audio::common::AudioProfile;
+using aidl::android::media::audio::common::PcmType;
 
 namespace aidl::android::hardware::audio::core {
 
@@ -73,6 +77,96 @@ std::vector<int> populateSampleRatesFromProfile(const alsa_device_profile* profi
     return sampleRates;
 }
 
+bool isFormatConvertible(const AudioFormatDescription& format) {
+    return usb::legacy2converter_pcm_format_SampleFormat(
+                   usb::aidl2legacy_AudioFormatDescription_pcm_format(format)) !=
+           usb::UsbPcmConverter::SampleFormat::INVALID;
+}
+
+bool isChannelMaskConvertible(const AudioChannelLayout& channelMask, bool isInput) {
+    return usb::getChannelCountFromChannelMask(channelMask, isInput) != 0;
+}
+
+// Whether the stream can use 'rate' with a device supporting 'deviceRates'.
+bool isSampleRateConvertible(int rate, const std::vector<int>& deviceRates, bool isInput) {
+    return std::any_of(deviceRates.begin(), deviceRates.end(), [&](int deviceRate) {
+        return isInput ? usb::UsbPcmConverter::isSampleRateConversionSupported(deviceRate, rate)
+                       : usb::UsbPcmConverter::isSampleRateConversionSupported(rate, deviceRate);
+    });
+}
+
+// The profiles which the streams can use through the format conversion of the USB streams, in
+// addition to the profiles of the device.
+void addConvertedProfiles(bool isInput, std::vector<AudioProfile>* profiles) {
+    auto addMissing = [](const auto& from, auto* to) {
+        for (const auto& item : from) {
+            if (std::find(to->begin(), to->end(), item) == to->end()) {
+                to->push_back(item);
+            }
+        }
+    };
+    std::vector<AudioChannelLayout> convertedChannels;
+    for (unsigned int channelCount : {1u, 2u}) {
+        if (auto layout = usb::getChannelLayoutMaskFromChannelCount(channelCount, isInput);
+            isChannelMaskConvertible(layout, isInput)) {
+            convertedChannels.push_back(layout);
+        }
+    }
+    // Each profile the converter can read or write keeps its own channel masks and sample rates,
+    // plus the ones the conversion produces from them. The added formats are converted from any
+    // of these profiles, so they get all of them.
+    std::vector<AudioChannelLayout> channels;
+    std::vector<int> sampleRates;
+    for (auto& profile : *profiles) {
+        if (!isFormatConvertible(profile.format)) continue;
+        std::vector<AudioChannelLayout> profileChannels;
+        std::copy_if(profile.channelMasks.begin(), profile.channelMasks.end(),
+                     std::back_inserter(profileChannels),
+                     [isInput](const auto& layout) {
+                         return isChannelMaskConvertible(layout, isInput);
+                     });
+        const std::vector<int> deviceRates = profile.sampleRates;
+        if (profileChannels.empty() || deviceRates.empty()) continue;
+        addMissing(convertedChannels, &profile.channelMasks);
+        addMissing(convertedChannels, &profileChannels);
+        for (int rate : {44100, 48000}) {
+            if (isSampleRateConvertible(rate, deviceRates, isInput)) {
+                addMissing(std::vector<int>{rate}, &profile.sampleRates);
+            }
+        }
+        addMissing(profileChannels, &channels);
+        addMissing(profile.sampleRates, &sampleRates);
+    }
+    if (channels.empty() || sampleRates.empty()) return;
+    for (PcmType pcmType : {PcmType::INT_16_BIT, PcmType::FLOAT_32_BIT}) {
+        AudioFormatDescription format;
+        format.type = AudioFormatType::PCM;
+        format.pcm = pcmType;
+        if (std::find_if(profiles->begin(), profiles->end(), [&format](const auto& profile) {
+                return profile.format == format;
+            }) == profiles->end()) {
+            profiles->push_back(AudioProfile{
+                    .format = format, .channelMasks = channels, .sampleRates = sampleRates});
+        }
+    }
+}
+
+// Whether the stream data can be converted between the configurations of the two ends of a patch.
+bool isConversionSupported(const AudioPortConfig& source, const AudioPortConfig& sink) {
+    // The USB device is the source of a capture patch.
+    const bool isInput = source.ext.getTag() == AudioPortExt::Tag::device;
+    for (const auto& config : {source, sink}) {
+        if (!config.format.has_value() || !isFormatConvertible(config.format.value()) ||
+            !config.channelMask.has_value() ||
+            !isChannelMaskConvertible(config.channelMask.value(), isInput)) {
+            return false;
+        }
+    }
+    return source.sampleRate.has_value() && sink.sampleRate.has_value() &&
+           usb::UsbPcmConverter::isSampleRateConversionSupported(source.sampleRate->value,
+                                                                 sink.sampleRate->value);
+}
+
 }  // namespace
 
 ndk::ScopedAStatus ModuleUsb::getTelephony(std::shared_ptr<ITelephony>* _aidl_return) {
@@ -145,6 +239,7 @@ ndk::ScopedAStatus ModuleUsb::populateConnectedDevicePort(AudioPort* audioPort)
                                      .sampleRates = sampleRates};
         audioPort->profiles.push_back(std::move(audioProfile));
     }
+    addConvertedProfiles(isInput, &audioPort->profiles);
 
     return ndk::ScopedAStatus::ok();
 }
@@ -153,8 +248,9 @@ ndk::ScopedAStatus ModuleUsb::checkAudioPatchEndpointsMatch(
         const std::vector<AudioPortConfig*>& sources, const std::vector<AudioPortConfig*>& sinks) {
     for (const auto& source : sources) {
         for (const auto& sink : sinks) {
-            if (source->sampleRate != sink->sampleRate ||
-                source->channelMask != sink->channelMask || source->format != sink->format) {
+            if ((source->sampleRate != sink->sampleRate ||
+                 source->channelMask != sink->channelMask || source->format != sink->format) &&
+                !isConversionSupported(*source, *sink)) {
                 LOG(ERROR) << __func__
                            << ": mismatch port configuration, source=" << source->toString()
                            << ", sink=" << sink->toString();
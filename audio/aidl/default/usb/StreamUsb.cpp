@@ -15,12 +15,15 @@
  */
 
 #define LOG_TAG "AHAL_StreamUsb"
+#include <cstring>
+
 #include <android-base/logging.h>
 
 #include <Utils.h>
 
 #include "UsbAlsaMixerControl.h"
 #include "UsbAlsaUtils.h"
+#include "UsbPcmConverter.h"
 #include "core-impl/Module.h"
 #include "core-impl/StreamUsb.h"
 
@@ -42,6 +45,51 @@ using android::status_t;
 
 namespace aidl::android::hardware::audio::core {
 
+namespace {
+
+// The formats to fall back to when the device does not support the format of the stream, from
+// the highest precision.
+constexpr pcm_format kFallbackFormats[] = {PCM_FORMAT_FLOAT_LE, PCM_FORMAT_S32_LE,
+                                           PCM_FORMAT_S24_3LE, PCM_FORMAT_S24_LE,
+                                           PCM_FORMAT_S16_LE};
+
+// Returns the configuration supported by the device which is the closest to the configuration of
+// the stream: the same format, channel count and rate when possible, else the format with the
+// highest precision, the closest channel count and the lowest rate above the rate of the stream.
+struct pcm_config getDeviceConfig(alsa_device_profile* profile, const struct pcm_config& config,
+                                  bool isInput) {
+    struct pcm_config result = config;
+    if (!profile_is_format_valid(profile, config.format)) {
+        for (pcm_format format : kFallbackFormats) {
+            if (profile_is_format_valid(profile, format)) {
+                result.format = format;
+                break;
+            }
+        }
+    }
+    if (!profile_is_channel_count_valid(profile, config.channels)) {
+        result.channels = profile_get_closest_channel_count(profile, config.channels);
+    }
+    if (!profile_is_sample_rate_valid(profile, config.rate)) {
+        unsigned int best = 0;
+        for (size_t i = 0; i < MAX_PROFILE_SAMPLE_RATES && profile->sample_rates[i] != 0; i++) {
+            const unsigned int rate = profile->sample_rates[i];
+            if (!usb::UsbPcmConverter::isSampleRateConversionSupported(
+                        isInput ? rate : config.rate, isInput ? config.rate : rate)) {
+                continue;
+            }
+            if (best == 0 || (rate >= config.rate && (best < config.rate || rate < best)) ||
+                (rate < config.rate && best < config.rate && rate > best)) {
+                best = rate;
+            }
+        }
+        if (best != 0) result.rate = best;
+    }
+    return result;
+}
+
+}  // namespace
+
 DriverUsb::DriverUsb(const StreamContext& context, bool isInput)
     : mFrameSizeBytes(context.getFrameSize()), mIsInput(isInput) {
     struct pcm_config config;
@@ -61,6 +109,7 @@ DriverUsb::DriverUsb(const StreamContext& context, bool isInput)
         return;
     }
     mConfig = config;
+    mChannelPositionMask = usb::getChannelPositionMask(context.getChannelLayout());
 }
 
 ::android::status_t DriverUsb::init() {
@@ -81,7 +130,7 @@ DriverUsb::DriverUsb(const StreamContext& context, bool isInput)
         }
     }
     std::lock_guard guard(mLock);
-    mAlsaDeviceProxies.clear();
+    mAlsaDevices.clear();
     mConnectedDevices.clear();
     for (const auto& connectedDevice : connectedDevices) {
         mConnectedDevices.push_back(connectedDevice.address);
@@ -95,6 +144,12 @@ DriverUsb::DriverUsb(const StreamContext& context, bool isInput)
 }
 
 ::android::status_t DriverUsb::flush() {
+    // Drop the frames kept by the resamplers.
+    for (auto& device : getAlsaDevices()) {
+        if (device.converter != nullptr) {
+            device.converter->reset();
+        }
+    }
     usleep(1000);
     return ::android::OK;
 }
@@ -117,18 +172,43 @@ DriverUsb::DriverUsb(const StreamContext& context, bool isInput)
             return status;
         }
     }
-    std::vector<std::shared_ptr<alsa_device_proxy>> alsaDeviceProxies;
-    {
-        std::lock_guard guard(mLock);
-        alsaDeviceProxies = mAlsaDeviceProxies;
-    }
+    std::vector<AlsaDevice> alsaDevices = getAlsaDevices();
     const size_t bytesToTransfer = frameCount * mFrameSizeBytes;
     if (mIsInput) {
         // For input case, only support single device.
-        proxy_read(alsaDeviceProxies[0].get(), buffer, bytesToTransfer);
+        auto& device = alsaDevices[0];
+        if (device.converter == nullptr) {
+            proxy_read(device.proxy.get(), buffer, bytesToTransfer);
+        } else {
+            const size_t deviceFrameCount = device.converter->getInputFramesFor(frameCount);
+            if (mConversionBuffer.size() < deviceFrameCount * device.frameSizeBytes) {
+                mConversionBuffer.resize(deviceFrameCount * device.frameSizeBytes);
+            }
+            proxy_read(device.proxy.get(), mConversionBuffer.data(),
+                       deviceFrameCount * device.frameSizeBytes);
+            const size_t convertedFrameCount = device.converter->convert(
+                    mConversionBuffer.data(), deviceFrameCount, buffer, frameCount);
+            if (convertedFrameCount < frameCount) {
+                // The resampler holds back some input at start, keep the stream timing by
+                // filling the rest with silence.
+                memset(static_cast<uint8_t*>(buffer) + convertedFrameCount * mFrameSizeBytes, 0,
+                       (frameCount - convertedFrameCount) * mFrameSizeBytes);
+            }
+        }
     } else {
-        for (auto& proxy : alsaDeviceProxies) {
-            proxy_write(proxy.get(), buffer, bytesToTransfer);
+        for (auto& device : alsaDevices) {
+            if (device.converter == nullptr) {
+                proxy_write(device.proxy.get(), buffer, bytesToTransfer);
+                continue;
+            }
+            const size_t maxDeviceFrameCount = device.converter->getMaxOutputFrames(frameCount);
+            if (mConversionBuffer.size() < maxDeviceFrameCount * device.frameSizeBytes) {
+                mConversionBuffer.resize(maxDeviceFrameCount * device.frameSizeBytes);
+            }
+            const size_t deviceFrameCount = device.converter->convert(
+                    buffer, frameCount, mConversionBuffer.data(), maxDeviceFrameCount);
+            proxy_write(device.proxy.get(), mConversionBuffer.data(),
+                        deviceFrameCount * device.frameSizeBytes);
         }
     }
     *actualFrameCount = frameCount;
@@ -139,7 +219,7 @@ DriverUsb::DriverUsb(const StreamContext& context, bool isInput)
 ::android::status_t DriverUsb::standby() {
     if (!mIsStandby) {
         std::lock_guard guard(mLock);
-        mAlsaDeviceProxies.clear();
+        mAlsaDevices.clear();
         mIsStandby = true;
     }
     return ::android::OK;
@@ -151,7 +231,7 @@ DriverUsb::DriverUsb(const StreamContext& context, bool isInput)
         std::lock_guard guard(mLock);
         connectedDevices = mConnectedDevices;
     }
-    std::vector<std::shared_ptr<alsa_device_proxy>> alsaDeviceProxies;
+    std::vector<AlsaDevice> alsaDevices;
     for (const auto& device : connectedDevices) {
         alsa_device_profile profile;
         profile_init(&profile, mIsInput ? PCM_IN : PCM_OUT);
@@ -168,11 +248,36 @@ DriverUsb::DriverUsb(const StreamContext& context, bool isInput)
                                                             proxy_close(proxy);
                                                             free(proxy);
                                                         });
-        // Always ask for alsa configure as required since the configuration should be supported
-        // by the connected device. That is guaranteed by `setAudioPortConfig` and
-        // `setAudioPatch`.
-        if (int err =
-                    proxy_prepare(proxy.get(), &profile, &mConfig.value(), true /*is_bit_perfect*/);
+        // The stream configuration is used as is when the device supports it. Otherwise the
+        // device is opened with its closest configuration and the stream data is converted.
+        struct pcm_config config = getDeviceConfig(&profile, mConfig.value(), mIsInput);
+        std::shared_ptr<usb::UsbPcmConverter> converter;
+        if (config.format != mConfig->format || config.channels != mConfig->channels ||
+            config.rate != mConfig->rate) {
+            const usb::UsbPcmConverter::Config streamConfig = {
+                    .format = usb::legacy2converter_pcm_format_SampleFormat(mConfig->format),
+                    .channelCount = mConfig->channels,
+                    .channelPositionMask = mChannelPositionMask,
+                    .sampleRate = mConfig->rate};
+            const usb::UsbPcmConverter::Config deviceConfig = {
+                    .format = usb::legacy2converter_pcm_format_SampleFormat(config.format),
+                    .channelCount = config.channels,
+                    .channelPositionMask = usb::getChannelPositionMask(
+                            usb::getChannelLayoutMaskFromChannelCount(config.channels, mIsInput)),
+                    .sampleRate = config.rate};
+            converter = mIsInput ? usb::UsbPcmConverter::create(deviceConfig, streamConfig)
+                                 : usb::UsbPcmConverter::create(streamConfig, deviceConfig);
+            if (converter == nullptr) {
+                LOG(ERROR) << __func__ << ": unsupported conversion for device address="
+                           << device.toString() << ", device format=" << config.format
+                           << ", channels=" << config.channels << ", rate=" << config.rate;
+                return ::android::UNKNOWN_ERROR;
+            }
+            LOG(DEBUG) << __func__ << ": converting for device address=" << device.toString()
+                       << ", device format=" << config.format << ", channels=" << config.channels
+                       << ", rate=" << config.rate;
+        }
+        if (int err = proxy_prepare(proxy.get(), &profile, &config, true /*is_bit_perfect*/);
             err != 0) {
             LOG(ERROR) << __func__ << ": fail to prepare for device address=" << device.toString()
                        << " error=" << err;
@@ -183,16 +288,26 @@ DriverUsb::DriverUsb(const StreamContext& context, bool isInput)
                        << " error=" << err;
             return ::android::UNKNOWN_ERROR;
         }
-        alsaDeviceProxies.push_back(std::move(proxy));
+        const size_t frameSizeBytes = converter != nullptr
+                                              ? usb::UsbPcmConverter::getFrameSize(
+                                                        mIsInput ? converter->getFromConfig()
+                                                                 : converter->getToConfig())
+                                              : mFrameSizeBytes;
+        alsaDevices.push_back({std::move(proxy), std::move(converter), frameSizeBytes});
     }
     {
         std::lock_guard guard(mLock);
-        mAlsaDeviceProxies = alsaDeviceProxies;
+        mAlsaDevices = alsaDevices;
     }
     mIsStandby = false;
     return ::android::OK;
 }
 
+std::vector<DriverUsb::AlsaDevice> DriverUsb::getAlsaDevices() {
+    std::lock_guard guard(mLock);
+    return mAlsaDevices;
+}
+
 // static
 ndk::ScopedAStatus StreamInUsb::createInstance(const SinkMetadata& sinkMetadata,
                                                StreamContext&& context,
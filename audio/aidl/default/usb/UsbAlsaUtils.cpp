@@ -178,4 +178,27 @@ pcm_format aidl2legacy_AudioFormatDescription_pcm_format(const AudioFormatDescri
     return findValueOrDefault(getAudioFormatDescriptorToPcmFormatMap(), aidl, PCM_FORMAT_INVALID);
 }
 
-}  // namespace aidl::android::hardware::audio::core::usb
+UsbPcmConverter::SampleFormat legacy2converter_pcm_format_SampleFormat(enum pcm_format legacy) {
+    switch (legacy) {
+        case PCM_FORMAT_S16_LE:
+            return UsbPcmConverter::SampleFormat::I16;
+        case PCM_FORMAT_S24_3LE:
+            return UsbPcmConverter::SampleFormat::I24_PACKED;
+        case PCM_FORMAT_S24_LE:
+            return UsbPcmConverter::SampleFormat::Q8_24;
+        case PCM_FORMAT_S32_LE:
+            return UsbPcmConverter::SampleFormat::I32;
+        case PCM_FORMAT_FLOAT_LE:
+            return UsbPcmConverter::SampleFormat::FLOAT;
+        default:
+            return UsbPcmConverter::SampleFormat::INVALID;
+    }
+}
+
+uint32_t getChannelPositionMask(const AudioChannelLayout& channelMask) {
+    return channelMask.getTag() == AudioChannelLayout::Tag::layoutMask
+                   ? channelMask.get<AudioChannelLayout::Tag::layoutMask>()
+                   : 0;
+}
+
+}  // namespace aidl::android::hardware::audio::core::usb
\ No newline at end of file
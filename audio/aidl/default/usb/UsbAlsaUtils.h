@@ -19,6 +19,8 @@
 #include <aidl/android/media/audio/common/AudioChannelLayout.h>
 #include <aidl/android/media/audio/common/AudioFormatDescription.h>
 
+#include "UsbPcmConverter.h"
+
 extern "C" {
 #include <tinyalsa/pcm.h>
 }
@@ -35,5 +37,9 @@ unsigned int getChannelCountFromChannelMask(
 legacy2aidl_pcm_format_AudioFormatDescription(enum pcm_format legacy);
 pcm_format aidl2legacy_AudioFormatDescription_pcm_format(
         const ::aidl::android::media::audio::common::AudioFormatDescription& aidl);
+UsbPcmConverter::SampleFormat legacy2converter_pcm_format_SampleFormat(enum pcm_format legacy);
+// The channel positions of a layout mask, 0 for other channel masks.
+uint32_t getChannelPositionMask(
+        const ::aidl::android::media::audio::common::AudioChannelLayout& channelMask);
 
 }  // namespace aidl::android::hardware::audio::core::usb
\ No newline at end of file
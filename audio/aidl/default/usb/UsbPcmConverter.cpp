@@ -0,0 +1,541 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "UsbPcmConverter.h"
+
+namespace aidl::android::hardware::audio::core::usb {
+
+namespace {
+
+constexpr size_t kLanes = 4;
+typedef float FloatVec __attribute__((vector_size(kLanes * sizeof(float))));
+typedef int32_t IntVec __attribute__((vector_size(kLanes * sizeof(int32_t))));
+
+constexpr size_t kMaxChannelCount = 32;
+constexpr float kMinus3dB = 0.70710678f;
+
+// AudioChannelLayout::CHANNEL_* bits grouped by the side of the listener they are on.
+constexpr uint32_t kFrontLeft = 1 << 0;
+constexpr uint32_t kFrontRight = 1 << 1;
+constexpr uint32_t kFrontCenter = 1 << 2;
+constexpr uint32_t kLeftChannels = (1 << 0) | (1 << 4) | (1 << 6) | (1 << 9) | (1 << 12) |
+                                   (1 << 15) | (1 << 18) | (1 << 20) | (1 << 24);
+constexpr uint32_t kRightChannels = (1 << 1) | (1 << 5) | (1 << 7) | (1 << 10) | (1 << 14) |
+                                    (1 << 17) | (1 << 19) | (1 << 22) | (1 << 25);
+constexpr uint32_t kLowFrequencyChannels = (1 << 3) | (1 << 23);
+
+inline FloatVec splat(float value) {
+    return FloatVec{value, value, value, value};
+}
+
+inline FloatVec loadFloat(const float* in) {
+    FloatVec value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+inline void storeFloat(float* out, const FloatVec& value) {
+    memcpy(out, &value, sizeof(value));
+}
+
+inline FloatVec selectLanes(const IntVec& mask, const FloatVec& a, const FloatVec& b) {
+    return (FloatVec)((mask & (IntVec)a) | (~mask & (IntVec)b));
+}
+
+// Scales to the integer range, saturates to [low, high] and rounds to the nearest integer.
+inline IntVec floatToInt(FloatVec value, float scale, float low, float high) {
+    value *= splat(scale);
+    value = selectLanes(value < splat(low), splat(low), value);
+    value = selectLanes(value > splat(high), splat(high), value);
+    value += selectLanes(value < splat(0.f), splat(-0.5f), splat(0.5f));
+    return __builtin_convertvector(value, IntVec);
+}
+
+inline int32_t floatToInt(float value, float scale, float low, float high) {
+    value = std::clamp(value * scale, low, high);
+    return static_cast<int32_t>(value < 0.f ? value - 0.5f : value + 0.5f);
+}
+
+inline int32_t loadPacked24(const uint8_t* in) {
+    // Place the sample in the upper bytes, the arithmetic shift extends the sign.
+    return static_cast<int32_t>(in[0] << 8 | in[1] << 16 | static_cast<uint32_t>(in[2]) << 24) >>
+           8;
+}
+
+inline void storePacked24(uint8_t* out, int32_t value) {
+    out[0] = value;
+    out[1] = value >> 8;
+    out[2] = value >> 16;
+}
+
+constexpr float k16Scale = 1 << 15;
+constexpr float k24Scale = 1 << 23;
+constexpr float k32Scale = 1u << 31;
+// The largest float below 2^31, 2^31 - 1 is not representable.
+constexpr float k32Max = 2147483520.f;
+
+void decode(UsbPcmConverter::SampleFormat format, const void* in, float* out, size_t count) {
+    using SampleFormat = UsbPcmConverter::SampleFormat;
+    size_t i = 0;
+    switch (format) {
+        case SampleFormat::I16: {
+            const int16_t* src = static_cast<const int16_t*>(in);
+            for (; i + kLanes <= count; i += kLanes) {
+                const IntVec value{src[i], src[i + 1], src[i + 2], src[i + 3]};
+                storeFloat(out + i, __builtin_convertvector(value, FloatVec) / splat(k16Scale));
+            }
+            for (; i < count; i++) out[i] = src[i] / k16Scale;
+            break;
+        }
+        case SampleFormat::I24_PACKED: {
+            const uint8_t* src = static_cast<const uint8_t*>(in);
+            for (; i + kLanes <= count; i += kLanes) {
+                const uint8_t* s = src + i * 3;
+                const IntVec value{loadPacked24(s), loadPacked24(s + 3), loadPacked24(s + 6),
+                                   loadPacked24(s + 9)};
+                storeFloat(out + i, __builtin_convertvector(value, FloatVec) / splat(k24Scale));
+            }
+            for (; i < count; i++) out[i] = loadPacked24(src + i * 3) / k24Scale;
+            break;
+        }
+        case SampleFormat::Q8_24:
+        case SampleFormat::I32: {
+            const int32_t* src = static_cast<const int32_t*>(in);
+            const float scale = format == SampleFormat::I32 ? k32Scale : k24Scale;
+            for (; i + kLanes <= count; i += kLanes) {
+                IntVec value;
+                memcpy(&value, src + i, sizeof(value));
+                if (format == SampleFormat::Q8_24) {
+                    // Only the lower 24 bits are significant.
+                    value = (value << 8) >> 8;
+                }
+                storeFloat(out + i, __builtin_convertvector(value, FloatVec) / splat(scale));
+            }
+            for (; i < count; i++) {
+                const int32_t value =
+                        format == SampleFormat::Q8_24
+                                ? static_cast<int32_t>(static_cast<uint32_t>(src[i]) << 8) >> 8
+                                : src[i];
+                out[i] = value / scale;
+            }
+            break;
+        }
+        case SampleFormat::FLOAT:
+            memcpy(out, in, count * sizeof(float));
+            break;
+        case SampleFormat::INVALID:
+            break;
+    }
+}
+
+void encode(UsbPcmConverter::SampleFormat format, const float* in, void* out, size_t count) {
+    using SampleFormat = UsbPcmConverter::SampleFormat;
+    size_t i = 0;
+    switch (format) {
+        case SampleFormat::I16: {
+            int16_t* dst = static_cast<int16_t*>(out);
+            for (; i + kLanes <= count; i += kLanes) {
+                const IntVec value = floatToInt(loadFloat(in + i), k16Scale, -k16Scale, 32767.f);
+                for (size_t lane = 0; lane < kLanes; lane++) dst[i + lane] = value[lane];
+            }
+            for (; i < count; i++) dst[i] = floatToInt(in[i], k16Scale, -k16Scale, 32767.f);
+            break;
+        }
+        case SampleFormat::I24_PACKED: {
+            uint8_t* dst = static_cast<uint8_t*>(out);
+            for (; i + kLanes <= count; i += kLanes) {
+                const IntVec value =
+                        floatToInt(loadFloat(in + i), k24Scale, -k24Scale, k24Scale - 1.f);
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    storePacked24(dst + (i + lane) * 3, value[lane]);
+                }
+            }
+            for (; i < count; i++) {
+                storePacked24(dst + i * 3, floatToInt(in[i], k24Scale, -k24Scale, k24Scale - 1.f));
+            }
+            break;
+        }
+        case SampleFormat::Q8_24:
+        case SampleFormat::I32: {
+            int32_t* dst = static_cast<int32_t*>(out);
+            const float scale = format == SampleFormat::I32 ? k32Scale : k24Scale;
+            const float high = format == SampleFormat::I32 ? k32Max : k24Scale - 1.f;
+            for (; i + kLanes <= count; i += kLanes) {
+                const IntVec value = floatToInt(loadFloat(in + i), scale, -scale, high);
+                memcpy(dst + i, &value, sizeof(value));
+            }
+            for (; i < count; i++) dst[i] = floatToInt(in[i], scale, -scale, high);
+            break;
+        }
+        case SampleFormat::FLOAT:
+            memcpy(out, in, count * sizeof(float));
+            break;
+        case SampleFormat::INVALID:
+            break;
+    }
+}
+
+void ensureSize(std::vector<float>* buffer, size_t size) {
+    if (buffer->size() < size) buffer->resize(size);
+}
+
+// The positions of a layout, or 0 if the mask does not describe all the channels.
+uint32_t getPositions(const UsbPcmConverter::Config& config) {
+    return static_cast<size_t>(__builtin_popcount(config.channelPositionMask)) ==
+                           config.channelCount
+                   ? config.channelPositionMask
+                   : 0;
+}
+
+// The index of the channel at 'position' in the interleaved frame of a layout.
+size_t getChannelIndex(uint32_t positions, uint32_t position) {
+    return __builtin_popcount(positions & (position - 1));
+}
+
+// Row major, to.channelCount rows of from.channelCount coefficients. The folds follow the
+// downmix of the framework: the channels missing from the output go to the front channels of
+// their side at -3dB, the center and low frequency channels to both sides at -3dB.
+std::vector<float> buildMixMatrix(const UsbPcmConverter::Config& from,
+                                  const UsbPcmConverter::Config& to) {
+    const size_t inCount = from.channelCount;
+    const size_t outCount = to.channelCount;
+    std::vector<float> matrix(outCount * inCount, 0.f);
+    auto add = [&](size_t out, size_t in, float gain) { matrix[out * inCount + in] += gain; };
+    const uint32_t inPositions = getPositions(from);
+    const uint32_t outPositions = getPositions(to);
+    if (outCount == 1) {
+        std::vector<size_t> channels;
+        for (size_t in = 0, position = 1; in < inCount; in++, position <<= 1) {
+            while (inPositions != 0 && !(inPositions & position)) position <<= 1;
+            if (!(inPositions & position & kLowFrequencyChannels)) channels.push_back(in);
+        }
+        for (size_t in : channels) add(0, in, 1.f / channels.size());
+    } else if (inCount == 1) {
+        const bool hasFront = (outPositions & (kFrontLeft | kFrontRight)) ==
+                              (kFrontLeft | kFrontRight);
+        add(hasFront ? getChannelIndex(outPositions, kFrontLeft) : 0, 0, 1.f);
+        add(hasFront ? getChannelIndex(outPositions, kFrontRight) : 1, 0, 1.f);
+    } else if (inPositions != 0 && outPositions != 0) {
+        const bool hasLeft = outPositions & kFrontLeft;
+        const bool hasRight = outPositions & kFrontRight;
+        const bool hasCenter = outPositions & kFrontCenter;
+        for (uint32_t position = 1, in = 0; in < inCount; position <<= 1) {
+            if (!(inPositions & position)) continue;
+            if (outPositions & position) {
+                add(getChannelIndex(outPositions, position), in, 1.f);
+            } else if ((position & kLeftChannels) && hasLeft) {
+                add(getChannelIndex(outPositions, kFrontLeft), in, kMinus3dB);
+            } else if ((position & kRightChannels) && hasRight) {
+                add(getChannelIndex(outPositions, kFrontRight), in, kMinus3dB);
+            } else if (hasLeft && hasRight) {
+                add(getChannelIndex(outPositions, kFrontLeft), in, kMinus3dB);
+                add(getChannelIndex(outPositions, kFrontRight), in, kMinus3dB);
+            } else if (hasCenter) {
+                add(getChannelIndex(outPositions, kFrontCenter), in, kMinus3dB);
+            }
+            in++;
+        }
+    } else {
+        // Without positions, the channels keep their index.
+        for (size_t i = 0; i < std::min(inCount, outCount); i++) add(i, i, 1.f);
+    }
+    return matrix;
+}
+
+}  // namespace
+
+// Polyphase windowed sinc resampler working on interleaved float frames. The ratio of the
+// rates is reduced to up / down, so there is one filter phase per output position between two
+// input frames and the phase never drifts. The history is kept planar so that the filter taps
+// of a channel are contiguous.
+class UsbPcmConverter::Resampler {
+  public:
+    static constexpr size_t kMaxPhases = 1024;
+
+    static bool getRatio(uint32_t fromRate, uint32_t toRate, size_t* up, size_t* down) {
+        if (fromRate == 0 || toRate == 0) return false;
+        const uint32_t divisor = std::gcd(fromRate, toRate);
+        *up = toRate / divisor;
+        *down = fromRate / divisor;
+        return *up <= kMaxPhases;
+    }
+
+    Resampler(size_t channelCount, uint32_t fromRate, uint32_t toRate)
+        : mChannelCount(channelCount) {
+        getRatio(fromRate, toRate, &mUp, &mDown);
+        // Widen the filter in input frames when decimating, so that its length in output
+        // frames stays the same.
+        const size_t factor = (mDown + mUp - 1) / mUp;
+        mTaps = std::min(kBaseTaps * factor, kMaxTaps);
+        designFilter();
+        mCapacity = mTaps;
+        mHistory.resize(mChannelCount * mCapacity);
+        reset();
+    }
+
+    size_t process(const float* in, size_t inFrames, float* out, size_t maxOutFrames) {
+        if (mFrames + inFrames > mCapacity) {
+            const size_t capacity = mFrames + inFrames;
+            std::vector<float> history(mChannelCount * capacity);
+            for (size_t ch = 0; ch < mChannelCount; ch++) {
+                std::copy_n(&mHistory[ch * mCapacity], mFrames, &history[ch * capacity]);
+            }
+            mHistory.swap(history);
+            mCapacity = capacity;
+        }
+        for (size_t ch = 0; ch < mChannelCount; ch++) {
+            float* row = &mHistory[ch * mCapacity + mFrames];
+            for (size_t i = 0; i < inFrames; i++) row[i] = in[i * mChannelCount + ch];
+        }
+        mFrames += inFrames;
+
+        size_t produced = 0;
+        while (produced < maxOutFrames && mPos + mTaps <= mFrames) {
+            const float* coefs = &mCoefs[mPhase * mTaps];
+            for (size_t ch = 0; ch < mChannelCount; ch++) {
+                out[produced * mChannelCount + ch] = dot(&mHistory[ch * mCapacity + mPos], coefs);
+            }
+            produced++;
+            mPhase += mDown;
+            mPos += mPhase / mUp;
+            mPhase %= mUp;
+        }
+
+        // Drop the frames which are not under the filter anymore.
+        if (const size_t consumed = std::min(mPos, mFrames); consumed > 0) {
+            for (size_t ch = 0; ch < mChannelCount; ch++) {
+                float* row = &mHistory[ch * mCapacity];
+                std::copy(row + consumed, row + mFrames, row);
+            }
+            mFrames -= consumed;
+            mPos -= consumed;
+        }
+        return produced;
+    }
+
+    size_t getInputFramesFor(size_t outFrames) const {
+        if (outFrames == 0) return 0;
+        const uint64_t last = mPos + (mPhase + static_cast<uint64_t>(outFrames - 1) * mDown) / mUp;
+        return last + mTaps > mFrames ? last + mTaps - mFrames : 0;
+    }
+
+    size_t getMaxOutputFrames(size_t inFrames) const {
+        const uint64_t total = mFrames + inFrames;
+        if (total < mPos + mTaps) return 0;
+        // The outputs j for which mPos + (mPhase + j * mDown) / mUp + mTaps <= total.
+        const uint64_t span = total - mTaps - mPos;
+        return ((span + 1) * mUp - 1 - mPhase) / mDown + 1;
+    }
+
+    void reset() {
+        // Start with half of the filter over silence, so that the first output is aligned
+        // with the first input frame.
+        mFrames = mTaps / 2 - 1;
+        mPos = 0;
+        mPhase = 0;
+        for (size_t ch = 0; ch < mChannelCount; ch++) {
+            std::fill_n(&mHistory[ch * mCapacity], mFrames, 0.f);
+        }
+    }
+
+  private:
+    static constexpr size_t kBaseTaps = 16;
+    static constexpr size_t kMaxTaps = 64;
+    // The cutoff relative to the lower of the two Nyquist frequencies.
+    static constexpr double kPassband = 0.92;
+    static constexpr double kKaiserBeta = 8.;
+
+    static double besselI0(double x) {
+        double sum = 1., term = 1.;
+        for (int k = 1; k < 32; k++) {
+            term *= (x / (2 * k)) * (x / (2 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    void designFilter() {
+        const double cutoff = kPassband * std::min(1., static_cast<double>(mUp) / mDown);
+        const double halfWidth = mTaps / 2.;
+        mCoefs.resize(mUp * mTaps);
+        for (size_t phase = 0; phase < mUp; phase++) {
+            float* coefs = &mCoefs[phase * mTaps];
+            double sum = 0.;
+            for (size_t k = 0; k < mTaps; k++) {
+                // The distance from the tap to the output position, in input frames.
+                const double u = static_cast<double>(phase) / mUp + (halfWidth - 1) - k;
+                const double x = M_PI * cutoff * u;
+                const double sinc = x == 0. ? 1. : std::sin(x) / x;
+                const double w = u / halfWidth;
+                const double window =
+                        besselI0(kKaiserBeta * std::sqrt(std::max(0., 1. - w * w))) /
+                        besselI0(kKaiserBeta);
+                coefs[k] = cutoff * sinc * window;
+                sum += coefs[k];
+            }
+            // Unity gain at DC for every phase.
+            for (size_t k = 0; k < mTaps; k++) coefs[k] /= sum;
+        }
+    }
+
+    float dot(const float* x, const float* coefs) const {
+        FloatVec acc = splat(0.f);
+        for (size_t k = 0; k < mTaps; k += kLanes) {
+            acc += loadFloat(x + k) * loadFloat(coefs + k);
+        }
+        return acc[0] + acc[1] + acc[2] + acc[3];
+    }
+
+    const size_t mChannelCount;
+    size_t mUp = 1;
+    size_t mDown = 1;
+    // A multiple of kLanes.
+    size_t mTaps = kBaseTaps;
+    // mUp phases of mTaps coefficients, the taps of a phase are in input frame order.
+    std::vector<float> mCoefs;
+    // Planar, mChannelCount rows of mCapacity frames.
+    std::vector<float> mHistory;
+    size_t mCapacity = 0;
+    // The frames in the history.
+    size_t mFrames = 0;
+    // The first frame under the filter for the next output, and the filter phase.
+    size_t mPos = 0;
+    size_t mPhase = 0;
+};
+
+// static
+size_t UsbPcmConverter::getSampleSize(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::I16:
+            return 2;
+        case SampleFormat::I24_PACKED:
+            return 3;
+        case SampleFormat::Q8_24:
+        case SampleFormat::I32:
+        case SampleFormat::FLOAT:
+            return 4;
+        case SampleFormat::INVALID:
+            break;
+    }
+    return 0;
+}
+
+// static
+bool UsbPcmConverter::isSampleRateConversionSupported(uint32_t fromRate, uint32_t toRate) {
+    size_t up, down;
+    return Resampler::getRatio(fromRate, toRate, &up, &down);
+}
+
+// static
+std::unique_ptr<UsbPcmConverter> UsbPcmConverter::create(const Config& from, const Config& to) {
+    for (const auto& config : {from, to}) {
+        if (getSampleSize(config.format) == 0 || config.channelCount == 0 ||
+            config.channelCount > kMaxChannelCount || config.sampleRate == 0) {
+            return nullptr;
+        }
+    }
+    if (!isSampleRateConversionSupported(from.sampleRate, to.sampleRate)) {
+        return nullptr;
+    }
+    std::unique_ptr<UsbPcmConverter> converter(new UsbPcmConverter(from, to));
+    return converter->init() ? std::move(converter) : nullptr;
+}
+
+UsbPcmConverter::UsbPcmConverter(const Config& from, const Config& to) : mFrom(from), mTo(to) {}
+
+UsbPcmConverter::~UsbPcmConverter() = default;
+
+bool UsbPcmConverter::init() {
+    const uint32_t fromPositions = getPositions(mFrom);
+    const uint32_t toPositions = getPositions(mTo);
+    if (mFrom.channelCount != mTo.channelCount ||
+        (fromPositions != 0 && toPositions != 0 && fromPositions != toPositions)) {
+        const std::vector<float> matrix = buildMixMatrix(mFrom, mTo);
+        for (size_t out = 0; out < mTo.channelCount; out++) {
+            for (size_t in = 0; in < mFrom.channelCount; in++) {
+                if (const float gain = matrix[out * mFrom.channelCount + in]; gain != 0.f) {
+                    mMixTerms.push_back({static_cast<uint32_t>(out), static_cast<uint32_t>(in),
+                                         gain});
+                }
+            }
+        }
+    }
+    if (mFrom.sampleRate != mTo.sampleRate) {
+        // Resample the side with fewer channels.
+        mResampleBeforeMix = mFrom.channelCount < mTo.channelCount;
+        mResampler = std::make_unique<Resampler>(
+                mResampleBeforeMix ? mFrom.channelCount : mTo.channelCount, mFrom.sampleRate,
+                mTo.sampleRate);
+    }
+    return true;
+}
+
+size_t UsbPcmConverter::convert(const void* in, size_t inFrames, void* out, size_t maxOutFrames) {
+    const float* samples = static_cast<const float*>(in);
+    if (mFrom.format != SampleFormat::FLOAT) {
+        ensureSize(&mDecoded, inFrames * mFrom.channelCount);
+        decode(mFrom.format, in, mDecoded.data(), inFrames * mFrom.channelCount);
+        samples = mDecoded.data();
+    }
+    size_t frames = inFrames;
+    if (!mResampler) {
+        frames = std::min(frames, maxOutFrames);
+        samples = mixChannels(samples, frames);
+    } else if (mResampleBeforeMix) {
+        ensureSize(&mResampled, maxOutFrames * mFrom.channelCount);
+        frames = mResampler->process(samples, frames, mResampled.data(), maxOutFrames);
+        samples = mixChannels(mResampled.data(), frames);
+    } else {
+        samples = mixChannels(samples, frames);
+        ensureSize(&mResampled, maxOutFrames * mTo.channelCount);
+        frames = mResampler->process(samples, frames, mResampled.data(), maxOutFrames);
+        samples = mResampled.data();
+    }
+    encode(mTo.format, samples, out, frames * mTo.channelCount);
+    return frames;
+}
+
+size_t UsbPcmConverter::getInputFramesFor(size_t outFrames) const {
+    return mResampler ? mResampler->getInputFramesFor(outFrames) : outFrames;
+}
+
+size_t UsbPcmConverter::getMaxOutputFrames(size_t inFrames) const {
+    return mResampler ? mResampler->getMaxOutputFrames(inFrames) : inFrames;
+}
+
+void UsbPcmConverter::reset() {
+    if (mResampler) mResampler->reset();
+}
+
+const float* UsbPcmConverter::mixChannels(const float* in, size_t frameCount) {
+    if (mMixTerms.empty()) return in;
+    const size_t inCount = mFrom.channelCount;
+    const size_t outCount = mTo.channelCount;
+    ensureSize(&mMixed, frameCount * outCount);
+    std::fill_n(mMixed.begin(), frameCount * outCount, 0.f);
+    float* out = mMixed.data();
+    for (size_t frame = 0; frame < frameCount; frame++, in += inCount, out += outCount) {
+        for (const auto& term : mMixTerms) out[term.out] += term.gain * in[term.in];
+    }
+    return mMixed.data();
+}
+
+}  // namespace aidl::android::hardware::audio::core::usb
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace aidl::android::hardware::audio::core::usb {
+
+// Converts interleaved PCM between the configuration of a stream and the configuration of the
+// USB device serving it: sample format, channel layout and sample rate.
+//
+// The stages run on float: the input is decoded, the channels are remapped or downmixed, the
+// sample rate is converted with a polyphase windowed sinc filter, then the output is encoded.
+// The sample kernels process four samples at a time with the compiler vector extensions.
+//
+// An instance is not thread safe, it is meant to be used from the stream worker thread.
+class UsbPcmConverter {
+  public:
+    enum class SampleFormat { INVALID, I16, I24_PACKED, Q8_24, I32, FLOAT };
+
+    struct Config {
+        SampleFormat format = SampleFormat::INVALID;
+        size_t channelCount = 0;
+        // The AudioChannelLayout::CHANNEL_* bits of a positional layout, 0 for index masks.
+        uint32_t channelPositionMask = 0;
+        uint32_t sampleRate = 0;
+    };
+
+    static size_t getSampleSize(SampleFormat format);
+    static size_t getFrameSize(const Config& config) {
+        return getSampleSize(config.format) * config.channelCount;
+    }
+    static bool isSampleRateConversionSupported(uint32_t fromRate, uint32_t toRate);
+    // Returns nullptr if the conversion is not supported.
+    static std::unique_ptr<UsbPcmConverter> create(const Config& from, const Config& to);
+
+    ~UsbPcmConverter();
+
+    // Converts all the input frames and returns the number of frames written to 'out', at most
+    // 'maxOutFrames'. When resampling, the input which can not be converted yet is kept for
+    // the next call.
+    size_t convert(const void* in, size_t inFrames, void* out, size_t maxOutFrames);
+    // The number of input frames needed to produce exactly 'outFrames' from the next call.
+    size_t getInputFramesFor(size_t outFrames) const;
+    // An upper bound of the number of frames produced from 'inFrames' input frames.
+    size_t getMaxOutputFrames(size_t inFrames) const;
+    // Drops the input kept for resampling, e.g. on standby.
+    void reset();
+
+    const Config& getFromConfig() const { return mFrom; }
+    const Config& getToConfig() const { return mTo; }
+
+  private:
+    class Resampler;
+    // The non zero coefficients of the channel mix matrix.
+    struct MixTerm {
+        uint32_t out;
+        uint32_t in;
+        float gain;
+    };
+
+    UsbPcmConverter(const Config& from, const Config& to);
+    bool init();
+    // Returns the interleaved float frames after the channel stage.
+    const float* mixChannels(const float* in, size_t frameCount);
+
+    const Config mFrom;
+    const Config mTo;
+    // Empty when the channels are passed through.
+    std::vector<MixTerm> mMixTerms;
+    bool mResampleBeforeMix = false;
+    std::unique_ptr<Resampler> mResampler;
+    std::vector<float> mDecoded;
+    std::vector<float> mMixed;
+    std::vector<float> mResampled;
+};
+
+}  // namespace aidl::android::hardware::audio::core::usb
@@ -216,17 +216,65 @@ RetCode VirtualizerSw::releaseContext() {
 
 // Processing method running in EffectWorker thread.
 IEffect::Status VirtualizerSw::effectProcessImpl(float* in, float* out, int samples) {
-    // TODO: get data buffer and process.
-    LOG(DEBUG) << __func__ << " in " << in << " out " << out << " samples " << samples;
-    for (int i = 0; i < samples; i++) {
-        *out++ = *in++;
-    }
-    return {STATUS_OK, samples, samples};
+    RETURN_VALUE_IF(!mContext, (IEffect::Status{EX_NULL_POINTER, 0, 0}), "nullContext");
+    return mContext->process(in, out, samples);
+}
+
+RetCode VirtualizerSwContext::setCommon(const Parameter::Common& common) {
+    std::lock_guard lg(mMutex);
+    mParamsUpdate.markChanged();
+    return EffectContext::setCommon(common);
 }
 
 RetCode VirtualizerSwContext::setVrStrength(int strength) {
+    std::lock_guard lg(mMutex);
     mStrength = strength;
+    mParamsUpdate.markChanged();
     return RetCode::SUCCESS;
 }
 
+IEffect::Status VirtualizerSwContext::process(float* in, float* out, int samples) {
+    mParamsUpdate.applyIfChanged(mMutex, [this]() NO_THREAD_SAFETY_ANALYSIS { updateFilter_l(); });
+
+    if (in != out) {
+        std::copy(in, in + samples, out);
+    }
+    // Nothing to widen for mono.
+    if (mChannelCount < 2) {
+        return {STATUS_OK, samples, samples};
+    }
+    const size_t stride = mChannelCount;
+    size_t frameCount = samples / mChannelCount;
+    float* midSide = mMidSide.data();
+    for (size_t offset = 0; offset < frameCount; offset += kBlockFrames) {
+        size_t blockFrames = std::min(kBlockFrames, frameCount - offset);
+        float* frames = out + offset * stride;
+        for (size_t i = 0; i < blockFrames; i++) {
+            float left = frames[i * stride];
+            float right = frames[i * stride + 1];
+            midSide[2 * i] = (left + right) * 0.5f;
+            midSide[2 * i + 1] = (left - right) * 0.5f;
+        }
+        mFilter.process(midSide, midSide, blockFrames);
+        for (size_t i = 0; i < blockFrames; i++) {
+            frames[i * stride] = midSide[2 * i] + midSide[2 * i + 1];
+            frames[i * stride + 1] = midSide[2 * i] - midSide[2 * i + 1];
+        }
+    }
+    return {STATUS_OK, samples, samples};
+}
+
+void VirtualizerSwContext::updateFilter_l() {
+    if (mFilter.getChannelCount() == 0) {
+        mFilter.configure(2 /* mid and side */, 1);
+        mMidSide.resize(kBlockFrames * 2);
+    }
+    mFilter.setCoefficients(0, 1 /* side */,
+                            BiquadCoefficients::highShelf(mCommon.input.base.sampleRate,
+                                                          kShelfFrequencyHz, M_SQRT1_2,
+                                                          kMaxSideBoostDb * mStrength / 1000.f));
+    mChannelCount = ::aidl::android::hardware::audio::common::getChannelCount(
+            mCommon.input.base.channelMask);
+}
+
 }  // namespace aidl::android::hardware::audio::effect
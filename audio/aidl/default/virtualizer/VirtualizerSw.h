@@ -17,10 +17,13 @@
 #pragma once
 
 #include <aidl/android/hardware/audio/effect/BnEffect.h>
+#include <android-base/thread_annotations.h>
 #include <fmq/AidlMessageQueue.h>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 
+#include "effect-impl/EffectDsp.h"
 #include "effect-impl/EffectImpl.h"
 
 namespace aidl::android::hardware::audio::effect {
@@ -30,9 +33,15 @@ class VirtualizerSwContext final : public EffectContext {
     VirtualizerSwContext(int statusDepth, const Parameter::Common& common)
         : EffectContext(statusDepth, common) {
         LOG(DEBUG) << __func__;
+        std::lock_guard lg(mMutex);
+        updateFilter_l();
     }
+    RetCode setCommon(const Parameter::Common& common) override;
     RetCode setVrStrength(int strength);
-    int getVrStrength() const { return mStrength; }
+    int getVrStrength() {
+        std::lock_guard lg(mMutex);
+        return mStrength;
+    }
     RetCode setForcedDevice(
             const ::aidl::android::media::audio::common::AudioDeviceDescription& device) {
         mForceDevice = device;
@@ -42,9 +51,28 @@ class VirtualizerSwContext final : public EffectContext {
         return mForceDevice;
     }
 
+    // Widen the front left/right pair of interleaved samples, called in the EffectWorker thread.
+    IEffect::Status process(float* in, float* out, int samples);
+
   private:
-    int mStrength = 0;
+    // Boost of the side (L - R) signal above the shelf frequency at full strength. Low
+    // frequencies are left alone so the bass stays centered.
+    static constexpr float kMaxSideBoostDb = 9.f;
+    static constexpr float kShelfFrequencyHz = 600.f;
+    // Frames of mid/side signal processed at a time.
+    static constexpr size_t kBlockFrames = 256;
+
+    std::mutex mMutex;
+    int mStrength GUARDED_BY(mMutex) = 0;
+    DspParamsUpdate mParamsUpdate;
     ::aidl::android::media::audio::common::AudioDeviceDescription mForceDevice;
+
+    size_t mChannelCount = 0;
+    // Filters the interleaved mid (channel 0) and side (channel 1) signals.
+    BiquadFilter mFilter;
+    std::vector<float> mMidSide;
+
+    void updateFilter_l() REQUIRES(mMutex);
 };
 
 class VirtualizerSw final : public EffectImpl {
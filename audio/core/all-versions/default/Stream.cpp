@@ -25,6 +25,7 @@
 
 #include <HidlUtils.h>
 #include <android/log.h>
+#include <cutils/properties.h>
 #include <hardware/audio.h>
 #include <hardware/audio_effect.h>
 #include <media/AudioContainers.h>
@@ -63,6 +64,14 @@ Result Stream::analyzeStatus(const char* funcName, int status,
     return util::analyzeStatus("stream", funcName, status, ignoreErrors);
 }
 
+// static
+bool Stream::isZeroCopyDataPathEnabled() {
+    // Opt-in, as the legacy HAL then accesses the memory shared with the client, and a wrapped
+    // around transfer is split into two calls, which some HALs may not expect.
+    static const bool enabled = property_get_bool("ro.vendor.audio.hal.zero_copy_data_path", false);
+    return enabled;
+}
+
 char* Stream::halGetParameters(const char* keys) {
     return mStream->get_parameters(mStream, keys);
 }
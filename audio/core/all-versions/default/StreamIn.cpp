@@ -49,7 +49,8 @@ class ReadThread : public Thread {
    public:
     // ReadThread's lifespan never exceeds StreamIn's lifespan.
     ReadThread(std::atomic<bool>* stop, audio_stream_in_t* stream, StreamIn::CommandMQ* commandMQ,
-               StreamIn::DataMQ* dataMQ, StreamIn::StatusMQ* statusMQ, EventFlag* efGroup)
+               StreamIn::DataMQ* dataMQ, StreamIn::StatusMQ* statusMQ, EventFlag* efGroup,
+               bool zeroCopy)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mStream(stream),
@@ -57,8 +58,10 @@ class ReadThread : public Thread {
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
           mEfGroup(efGroup),
+          mZeroCopy(zeroCopy),
           mBuffer(nullptr) {}
     bool init() {
+        if (mZeroCopy) return true;
         mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
         return mBuffer != nullptr;
     }
@@ -71,6 +74,7 @@ class ReadThread : public Thread {
     StreamIn::DataMQ* mDataMQ;
     StreamIn::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
+    const bool mZeroCopy;
     std::unique_ptr<uint8_t[]> mBuffer;
     IStreamIn::ReadParameters mParameters;
     IStreamIn::ReadStatus mStatus;
@@ -79,6 +83,7 @@ class ReadThread : public Thread {
 
     void doGetCapturePosition();
     void doRead();
+    void doReadZeroCopy(size_t requestedToRead);
 };
 
 void ReadThread::doRead() {
@@ -91,6 +96,10 @@ void ReadThread::doRead() {
             (int32_t)requestedToRead, (int32_t)availableToWrite);
         requestedToRead = availableToWrite;
     }
+    if (mZeroCopy) {
+        doReadZeroCopy(requestedToRead);
+        return;
+    }
     ssize_t readResult = mStream->read(mStream, &mBuffer[0], requestedToRead);
     mStatus.retval = Result::OK;
     if (readResult >= 0) {
@@ -103,6 +112,36 @@ void ReadThread::doRead() {
     }
 }
 
+// Reads into the data MQ memory, with a second read call when the space wraps around.
+void ReadThread::doReadZeroCopy(size_t requestedToRead) {
+    mStatus.retval = Result::OK;
+    mStatus.reply.read = 0;
+    StreamIn::DataMQ::MemTransaction tx;
+    if (!mDataMQ->beginWrite(requestedToRead, &tx)) {
+        ALOGW("data message queue write failed");
+        return;
+    }
+    size_t totalRead = 0;
+    for (const auto* region : {&tx.getFirstRegion(), &tx.getSecondRegion()}) {
+        if (region->getLength() == 0) break;
+        ssize_t readResult = mStream->read(mStream, region->getAddress(), region->getLength());
+        if (readResult < 0) {
+            // Report the error only if nothing has been read yet.
+            if (totalRead == 0) {
+                mStatus.retval = Stream::analyzeStatus("read", readResult);
+            }
+            break;
+        }
+        totalRead += readResult;
+        if (static_cast<size_t>(readResult) < region->getLength()) break;
+    }
+    if (totalRead > 0 && !mDataMQ->commitWrite(totalRead)) {
+        ALOGW("data message queue write failed");
+        return;
+    }
+    mStatus.reply.read = totalRead;
+}
+
 void ReadThread::doGetCapturePosition() {
     mStatus.retval = StreamIn::getCapturePositionImpl(
         mStream, &mStatus.reply.capturePosition.frames, &mStatus.reply.capturePosition.time);
@@ -418,7 +457,8 @@ Return<void> StreamIn::prepareForReading(uint32_t frameSize, uint32_t framesCoun
     // Create and launch the thread.
     auto tempReadThread =
             sp<ReadThread>::make(&mStopReadThread, mStream, tempCommandMQ.get(), tempDataMQ.get(),
-                                 tempStatusMQ.get(), tempElfGroup.get());
+                                 tempStatusMQ.get(), tempElfGroup.get(),
+                                 Stream::isZeroCopyDataPathEnabled());
     if (!tempReadThread->init()) {
         ALOGW("failed to start reader thread: %s", strerror(-status));
         sendError(Result::INVALID_ARGUMENTS);
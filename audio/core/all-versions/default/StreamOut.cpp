@@ -52,7 +52,7 @@ class WriteThread : public Thread {
     // WriteThread's lifespan never exceeds StreamOut's lifespan.
     WriteThread(std::atomic<bool>* stop, audio_stream_out_t* stream,
                 StreamOut::CommandMQ* commandMQ, StreamOut::DataMQ* dataMQ,
-                StreamOut::StatusMQ* statusMQ, EventFlag* efGroup)
+                StreamOut::StatusMQ* statusMQ, EventFlag* efGroup, bool zeroCopy)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mStream(stream),
@@ -60,8 +60,10 @@ class WriteThread : public Thread {
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
           mEfGroup(efGroup),
+          mZeroCopy(zeroCopy),
           mBuffer(nullptr) {}
     bool init() {
+        if (mZeroCopy) return true;
         mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
         return mBuffer != nullptr;
     }
@@ -74,6 +76,7 @@ class WriteThread : public Thread {
     StreamOut::DataMQ* mDataMQ;
     StreamOut::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
+    const bool mZeroCopy;
     std::unique_ptr<uint8_t[]> mBuffer;
     IStreamOut::WriteStatus mStatus;
 
@@ -82,9 +85,14 @@ class WriteThread : public Thread {
     void doGetLatency();
     void doGetPresentationPosition();
     void doWrite();
+    void doWriteZeroCopy();
 };
 
 void WriteThread::doWrite() {
+    if (mZeroCopy) {
+        doWriteZeroCopy();
+        return;
+    }
     const size_t availToRead = mDataMQ->availableToRead();
     mStatus.retval = Result::OK;
     mStatus.reply.written = 0;
@@ -98,6 +106,32 @@ void WriteThread::doWrite() {
     }
 }
 
+// Writes from the data MQ memory, with a second write call when the data wraps around.
+// As with the copy, all the available data is consumed even if the HAL writes less.
+void WriteThread::doWriteZeroCopy() {
+    const size_t availToRead = mDataMQ->availableToRead();
+    mStatus.retval = Result::OK;
+    mStatus.reply.written = 0;
+    StreamOut::DataMQ::MemTransaction tx;
+    if (!mDataMQ->beginRead(availToRead, &tx)) {
+        return;
+    }
+    for (const auto* region : {&tx.getFirstRegion(), &tx.getSecondRegion()}) {
+        if (region->getLength() == 0) break;
+        ssize_t writeResult = mStream->write(mStream, region->getAddress(), region->getLength());
+        if (writeResult < 0) {
+            // Report the error only if nothing has been written yet.
+            if (mStatus.reply.written == 0) {
+                mStatus.retval = Stream::analyzeStatus("write", writeResult);
+            }
+            break;
+        }
+        mStatus.reply.written += writeResult;
+        if (static_cast<size_t>(writeResult) < region->getLength()) break;
+    }
+    mDataMQ->commitRead(availToRead);
+}
+
 void WriteThread::doGetPresentationPosition() {
     mStatus.retval =
         StreamOut::getPresentationPositionImpl(mStream, &mStatus.reply.presentationPosition.frames,
@@ -404,7 +438,8 @@ Return<void> StreamOut::prepareForWriting(uint32_t frameSize, uint32_t framesCou
     // Create and launch the thread.
     auto tempWriteThread =
             sp<WriteThread>::make(&mStopWriteThread, mStream, tempCommandMQ.get(), tempDataMQ.get(),
-                                  tempStatusMQ.get(), tempElfGroup.get());
+                                  tempStatusMQ.get(), tempElfGroup.get(),
+                                  Stream::isZeroCopyDataPathEnabled());
     if (!tempWriteThread->init()) {
         ALOGW("failed to start writer thread: %s", strerror(-status));
         sendError(Result::INVALID_ARGUMENTS);
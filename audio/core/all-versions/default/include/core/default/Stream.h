@@ -120,6 +120,9 @@ struct Stream : public IStream, public ParametersUtil {
     static Result analyzeStatus(const char* funcName, int status);
     static Result analyzeStatus(const char* funcName, int status,
                                 const std::vector<int>& ignoreErrors);
+    // Whether the I/O threads pass the data MQ memory directly to the legacy HAL
+    // instead of going through an intermediate buffer.
+    static bool isZeroCopyDataPathEnabled();
 
    private:
      const bool mIsInput;
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_aidl_impl_default_config_JsonConfigLoader_include_BinaryConfigCache_H_
+#define android_hardware_automotive_vehicle_aidl_impl_default_config_JsonConfigLoader_include_BinaryConfigCache_H_
+
+#include <ConfigDeclaration.h>
+
+#include <android-base/result.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+// A compact binary image of ConfigDeclarations, used to cache the parsed JSON config files.
+//
+// The image only contains fixed-size fields and length-prefixed arrays in native byte order, so it
+// could be loaded by copying the fields out of a memory-mapped file, without parsing JSON or
+// resolving any symbolic constants. The image is only meant to be read on the device it was
+// written on.
+//
+// Each image carries a stamp of the JSON content it was generated from, so a stale image would be
+// rejected after the JSON config is updated.
+
+// Returns the stamp for the JSON config content, it also covers the image format version and
+// whether test properties are enabled.
+uint64_t getBinaryConfigStamp(const std::string& jsonContent);
+
+// Serializes the config declarations into a binary image.
+std::string serializeBinaryConfig(
+        const std::unordered_map<int32_t, ConfigDeclaration>& configsByPropId, uint64_t stamp);
+
+// Deserializes a binary image. Returns error if the image is malformed or its stamp does not
+// match 'stamp'.
+android::base::Result<std::unordered_map<int32_t, ConfigDeclaration>> deserializeBinaryConfig(
+        const uint8_t* data, size_t size, uint64_t stamp);
+
+// Memory-maps the binary image at 'cachePath' and deserializes it.
+android::base::Result<std::unordered_map<int32_t, ConfigDeclaration>> loadBinaryConfig(
+        const std::string& cachePath, uint64_t stamp);
+
+// Writes the binary image to 'cachePath'. The image is written to a temporary file first and then
+// renamed, so readers never see a partially written image.
+android::base::Result<void> writeBinaryConfig(
+        const std::string& cachePath,
+        const std::unordered_map<int32_t, ConfigDeclaration>& configsByPropId, uint64_t stamp);
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_aidl_impl_default_config_JsonConfigLoader_include_BinaryConfigCache_H_
@@ -164,6 +164,13 @@ class JsonConfigLoader final {
     android::base::Result<std::unordered_map<int32_t, ConfigDeclaration>> loadPropConfig(
             const std::string& configPath);
 
+    // Loads a JSON config file like loadPropConfig, but tries the binary image at cachePath
+    // first, see BinaryConfigCache.h. If the image does not exist or is stale, parses the JSON
+    // file and tries to write a new image to cachePath for the next time. Failing to write the
+    // image is not an error.
+    android::base::Result<std::unordered_map<int32_t, ConfigDeclaration>>
+    loadPropConfigWithCache(const std::string& configPath, const std::string& cachePath);
+
   private:
     std::unique_ptr<jsonconfigloader_impl::JsonConfigParser> mParser;
 };
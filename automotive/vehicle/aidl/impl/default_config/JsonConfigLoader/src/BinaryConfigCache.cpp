@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <BinaryConfigCache.h>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::vehicle::RawPropValues;
+using ::aidl::android::hardware::automotive::vehicle::VehicleAreaConfig;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropConfig;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyAccess;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyChangeMode;
+using ::android::base::ErrnoError;
+using ::android::base::Error;
+using ::android::base::Result;
+using ::android::base::unique_fd;
+
+// "VHBC" in native byte order.
+constexpr uint32_t MAGIC = 0x43424856;
+// Must be increased whenever the image layout changes.
+constexpr uint32_t FORMAT_VERSION = 1;
+
+#ifdef ENABLE_VEHICLE_HAL_TEST_PROPERTIES
+constexpr uint64_t TEST_PROPERTIES_ENABLED = 1;
+#else
+constexpr uint64_t TEST_PROPERTIES_ENABLED = 0;
+#endif  // ENABLE_VEHICLE_HAL_TEST_PROPERTIES
+
+class BinaryWriter final {
+  public:
+    template <class T>
+    void write(T value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        mBuffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <class T>
+    void writeArray(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write(static_cast<uint32_t>(values.size()));
+        mBuffer.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    void writeString(const std::string& value) {
+        write(static_cast<uint32_t>(value.size()));
+        mBuffer.append(value);
+    }
+
+    void writeRawPropValues(const RawPropValues& values) {
+        writeArray(values.int32Values);
+        writeArray(values.floatValues);
+        writeArray(values.int64Values);
+        writeArray(values.byteValues);
+        writeString(values.stringValue);
+    }
+
+    void writeAreaConfig(const VehicleAreaConfig& areaConfig) {
+        write(areaConfig.areaId);
+        write(areaConfig.minInt32Value);
+        write(areaConfig.maxInt32Value);
+        write(areaConfig.minInt64Value);
+        write(areaConfig.maxInt64Value);
+        write(areaConfig.minFloatValue);
+        write(areaConfig.maxFloatValue);
+        write(static_cast<uint8_t>(areaConfig.supportedEnumValues.has_value()));
+        if (areaConfig.supportedEnumValues.has_value()) {
+            writeArray(*areaConfig.supportedEnumValues);
+        }
+    }
+
+    void writeConfigDeclaration(const ConfigDeclaration& configDecl) {
+        const VehiclePropConfig& config = configDecl.config;
+        write(config.prop);
+        write(static_cast<int32_t>(config.access));
+        write(static_cast<int32_t>(config.changeMode));
+        write(config.minSampleRate);
+        write(config.maxSampleRate);
+        writeArray(config.configArray);
+        writeString(config.configString);
+        write(static_cast<uint32_t>(config.areaConfigs.size()));
+        for (const auto& areaConfig : config.areaConfigs) {
+            writeAreaConfig(areaConfig);
+        }
+        writeRawPropValues(configDecl.initialValue);
+        write(static_cast<uint32_t>(configDecl.initialAreaValues.size()));
+        for (const auto& [areaId, values] : configDecl.initialAreaValues) {
+            write(areaId);
+            writeRawPropValues(values);
+        }
+    }
+
+    std::string release() { return std::move(mBuffer); }
+
+  private:
+    std::string mBuffer;
+};
+
+// Reads fields out of a binary image. All the reads are bounds-checked, once a read fails, all
+// the following reads fail.
+class BinaryReader final {
+  public:
+    BinaryReader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+    template <class T>
+    bool read(T* value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (!mOk || mSize - mOffset < sizeof(T)) {
+            mOk = false;
+            return false;
+        }
+        memcpy(value, mData + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return true;
+    }
+
+    template <class T>
+    bool readArray(std::vector<T>* values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint32_t count = 0;
+        if (!read(&count)) {
+            return false;
+        }
+        // Check the size before allocating, so a corrupted count could not cause a huge
+        // allocation.
+        if ((mSize - mOffset) / sizeof(T) < count) {
+            mOk = false;
+            return false;
+        }
+        values->resize(count);
+        memcpy(values->data(), mData + mOffset, count * sizeof(T));
+        mOffset += count * sizeof(T);
+        return true;
+    }
+
+    bool readString(std::string* value) {
+        uint32_t size = 0;
+        if (!read(&size)) {
+            return false;
+        }
+        if (mSize - mOffset < size) {
+            mOk = false;
+            return false;
+        }
+        value->assign(reinterpret_cast<const char*>(mData + mOffset), size);
+        mOffset += size;
+        return true;
+    }
+
+    bool readRawPropValues(RawPropValues* values) {
+        return readArray(&values->int32Values) && readArray(&values->floatValues) &&
+               readArray(&values->int64Values) && readArray(&values->byteValues) &&
+               readString(&values->stringValue);
+    }
+
+    bool readAreaConfig(VehicleAreaConfig* areaConfig) {
+        uint8_t hasSupportedEnumValues = 0;
+        if (!(read(&areaConfig->areaId) && read(&areaConfig->minInt32Value) &&
+              read(&areaConfig->maxInt32Value) && read(&areaConfig->minInt64Value) &&
+              read(&areaConfig->maxInt64Value) && read(&areaConfig->minFloatValue) &&
+              read(&areaConfig->maxFloatValue) && read(&hasSupportedEnumValues))) {
+            return false;
+        }
+        if (hasSupportedEnumValues) {
+            return readArray(&areaConfig->supportedEnumValues.emplace());
+        }
+        return true;
+    }
+
+    bool readConfigDeclaration(ConfigDeclaration* configDecl) {
+        VehiclePropConfig& config = configDecl->config;
+        int32_t access = 0;
+        int32_t changeMode = 0;
+        uint32_t areaConfigCount = 0;
+        if (!(read(&config.prop) && read(&access) && read(&changeMode) &&
+              read(&config.minSampleRate) && read(&config.maxSampleRate) &&
+              readArray(&config.configArray) && readString(&config.configString) &&
+              read(&areaConfigCount))) {
+            return false;
+        }
+        config.access = static_cast<VehiclePropertyAccess>(access);
+        config.changeMode = static_cast<VehiclePropertyChangeMode>(changeMode);
+        for (uint32_t i = 0; i < areaConfigCount; i++) {
+            if (!readAreaConfig(&config.areaConfigs.emplace_back())) {
+                return false;
+            }
+        }
+
+        uint32_t areaValueCount = 0;
+        if (!(readRawPropValues(&configDecl->initialValue) && read(&areaValueCount))) {
+            return false;
+        }
+        for (uint32_t i = 0; i < areaValueCount; i++) {
+            int32_t areaId = 0;
+            if (!(read(&areaId) && readRawPropValues(&configDecl->initialAreaValues[areaId]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool isAtEnd() const { return mOk && mOffset == mSize; }
+
+  private:
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mOffset = 0;
+    bool mOk = true;
+};
+
+}  // namespace
+
+uint64_t getBinaryConfigStamp(const std::string& jsonContent) {
+    // 64-bit FNV-1a.
+    uint64_t hash = 0xcbf29ce484222325;
+    auto mix = [&hash](uint8_t byte) {
+        hash ^= byte;
+        hash *= 0x100000001b3;
+    };
+    for (char c : jsonContent) {
+        mix(static_cast<uint8_t>(c));
+    }
+    mix(static_cast<uint8_t>(FORMAT_VERSION));
+    mix(static_cast<uint8_t>(TEST_PROPERTIES_ENABLED));
+    return hash;
+}
+
+std::string serializeBinaryConfig(
+        const std::unordered_map<int32_t, ConfigDeclaration>& configsByPropId, uint64_t stamp) {
+    BinaryWriter writer;
+    writer.write(MAGIC);
+    writer.write(FORMAT_VERSION);
+    writer.write(stamp);
+    writer.write(static_cast<uint32_t>(configsByPropId.size()));
+    for (const auto& [_, configDecl] : configsByPropId) {
+        writer.writeConfigDeclaration(configDecl);
+    }
+    return writer.release();
+}
+
+Result<std::unordered_map<int32_t, ConfigDeclaration>> deserializeBinaryConfig(const uint8_t* data,
+                                                                               size_t size,
+                                                                               uint64_t stamp) {
+    BinaryReader reader(data, size);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t imageStamp = 0;
+    uint32_t count = 0;
+    if (!(reader.read(&magic) && reader.read(&version) && reader.read(&imageStamp) &&
+          reader.read(&count))) {
+        return Error() << "binary config image is too short";
+    }
+    if (magic != MAGIC || version != FORMAT_VERSION) {
+        return Error() << "unsupported binary config image, version: " << version;
+    }
+    if (imageStamp != stamp) {
+        return Error() << "binary config image is stale";
+    }
+
+    std::unordered_map<int32_t, ConfigDeclaration> configsByPropId;
+    configsByPropId.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        ConfigDeclaration configDecl;
+        if (!reader.readConfigDeclaration(&configDecl)) {
+            return Error() << "binary config image is truncated";
+        }
+        int32_t propId = configDecl.config.prop;
+        configsByPropId[propId] = std::move(configDecl);
+    }
+    if (!reader.isAtEnd()) {
+        return Error() << "binary config image has trailing data";
+    }
+    return configsByPropId;
+}
+
+Result<std::unordered_map<int32_t, ConfigDeclaration>> loadBinaryConfig(
+        const std::string& cachePath, uint64_t stamp) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(cachePath.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (!fd.ok()) {
+        return ErrnoError() << "couldn't open " << cachePath;
+    }
+    struct stat st;
+    if (fstat(fd.get(), &st) != 0) {
+        return ErrnoError() << "couldn't stat " << cachePath;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        return Error() << cachePath << " is empty";
+    }
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    if (data == MAP_FAILED) {
+        return ErrnoError() << "couldn't mmap " << cachePath;
+    }
+    auto result = deserializeBinaryConfig(static_cast<const uint8_t*>(data), size, stamp);
+    munmap(data, size);
+    return result;
+}
+
+Result<void> writeBinaryConfig(
+        const std::string& cachePath,
+        const std::unordered_map<int32_t, ConfigDeclaration>& configsByPropId, uint64_t stamp) {
+    std::string tmpPath = cachePath + ".tmp";
+    if (!android::base::WriteStringToFile(serializeBinaryConfig(configsByPropId, stamp),
+                                          tmpPath)) {
+        return ErrnoError() << "couldn't write " << tmpPath;
+    }
+    if (rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+        Result<void> error = ErrnoError() << "couldn't rename " << tmpPath << " to " << cachePath;
+        unlink(tmpPath.c_str());
+        return error;
+    }
+    return {};
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
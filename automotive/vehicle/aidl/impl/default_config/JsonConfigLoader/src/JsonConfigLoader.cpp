@@ -24,8 +24,11 @@
 #include <TestPropertyUtils.h>
 #endif  // ENABLE_VEHICLE_HAL_TEST_PROPERTIES
 
+#include <BinaryConfigCache.h>
+#include <android-base/file.h>
 #include <android-base/strings.h>
 #include <fstream>
+#include <sstream>
 
 namespace android {
 namespace hardware {
@@ -625,6 +628,28 @@ JsonConfigLoader::loadPropConfig(const std::string& configPath) {
     return loadPropConfig(ifs);
 }
 
+android::base::Result<std::unordered_map<int32_t, ConfigDeclaration>>
+JsonConfigLoader::loadPropConfigWithCache(const std::string& configPath,
+                                          const std::string& cachePath) {
+    std::string content;
+    if (!android::base::ReadFileToString(configPath, &content)) {
+        return android::base::Error() << "couldn't open " << configPath << " for parsing.";
+    }
+
+    uint64_t stamp = getBinaryConfigStamp(content);
+    if (auto result = loadBinaryConfig(cachePath, stamp); result.ok()) {
+        return result;
+    }
+
+    std::istringstream iss(content);
+    auto result = loadPropConfig(iss);
+    if (result.ok()) {
+        // The cache is only an optimization, failing to write it is not an error.
+        (void)writeBinaryConfig(cachePath, result.value(), stamp);
+    }
+    return result;
+}
+
 }  // namespace vehicle
 }  // namespace automotive
 }  // namespace hardware
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <BinaryConfigCache.h>
+#include <JsonConfigLoader.h>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+constexpr char TEST_CONFIG[] = R"(
+{
+    "properties": [
+        {
+            "property": "VehicleProperty::INFO_FUEL_TYPE",
+            "defaultValue": {
+                "int32Values": [1, 2]
+            },
+            "configArray": [1, 2, 3],
+            "configString": "test"
+        },
+        {
+            "property": "VehicleProperty::HVAC_FAN_SPEED",
+            "areas": [{
+                "areaId": 1,
+                "minInt32Value": 1,
+                "maxInt32Value": 7,
+                "defaultValue": {
+                    "int32Values": [3]
+                }
+            }, {
+                "areaId": 2,
+                "minInt32Value": 1,
+                "maxInt32Value": 7
+            }]
+        },
+        {
+            "property": "VehicleProperty::PERF_VEHICLE_SPEED",
+            "minSampleRate": 1.0,
+            "maxSampleRate": 10.0,
+            "defaultValue": {
+                "floatValues": [0.5]
+            }
+        }
+    ]
+}
+)";
+
+}  // namespace
+
+class BinaryConfigCacheUnitTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        std::istringstream iss(TEST_CONFIG);
+        auto result = mLoader.loadPropConfig(iss);
+        ASSERT_TRUE(result.ok()) << result.error().message();
+        mConfigs = result.value();
+        mStamp = getBinaryConfigStamp(TEST_CONFIG);
+    }
+
+    JsonConfigLoader mLoader;
+    std::unordered_map<int32_t, ConfigDeclaration> mConfigs;
+    uint64_t mStamp;
+};
+
+TEST_F(BinaryConfigCacheUnitTest, testSerializeDeserialize) {
+    std::string image = serializeBinaryConfig(mConfigs, mStamp);
+
+    auto result = deserializeBinaryConfig(reinterpret_cast<const uint8_t*>(image.data()),
+                                          image.size(), mStamp);
+
+    ASSERT_TRUE(result.ok()) << result.error().message();
+    ASSERT_EQ(result.value(), mConfigs);
+}
+
+TEST_F(BinaryConfigCacheUnitTest, testDeserializeStaleImage) {
+    std::string image = serializeBinaryConfig(mConfigs, mStamp);
+
+    auto result = deserializeBinaryConfig(reinterpret_cast<const uint8_t*>(image.data()),
+                                          image.size(), getBinaryConfigStamp("{}"));
+
+    ASSERT_FALSE(result.ok()) << "image for another config must be rejected";
+}
+
+TEST_F(BinaryConfigCacheUnitTest, testDeserializeTruncatedImage) {
+    std::string image = serializeBinaryConfig(mConfigs, mStamp);
+
+    for (size_t size = 0; size < image.size(); size++) {
+        auto result = deserializeBinaryConfig(reinterpret_cast<const uint8_t*>(image.data()),
+                                              size, mStamp);
+
+        ASSERT_FALSE(result.ok()) << "truncated image with size: " << size << " must be rejected";
+    }
+}
+
+TEST_F(BinaryConfigCacheUnitTest, testLoadPropConfigWithCache) {
+    TemporaryDir tempDir;
+    std::string configPath = std::string(tempDir.path) + "/config.json";
+    std::string cachePath = std::string(tempDir.path) + "/config.bin";
+    ASSERT_TRUE(android::base::WriteStringToFile(TEST_CONFIG, configPath));
+
+    auto result = mLoader.loadPropConfigWithCache(configPath, cachePath);
+
+    ASSERT_TRUE(result.ok()) << result.error().message();
+    ASSERT_EQ(result.value(), mConfigs);
+
+    auto cacheResult = loadBinaryConfig(cachePath, mStamp);
+
+    ASSERT_TRUE(cacheResult.ok()) << "cache must be written after parsing JSON, error: "
+                                  << cacheResult.error().message();
+    ASSERT_EQ(cacheResult.value(), mConfigs);
+
+    // Loading again should use the cache and return the same configs.
+    result = mLoader.loadPropConfigWithCache(configPath, cachePath);
+
+    ASSERT_TRUE(result.ok()) << result.error().message();
+    ASSERT_EQ(result.value(), mConfigs);
+}
+
+TEST_F(BinaryConfigCacheUnitTest, testLoadPropConfigWithStaleCache) {
+    TemporaryDir tempDir;
+    std::string configPath = std::string(tempDir.path) + "/config.json";
+    std::string cachePath = std::string(tempDir.path) + "/config.bin";
+    ASSERT_TRUE(android::base::WriteStringToFile(R"({"properties": []})", configPath));
+    ASSERT_TRUE(mLoader.loadPropConfigWithCache(configPath, cachePath).ok());
+
+    // Update the config file, the cache must not be used any more.
+    ASSERT_TRUE(android::base::WriteStringToFile(TEST_CONFIG, configPath));
+    auto result = mLoader.loadPropConfigWithCache(configPath, cachePath);
+
+    ASSERT_TRUE(result.ok()) << result.error().message();
+    ASSERT_EQ(result.value(), mConfigs);
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_aidl_impl_fake_impl_GeneratorHub_include_TraceFakeValueGenerator_H_
+#define android_hardware_automotive_vehicle_aidl_impl_fake_impl_GeneratorHub_include_TraceFakeValueGenerator_H_
+
+#include "FakeValueGenerator.h"
+
+#include <android-base/result.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace fake {
+
+// A generator that replays a recorded trace file.
+//
+// The trace is a compact binary file: a header followed by one variable-length record per event,
+// each carrying the event timestamp and value in native byte order. The file is memory-mapped and
+// events are decoded one at a time, so arbitrarily long recordings could be replayed without
+// loading them into memory.
+class TraceFakeValueGenerator : public FakeValueGenerator {
+  public:
+    // Statistics for a replay, safe to be read from other threads while the replay is running.
+    struct ReplayStats {
+        // Number of events delivered to the generator hub's callback.
+        std::atomic<int64_t> deliveredEventCount{0};
+        // elapsedRealtimeNano() when the first event was generated.
+        std::atomic<int64_t> startTimeNanos{0};
+        // elapsedRealtimeNano() when the last event was delivered.
+        std::atomic<int64_t> lastDeliveryTimeNanos{0};
+        // Whether all the events have been replayed.
+        std::atomic<bool> finished{false};
+
+        // Returns a human readable throughput report.
+        std::string toString() const;
+    };
+
+    // Create a new trace generator replaying the trace file at {@code path}.
+    //
+    // {@code speed} is the replay speed relative to the recording, e.g. 1 replays in real time and
+    // 10 replays 10 times faster. If speed is 0, events are generated as fast as they could be
+    // consumed, which is useful for load testing.
+    //
+    // All the events in the trace would be generated for number of {@code iteration}. If
+    // iteration is less than 0, it would iterate indefinitely.
+    explicit TraceFakeValueGenerator(const std::string& path, float speed, int32_t iteration);
+
+    ~TraceFakeValueGenerator();
+
+    std::optional<aidl::android::hardware::automotive::vehicle::VehiclePropValue> nextEvent()
+            override;
+
+    // Whether there are events left to replay for this generator.
+    bool hasNext();
+
+    std::shared_ptr<const ReplayStats> getStats() const { return mStats; }
+
+    // Writes the events as a trace file that could be replayed by this generator.
+    static android::base::Result<void> writeTrace(
+            const std::string& path,
+            const std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&
+                    events);
+
+  private:
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+    // Offset of the first record in the file.
+    size_t mFirstEventOffset = 0;
+    // Offset of the next record to decode.
+    size_t mOffset = 0;
+    uint64_t mEventCount = 0;
+    uint64_t mEventIndex = 0;
+    float mSpeed = 1;
+    int32_t mNumOfIterations = 0;
+    int64_t mFirstEventTimestamp = 0;
+    // The time the first event of the current iteration is generated for.
+    int64_t mIterationStartTime = 0;
+    int64_t mLastEventTimestamp = 0;
+    // Whether an event has been returned and not delivered yet. The generator hub asks for the
+    // next event right after delivering the previous one.
+    bool mHasUndeliveredEvent = false;
+    std::shared_ptr<ReplayStats> mStats = std::make_shared<ReplayStats>();
+
+    void init(const std::string& path);
+    bool readEvent(aidl::android::hardware::automotive::vehicle::VehiclePropValue* event);
+    void onEventDelivered();
+};
+
+}  // namespace fake
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_aidl_impl_fake_impl_GeneratorHub_include_TraceFakeValueGenerator_H_
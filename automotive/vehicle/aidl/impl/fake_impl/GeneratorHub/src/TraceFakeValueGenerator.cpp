@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TraceFakeValueGenerator"
+
+#include "TraceFakeValueGenerator.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <utils/Log.h>
+#include <utils/SystemClock.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <type_traits>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace fake {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyStatus;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
+using ::android::base::Error;
+using ::android::base::Result;
+using ::android::base::StringPrintf;
+using ::android::base::unique_fd;
+
+// "VHTR" in native byte order.
+constexpr uint32_t TRACE_MAGIC = 0x52544856;
+// Must be increased whenever the record layout changes.
+constexpr uint32_t TRACE_VERSION = 1;
+// Header: magic, version, event count.
+constexpr size_t TRACE_HEADER_SIZE = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+// The delay before starting another iteration, same as JsonFakeValueGenerator.
+constexpr int64_t ITERATION_DELAY_NANOS = 1'000'000;
+
+template <class T>
+void append(std::string* buffer, T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    buffer->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <class T>
+void appendArray(std::string* buffer, const T* values, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    buffer->append(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+// Reads fields from a memory-mapped trace, all the reads are bounds-checked.
+class TraceReader final {
+  public:
+    TraceReader(const uint8_t* data, size_t size, size_t offset)
+        : mData(data), mSize(size), mOffset(offset) {}
+
+    template <class T>
+    bool read(T* value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (mSize - mOffset < sizeof(T)) {
+            return false;
+        }
+        memcpy(value, mData + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return true;
+    }
+
+    template <class T>
+    bool readArray(std::vector<T>* values, uint32_t count) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if ((mSize - mOffset) / sizeof(T) < count) {
+            return false;
+        }
+        values->resize(count);
+        memcpy(values->data(), mData + mOffset, count * sizeof(T));
+        mOffset += count * sizeof(T);
+        return true;
+    }
+
+    bool readString(std::string* value, uint32_t size) {
+        if (mSize - mOffset < size) {
+            return false;
+        }
+        value->assign(reinterpret_cast<const char*>(mData + mOffset), size);
+        mOffset += size;
+        return true;
+    }
+
+    size_t offset() const { return mOffset; }
+
+  private:
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mOffset;
+};
+
+}  // namespace
+
+std::string TraceFakeValueGenerator::ReplayStats::toString() const {
+    int64_t count = deliveredEventCount.load();
+    int64_t elapsedNanos = lastDeliveryTimeNanos.load() - startTimeNanos.load();
+    double eventsPerSecond = elapsedNanos > 0 ? count * 1e9 / elapsedNanos : 0;
+    return StringPrintf("%s, delivered %" PRId64 " events in %.3f ms, %.1f events/s",
+                        finished.load() ? "finished" : "running", count, elapsedNanos / 1e6,
+                        eventsPerSecond);
+}
+
+TraceFakeValueGenerator::TraceFakeValueGenerator(const std::string& path, float speed,
+                                                 int32_t iteration)
+    : mSpeed(speed < 0 ? 0 : speed) {
+    init(path);
+    mNumOfIterations = mEventCount == 0 ? 0 : iteration;
+}
+
+TraceFakeValueGenerator::~TraceFakeValueGenerator() {
+    if (mData != nullptr) {
+        munmap(const_cast<uint8_t*>(mData), mSize);
+    }
+}
+
+void TraceFakeValueGenerator::init(const std::string& path) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (!fd.ok()) {
+        ALOGE("%s: couldn't open %s, errno: %d", __func__, path.c_str(), errno);
+        return;
+    }
+    struct stat st;
+    if (fstat(fd.get(), &st) != 0 || static_cast<size_t>(st.st_size) < TRACE_HEADER_SIZE) {
+        ALOGE("%s: %s is not a valid trace file", __func__, path.c_str());
+        return;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    if (data == MAP_FAILED) {
+        ALOGE("%s: couldn't mmap %s, errno: %d", __func__, path.c_str(), errno);
+        return;
+    }
+    // Records are always read in order.
+    madvise(data, size, MADV_SEQUENTIAL);
+    mData = static_cast<const uint8_t*>(data);
+    mSize = size;
+
+    TraceReader reader(mData, mSize, 0);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t eventCount = 0;
+    reader.read(&magic);
+    reader.read(&version);
+    reader.read(&eventCount);
+    if (magic != TRACE_MAGIC || version != TRACE_VERSION) {
+        ALOGE("%s: %s is not a supported trace file, version: %" PRIu32, __func__, path.c_str(),
+              version);
+        return;
+    }
+    mFirstEventOffset = reader.offset();
+    mOffset = mFirstEventOffset;
+    if (eventCount != 0 && !reader.read(&mFirstEventTimestamp)) {
+        ALOGE("%s: trace file %s is truncated", __func__, path.c_str());
+        return;
+    }
+    mEventCount = eventCount;
+}
+
+bool TraceFakeValueGenerator::readEvent(VehiclePropValue* event) {
+    TraceReader reader(mData, mSize, mOffset);
+    int32_t status = 0;
+    uint32_t int32Count = 0;
+    uint32_t floatCount = 0;
+    uint32_t int64Count = 0;
+    uint32_t byteCount = 0;
+    uint32_t stringSize = 0;
+    auto& value = event->value;
+    if (!(reader.read(&event->timestamp) && reader.read(&event->prop) &&
+          reader.read(&event->areaId) && reader.read(&status) && reader.read(&int32Count) &&
+          reader.read(&floatCount) && reader.read(&int64Count) && reader.read(&byteCount) &&
+          reader.read(&stringSize) && reader.readArray(&value.int32Values, int32Count) &&
+          reader.readArray(&value.floatValues, floatCount) &&
+          reader.readArray(&value.int64Values, int64Count) &&
+          reader.readArray(&value.byteValues, byteCount) &&
+          reader.readString(&value.stringValue, stringSize))) {
+        return false;
+    }
+    event->status = static_cast<VehiclePropertyStatus>(status);
+    mOffset = reader.offset();
+    return true;
+}
+
+void TraceFakeValueGenerator::onEventDelivered() {
+    if (!mHasUndeliveredEvent) {
+        return;
+    }
+    mHasUndeliveredEvent = false;
+    mStats->deliveredEventCount.fetch_add(1);
+    mStats->lastDeliveryTimeNanos.store(elapsedRealtimeNano());
+}
+
+std::optional<VehiclePropValue> TraceFakeValueGenerator::nextEvent() {
+    onEventDelivered();
+    if (mNumOfIterations == 0 || mEventCount == 0) {
+        mStats->finished.store(true);
+        return std::nullopt;
+    }
+
+    VehiclePropValue event;
+    if (!readEvent(&event)) {
+        ALOGE("%s: trace file is truncated at event %" PRIu64 ", stop replaying", __func__,
+              mEventIndex);
+        mNumOfIterations = 0;
+        mStats->finished.store(true);
+        return std::nullopt;
+    }
+
+    int64_t now = elapsedRealtimeNano();
+    if (mLastEventTimestamp == 0) {
+        mStats->startTimeNanos.store(now);
+        mIterationStartTime = now;
+    } else if (mEventIndex == 0) {
+        // We are starting another iteration, immediately send the next event after 1ms.
+        mIterationStartTime = mLastEventTimestamp + ITERATION_DELAY_NANOS;
+    }
+    int64_t eventTime;
+    if (mSpeed == 0) {
+        eventTime = now;
+    } else {
+        // Scale the offset from the first event instead of the delay from the previous event, so
+        // rounding errors do not accumulate over long traces.
+        eventTime = mIterationStartTime +
+                    static_cast<int64_t>((event.timestamp - mFirstEventTimestamp) /
+                                         static_cast<double>(mSpeed));
+    }
+    // Events must never go back in time, otherwise the property store would drop them.
+    mLastEventTimestamp = std::max(eventTime, mLastEventTimestamp);
+    event.timestamp = mLastEventTimestamp;
+
+    mEventIndex++;
+    if (mEventIndex == mEventCount) {
+        mEventIndex = 0;
+        mOffset = mFirstEventOffset;
+        if (mNumOfIterations > 0) {
+            mNumOfIterations--;
+        }
+    }
+    mHasUndeliveredEvent = true;
+    return event;
+}
+
+bool TraceFakeValueGenerator::hasNext() {
+    return mNumOfIterations != 0 && mEventCount > 0;
+}
+
+Result<void> TraceFakeValueGenerator::writeTrace(const std::string& path,
+                                                 const std::vector<VehiclePropValue>& events) {
+    std::string buffer;
+    append(&buffer, TRACE_MAGIC);
+    append(&buffer, TRACE_VERSION);
+    append(&buffer, static_cast<uint64_t>(events.size()));
+    for (const auto& event : events) {
+        const auto& value = event.value;
+        append(&buffer, event.timestamp);
+        append(&buffer, event.prop);
+        append(&buffer, event.areaId);
+        append(&buffer, static_cast<int32_t>(event.status));
+        append(&buffer, static_cast<uint32_t>(value.int32Values.size()));
+        append(&buffer, static_cast<uint32_t>(value.floatValues.size()));
+        append(&buffer, static_cast<uint32_t>(value.int64Values.size()));
+        append(&buffer, static_cast<uint32_t>(value.byteValues.size()));
+        append(&buffer, static_cast<uint32_t>(value.stringValue.size()));
+        appendArray(&buffer, value.int32Values.data(), value.int32Values.size());
+        appendArray(&buffer, value.floatValues.data(), value.floatValues.size());
+        appendArray(&buffer, value.int64Values.data(), value.int64Values.size());
+        appendArray(&buffer, value.byteValues.data(), value.byteValues.size());
+        buffer.append(value.stringValue);
+    }
+    if (!android::base::WriteStringToFile(buffer, path)) {
+        return Error() << "couldn't write trace file: " << path;
+    }
+    return {};
+}
+
+}  // namespace fake
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
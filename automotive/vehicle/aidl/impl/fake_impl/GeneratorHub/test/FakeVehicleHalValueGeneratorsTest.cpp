@@ -17,6 +17,7 @@
 #include <GeneratorHub.h>
 #include <JsonFakeValueGenerator.h>
 #include <LinearFakeValueGenerator.h>
+#include <TraceFakeValueGenerator.h>
 #include <VehicleUtils.h>
 #include <android-base/file.h>
 #include <android-base/thread_annotations.h>
@@ -476,6 +477,140 @@ TEST_F(FakeVehicleHalValueGeneratorsTest, testJsonFakeValueGeneratorDifferentTyp
     EXPECT_EQ(events, expectedValues);
 }
 
+TEST_F(FakeVehicleHalValueGeneratorsTest, testTraceFakeValueGenerator) {
+    TemporaryDir tempDir;
+    std::string tracePath = std::string(tempDir.path) + "/trace.bin";
+    std::vector<VehiclePropValue> recordedValues = {
+            VehiclePropValue{
+                    .timestamp = 1'000'000'000,
+                    .areaId = 0,
+                    .value.int32Values = {8},
+                    .prop = 289408000,
+            },
+            VehiclePropValue{
+                    .timestamp = 1'010'000'000,
+                    .areaId = 1,
+                    .value =
+                            {
+                                    .floatValues = {1.5},
+                                    .int64Values = {3},
+                                    .byteValues = {0x1, 0x2},
+                                    .stringValue = "test",
+                            },
+                    .prop = 289408001,
+            },
+            VehiclePropValue{
+                    .timestamp = 1'030'000'000,
+                    .areaId = 0,
+                    .value.int32Values = {16},
+                    .prop = 289408000,
+            },
+    };
+    auto result = TraceFakeValueGenerator::writeTrace(tracePath, recordedValues);
+    ASSERT_TRUE(result.ok()) << result.error().message();
+
+    int64_t currentTime = elapsedRealtimeNano();
+    // Replay twice at 10 times the recorded speed.
+    auto generator = std::make_unique<TraceFakeValueGenerator>(tracePath, 10, 2);
+    auto stats = generator->getStats();
+    getHub()->registerGenerator(0, std::move(generator));
+
+    std::vector<VehiclePropValue> expectedValues = recordedValues;
+    for (size_t i = 0; i < recordedValues.size(); i++) {
+        expectedValues.push_back(recordedValues[i]);
+    }
+
+    waitForEvents(expectedValues.size());
+    auto events = getEvents();
+
+    int64_t lastEventTime = currentTime;
+    for (size_t i = 0; i < events.size(); i++) {
+        EXPECT_GT(events[i].timestamp, lastEventTime);
+        if (i % recordedValues.size() != 0) {
+            // The recorded interval is 10ms or 20ms, which must be scaled down by 10.
+            EXPECT_EQ(events[i].timestamp - lastEventTime,
+                      (recordedValues[i % recordedValues.size()].timestamp -
+                       recordedValues[i % recordedValues.size() - 1].timestamp) /
+                              10);
+        }
+        lastEventTime = events[i].timestamp;
+        events[i].timestamp = 0;
+        expectedValues[i].timestamp = 0;
+    }
+
+    EXPECT_EQ(events, expectedValues);
+
+    // Wait until the hub asks for the event after the last one, so the stats are final.
+    for (int i = 0; i < 100 && !stats->finished.load(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(stats->finished.load());
+    EXPECT_EQ(stats->deliveredEventCount.load(), static_cast<int64_t>(expectedValues.size()));
+}
+
+TEST_F(FakeVehicleHalValueGeneratorsTest, testTraceFakeValueGeneratorMaxSpeed) {
+    TemporaryDir tempDir;
+    std::string tracePath = std::string(tempDir.path) + "/trace.bin";
+    std::vector<VehiclePropValue> recordedValues;
+    for (int32_t i = 0; i < 100; i++) {
+        recordedValues.push_back(VehiclePropValue{
+                // One hour between events, only replaying at max speed could finish in time.
+                .timestamp = i * 3600'000'000'000,
+                .areaId = 0,
+                .value.int32Values = {i},
+                .prop = 289408000,
+        });
+    }
+    auto result = TraceFakeValueGenerator::writeTrace(tracePath, recordedValues);
+    ASSERT_TRUE(result.ok()) << result.error().message();
+
+    getHub()->registerGenerator(0, std::make_unique<TraceFakeValueGenerator>(tracePath, 0, 1));
+
+    waitForEvents(recordedValues.size());
+    auto events = getEvents();
+
+    ASSERT_EQ(events.size(), recordedValues.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        EXPECT_EQ(events[i].value.int32Values, recordedValues[i].value.int32Values);
+    }
+}
+
+TEST_F(FakeVehicleHalValueGeneratorsTest, testTraceFakeValueGeneratorTruncatedFile) {
+    TemporaryDir tempDir;
+    std::string tracePath = std::string(tempDir.path) + "/trace.bin";
+    std::vector<VehiclePropValue> recordedValues = {
+            VehiclePropValue{
+                    .timestamp = 1,
+                    .value.int32Values = {8},
+                    .prop = 289408000,
+            },
+    };
+    ASSERT_TRUE(TraceFakeValueGenerator::writeTrace(tracePath, recordedValues).ok());
+    std::string content;
+    ASSERT_TRUE(android::base::ReadFileToString(tracePath, &content));
+    ASSERT_TRUE(
+            android::base::WriteStringToFile(content.substr(0, content.size() - 1), tracePath));
+
+    TraceFakeValueGenerator generator(tracePath, 1, 1);
+
+    ASSERT_FALSE(generator.nextEvent().has_value());
+    ASSERT_FALSE(generator.hasNext());
+}
+
+TEST_F(FakeVehicleHalValueGeneratorsTest, testTraceFakeValueGeneratorInvalidFile) {
+    TraceFakeValueGenerator generator(getTestFilePath("prop.json"), 1, 1);
+
+    ASSERT_FALSE(generator.hasNext());
+    ASSERT_FALSE(generator.nextEvent().has_value());
+}
+
+TEST_F(FakeVehicleHalValueGeneratorsTest, testTraceFakeValueGeneratorNonExistingFile) {
+    TraceFakeValueGenerator generator("non_existing_file", 1, 1);
+
+    ASSERT_FALSE(generator.hasNext());
+    ASSERT_FALSE(generator.nextEvent().has_value());
+}
+
 }  // namespace fake
 }  // namespace vehicle
 }  // namespace automotive
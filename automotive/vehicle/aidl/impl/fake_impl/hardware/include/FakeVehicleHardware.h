@@ -25,6 +25,7 @@
 #include <IVehicleHardware.h>
 #include <JsonConfigLoader.h>
 #include <RecurrentTimer.h>
+#include <TraceFakeValueGenerator.h>
 #include <VehicleHalTypes.h>
 #include <VehiclePropertyStore.h>
 #include <aidl/android/hardware/automotive/vehicle/VehicleHwKeyInputAction.h>
@@ -128,6 +129,8 @@ class FakeVehicleHardware : public IVehicleHardware {
         FakeVehicleHardware* mHardware;
         std::thread mThread;
         ConcurrentQueue<RequestWithCallback<CallbackType, RequestType>> mRequests;
+        // Only accessed from mThread. Reused across handleRequestsOnce to avoid allocations.
+        std::vector<RequestWithCallback<CallbackType, RequestType>> mRequestsToHandle;
 
         void handleRequestsOnce();
     };
@@ -148,6 +151,9 @@ class FakeVehicleHardware : public IVehicleHardware {
             mRecurrentActions GUARDED_BY(mLock);
     std::unordered_map<PropIdAreaId, VehiclePropValuePool::RecyclableType, PropIdAreaIdHash>
             mSavedProps GUARDED_BY(mLock);
+    // Replay statistics for trace generators started by --genfakedata --starttrace, by generator ID.
+    std::unordered_map<int32_t, std::shared_ptr<const TraceFakeValueGenerator::ReplayStats>>
+            mTraceReplayStats GUARDED_BY(mLock);
     // PendingRequestHandler is thread-safe.
     mutable PendingRequestHandler<GetValuesCallback,
                                   aidl::android::hardware::automotive::vehicle::GetValueRequest>
@@ -25,6 +25,7 @@
 #include <LinearFakeValueGenerator.h>
 #include <PropertyUtils.h>
 #include <TestPropertyUtils.h>
+#include <TraceFakeValueGenerator.h>
 #include <VehicleHalTypes.h>
 #include <VehicleUtils.h>
 
@@ -39,6 +40,7 @@
 #include <dirent.h>
 #include <inttypes.h>
 #include <sys/types.h>
+#include <algorithm>
 #include <fstream>
 #include <regex>
 #include <unordered_set>
@@ -102,6 +104,9 @@ constexpr char OVERRIDE_CONFIG_DIR[] = "/vendor/etc/automotive/vhaloverride/";
 // If OVERRIDE_PROPERTY is set, we will use the configuration files from OVERRIDE_CONFIG_DIR to
 // overwrite the default configs.
 constexpr char OVERRIDE_PROPERTY[] = "persist.vendor.vhal_init_value_override";
+// If CONFIG_CACHE_DIR_PROPERTY is set to a writable directory, the parsed configuration files are
+// cached there as binary images, so that later boots could skip parsing JSON.
+constexpr char CONFIG_CACHE_DIR_PROPERTY[] = "ro.vendor.fake_vhal.config_cache_dir";
 constexpr char POWER_STATE_REQ_CONFIG_PROPERTY[] = "ro.vendor.fake_vhal.ap_power_state_req.config";
 // The value to be returned if VENDOR_PROPERTY_ID is set as the property
 constexpr int VENDOR_ERROR_CODE = 0x00ab0005;
@@ -190,6 +195,16 @@ const std::unordered_map<int32_t, std::vector<int32_t>> mAdasEnabledPropToAdasPr
                 },
         },
 };
+
+// Returns the path to the binary config cache for the config file. The whole config file path is
+// encoded into the cache file name, so that config files with the same name in different
+// directories do not share one cache file.
+std::string getConfigCachePath(const std::string& cacheDir, const std::string& configPath) {
+    std::string fileName = configPath;
+    std::replace(fileName.begin(), fileName.end(), '/', '_');
+    return cacheDir + "/" + fileName + ".bin";
+}
+
 }  // namespace
 
 void FakeVehicleHardware::storePropInitialValue(const ConfigDeclaration& config) {
@@ -1033,6 +1048,20 @@ provided, it would iterate indefinitely.
 
 --genfakedata --stopjson [generatorID(string)]: Stop a JSON generator.
 
+--genfakedata --starttrace [traceFilePath] [speed(float)] [repetition(int32)]:
+Start a generator that replays a binary trace file recorded from a vehicle.
+speed(float): The replay speed relative to the recording, e.g. 1 for real time, 10 for 10 times
+faster. 0 means replaying as fast as the events could be consumed.
+repetition(int32, optional): how many iterations the events would be generated. If it is not
+provided, the trace would be replayed once.
+
+--genfakedata --stoptrace [generatorID(int32)]: Stop a trace generator.
+
+--genfakedata --tracestats [generatorID(int32)]: Show the throughput of a trace generator.
+
+--genfakedata --jsontotrace [jsonFilePath] [traceFilePath]: Convert a JSON file in the format
+used by --startjson to a binary trace file.
+
 --genfakedata --keypress [keyCode(int32)] [display[int32]]: Generate key press.
 
 --genfakedata --keyinputv2 [area(int32)] [display(int32)] [keyCode[int32]] [action[int32]]
@@ -1172,6 +1201,86 @@ std::string FakeVehicleHardware::genFakeDataCommand(const std::vector<std::strin
         } else {
             return StringPrintf("No JSON event generator found for ID: %s", options[2].c_str());
         }
+    } else if (command == "--starttrace") {
+        // --genfakedata --starttrace [traceFilePath] [speed(float)] [repetition(int32)]
+        if (options.size() != 4 && options.size() != 5) {
+            return "incorrect argument count, need 4 or 5 arguments for --genfakedata "
+                   "--starttrace\n";
+        }
+        float speed;
+        if (!android::base::ParseFloat(options[3], &speed) || speed < 0) {
+            return parseErrMsg("speed", options[3], "non-negative float");
+        }
+        int32_t repetition = 1;
+        if (options.size() == 5) {
+            if (!android::base::ParseInt(options[4], &repetition)) {
+                return parseErrMsg("repetition", options[4], "int");
+            }
+        }
+        const std::string& fileName = options[2];
+        auto generator = std::make_unique<TraceFakeValueGenerator>(fileName, speed, repetition);
+        if (!generator->hasNext()) {
+            return "invalid trace file, no events";
+        }
+        int32_t cookie = std::hash<std::string>()(fileName);
+        {
+            std::scoped_lock<std::mutex> lockGuard(mLock);
+            // Statistics of finished replays are kept until the next replay starts.
+            std::erase_if(mTraceReplayStats,
+                          [](const auto& entry) { return entry.second->finished.load(); });
+            mTraceReplayStats[cookie] = generator->getStats();
+        }
+        mGeneratorHub->registerGenerator(cookie, std::move(generator));
+        return StringPrintf("Trace event generator started successfully, ID: %" PRId32, cookie);
+    } else if (command == "--stoptrace") {
+        // --genfakedata --stoptrace [generatorID(int32)]
+        if (options.size() != 3) {
+            return "incorrect argument count, need 3 arguments for --genfakedata --stoptrace\n";
+        }
+        int32_t cookie;
+        if (!android::base::ParseInt(options[2], &cookie)) {
+            return parseErrMsg("cookie", options[2], "int");
+        }
+        bool hadStats;
+        {
+            std::scoped_lock<std::mutex> lockGuard(mLock);
+            hadStats = mTraceReplayStats.erase(cookie) > 0;
+        }
+        // The generator is already unregistered if the replay has finished.
+        if (mGeneratorHub->unregisterGenerator(cookie) || hadStats) {
+            return "Trace event generator stopped successfully";
+        }
+        return StringPrintf("No trace event generator found for ID: %s", options[2].c_str());
+    } else if (command == "--tracestats") {
+        // --genfakedata --tracestats [generatorID(int32)]
+        if (options.size() != 3) {
+            return "incorrect argument count, need 3 arguments for --genfakedata --tracestats\n";
+        }
+        int32_t cookie;
+        if (!android::base::ParseInt(options[2], &cookie)) {
+            return parseErrMsg("cookie", options[2], "int");
+        }
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        auto it = mTraceReplayStats.find(cookie);
+        if (it == mTraceReplayStats.end()) {
+            return StringPrintf("No trace event generator found for ID: %s", options[2].c_str());
+        }
+        return "Trace event generator " + options[2] + ": " + it->second->toString();
+    } else if (command == "--jsontotrace") {
+        // --genfakedata --jsontotrace [jsonFilePath] [traceFilePath]
+        if (options.size() != 4) {
+            return "incorrect argument count, need 4 arguments for --genfakedata --jsontotrace\n";
+        }
+        JsonFakeValueGenerator jsonGenerator(options[2]);
+        if (!jsonGenerator.hasNext()) {
+            return "invalid JSON file, no events";
+        }
+        auto result = TraceFakeValueGenerator::writeTrace(options[3], jsonGenerator.getAllEvents());
+        if (!result.ok()) {
+            return "failed to write trace file: " + result.error().message();
+        }
+        return StringPrintf("Converted %zu events to trace file: %s",
+                            jsonGenerator.getAllEvents().size(), options[3].c_str());
     } else if (command == "--keypress") {
         int32_t keyCode;
         int32_t display;
@@ -1868,6 +1977,7 @@ void FakeVehicleHardware::loadPropConfigsFromDir(
         const std::string& dirPath,
         std::unordered_map<int32_t, ConfigDeclaration>* configsByPropId) {
     ALOGI("loading properties from %s", dirPath.c_str());
+    std::string cacheDir = android::base::GetProperty(CONFIG_CACHE_DIR_PROPERTY, "");
     if (auto dir = opendir(dirPath.c_str()); dir != NULL) {
         std::regex regJson(".*[.]json", std::regex::icase);
         while (auto f = readdir(dir)) {
@@ -1876,7 +1986,10 @@ void FakeVehicleHardware::loadPropConfigsFromDir(
             }
             std::string filePath = dirPath + "/" + std::string(f->d_name);
             ALOGI("loading properties from %s", filePath.c_str());
-            auto result = mLoader.loadPropConfig(filePath);
+            auto result = cacheDir.empty()
+                                  ? mLoader.loadPropConfig(filePath)
+                                  : mLoader.loadPropConfigWithCache(
+                                            filePath, getConfigCachePath(cacheDir, filePath));
             if (!result.ok()) {
                 ALOGE("failed to load config file: %s, error: %s", filePath.c_str(),
                       result.error().message().c_str());
@@ -1968,7 +2081,8 @@ void FakeVehicleHardware::PendingRequestHandler<FakeVehicleHardware::GetValuesCa
                                                 GetValueRequest>::handleRequestsOnce() {
     std::unordered_map<std::shared_ptr<const GetValuesCallback>, std::vector<GetValueResult>>
             callbackToResults;
-    for (const auto& rwc : mRequests.flush()) {
+    mRequests.flush(&mRequestsToHandle);
+    for (const auto& rwc : mRequestsToHandle) {
         ATRACE_BEGIN("FakeVehicleHardware:handleGetValueRequest");
         auto result = mHardware->handleGetValueRequest(rwc.request);
         ATRACE_END();
@@ -1986,7 +2100,8 @@ void FakeVehicleHardware::PendingRequestHandler<FakeVehicleHardware::SetValuesCa
                                                 SetValueRequest>::handleRequestsOnce() {
     std::unordered_map<std::shared_ptr<const SetValuesCallback>, std::vector<SetValueResult>>
             callbackToResults;
-    for (const auto& rwc : mRequests.flush()) {
+    mRequests.flush(&mRequestsToHandle);
+    for (const auto& rwc : mRequestsToHandle) {
         ATRACE_BEGIN("FakeVehicleHardware:handleSetValueRequest");
         auto result = mHardware->handleSetValueRequest(rwc.request);
         ATRACE_END();
@@ -2530,6 +2530,27 @@ std::vector<OptionsTestCase> GenInvalidOptions() {
             {"genfakedata_stopjson_no_args",
              {"--genfakedata", "--stopjson"},
              "incorrect argument count"},
+            {"genfakedata_starttrace_no_args",
+             {"--genfakedata", "--starttrace"},
+             "incorrect argument count"},
+            {"genfakedata_starttrace_invalid_speed",
+             {"--genfakedata", "--starttrace", "file", "-1"},
+             "failed to parse speed as non-negative float: \"-1\""},
+            {"genfakedata_starttrace_invalid_repetition",
+             {"--genfakedata", "--starttrace", "file", "1", "0.1"},
+             "failed to parse repetition as int: \"0.1\""},
+            {"genfakedata_starttrace_invalid_trace_file",
+             {"--genfakedata", "--starttrace", "file", "1"},
+             "invalid trace file"},
+            {"genfakedata_stoptrace_no_args",
+             {"--genfakedata", "--stoptrace"},
+             "incorrect argument count"},
+            {"genfakedata_tracestats_unknown_id",
+             {"--genfakedata", "--tracestats", "1"},
+             "No trace event generator found for ID: 1"},
+            {"genfakedata_jsontotrace_no_args",
+             {"--genfakedata", "--jsontotrace"},
+             "incorrect argument count"},
             {"genfakedata_keypress_no_args",
              {"--genfakedata", "--keypress"},
              "incorrect argument count"},
@@ -2685,6 +2706,43 @@ TEST_F(FakeVehicleHardwareTest, testDebugGenFakeDataJson) {
     EXPECT_EQ(10, events[7].value.int32Values[0]);
 }
 
+TEST_F(FakeVehicleHardwareTest, testDebugGenFakeDataTrace) {
+    TemporaryDir tempDir;
+    std::string tracePath = std::string(tempDir.path) + "/prop.trace";
+    DumpResult result = getHardware()->dump(
+            {"--genfakedata", "--jsontotrace", getTestFilePath("prop.json"), tracePath});
+
+    ASSERT_THAT(result.buffer, HasSubstr("Converted 4 events"));
+
+    result = getHardware()->dump({"--genfakedata", "--starttrace", tracePath, "0", "2"});
+
+    ASSERT_FALSE(result.callerShouldDumpState);
+    ASSERT_THAT(result.buffer, HasSubstr("successfully"));
+
+    ASSERT_TRUE(waitForChangedProperties(/*count=*/8, milliseconds(1000)))
+            << "not enough events generated for trace data generator";
+
+    auto events = getChangedProperties();
+    ASSERT_EQ(8u, events.size());
+    EXPECT_EQ(1u, events[0].value.int32Values.size());
+    EXPECT_EQ(8, events[0].value.int32Values[0]);
+    EXPECT_EQ(1u, events[7].value.int32Values.size());
+    EXPECT_EQ(10, events[7].value.int32Values[0]);
+
+    std::string id = std::to_string(static_cast<int32_t>(std::hash<std::string>()(tracePath)));
+    result = getHardware()->dump({"--genfakedata", "--tracestats", id});
+
+    ASSERT_THAT(result.buffer, HasSubstr("delivered"));
+
+    result = getHardware()->dump({"--genfakedata", "--stoptrace", id});
+
+    ASSERT_THAT(result.buffer, HasSubstr("stopped successfully"));
+
+    result = getHardware()->dump({"--genfakedata", "--tracestats", id});
+
+    ASSERT_THAT(result.buffer, HasSubstr("No trace event generator found"));
+}
+
 TEST_F(FakeVehicleHardwareTest, testDebugGenFakeDataJsonByContent) {
     std::vector<std::string> options = {
             "--genfakedata", "--startjson", "--content",
@@ -19,25 +19,43 @@
 #include "ProtoMessageConverter.h"
 
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <grpc++/grpc++.h>
 
+#include <chrono>
 #include <cstdlib>
 #include <mutex>
 #include <shared_mutex>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace android::hardware::automotive::vehicle::virtualization {
 
+// If true, getValues/setValues requests are sent over the ProcessValueRequests stream.
+static constexpr char kValueRequestStreamProperty[] = "ro.vendor.vhal.grpc.value_request_stream";
+static constexpr auto kValueRequestStreamRetryInterval = std::chrono::milliseconds(100);
+
 static std::shared_ptr<::grpc::ChannelCredentials> getChannelCredentials() {
     // TODO(chenhaosjtuacm): get secured credentials here
     return ::grpc::InsecureChannelCredentials();
 }
 
 GRPCVehicleHardware::GRPCVehicleHardware(std::string service_addr)
+    : GRPCVehicleHardware(std::move(service_addr),
+                          android::base::GetBoolProperty(kValueRequestStreamProperty, false)) {}
+
+GRPCVehicleHardware::GRPCVehicleHardware(std::string service_addr, bool useValueRequestStream)
     : mServiceAddr(std::move(service_addr)),
       mGrpcChannel(::grpc::CreateChannel(mServiceAddr, getChannelCredentials())),
       mGrpcStub(proto::VehicleServer::NewStub(mGrpcChannel)),
-      mValuePollingThread([this] { ValuePollingLoop(); }) {}
+      mValuePollingThread([this] { ValuePollingLoop(); }) {
+    if (useValueRequestStream) {
+        mValueRequestThread = std::thread([this] { ValueRequestLoop(); });
+    } else {
+        mValueRequestStreamUnsupported = true;
+    }
+}
 
 GRPCVehicleHardware::~GRPCVehicleHardware() {
     {
@@ -46,6 +64,9 @@ GRPCVehicleHardware::~GRPCVehicleHardware() {
     }
     mShutdownCV.notify_all();
     mValuePollingThread.join();
+    if (mValueRequestThread.joinable()) {
+        mValueRequestThread.join();
+    }
 }
 
 std::vector<aidlvhal::VehiclePropConfig> GRPCVehicleHardware::getAllPropertyConfigs() const {
@@ -69,6 +90,9 @@ std::vector<aidlvhal::VehiclePropConfig> GRPCVehicleHardware::getAllPropertyConf
 aidlvhal::StatusCode GRPCVehicleHardware::setValues(
         std::shared_ptr<const SetValuesCallback> callback,
         const std::vector<aidlvhal::SetValueRequest>& requests) {
+    if (queueSetValueRequests(callback, requests)) {
+        return aidlvhal::StatusCode::OK;
+    }
     ::grpc::ClientContext context;
     proto::VehiclePropValueRequests protoRequests;
     proto::SetValueResults protoResults;
@@ -102,6 +126,9 @@ aidlvhal::StatusCode GRPCVehicleHardware::setValues(
 aidlvhal::StatusCode GRPCVehicleHardware::getValues(
         std::shared_ptr<const GetValuesCallback> callback,
         const std::vector<aidlvhal::GetValueRequest>& requests) const {
+    if (queueGetValueRequests(callback, requests)) {
+        return aidlvhal::StatusCode::OK;
+    }
     ::grpc::ClientContext context;
     proto::VehiclePropValueRequests protoRequests;
     proto::GetValueResults protoResults;
@@ -202,6 +229,237 @@ bool GRPCVehicleHardware::waitForConnected(std::chrono::milliseconds waitTime) {
             gpr_now(GPR_CLOCK_MONOTONIC), gpr_time_from_millis(waitTime.count(), GPR_TIMESPAN)));
 }
 
+bool GRPCVehicleHardware::waitForValueRequestStream(std::chrono::milliseconds waitTime) {
+    std::unique_lock lck(mValueRequestMutex);
+    mValueRequestCV.wait_for(lck, waitTime, [this] {
+        return mValueRequestStream != nullptr || mValueRequestStreamUnsupported;
+    });
+    return mValueRequestStream != nullptr;
+}
+
+bool GRPCVehicleHardware::queueGetValueRequests(
+        std::shared_ptr<const GetValuesCallback> callback,
+        const std::vector<aidlvhal::GetValueRequest>& requests) const {
+    std::unique_lock lck(mValueRequestMutex);
+    if (mValueRequestStream == nullptr) {
+        return false;
+    }
+    auto* protoRequests = mQueuedValueRequests.mutable_get_value_requests();
+    for (const auto& request : requests) {
+        int64_t streamRequestId = mNextStreamRequestId++;
+        auto& pendingRequest = mPendingValueRequests[streamRequestId];
+        pendingRequest.requestId = request.requestId;
+        pendingRequest.getValuesCallback = callback;
+        auto& protoRequest = *protoRequests->add_requests();
+        protoRequest.set_request_id(streamRequestId);
+        proto_msg_converter::aidlToProto(request.prop, protoRequest.mutable_value());
+    }
+    flushValueRequestsLocked(lck);
+    return true;
+}
+
+bool GRPCVehicleHardware::queueSetValueRequests(
+        std::shared_ptr<const SetValuesCallback> callback,
+        const std::vector<aidlvhal::SetValueRequest>& requests) {
+    std::unique_lock lck(mValueRequestMutex);
+    if (mValueRequestStream == nullptr) {
+        return false;
+    }
+    auto* protoRequests = mQueuedValueRequests.mutable_set_value_requests();
+    for (const auto& request : requests) {
+        int64_t streamRequestId = mNextStreamRequestId++;
+        auto& pendingRequest = mPendingValueRequests[streamRequestId];
+        pendingRequest.requestId = request.requestId;
+        pendingRequest.setValuesCallback = callback;
+        auto& protoRequest = *protoRequests->add_requests();
+        protoRequest.set_request_id(streamRequestId);
+        proto_msg_converter::aidlToProto(request.value, protoRequest.mutable_value());
+    }
+    flushValueRequestsLocked(lck);
+    return true;
+}
+
+void GRPCVehicleHardware::flushValueRequestsLocked(std::unique_lock<std::mutex>& lck) const {
+    if (mWritingValueRequests) {
+        return;
+    }
+    mWritingValueRequests = true;
+    while (mValueRequestStream != nullptr &&
+           (mQueuedValueRequests.get_value_requests().requests_size() != 0 ||
+            mQueuedValueRequests.set_value_requests().requests_size() != 0)) {
+        proto::ValueRequests requests;
+        requests.Swap(&mQueuedValueRequests);
+        auto* stream = mValueRequestStream;
+        // Requests queued during the write are batched into the next write.
+        lck.unlock();
+        bool writeOk = stream->Write(requests);
+        lck.lock();
+        if (!writeOk) {
+            // The reading thread would notice the broken stream and finish the pending requests.
+            LOG(ERROR) << __func__ << ": GRPC value request stream write failed";
+            break;
+        }
+    }
+    mWritingValueRequests = false;
+    mValueRequestCV.notify_all();
+}
+
+void GRPCVehicleHardware::onValueResults(const proto::ValueResults& results) {
+    std::vector<std::pair<const proto::GetValueResult*, PendingValueRequest>> getResults;
+    std::vector<std::pair<const proto::SetValueResult*, PendingValueRequest>> setResults;
+    {
+        std::lock_guard lck(mValueRequestMutex);
+        for (const auto& protoResult : results.get_value_results().results()) {
+            auto it = mPendingValueRequests.find(protoResult.request_id());
+            if (it == mPendingValueRequests.end()) {
+                LOG(WARNING) << __func__ << ": unknown request ID: " << protoResult.request_id();
+                continue;
+            }
+            getResults.emplace_back(&protoResult, std::move(it->second));
+            mPendingValueRequests.erase(it);
+        }
+        for (const auto& protoResult : results.set_value_results().results()) {
+            auto it = mPendingValueRequests.find(protoResult.request_id());
+            if (it == mPendingValueRequests.end()) {
+                LOG(WARNING) << __func__ << ": unknown request ID: " << protoResult.request_id();
+                continue;
+            }
+            setResults.emplace_back(&protoResult, std::move(it->second));
+            mPendingValueRequests.erase(it);
+        }
+    }
+
+    // Group the results by callback, so each caller gets one callback per batch.
+    std::unordered_map<std::shared_ptr<const GetValuesCallback>,
+                       std::vector<aidlvhal::GetValueResult>>
+            getResultsByCallback;
+    for (const auto& [protoResult, pendingRequest] : getResults) {
+        auto& result = getResultsByCallback[pendingRequest.getValuesCallback].emplace_back();
+        result.requestId = pendingRequest.requestId;
+        result.status = static_cast<aidlvhal::StatusCode>(protoResult->status());
+        if (protoResult->has_value()) {
+            aidlvhal::VehiclePropValue value;
+            proto_msg_converter::protoToAidl(protoResult->value(), &value);
+            result.prop = std::move(value);
+        }
+    }
+    std::unordered_map<std::shared_ptr<const SetValuesCallback>,
+                       std::vector<aidlvhal::SetValueResult>>
+            setResultsByCallback;
+    for (const auto& [protoResult, pendingRequest] : setResults) {
+        auto& result = setResultsByCallback[pendingRequest.setValuesCallback].emplace_back();
+        result.requestId = pendingRequest.requestId;
+        result.status = static_cast<aidlvhal::StatusCode>(protoResult->status());
+    }
+    for (auto& [callback, callbackResults] : getResultsByCallback) {
+        (*callback)(std::move(callbackResults));
+    }
+    for (auto& [callback, callbackResults] : setResultsByCallback) {
+        (*callback)(std::move(callbackResults));
+    }
+}
+
+void GRPCVehicleHardware::closeValueRequestStream() {
+    std::unordered_map<int64_t, PendingValueRequest> pendingRequests;
+    {
+        std::unique_lock lck(mValueRequestMutex);
+        mValueRequestStream = nullptr;
+        // The stream must not be destroyed while another thread is writing to it.
+        mValueRequestCV.wait(lck, [this] { return !mWritingValueRequests; });
+        mQueuedValueRequests.Clear();
+        pendingRequests.swap(mPendingValueRequests);
+    }
+
+    std::unordered_map<std::shared_ptr<const GetValuesCallback>,
+                       std::vector<aidlvhal::GetValueResult>>
+            getResultsByCallback;
+    std::unordered_map<std::shared_ptr<const SetValuesCallback>,
+                       std::vector<aidlvhal::SetValueResult>>
+            setResultsByCallback;
+    for (const auto& [_, pendingRequest] : pendingRequests) {
+        if (pendingRequest.getValuesCallback) {
+            getResultsByCallback[pendingRequest.getValuesCallback].push_back({
+                    .requestId = pendingRequest.requestId,
+                    .status = aidlvhal::StatusCode::TRY_AGAIN,
+                    .prop = {},
+            });
+        } else {
+            setResultsByCallback[pendingRequest.setValuesCallback].push_back({
+                    .requestId = pendingRequest.requestId,
+                    .status = aidlvhal::StatusCode::TRY_AGAIN,
+            });
+        }
+    }
+    for (auto& [callback, callbackResults] : getResultsByCallback) {
+        (*callback)(std::move(callbackResults));
+    }
+    for (auto& [callback, callbackResults] : setResultsByCallback) {
+        (*callback)(std::move(callbackResults));
+    }
+}
+
+void GRPCVehicleHardware::ValueRequestLoop() {
+    while (!mShuttingDownFlag.load()) {
+        ::grpc::ClientContext context;
+        // Wait for the server instead of failing immediately, so we don't spin while the server
+        // is unavailable.
+        context.set_wait_for_ready(true);
+
+        bool rpc_stopped{false};
+        std::thread shuttingdown_watcher([this, &rpc_stopped, &context]() {
+            std::unique_lock<std::mutex> lck(mShutdownMutex);
+            mShutdownCV.wait(lck, [this, &rpc_stopped]() {
+                return rpc_stopped || mShuttingDownFlag.load();
+            });
+            context.TryCancel();
+        });
+
+        auto request_stream = mGrpcStub->ProcessValueRequests(&context);
+        proto::ValueResults protoResults;
+        // The server sends an empty ValueResults once the stream is accepted.
+        if (request_stream->Read(&protoResults)) {
+            {
+                std::lock_guard lck(mValueRequestMutex);
+                mValueRequestStream = request_stream.get();
+            }
+            mValueRequestCV.notify_all();
+            LOG(INFO) << __func__ << ": GRPC Value Request Streaming Started";
+            while (!mShuttingDownFlag.load() && request_stream->Read(&protoResults)) {
+                onValueResults(protoResults);
+            }
+            closeValueRequestStream();
+        }
+
+        // Get the status before the watcher cancels the context.
+        auto grpc_status = request_stream->Finish();
+        {
+            std::lock_guard lck(mShutdownMutex);
+            rpc_stopped = true;
+        }
+        mShutdownCV.notify_all();
+        shuttingdown_watcher.join();
+
+        if (grpc_status.error_code() == ::grpc::StatusCode::UNIMPLEMENTED) {
+            LOG(WARNING) << __func__
+                         << ": GRPC Value Request Streaming is not supported by the server, "
+                         << "fall back to unary requests";
+            {
+                std::lock_guard lck(mValueRequestMutex);
+                mValueRequestStreamUnsupported = true;
+            }
+            mValueRequestCV.notify_all();
+            return;
+        }
+        LOG(ERROR) << __func__
+                   << ": GRPC Value Request Streaming Failed: " << grpc_status.error_message();
+
+        // try to reconnect after a while, unary RPCs are used in the meantime.
+        std::unique_lock<std::mutex> lck(mShutdownMutex);
+        mShutdownCV.wait_for(lck, kValueRequestStreamRetryInterval,
+                             [this] { return mShuttingDownFlag.load(); });
+    }
+}
+
 void GRPCVehicleHardware::ValuePollingLoop() {
     while (!mShuttingDownFlag.load()) {
         ::grpc::ClientContext context;
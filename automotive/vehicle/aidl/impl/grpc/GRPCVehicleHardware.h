@@ -28,9 +28,11 @@
 #include <chrono>
 #include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace android::hardware::automotive::vehicle::virtualization {
@@ -39,8 +41,16 @@ namespace aidlvhal = ::aidl::android::hardware::automotive::vehicle;
 
 class GRPCVehicleHardware : public IVehicleHardware {
   public:
+    // Uses the value request stream if the "ro.vendor.vhal.grpc.value_request_stream" system
+    // property is true.
     explicit GRPCVehicleHardware(std::string service_addr);
 
+    // If {@code useValueRequestStream} is true, getValues/setValues requests are pipelined over one
+    // long-lived ProcessValueRequests stream instead of one unary RPC per call. Requests issued
+    // while a previous batch is being written are sent together in the next write. Unary RPCs are
+    // still used while the stream is not connected, or if the server does not support it.
+    GRPCVehicleHardware(std::string service_addr, bool useValueRequestStream);
+
     ~GRPCVehicleHardware();
 
     // Get all the property configs.
@@ -80,9 +90,44 @@ class GRPCVehicleHardware : public IVehicleHardware {
 
     bool waitForConnected(std::chrono::milliseconds waitTime);
 
+    // Waits until the value request stream is connected. Returns false on timeout, or if the
+    // stream is not enabled or not supported by the server.
+    bool waitForValueRequestStream(std::chrono::milliseconds waitTime);
+
   private:
+    using ValueRequestStream =
+            ::grpc::ClientReaderWriter<proto::ValueRequests, proto::ValueResults>;
+
+    // A request sent over the value request stream, keyed by the stream-wide request ID.
+    struct PendingValueRequest {
+        // The request ID from the caller.
+        int64_t requestId;
+        // Exactly one of the callbacks is set.
+        std::shared_ptr<const GetValuesCallback> getValuesCallback;
+        std::shared_ptr<const SetValuesCallback> setValuesCallback;
+    };
+
     void ValuePollingLoop();
 
+    void ValueRequestLoop();
+
+    // Queues the requests on the value request stream. Returns false if the stream is not
+    // connected, in which case the caller should use the unary RPC.
+    bool queueGetValueRequests(std::shared_ptr<const GetValuesCallback> callback,
+                               const std::vector<aidlvhal::GetValueRequest>& requests) const;
+
+    bool queueSetValueRequests(std::shared_ptr<const SetValuesCallback> callback,
+                               const std::vector<aidlvhal::SetValueRequest>& requests);
+
+    // Writes the queued requests, unless another thread is writing, in which case that thread
+    // would write them once its current write finishes.
+    void flushValueRequestsLocked(std::unique_lock<std::mutex>& lck) const;
+
+    void onValueResults(const proto::ValueResults& results);
+
+    // Detaches the stream and finishes all the pending requests with TRY_AGAIN.
+    void closeValueRequestStream();
+
     std::string mServiceAddr;
     std::shared_ptr<::grpc::Channel> mGrpcChannel;
     std::unique_ptr<proto::VehicleServer::Stub> mGrpcStub;
@@ -95,6 +140,18 @@ class GRPCVehicleHardware : public IVehicleHardware {
     std::mutex mShutdownMutex;
     std::condition_variable mShutdownCV;
     std::atomic<bool> mShuttingDownFlag{false};
+
+    // Members for the value request stream. They are mutable since getValues is const.
+    mutable std::mutex mValueRequestMutex;
+    mutable std::condition_variable mValueRequestCV;
+    // Owned by mValueRequestThread, only set while the stream is usable.
+    ValueRequestStream* mValueRequestStream = nullptr;
+    bool mValueRequestStreamUnsupported = false;
+    mutable bool mWritingValueRequests = false;
+    mutable proto::ValueRequests mQueuedValueRequests;
+    mutable int64_t mNextStreamRequestId = 0;
+    mutable std::unordered_map<int64_t, PendingValueRequest> mPendingValueRequests;
+    std::thread mValueRequestThread;
 };
 
 }  // namespace android::hardware::automotive::vehicle::virtualization
@@ -38,6 +38,132 @@ static std::shared_ptr<::grpc::ServerCredentials> getServerCredentials() {
     return ::grpc::InsecureServerCredentials();
 }
 
+namespace {
+
+using ValueRequestStream = ::grpc::ServerReaderWriter<proto::ValueResults, proto::ValueRequests>;
+
+// Serializes the writes to a value request stream. The hardware callbacks could run after the RPC
+// returns, so the RPC must close the writer before returning.
+class ValueResultWriter final {
+  public:
+    explicit ValueResultWriter(ValueRequestStream* stream) : mStream(stream) {}
+
+    bool Write(const proto::ValueResults& results) {
+        std::lock_guard lck(mMtx);
+        return mStream != nullptr && mStream->Write(results);
+    }
+
+    // The stream is never accessed after this returns.
+    void Close() {
+        std::lock_guard lck(mMtx);
+        mStream = nullptr;
+    }
+
+  private:
+    std::mutex mMtx;
+    ValueRequestStream* mStream;
+};
+
+std::vector<aidlvhal::SetValueRequest> toAidlSetValueRequests(
+        const proto::VehiclePropValueRequests& protoRequests) {
+    std::vector<aidlvhal::SetValueRequest> aidlRequests;
+    for (const auto& protoRequest : protoRequests.requests()) {
+        auto& aidlRequest = aidlRequests.emplace_back();
+        aidlRequest.requestId = protoRequest.request_id();
+        proto_msg_converter::protoToAidl(protoRequest.value(), &aidlRequest.value);
+    }
+    return aidlRequests;
+}
+
+std::vector<aidlvhal::GetValueRequest> toAidlGetValueRequests(
+        const proto::VehiclePropValueRequests& protoRequests) {
+    std::vector<aidlvhal::GetValueRequest> aidlRequests;
+    for (const auto& protoRequest : protoRequests.requests()) {
+        auto& aidlRequest = aidlRequests.emplace_back();
+        aidlRequest.requestId = protoRequest.request_id();
+        proto_msg_converter::protoToAidl(protoRequest.value(), &aidlRequest.prop);
+    }
+    return aidlRequests;
+}
+
+void toProtoSetValueResults(const std::vector<aidlvhal::SetValueResult>& aidlResults,
+                            proto::SetValueResults* protoResults) {
+    for (const auto& aidlResult : aidlResults) {
+        auto& protoResult = *protoResults->add_results();
+        protoResult.set_request_id(aidlResult.requestId);
+        protoResult.set_status(static_cast<proto::StatusCode>(aidlResult.status));
+    }
+}
+
+void toProtoGetValueResults(const std::vector<aidlvhal::GetValueResult>& aidlResults,
+                            proto::GetValueResults* protoResults) {
+    for (const auto& aidlResult : aidlResults) {
+        auto& protoResult = *protoResults->add_results();
+        protoResult.set_request_id(aidlResult.requestId);
+        protoResult.set_status(static_cast<proto::StatusCode>(aidlResult.status));
+        if (aidlResult.prop) {
+            auto* valuePtr = protoResult.mutable_value();
+            proto_msg_converter::aidlToProto(*aidlResult.prop, valuePtr);
+        }
+    }
+}
+
+void processSetValueRequests(IVehicleHardware& hardware,
+                             const proto::VehiclePropValueRequests& protoRequests,
+                             const std::shared_ptr<ValueResultWriter>& writer) {
+    auto aidlRequests = toAidlSetValueRequests(protoRequests);
+    auto aidlStatus = hardware.setValues(
+            std::make_shared<const IVehicleHardware::SetValuesCallback>(
+                    [writer](std::vector<aidlvhal::SetValueResult> setValueResults) {
+                        proto::ValueResults protoResults;
+                        toProtoSetValueResults(setValueResults,
+                                               protoResults.mutable_set_value_results());
+                        writer->Write(protoResults);
+                    }),
+            aidlRequests);
+    if (aidlStatus == aidlvhal::StatusCode::OK) {
+        return;
+    }
+    LOG(ERROR) << __func__ << ": The underlying hardware fails to set values, VHAL status: "
+               << toString(aidlStatus);
+    proto::ValueResults protoResults;
+    for (const auto& aidlRequest : aidlRequests) {
+        auto& protoResult = *protoResults.mutable_set_value_results()->add_results();
+        protoResult.set_request_id(aidlRequest.requestId);
+        protoResult.set_status(static_cast<proto::StatusCode>(aidlStatus));
+    }
+    writer->Write(protoResults);
+}
+
+void processGetValueRequests(IVehicleHardware& hardware,
+                             const proto::VehiclePropValueRequests& protoRequests,
+                             const std::shared_ptr<ValueResultWriter>& writer) {
+    auto aidlRequests = toAidlGetValueRequests(protoRequests);
+    auto aidlStatus = hardware.getValues(
+            std::make_shared<const IVehicleHardware::GetValuesCallback>(
+                    [writer](std::vector<aidlvhal::GetValueResult> getValueResults) {
+                        proto::ValueResults protoResults;
+                        toProtoGetValueResults(getValueResults,
+                                               protoResults.mutable_get_value_results());
+                        writer->Write(protoResults);
+                    }),
+            aidlRequests);
+    if (aidlStatus == aidlvhal::StatusCode::OK) {
+        return;
+    }
+    LOG(ERROR) << __func__ << ": The underlying hardware fails to get values, VHAL status: "
+               << toString(aidlStatus);
+    proto::ValueResults protoResults;
+    for (const auto& aidlRequest : aidlRequests) {
+        auto& protoResult = *protoResults.mutable_get_value_results()->add_results();
+        protoResult.set_request_id(aidlRequest.requestId);
+        protoResult.set_status(static_cast<proto::StatusCode>(aidlStatus));
+    }
+    writer->Write(protoResults);
+}
+
+}  // namespace
+
 GrpcVehicleProxyServer::GrpcVehicleProxyServer(std::string serverAddr,
                                                std::unique_ptr<IVehicleHardware>&& hardware)
     : mServiceAddr(std::move(serverAddr)), mHardware(std::move(hardware)) {
@@ -64,12 +190,7 @@ GrpcVehicleProxyServer::GrpcVehicleProxyServer(std::string serverAddr,
 ::grpc::Status GrpcVehicleProxyServer::SetValues(::grpc::ServerContext* context,
                                                  const proto::VehiclePropValueRequests* requests,
                                                  proto::SetValueResults* results) {
-    std::vector<aidlvhal::SetValueRequest> aidlRequests;
-    for (const auto& protoRequest : requests->requests()) {
-        auto& aidlRequest = aidlRequests.emplace_back();
-        aidlRequest.requestId = protoRequest.request_id();
-        proto_msg_converter::protoToAidl(protoRequest.value(), &aidlRequest.value);
-    }
+    auto aidlRequests = toAidlSetValueRequests(*requests);
     auto waitMtx = std::make_shared<std::mutex>();
     auto waitCV = std::make_shared<std::condition_variable>();
     auto complete = std::make_shared<bool>(false);
@@ -78,12 +199,7 @@ GrpcVehicleProxyServer::GrpcVehicleProxyServer(std::string serverAddr,
             std::make_shared<const IVehicleHardware::SetValuesCallback>(
                     [waitMtx, waitCV, complete,
                      tmpResults](std::vector<aidlvhal::SetValueResult> setValueResults) {
-                        for (const auto& aidlResult : setValueResults) {
-                            auto& protoResult = *tmpResults->add_results();
-                            protoResult.set_request_id(aidlResult.requestId);
-                            protoResult.set_status(
-                                    static_cast<proto::StatusCode>(aidlResult.status));
-                        }
+                        toProtoSetValueResults(setValueResults, tmpResults.get());
                         {
                             std::lock_guard lck(*waitMtx);
                             *complete = true;
@@ -109,12 +225,7 @@ GrpcVehicleProxyServer::GrpcVehicleProxyServer(std::string serverAddr,
 ::grpc::Status GrpcVehicleProxyServer::GetValues(::grpc::ServerContext* context,
                                                  const proto::VehiclePropValueRequests* requests,
                                                  proto::GetValueResults* results) {
-    std::vector<aidlvhal::GetValueRequest> aidlRequests;
-    for (const auto& protoRequest : requests->requests()) {
-        auto& aidlRequest = aidlRequests.emplace_back();
-        aidlRequest.requestId = protoRequest.request_id();
-        proto_msg_converter::protoToAidl(protoRequest.value(), &aidlRequest.prop);
-    }
+    auto aidlRequests = toAidlGetValueRequests(*requests);
     auto waitMtx = std::make_shared<std::mutex>();
     auto waitCV = std::make_shared<std::condition_variable>();
     auto complete = std::make_shared<bool>(false);
@@ -123,16 +234,7 @@ GrpcVehicleProxyServer::GrpcVehicleProxyServer(std::string serverAddr,
             std::make_shared<const IVehicleHardware::GetValuesCallback>(
                     [waitMtx, waitCV, complete,
                      tmpResults](std::vector<aidlvhal::GetValueResult> getValueResults) {
-                        for (const auto& aidlResult : getValueResults) {
-                            auto& protoResult = *tmpResults->add_results();
-                            protoResult.set_request_id(aidlResult.requestId);
-                            protoResult.set_status(
-                                    static_cast<proto::StatusCode>(aidlResult.status));
-                            if (aidlResult.prop) {
-                                auto* valuePtr = protoResult.mutable_value();
-                                proto_msg_converter::aidlToProto(*aidlResult.prop, valuePtr);
-                            }
-                        }
+                        toProtoGetValueResults(getValueResults, tmpResults.get());
                         {
                             std::lock_guard lck(*waitMtx);
                             *complete = true;
@@ -188,6 +290,9 @@ GrpcVehicleProxyServer::GrpcVehicleProxyServer(std::string serverAddr,
     auto conn = std::make_shared<ConnectionDescriptor>(stream);
     {
         std::lock_guard lck(mConnectionMutex);
+        if (mShuttingDown) {
+            return ::grpc::Status(::grpc::StatusCode::UNAVAILABLE, "Server is shutting down.");
+        }
         mValueStreamingConnections.push_back(conn);
     }
     conn->Wait();
@@ -195,6 +300,39 @@ GrpcVehicleProxyServer::GrpcVehicleProxyServer(std::string serverAddr,
     return ::grpc::Status(::grpc::StatusCode::ABORTED, "Connection lost.");
 }
 
+::grpc::Status GrpcVehicleProxyServer::ProcessValueRequests(
+        ::grpc::ServerContext* context,
+        ::grpc::ServerReaderWriter<proto::ValueResults, proto::ValueRequests>* stream) {
+    {
+        std::lock_guard lck(mConnectionMutex);
+        if (mShuttingDown) {
+            return ::grpc::Status(::grpc::StatusCode::UNAVAILABLE, "Server is shutting down.");
+        }
+        mValueRequestContexts.insert(context);
+    }
+    auto writer = std::make_shared<ValueResultWriter>(stream);
+    // Tell the client that the stream is accepted.
+    bool connected = writer->Write(proto::ValueResults());
+    proto::ValueRequests requests;
+    while (connected && stream->Read(&requests)) {
+        if (requests.get_value_requests().requests_size() != 0) {
+            processGetValueRequests(*mHardware, requests.get_value_requests(), writer);
+        }
+        if (requests.set_value_requests().requests_size() != 0) {
+            processSetValueRequests(*mHardware, requests.set_value_requests(), writer);
+        }
+    }
+    // Results for the requests still being processed are dropped, the client fails them once
+    // the stream is closed.
+    writer->Close();
+    {
+        std::lock_guard lck(mConnectionMutex);
+        mValueRequestContexts.erase(context);
+    }
+    LOG(INFO) << __func__ << ": Value request stream closed";
+    return ::grpc::Status::OK;
+}
+
 void GrpcVehicleProxyServer::OnVehiclePropChange(
         const std::vector<aidlvhal::VehiclePropValue>& values) {
     std::unordered_set<uint64_t> brokenConn;
@@ -241,9 +379,18 @@ GrpcVehicleProxyServer& GrpcVehicleProxyServer::Start() {
 }
 
 GrpcVehicleProxyServer& GrpcVehicleProxyServer::Shutdown() {
-    std::shared_lock read_lock(mConnectionMutex);
-    for (auto& conn : mValueStreamingConnections) {
-        conn->Shutdown();
+    {
+        // The lock must be released before shutting down the server, which waits for the
+        // value request streams to unregister themselves. Streams started after this are
+        // rejected.
+        std::unique_lock write_lock(mConnectionMutex);
+        mShuttingDown = true;
+        for (auto& conn : mValueStreamingConnections) {
+            conn->Shutdown();
+        }
+        for (auto* context : mValueRequestContexts) {
+            context->TryCancel();
+        }
     }
     if (mServer) {
         mServer->Shutdown();
@@ -30,6 +30,7 @@
 #include <memory>
 #include <shared_mutex>
 #include <string>
+#include <unordered_set>
 #include <utility>
 
 namespace android::hardware::automotive::vehicle::virtualization {
@@ -67,6 +68,10 @@ class GrpcVehicleProxyServer : public proto::VehicleServer::Service {
             ::grpc::ServerContext* context, const ::google::protobuf::Empty* request,
             ::grpc::ServerWriter<proto::VehiclePropValues>* stream) override;
 
+    ::grpc::Status ProcessValueRequests(
+            ::grpc::ServerContext* context,
+            ::grpc::ServerReaderWriter<proto::ValueResults, proto::ValueRequests>* stream) override;
+
     GrpcVehicleProxyServer& Start();
 
     GrpcVehicleProxyServer& Shutdown();
@@ -115,6 +120,9 @@ class GrpcVehicleProxyServer : public proto::VehicleServer::Service {
 
     std::shared_mutex mConnectionMutex;
     std::vector<std::shared_ptr<ConnectionDescriptor>> mValueStreamingConnections;
+    // Contexts of the active value request streams, cancelled on shutdown.
+    std::unordered_set<::grpc::ServerContext*> mValueRequestContexts;
+    bool mShuttingDown{false};
 
     static constexpr auto kHardwareOpTimeout = std::chrono::seconds(1);
 };
@@ -91,4 +91,33 @@ TEST(GRPCVehicleHardwareUnitTest, Reconnect) {
     }
 }
 
+TEST(GRPCVehicleHardwareUnitTest, ValueRequestStreamFallback) {
+    auto fakeServer = std::make_unique<FakeVehicleServer>();
+    ::grpc::ServerBuilder builder;
+    builder.RegisterService(fakeServer.get());
+    builder.AddListeningPort(kFakeServerAddr, ::grpc::InsecureServerCredentials());
+    auto grpcServer = builder.BuildAndStart();
+
+    auto vehicleHardware = std::make_unique<GRPCVehicleHardware>(kFakeServerAddr,
+                                                                 /*useValueRequestStream=*/true);
+
+    // The fake server does not implement ProcessValueRequests.
+    constexpr auto kWaitForStreamMaxTime = std::chrono::seconds(5);
+    EXPECT_FALSE(vehicleHardware->waitForValueRequestStream(kWaitForStreamMaxTime));
+
+    // Requests still go through the unary RPCs.
+    auto callbackCalled = std::make_shared<std::atomic<bool>>(false);
+    auto status = vehicleHardware->getValues(
+            std::make_shared<const IVehicleHardware::GetValuesCallback>(
+                    [callbackCalled](const auto&) { callbackCalled->store(true); }),
+            {aidl::android::hardware::automotive::vehicle::GetValueRequest()});
+
+    EXPECT_EQ(status, aidl::android::hardware::automotive::vehicle::StatusCode::OK);
+    EXPECT_TRUE(callbackCalled->load());
+
+    vehicleHardware.reset();
+    grpcServer->Shutdown();
+    grpcServer->Wait();
+}
+
 }  // namespace android::hardware::automotive::vehicle::virtualization
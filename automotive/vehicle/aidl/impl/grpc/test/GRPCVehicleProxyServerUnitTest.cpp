@@ -22,11 +22,15 @@
 #include <grpc++/grpc++.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
 namespace android::hardware::automotive::vehicle::virtualization {
 
@@ -79,6 +83,43 @@ class VehicleHardwareForTest : public IVehicleHardware {
     std::unique_ptr<const PropertyChangeCallback> mOnProp;
 };
 
+// Answers every get and set request right away.
+class EchoVehicleHardwareForTest : public VehicleHardwareForTest {
+  public:
+    // Sets always succeed.
+    aidl::android::hardware::automotive::vehicle::StatusCode setValues(
+            std::shared_ptr<const SetValuesCallback> callback,
+            const std::vector<aidl::android::hardware::automotive::vehicle::SetValueRequest>&
+                    requests) override {
+        std::vector<aidl::android::hardware::automotive::vehicle::SetValueResult> results;
+        for (const auto& request : requests) {
+            results.push_back({
+                    .requestId = request.requestId,
+                    .status = aidl::android::hardware::automotive::vehicle::StatusCode::OK,
+            });
+        }
+        (*callback)(std::move(results));
+        return aidl::android::hardware::automotive::vehicle::StatusCode::OK;
+    }
+
+    // Gets return the requested value.
+    aidl::android::hardware::automotive::vehicle::StatusCode getValues(
+            std::shared_ptr<const GetValuesCallback> callback,
+            const std::vector<aidl::android::hardware::automotive::vehicle::GetValueRequest>&
+                    requests) const override {
+        std::vector<aidl::android::hardware::automotive::vehicle::GetValueResult> results;
+        for (const auto& request : requests) {
+            results.push_back({
+                    .requestId = request.requestId,
+                    .status = aidl::android::hardware::automotive::vehicle::StatusCode::OK,
+                    .prop = request.prop,
+            });
+        }
+        (*callback)(std::move(results));
+        return aidl::android::hardware::automotive::vehicle::StatusCode::OK;
+    }
+};
+
 TEST(GRPCVehicleProxyServerUnitTest, ClientConnectDisconnect) {
     auto testHardware = std::make_unique<VehicleHardwareForTest>();
     // HACK: manipulate the underlying hardware via raw pointer for testing.
@@ -144,4 +185,81 @@ TEST(GRPCVehicleProxyServerUnitTest, ClientConnectDisconnect) {
     vehicleServer->Shutdown().Wait();
 }
 
+TEST(GRPCVehicleProxyServerUnitTest, ValueRequestStream) {
+    using aidl::android::hardware::automotive::vehicle::GetValueResult;
+    using aidl::android::hardware::automotive::vehicle::SetValueResult;
+    using aidl::android::hardware::automotive::vehicle::StatusCode;
+
+    auto vehicleServer = std::make_unique<GrpcVehicleProxyServer>(
+            kFakeServerAddr, std::make_unique<EchoVehicleHardwareForTest>());
+    vehicleServer->Start();
+
+    constexpr auto kWaitForStreamMaxTime = std::chrono::seconds(5);
+    constexpr auto kWaitForResultsMaxTime = std::chrono::seconds(5);
+    constexpr int64_t kRequestCount = 100;
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::vector<GetValueResult> getValueResults;
+    std::vector<SetValueResult> setValueResults;
+    auto getValuesCallback = std::make_shared<const IVehicleHardware::GetValuesCallback>(
+            [&](std::vector<GetValueResult> results) {
+                std::lock_guard<std::mutex> lockGuard(lock);
+                getValueResults.insert(getValueResults.end(), results.begin(), results.end());
+                cv.notify_all();
+            });
+    auto setValuesCallback = std::make_shared<const IVehicleHardware::SetValuesCallback>(
+            [&](std::vector<SetValueResult> results) {
+                std::lock_guard<std::mutex> lockGuard(lock);
+                setValueResults.insert(setValueResults.end(), results.begin(), results.end());
+                cv.notify_all();
+            });
+
+    auto vehicleHardware = std::make_unique<GRPCVehicleHardware>(kFakeServerAddr,
+                                                                 /*useValueRequestStream=*/true);
+    ASSERT_TRUE(vehicleHardware->waitForValueRequestStream(kWaitForStreamMaxTime));
+
+    // Requests from different threads are pipelined over the same stream.
+    std::thread getThread([&] {
+        for (int64_t i = 0; i < kRequestCount; i++) {
+            aidl::android::hardware::automotive::vehicle::GetValueRequest request;
+            request.requestId = i;
+            request.prop.prop = static_cast<int32_t>(i);
+            EXPECT_EQ(vehicleHardware->getValues(getValuesCallback, {request}), StatusCode::OK);
+        }
+    });
+    for (int64_t i = 0; i < kRequestCount; i++) {
+        aidl::android::hardware::automotive::vehicle::SetValueRequest request;
+        request.requestId = i;
+        request.value.prop = static_cast<int32_t>(i);
+        EXPECT_EQ(vehicleHardware->setValues(setValuesCallback, {request}), StatusCode::OK);
+    }
+    getThread.join();
+
+    {
+        std::unique_lock<std::mutex> uniqueLock(lock);
+        ASSERT_TRUE(cv.wait_for(uniqueLock, kWaitForResultsMaxTime, [&] {
+            return getValueResults.size() == kRequestCount &&
+                   setValueResults.size() == kRequestCount;
+        })) << "not all the results are received";
+    }
+
+    // Results must carry the request IDs from the caller.
+    std::sort(getValueResults.begin(), getValueResults.end(),
+              [](const auto& a, const auto& b) { return a.requestId < b.requestId; });
+    std::sort(setValueResults.begin(), setValueResults.end(),
+              [](const auto& a, const auto& b) { return a.requestId < b.requestId; });
+    for (int64_t i = 0; i < kRequestCount; i++) {
+        EXPECT_EQ(getValueResults[i].requestId, i);
+        EXPECT_EQ(getValueResults[i].status, StatusCode::OK);
+        ASSERT_TRUE(getValueResults[i].prop.has_value());
+        EXPECT_EQ(getValueResults[i].prop->prop, static_cast<int32_t>(i));
+        EXPECT_EQ(setValueResults[i].requestId, i);
+        EXPECT_EQ(setValueResults[i].status, StatusCode::OK);
+    }
+
+    vehicleHardware.reset();
+    vehicleServer->Shutdown().Wait();
+}
+
 }  // namespace android::hardware::automotive::vehicle::virtualization
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ConcurrentQueue.h>
+#include <benchmark/benchmark.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+constexpr int64_t kItemsPerProducer = 10'000;
+
+// The previous mutex and condition variable based queue, kept as a baseline.
+template <typename T>
+class LockedQueue {
+  public:
+    bool waitForItems() {
+        std::unique_lock<std::mutex> lockGuard(mLock);
+        mCond.wait(lockGuard, [this] { return !mQueue.empty() || !mIsActive; });
+        return mIsActive;
+    }
+
+    std::vector<T> flush() {
+        std::vector<T> items;
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        if (mQueue.empty() || !mIsActive) {
+            return items;
+        }
+        while (!mQueue.empty()) {
+            items.push_back(std::move(mQueue.front()));
+            mQueue.pop();
+        }
+        return items;
+    }
+
+    void push(T&& item) {
+        {
+            std::scoped_lock<std::mutex> lockGuard(mLock);
+            if (!mIsActive) {
+                return;
+            }
+            mQueue.push(std::move(item));
+        }
+        mCond.notify_one();
+    }
+
+    void deactivate() {
+        {
+            std::scoped_lock<std::mutex> lockGuard(mLock);
+            mIsActive = false;
+        }
+        mCond.notify_all();
+    }
+
+  private:
+    mutable std::mutex mLock;
+    bool mIsActive = true;
+    std::condition_variable mCond;
+    std::queue<T> mQueue;
+};
+
+// Runs state.range(0) producers, each pushing kItemsPerProducer items, against a single consumer
+// that drains the queue with waitForItems() and flush().
+template <typename Queue>
+void runProducersAndConsumer(benchmark::State& state) {
+    int64_t producerCount = state.range(0);
+    int64_t totalItems = producerCount * kItemsPerProducer;
+
+    for (auto _ : state) {
+        Queue queue;
+        std::thread consumer([&queue, totalItems] {
+            int64_t received = 0;
+            while (received < totalItems && queue.waitForItems()) {
+                received += queue.flush().size();
+            }
+        });
+
+        std::vector<std::thread> producers;
+        for (int64_t i = 0; i < producerCount; i++) {
+            producers.emplace_back([&queue] {
+                for (int64_t j = 0; j < kItemsPerProducer; j++) {
+                    int64_t value = j;
+                    queue.push(std::move(value));
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        consumer.join();
+        queue.deactivate();
+    }
+    state.SetItemsProcessed(state.iterations() * totalItems);
+}
+
+}  // namespace
+
+static void BM_LockFreeQueue(benchmark::State& state) {
+    runProducersAndConsumer<ConcurrentQueue<int64_t>>(state);
+}
+BENCHMARK(BM_LockFreeQueue)->Arg(1)->Arg(4)->Arg(16)->UseRealTime();
+
+static void BM_LockedQueue(benchmark::State& state) {
+    runProducersAndConsumer<LockedQueue<int64_t>>(state);
+}
+BENCHMARK(BM_LockedQueue)->Arg(1)->Arg(4)->Arg(16)->UseRealTime();
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
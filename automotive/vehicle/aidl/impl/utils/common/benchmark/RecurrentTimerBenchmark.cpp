@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <RecurrentTimer.h>
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+std::vector<std::shared_ptr<RecurrentTimer::Callback>> createCallbacks(size_t count) {
+    std::vector<std::shared_ptr<RecurrentTimer::Callback>> callbacks;
+    callbacks.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        callbacks.push_back(std::make_shared<RecurrentTimer::Callback>([] {}));
+    }
+    return callbacks;
+}
+
+}  // namespace
+
+// Registers and then unregisters N callbacks with intervals between 10ms and 1s, similar to
+// continuous property subscriptions.
+static void BM_RegisterUnregisterCallbacks(benchmark::State& state) {
+    RecurrentTimer timer;
+    auto callbacks = createCallbacks(state.range(0));
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < callbacks.size(); i++) {
+            // 10ms to 1s.
+            int64_t interval = 10'000'000 * (1 + i % 100);
+            timer.registerTimerCallback(interval, callbacks[i]);
+        }
+        for (const auto& callback : callbacks) {
+            timer.unregisterTimerCallback(callback);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * callbacks.size() * 2);
+}
+BENCHMARK(BM_RegisterUnregisterCallbacks)->Range(64, 8192);
+
+// Re-registers N already registered callbacks with a different interval, similar to updating the
+// sample rate for existing subscriptions.
+static void BM_ReregisterCallbacks(benchmark::State& state) {
+    RecurrentTimer timer;
+    auto callbacks = createCallbacks(state.range(0));
+    for (const auto& callback : callbacks) {
+        timer.registerTimerCallback(/*intervalInNano=*/100'000'000, callback);
+    }
+
+    int64_t round = 0;
+    for (auto _ : state) {
+        // Alternates between 50ms and 100ms.
+        int64_t interval = 50'000'000 * (1 + round++ % 2);
+        for (const auto& callback : callbacks) {
+            timer.registerTimerCallback(interval, callback);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * callbacks.size());
+
+    for (const auto& callback : callbacks) {
+        timer.unregisterTimerCallback(callback);
+    }
+}
+BENCHMARK(BM_ReregisterCallbacks)->Range(64, 8192);
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <VehicleHalTypes.h>
+#include <VehiclePropertyStore.h>
+#include <VehicleUtils.h>
+#include <benchmark/benchmark.h>
+#include <utils/SystemClock.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::vehicle::VehicleArea;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropConfig;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyAccess;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyChangeMode;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyGroup;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyType;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
+
+// The number of distinct properties the threads operate on. Each thread operates on a different
+// property, so ideally the throughput should scale with the number of threads.
+constexpr int32_t kNumProperties = 64;
+
+int32_t getTestPropId(int32_t index) {
+    return (index + 1) | toInt(VehiclePropertyGroup::VENDOR) | toInt(VehicleArea::GLOBAL) |
+           toInt(VehiclePropertyType::FLOAT);
+}
+
+// Shared by all the benchmark threads.
+VehiclePropertyStore* getStore() {
+    static VehiclePropertyStore* store = [] {
+        auto store = new VehiclePropertyStore(std::make_shared<VehiclePropValuePool>());
+        for (int32_t i = 0; i < kNumProperties; i++) {
+            store->registerProperty(VehiclePropConfig{
+                    .prop = getTestPropId(i),
+                    .access = VehiclePropertyAccess::READ_WRITE,
+                    .changeMode = VehiclePropertyChangeMode::CONTINUOUS,
+            });
+        }
+        store->setOnValueChangeCallback([](const VehiclePropValue&) {});
+        return store;
+    }();
+    return store;
+}
+
+}  // namespace
+
+// Each thread writes to its own property, and reads from it.
+static void BM_WriteReadOwnProperty(benchmark::State& state) {
+    VehiclePropertyStore* store = getStore();
+    std::shared_ptr<VehiclePropValuePool> pool = store->getValuePool();
+    int32_t propId = getTestPropId(state.thread_index() % kNumProperties);
+    int64_t timestamp = 0;
+
+    for (auto _ : state) {
+        auto value = pool->obtainFloat(static_cast<float>(timestamp));
+        value->prop = propId;
+        value->timestamp = timestamp++;
+        benchmark::DoNotOptimize(store->writeValue(std::move(value)));
+        benchmark::DoNotOptimize(store->readValue(propId));
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_WriteReadOwnProperty)->ThreadRange(1, 16)->UseRealTime();
+
+// One thread out of four writes to a property while the others read the same property. This
+// measures contention on a single property.
+static void BM_WriteReadSameProperty(benchmark::State& state) {
+    VehiclePropertyStore* store = getStore();
+    std::shared_ptr<VehiclePropValuePool> pool = store->getValuePool();
+    int32_t propId = getTestPropId(0);
+    bool isWriter = state.thread_index() % 4 == 0;
+    float floatValue = 0;
+
+    for (auto _ : state) {
+        if (isWriter) {
+            auto value = pool->obtainFloat(floatValue++);
+            value->prop = propId;
+            // Writers from different threads might still race, in which case the outdated value is
+            // dropped by the store. That is fine for this benchmark.
+            value->timestamp = elapsedRealtimeNano();
+            benchmark::DoNotOptimize(store->writeValue(std::move(value)));
+        } else {
+            benchmark::DoNotOptimize(store->readValue(propId));
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WriteReadSameProperty)->ThreadRange(1, 16)->UseRealTime();
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
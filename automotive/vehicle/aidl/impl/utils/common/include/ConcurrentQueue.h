@@ -21,75 +21,209 @@
 
 #include <atomic>
 #include <condition_variable>
-#include <iostream>
-#include <queue>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <thread>
+#include <vector>
 
 namespace android {
 namespace hardware {
 namespace automotive {
 namespace vehicle {
 
+// A lock-free, multi-producer queue.
+//
+// Items are stored in a ring buffer where each cell carries a sequence number that tells whether
+// it is ready to be written or read, so producers and the consumer never take a lock. If the ring
+// buffer is full, items go to an unbounded overflow list guarded by a lock instead, so push()
+// never blocks the caller. Once the overflow list is in use, producers keep appending to it until
+// the consumer drains it, so that the items pushed by one thread are flushed in order.
+//
+// Consumers only take a lock when they have to sleep in waitForItems() because the queue is
+// empty, or when there are overflowed items to flush. Producers only take a lock when the ring
+// buffer is full or when there is a sleeping consumer to wake up.
 template <typename T>
 class ConcurrentQueue {
   public:
-    bool waitForItems() {
-        std::unique_lock<std::mutex> lockGuard(mLock);
-        android::base::ScopedLockAssertion lockAssertion(mLock);
-        while (mQueue.empty() && mIsActive) {
-            mCond.wait(lockGuard);
+    static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+    // The capacity is rounded up to the next power of 2.
+    explicit ConcurrentQueue(size_t capacity = DEFAULT_CAPACITY) {
+        size_t roundedCapacity = 1;
+        while (roundedCapacity < capacity) {
+            roundedCapacity <<= 1;
+        }
+        mMask = roundedCapacity - 1;
+        mCells = std::make_unique<Cell[]>(roundedCapacity);
+        for (size_t i = 0; i < roundedCapacity; i++) {
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
         }
-        return mIsActive;
     }
 
-    std::vector<T> flush() {
-        std::vector<T> items;
+    // Blocks until there are items in the queue or the queue is deactivated. Returns whether the
+    // queue is still active.
+    bool waitForItems() {
+        while (true) {
+            if (!mIsActive.load(std::memory_order_acquire) || hasItems()) {
+                return mIsActive.load(std::memory_order_acquire);
+            }
+
+            std::unique_lock<std::mutex> lockGuard(mWaitLock);
+            // Announce that we are about to sleep before checking the queue again, so that a
+            // producer either sees us waiting or we see its item.
+            mWaiterCount.fetch_add(1, std::memory_order_seq_cst);
+            if (mIsActive.load(std::memory_order_seq_cst) && !hasItems()) {
+                mCond.wait(lockGuard);
+            }
+            mWaiterCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
 
-        std::scoped_lock<std::mutex> lockGuard(mLock);
-        if (mQueue.empty()) {
-            return items;
+    // Moves all the items in the queue into 'items'. 'items' is cleared first but its capacity is
+    // kept, so that the caller could reuse the same buffer to avoid allocations.
+    void flush(std::vector<T>* items) {
+        items->clear();
+        // Even if the queue is deactivated, we should still flush all the remaining values in the
+        // queue.
+        while (std::optional<T> item = pop()) {
+            items->push_back(std::move(*item));
         }
-        while (!mQueue.empty()) {
-            // Even if the queue is deactivated, we should still flush all the remaining values
-            // in the queue.
-            items.push_back(std::move(mQueue.front()));
-            mQueue.pop();
+        // Overflowed items were pushed after the ring buffer was full, so they go last.
+        if (mOverflowSize.load(std::memory_order_acquire) > 0) {
+            std::scoped_lock<std::mutex> lockGuard(mOverflowLock);
+            for (T& item : mOverflow) {
+                items->push_back(std::move(item));
+            }
+            mOverflow.clear();
+            mOverflowSize.store(0, std::memory_order_release);
         }
+    }
+
+    std::vector<T> flush() {
+        std::vector<T> items;
+        flush(&items);
         return items;
     }
 
     void push(T&& item) {
-        {
-            std::scoped_lock<std::mutex> lockGuard(mLock);
-            if (!mIsActive) {
-                return;
+        if (!mIsActive.load(std::memory_order_acquire)) {
+            return;
+        }
+        if (mOverflowSize.load(std::memory_order_acquire) > 0 || !tryPush(item)) {
+            pushOverflow(std::move(item));
+        }
+        // Make sure the item is published before checking for waiters. Pairs with the
+        // fetch_add in waitForItems.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mWaiterCount.load(std::memory_order_relaxed) > 0) {
+            {
+                // Taking the lock makes sure the waiter is either sleeping or has not yet checked
+                // the queue, so the notification could not be lost.
+                std::scoped_lock<std::mutex> lockGuard(mWaitLock);
             }
-            mQueue.push(std::move(item));
+            mCond.notify_one();
         }
-        mCond.notify_one();
     }
 
     // Deactivates the queue, thus no one can push items to it, also notifies all waiting thread.
     // The items already in the queue could still be flushed even after the queue is deactivated.
     void deactivate() {
+        mIsActive.store(false, std::memory_order_seq_cst);
         {
-            std::scoped_lock<std::mutex> lockGuard(mLock);
-            mIsActive = false;
+            // Synchronize with waiters that are about to sleep.
+            std::scoped_lock<std::mutex> lockGuard(mWaitLock);
         }
         // To unblock all waiting consumers.
         mCond.notify_all();
     }
 
-    ConcurrentQueue() = default;
-
     ConcurrentQueue(const ConcurrentQueue&) = delete;
     ConcurrentQueue& operator=(const ConcurrentQueue&) = delete;
 
   private:
-    mutable std::mutex mLock;
-    bool mIsActive GUARDED_BY(mLock) = true;
+    struct Cell {
+        // Equals to the position if the cell is ready to be written for that position. Equals to
+        // the position + 1 if the cell holds the item for that position.
+        std::atomic<size_t> sequence;
+        std::optional<T> item;
+    };
+
+    // Producers and consumers update different positions, keep them on separate cache lines.
+    alignas(64) std::atomic<size_t> mEnqueuePos = 0;
+    alignas(64) std::atomic<size_t> mDequeuePos = 0;
+    alignas(64) std::atomic<bool> mIsActive = true;
+    std::atomic<size_t> mWaiterCount = 0;
+    // The number of items in mOverflow, readable without taking mOverflowLock.
+    std::atomic<size_t> mOverflowSize = 0;
+    std::unique_ptr<Cell[]> mCells;
+    size_t mMask;
+
+    std::mutex mWaitLock;
     std::condition_variable mCond;
-    std::queue<T> mQueue GUARDED_BY(mLock);
+
+    std::mutex mOverflowLock;
+    std::vector<T> mOverflow GUARDED_BY(mOverflowLock);
+
+    // Tries to push the item, returns false if the queue is full. 'item' is only moved from if
+    // this returns true.
+    bool tryPush(T& item) {
+        size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = mCells[pos & mMask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.item.emplace(std::move(item));
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // The cell still holds an item from the previous round.
+                return false;
+            } else {
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::optional<T> pop() {
+        size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = mCells[pos & mMask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (mDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    std::optional<T> item = std::move(cell.item);
+                    cell.item.reset();
+                    cell.sequence.store(pos + mMask + 1, std::memory_order_release);
+                    return item;
+                }
+            } else if (diff < 0) {
+                // Empty.
+                return std::nullopt;
+            } else {
+                pos = mDequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void pushOverflow(T&& item) {
+        std::scoped_lock<std::mutex> lockGuard(mOverflowLock);
+        mOverflow.push_back(std::move(item));
+        mOverflowSize.store(mOverflow.size(), std::memory_order_seq_cst);
+    }
+
+    bool hasItems() {
+        if (mOverflowSize.load(std::memory_order_seq_cst) > 0) {
+            return true;
+        }
+        size_t pos = mDequeuePos.load(std::memory_order_seq_cst);
+        return mCells[pos & mMask].sequence.load(std::memory_order_seq_cst) == pos + 1;
+    }
 };
 
 }  // namespace vehicle
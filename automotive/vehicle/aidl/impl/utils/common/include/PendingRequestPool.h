@@ -21,11 +21,15 @@
 #include <android-base/result.h>
 #include <android-base/thread_annotations.h>
 
-#include <list>
+#include <array>
+#include <condition_variable>
+#include <map>
 #include <mutex>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace android {
 namespace hardware {
@@ -33,11 +37,33 @@ namespace automotive {
 namespace vehicle {
 
 // A thread-safe pending request pool that tracks whether each request has timed-out.
+//
+// Pending requests are indexed by their timeout timestamp, so the timeout thread only wakes up
+// when the earliest request times out, and finishing a request takes O(log n).
 class PendingRequestPool final {
   public:
     using TimeoutCallbackFunc = std::function<void(const std::unordered_set<int64_t>&)>;
 
-    explicit PendingRequestPool(int64_t timeoutInNano);
+    // The default maximum number of pending requests allowed per client. If exceeds this number,
+    // adding more requests would fail with TRY_AGAIN. This is to prevent spamming from client.
+    static constexpr size_t MAX_PENDING_REQUEST_PER_CLIENT = 10000;
+
+    // The number of buckets in the request latency histogram. Bucket 0 counts requests finished
+    // within 1ms, bucket i counts requests finished within [2^(i-1), 2^i) ms and the last bucket
+    // also counts all the requests that take longer.
+    static constexpr size_t LATENCY_BUCKET_COUNT = 12;
+
+    struct RequestStats {
+        std::array<uint64_t, LATENCY_BUCKET_COUNT> latencyHistogram = {};
+        uint64_t finishedCount = 0;
+        uint64_t timeoutCount = 0;
+        // The number of requests rejected because the client has too many pending requests.
+        uint64_t rejectedCount = 0;
+    };
+
+    explicit PendingRequestPool(
+            int64_t timeoutInNano,
+            size_t maxPendingRequestsPerClient = MAX_PENDING_REQUEST_PER_CLIENT);
 
     ~PendingRequestPool();
 
@@ -46,7 +72,9 @@ class PendingRequestPool final {
     // structure that represents a client. The caller must maintain this data structure.
     // All the request IDs must be unique for one client, if any of the requestIds is duplicate with
     // any pending request IDs for the client, this function returns error and no requests would be
-    // added. Otherwise, they would be added to the request pool.
+    // added. If the client would have more than {@code maxPendingRequestsPerClient} pending
+    // requests, this function returns TRY_AGAIN and no requests would be added. Otherwise, they
+    // would be added to the request pool.
     // The callback would be called if requests are not finished within {@code mTimeoutInNano}
     // seconds.
     VhalResult<void> addRequests(const void* clientId,
@@ -68,30 +96,41 @@ class PendingRequestPool final {
 
     size_t countPendingRequests() const;
 
+    // Returns the completion latency histogram and counters for all the requests added so far.
+    RequestStats getRequestStats() const;
+
   private:
-    // The maximum number of pending requests allowed per client. If exceeds this number, adding
-    // more requests would fail. This is to prevent spamming from client.
-    static constexpr size_t MAX_PENDING_REQUEST_PER_CLIENT = 10000;
+    // Requests are ordered by their timeout timestamp, the sequence number breaks the ties.
+    using DeadlineKey = std::pair<int64_t, uint64_t>;
 
     struct PendingRequest {
+        const void* clientId;
         std::unordered_set<int64_t> requestIds;
-        int64_t timeoutTimestamp;
+        int64_t addTimestamp;
         std::shared_ptr<const TimeoutCallbackFunc> callback;
     };
 
-    int64_t mTimeoutInNano;
+    const int64_t mTimeoutInNano;
+    const size_t mMaxPendingRequestsPerClient;
     mutable std::mutex mLock;
-    std::unordered_map<const void*, std::list<PendingRequest>> mPendingRequestsByClient
-            GUARDED_BY(mLock);
+    std::map<DeadlineKey, PendingRequest> mPendingRequestsByDeadline GUARDED_BY(mLock);
+    // Maps each pending request ID to the key of the request batch containing it.
+    std::unordered_map<const void*, std::unordered_map<int64_t, DeadlineKey>>
+            mDeadlineKeysByClient GUARDED_BY(mLock);
+    uint64_t mNextSequence GUARDED_BY(mLock) = 0;
+    RequestStats mRequestStats GUARDED_BY(mLock);
     std::thread mThread;
-    bool mThreadStop = false;
+    bool mThreadStop GUARDED_BY(mLock) = false;
     std::condition_variable mCv;
-    std::mutex mCvLock;
 
-    bool isRequestPendingLocked(const void* clientId, int64_t requestId) const REQUIRES(mLock);
+    // Waits for the earliest pending request to time out and calls its callback, runs in a
+    // separate thread.
+    void checkTimeoutLoop();
+
+    // Removes all the requests with timeout timestamp earlier than 'currentTime' from the pool.
+    std::vector<PendingRequest> takeTimeoutRequestsLocked(int64_t currentTime) REQUIRES(mLock);
 
-    // Checks whether the requests in the pool has timed-out, run periodically in a separate thread.
-    void checkTimeout();
+    void removeRequestIdsLocked(const PendingRequest& request) REQUIRES(mLock);
 };
 
 }  // namespace vehicle
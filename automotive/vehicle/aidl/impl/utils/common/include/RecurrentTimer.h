@@ -19,9 +19,10 @@
 
 #include <android-base/thread_annotations.h>
 
+#include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <unordered_map>
 #include <vector>
@@ -32,12 +33,20 @@ namespace automotive {
 namespace vehicle {
 
 // A thread-safe recurrent timer.
+//
+// Callbacks are kept in a hierarchical timer wheel with a resolution of one tick
+// (kTickInNano). All the callbacks that are due in the same tick are run in one batch after a
+// single wakeup. Registering and unregistering a callback is O(1).
+//
+// By default, all the callbacks are run on the timer thread. If workerThreadCount is not 0, the
+// callbacks are handed to a pool of worker threads instead, in which case the same callback
+// might run concurrently with itself if it takes longer than its interval.
 class RecurrentTimer final {
   public:
     // The class for the function that would be called recurrently.
     using Callback = std::function<void()>;
 
-    RecurrentTimer();
+    explicit RecurrentTimer(size_t workerThreadCount = 0);
 
     ~RecurrentTimer();
 
@@ -52,40 +61,71 @@ class RecurrentTimer final {
     // friend class for unit testing.
     friend class RecurrentTimerTest;
 
+    // The resolution of the timer wheel, 1ms.
+    static constexpr int64_t kTickInNano = 1'000'000;
+    // Each level of the wheel has 64 slots, so that the occupied slots fit in one uint64_t.
+    static constexpr int64_t kSlotBits = 6;
+    static constexpr int64_t kSlotsPerLevel = 1 << kSlotBits;
+    static constexpr int64_t kSlotMask = kSlotsPerLevel - 1;
+    // With 4 levels, the wheel covers 64^4 ticks, which is more than 4 hours. Callbacks that
+    // expire later than that are put in the last level and moved down when they get closer.
+    static constexpr int64_t kLevels = 4;
+
+    // A CallbackInfo is linked in exactly one slot of the wheel. It is an intrusive doubly linked
+    // list node so that it could be removed from its slot without searching.
     struct CallbackInfo {
         std::shared_ptr<Callback> callback;
         int64_t interval;
         int64_t nextTime;
-        // A flag to indicate whether this CallbackInfo is already outdated and should be ignored.
-        // The reason we need this flag is because we cannot easily remove an element from a heap.
-        bool outdated = false;
-
-        static bool cmp(const std::unique_ptr<CallbackInfo>& lhs,
-                        const std::unique_ptr<CallbackInfo>& rhs);
+        // The tick at which the callback should be run, the tick that contains nextTime rounded
+        // up.
+        int64_t expireTick;
+        int64_t level = 0;
+        int64_t slot = 0;
+        CallbackInfo* prev = nullptr;
+        CallbackInfo* next = nullptr;
     };
 
     std::mutex mLock;
     std::thread mThread;
     std::condition_variable mCond;
     bool mStopRequested GUARDED_BY(mLock) = false;
-    // A map to map each callback to its current active CallbackInfo in the mCallbackQueue.
-    std::unordered_map<std::shared_ptr<Callback>, CallbackInfo*> mCallbacks GUARDED_BY(mLock);
-    // A min-heap sorted by nextTime. Note that because we cannot remove arbitrary element from the
-    // heap, a single Callback can have multiple entries in this queue, all but one should be valid.
-    // The rest should be mark as outdated. The valid one is one stored in mCallbacks.
-    std::vector<std::unique_ptr<CallbackInfo>> mCallbackQueue GUARDED_BY(mLock);
+    // Increased each time a callback is registered so that the timer thread recalculates the
+    // time to wait.
+    uint64_t mUpdateCount GUARDED_BY(mLock) = 0;
+    // The next tick to process. All the ticks before it have already been processed.
+    int64_t mCurrentTick GUARDED_BY(mLock) = 0;
+    // A map to map each callback to its CallbackInfo which is linked in the wheel.
+    std::unordered_map<std::shared_ptr<Callback>, std::unique_ptr<CallbackInfo>> mCallbacks
+            GUARDED_BY(mLock);
+    // The head of the linked list for each slot of each level.
+    CallbackInfo* mSlots[kLevels][kSlotsPerLevel] GUARDED_BY(mLock) = {};
+    // One bit for each non-empty slot in each level.
+    uint64_t mOccupiedSlots[kLevels] GUARDED_BY(mLock) = {};
+
+    std::mutex mWorkLock;
+    std::condition_variable mWorkCond;
+    std::vector<std::thread> mWorkerThreads;
+    bool mWorkerStopRequested GUARDED_BY(mWorkLock) = false;
+    std::vector<std::shared_ptr<Callback>> mPendingWork GUARDED_BY(mWorkLock);
 
     void loop();
 
-    // Mark the callbackInfo as outdated and should be ignored when popped from the heap.
-    void markOutdatedLocked(CallbackInfo* callback) REQUIRES(mLock);
-    // Remove all outdated callbackInfos from the top of the heap. This function must be called
-    // each time we might introduce outdated elements to the top. We must make sure the heap is
-    // always valid from the top.
-    void removeInvalidCallbackLocked() REQUIRES(mLock);
-    // Gets the next calblack to run (must be valid) from the heap, update its nextTime and put
-    // it back to the heap.
-    std::shared_ptr<Callback> getNextCallbackLocked(int64_t now) REQUIRES(mLock);
+    void workerLoop();
+
+    // Links the callbackInfo into the slot for its expireTick.
+    void linkLocked(CallbackInfo* info) REQUIRES(mLock);
+    // Removes the callbackInfo from its slot.
+    void unlinkLocked(CallbackInfo* info) REQUIRES(mLock);
+    // Detaches the whole list of callbackInfos in the slot, returns the head.
+    CallbackInfo* takeSlotLocked(int64_t level, int64_t slot) REQUIRES(mLock);
+    // Moves the callbackInfos in the higher levels whose slots start at mCurrentTick down.
+    void cascadeLocked() REQUIRES(mLock);
+    // Gets the earliest tick at which a callback needs to run or a slot needs to be cascaded.
+    int64_t getNextEventTickLocked() REQUIRES(mLock);
+    // Processes all the ticks until nowTick, adds the callbacks to run to 'callbacksToRun'.
+    void advanceLocked(int64_t now, std::vector<std::shared_ptr<Callback>>* callbacksToRun)
+            REQUIRES(mLock);
 };
 
 }  // namespace vehicle
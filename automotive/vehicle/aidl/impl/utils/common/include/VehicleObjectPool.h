@@ -17,10 +17,13 @@
 #ifndef android_hardware_automotive_vehicle_utils_include_VehicleObjectPool_H_
 #define android_hardware_automotive_vehicle_utils_include_VehicleObjectPool_H_
 
+#include <atomic>
 #include <deque>
-#include <map>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include <VehicleHalTypes.h>
 
@@ -32,7 +35,7 @@ namespace automotive {
 namespace vehicle {
 
 // Handy metric mostly for unit tests and debug.
-#define INC_METRIC_IF_DEBUG(val) PoolStats::instance()->val++;
+#define INC_METRIC_IF_DEBUG(val) PoolStats::instance()->val.fetch_add(1, std::memory_order_relaxed);
 
 struct PoolStats {
     std::atomic<uint32_t> Obtained{0};
@@ -70,27 +73,64 @@ using recyclable_ptr = typename std::unique_ptr<T, Deleter<T>>;
 //
 // This class is thread-safe. Concurrent calls to {@Code obtain} from multiple threads is OK, also
 // client can obtain an object in one thread and then move ownership to another thread.
+//
+// Each thread keeps a small cache of free objects for each pool, so obtaining and recycling
+// objects on the same thread does not need to take the pool lock. Only when the thread's cache is
+// empty (or full), a batch of objects is moved from (or to) the shared pool under the lock. The
+// cached objects count towards {@Code maxPoolObjectsSize}, so they are bounded by the pool size
+// like the shared objects. A thread keeps one cache for each live pool it used, and gives the
+// objects back to their pool when it exits. The caches for a destroyed pool are dropped the next
+// time each thread uses any pool.
 template <typename T>
 class ObjectPool {
   public:
     using GetSizeFunc = std::function<size_t(const T&)>;
 
+    // The max number of free objects each thread caches for one pool.
+    static constexpr size_t kLocalCacheSize = 16;
+
     ObjectPool(size_t maxPoolObjectsSize, GetSizeFunc getSizeFunc)
         : mMaxPoolObjectsSize(maxPoolObjectsSize), mGetSizeFunc(getSizeFunc){};
-    virtual ~ObjectPool() = default;
+
+    virtual ~ObjectPool() {
+        if (auto* caches = getLocalCaches(); caches != nullptr) {
+            caches->caches.erase(mId);
+        }
+        // Other threads drop their caches for this pool when they see the new count.
+        sDestroyedPools.fetch_add(1, std::memory_order_release);
+    }
 
     virtual recyclable_ptr<T> obtain() {
-        std::scoped_lock<std::mutex> lock(mLock);
         INC_METRIC_IF_DEBUG(Obtained)
-        if (mObjects.empty()) {
-            INC_METRIC_IF_DEBUG(Created)
-            return wrap(createObject());
+        std::unique_ptr<T> object;
+        LocalCache* cache = getLocalCache();
+        if (cache != nullptr) {
+            if (cache->objects.empty()) {
+                std::scoped_lock<std::mutex> lock(mShared->lock);
+                takeObjectsLocked(&cache->objects, kLocalCacheSize / 2);
+            }
+            if (!cache->objects.empty()) {
+                object = std::move(cache->objects.back());
+                cache->objects.pop_back();
+            }
+        } else {
+            // The thread local caches are already destroyed because this thread is exiting.
+            LocalObjects objects;
+            {
+                std::scoped_lock<std::mutex> lock(mShared->lock);
+                takeObjectsLocked(&objects, 1);
+            }
+            if (!objects.empty()) {
+                object = std::move(objects.back());
+            }
         }
 
-        auto o = wrap(mObjects.front().release());
-        mObjects.pop_front();
-        mPoolObjectsSize -= mGetSizeFunc(*o);
-        return o;
+        if (object != nullptr) {
+            mShared->objectsSize.fetch_sub(mGetSizeFunc(*object), std::memory_order_relaxed);
+            return wrap(object.release());
+        }
+        INC_METRIC_IF_DEBUG(Created)
+        return wrap(createObject());
     }
 
     ObjectPool& operator=(const ObjectPool&) = delete;
@@ -100,42 +140,147 @@ class ObjectPool {
     virtual T* createObject() = 0;
 
     virtual void recycle(T* o) {
-        std::scoped_lock<std::mutex> lock(mLock);
-        size_t objectSize = mGetSizeFunc(*o);
-
-        if (objectSize > mMaxPoolObjectsSize ||
-            mPoolObjectsSize > mMaxPoolObjectsSize - objectSize) {
+        std::unique_ptr<T> object{o};
+        if (!tryReserve(mGetSizeFunc(*object))) {
             INC_METRIC_IF_DEBUG(Deleted)
 
             // We have no space left in the pool.
-            delete o;
             return;
         }
-
         INC_METRIC_IF_DEBUG(Recycled)
 
-        mObjects.push_back(std::unique_ptr<T>{o});
-        mPoolObjectsSize += objectSize;
+        LocalCache* cache = getLocalCache();
+        if (cache != nullptr && cache->objects.size() < kLocalCacheSize) {
+            cache->objects.push_back(std::move(object));
+            return;
+        }
+
+        std::scoped_lock<std::mutex> lock(mShared->lock);
+        if (cache != nullptr) {
+            // Move half of the local cache to the shared pool, so that the following recycle
+            // calls on this thread do not need the lock.
+            while (cache->objects.size() > kLocalCacheSize / 2) {
+                mShared->objects.push_back(std::move(cache->objects.back()));
+                cache->objects.pop_back();
+            }
+        }
+        mShared->objects.push_back(std::move(object));
     }
 
     const size_t mMaxPoolObjectsSize;
 
   private:
-    const Deleter<T>& getDeleter() {
-        if (!mDeleter.get()) {
-            Deleter<T>* d =
-                    new Deleter<T>(std::bind(&ObjectPool::recycle, this, std::placeholders::_1));
-            mDeleter.reset(d);
+    using LocalObjects = std::vector<std::unique_ptr<T>>;
+
+    // The part of the pool the thread caches refer to. They only hold a weak reference, so it is
+    // destroyed with the pool.
+    struct SharedPool {
+        std::mutex lock;
+        std::deque<std::unique_ptr<T>> objects GUARDED_BY(lock);
+        // The size of all the free objects of the pool, including the ones in thread caches.
+        std::atomic<size_t> objectsSize = 0;
+    };
+
+    // The free objects of one pool cached by one thread.
+    struct LocalCache {
+        std::weak_ptr<SharedPool> pool;
+        LocalObjects objects;
+
+        LocalCache() = default;
+        LocalCache(LocalCache&&) = default;
+        LocalCache& operator=(LocalCache&&) = default;
+
+        // Gives the objects back to the pool if it still exists. They are already counted in
+        // its objectsSize.
+        ~LocalCache() {
+            if (objects.empty()) {
+                return;
+            }
+            if (auto shared = pool.lock(); shared != nullptr) {
+                std::scoped_lock<std::mutex> lock(shared->lock);
+                for (auto& object : objects) {
+                    shared->objects.push_back(std::move(object));
+                }
+            }
         }
-        return *mDeleter.get();
+    };
+
+    // The free object caches of one thread for all the pools.
+    struct LocalCaches {
+        // Keyed by pool ID.
+        std::unordered_map<uint64_t, LocalCache> caches;
+        // The value of sDestroyedPools when the caches for destroyed pools were last dropped.
+        uint64_t destroyedPools = 0;
+    };
+
+    static inline std::atomic<uint64_t> sNextId = 0;
+    static inline std::atomic<uint64_t> sDestroyedPools = 0;
+
+    // Returns the free object caches of the current thread. Returns nullptr if the caches are
+    // already destroyed because the thread is exiting.
+    static LocalCaches* getLocalCaches() {
+        // This is trivially destructible, so it is still valid after sHolder is destroyed.
+        static thread_local bool sDestroyed = false;
+        struct Holder {
+            LocalCaches caches;
+            ~Holder() { sDestroyed = true; }
+        };
+        if (sDestroyed) {
+            return nullptr;
+        }
+        static thread_local Holder sHolder;
+        return &sHolder.caches;
     }
 
-    recyclable_ptr<T> wrap(T* raw) { return recyclable_ptr<T>{raw, getDeleter()}; }
+    LocalCache* getLocalCache() {
+        LocalCaches* local = getLocalCaches();
+        if (local == nullptr) {
+            return nullptr;
+        }
+        uint64_t destroyedPools = sDestroyedPools.load(std::memory_order_acquire);
+        if (local->destroyedPools != destroyedPools) {
+            for (auto it = local->caches.begin(); it != local->caches.end();) {
+                it = it->second.pool.expired() ? local->caches.erase(it) : std::next(it);
+            }
+            local->destroyedPools = destroyedPools;
+        }
+        if (auto it = local->caches.find(mId); it != local->caches.end()) {
+            return &it->second;
+        }
+        LocalCache& cache = local->caches[mId];
+        cache.pool = mShared;
+        return &cache;
+    }
 
-    mutable std::mutex mLock;
-    std::deque<std::unique_ptr<T>> mObjects GUARDED_BY(mLock);
-    std::unique_ptr<Deleter<T>> mDeleter;
-    size_t mPoolObjectsSize GUARDED_BY(mLock);
+    // Counts an object of the given size as free, returns false if there is not enough space
+    // left in the pool.
+    bool tryReserve(size_t objectSize) {
+        size_t objectsSize = mShared->objectsSize.load(std::memory_order_relaxed);
+        do {
+            if (objectSize > mMaxPoolObjectsSize ||
+                objectsSize > mMaxPoolObjectsSize - objectSize) {
+                return false;
+            }
+        } while (!mShared->objectsSize.compare_exchange_weak(objectsSize, objectsSize + objectSize,
+                                                             std::memory_order_relaxed));
+        return true;
+    }
+
+    void takeObjectsLocked(LocalObjects* objects, size_t count) REQUIRES(mShared->lock) {
+        while (count > 0 && !mShared->objects.empty()) {
+            objects->push_back(std::move(mShared->objects.back()));
+            mShared->objects.pop_back();
+            count--;
+        }
+    }
+
+    recyclable_ptr<T> wrap(T* raw) { return recyclable_ptr<T>{raw, mDeleter}; }
+
+    // Used as the key for the thread local caches. Unlike 'this', the ID is never reused by
+    // another pool.
+    const uint64_t mId = sNextId.fetch_add(1, std::memory_order_relaxed);
+    const std::shared_ptr<SharedPool> mShared = std::make_shared<SharedPool>();
+    const Deleter<T> mDeleter{[this](T* o) { recycle(o); }};
     GetSizeFunc mGetSizeFunc;
 };
 
@@ -155,6 +300,9 @@ class ObjectPool {
 // immediately once the go out of scope. There's no synchronization penalty for these objects since
 // we do not store them in the pool.
 //
+// Vector values are pooled by size class: a value with vector size N comes from the pool for the
+// next power of 2 >= N, so values with different but similar sizes could reuse the same objects.
+//
 // This class is thread-safe. Users can obtain an object in one thread and pass it to another.
 //
 // Sample usage:
@@ -178,11 +326,10 @@ class VehiclePropValuePool {
     // unique pointer instead of a recyclable pointer. The object would not be recycled once it
     // goes out of scope, but would be deleted.
     // @param maxPoolObjectsSize - The approximate upper bound of memory each internal recycling
-    // pool could take. We have 4 different type pools, each with 4 different vector size, so
-    // approximately this pool would at-most take 4 * 4 * 10240 = 160k memory.
-    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4, size_t maxPoolObjectsSize = 10240)
-        : mMaxRecyclableVectorSize(maxRecyclableVectorSize),
-          mMaxPoolObjectsSize(maxPoolObjectsSize){};
+    // pool could take, including the objects cached by each thread. We have 8 different type
+    // pools, each with 3 different size classes, so approximately this pool would at-most take
+    // 8 * 3 * 10240 = 240k memory.
+    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4, size_t maxPoolObjectsSize = 10240);
 
     // Obtain a recyclable VehiclePropertyValue object from the pool for the given type. If the
     // given type is not MIXED or STRING, the internal value vector size would be set to 1.
@@ -245,6 +392,10 @@ class VehiclePropValuePool {
             aidl::android::hardware::automotive::vehicle::VehiclePropertyType type,
             size_t vectorSize);
 
+    // Returns the index of the size class for the vector size, size class i holds values with
+    // vector size up to 2^i.
+    static size_t getSizeClass(size_t vectorSize);
+
     class InternalPool
         : public ObjectPool<aidl::android::hardware::automotive::vehicle::VehiclePropValue> {
       public:
@@ -264,11 +415,12 @@ class VehiclePropValuePool {
 
         template <typename VecType>
         bool check(std::vector<VecType>* vec, bool isVectorType) {
-            return vec->size() == (isVectorType ? mVectorSize : 0);
+            return isVectorType ? vec->size() <= mVectorSize : vec->empty();
         }
 
       private:
         aidl::android::hardware::automotive::vehicle::VehiclePropertyType mPropType;
+        // The max vector size for this size class.
         size_t mVectorSize;
     };
     const Deleter<aidl::android::hardware::automotive::vehicle::VehiclePropValue>
@@ -277,12 +429,13 @@ class VehiclePropValuePool {
                         delete v;
                     }};
 
-    mutable std::mutex mLock;
     const size_t mMaxRecyclableVectorSize;
     const size_t mMaxPoolObjectsSize;
-    // A map with 'property_type' | 'value_vector_size' as key and a recyclable object pool as
-    // value. We would create a recyclable pool for each property type and vector size combination.
-    std::map<int32_t, std::unique_ptr<InternalPool>> mValueTypePools GUARDED_BY(mLock);
+    const size_t mSizeClassCount;
+    // The recyclable object pools, indexed by 'type_index' * mSizeClassCount + 'size_class'. All
+    // the pools are created in the constructor and never change, so no lock is needed to find
+    // them.
+    std::vector<std::unique_ptr<InternalPool>> mValueTypePools;
 };
 
 }  // namespace vehicle
@@ -21,6 +21,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 
 #include <VehicleHalTypes.h>
@@ -40,7 +41,10 @@ namespace vehicle {
 // VehiclePropertyValues stored in a sorted map thus it makes easier to get range of values, e.g.
 // to get value for all areas for particular property.
 //
-// This class is thread-safe, however it uses blocking synchronization across all methods.
+// This class is thread-safe. Property configs are immutable once registered, so the map of records
+// is protected by a reader-writer lock that is only taken exclusively by registerProperty and
+// setOnValueChangeCallback. Each record has its own lock protecting its values, so reads and
+// writes for different properties never contend with each other.
 class VehiclePropertyStore final {
   public:
     using ValueResultType = VhalResult<VehiclePropValuePool::RecyclableType>;
@@ -157,27 +161,38 @@ class VehiclePropertyStore final {
         size_t operator()(RecordId const& recordId) const;
     };
 
+    // A record is only modified while holding 'lock'. 'propConfig' and 'tokenFunction' are only
+    // modified while holding 'mLock' exclusively, so they could be read without 'lock' while
+    // holding 'mLock' in shared mode.
     struct Record {
         aidl::android::hardware::automotive::vehicle::VehiclePropConfig propConfig;
         TokenFunction tokenFunction;
-        std::unordered_map<RecordId, VehiclePropValuePool::RecyclableType, RecordIdHash> values;
+        mutable std::mutex lock;
+        std::unordered_map<RecordId, VehiclePropValuePool::RecyclableType, RecordIdHash> values
+                GUARDED_BY(lock);
     };
 
     // {@code VehiclePropValuePool} is thread-safe.
     std::shared_ptr<VehiclePropValuePool> mValuePool;
-    mutable std::mutex mLock;
-    std::unordered_map<int32_t, Record> mRecordsByPropId GUARDED_BY(mLock);
-    OnValueChangeCallback mOnValueChangeCallback GUARDED_BY(mLock);
-
-    const Record* getRecordLocked(int32_t propId) const;
-
-    Record* getRecordLocked(int32_t propId);
-
+    // Only held exclusively when registering a property or changing the callback. All the other
+    // operations hold it in shared mode and then lock the record they operate on.
+    mutable std::shared_mutex mLock;
+    // Guarded by mLock. Records are allocated separately so that the address of a record, as well
+    // as the config returned by getConfig, stays stable while the map grows.
+    std::unordered_map<int32_t, std::unique_ptr<Record>> mRecordsByPropId;
+    // Guarded by mLock.
+    OnValueChangeCallback mOnValueChangeCallback;
+
+    // Requires mLock to be held, either shared or exclusive.
+    Record* getRecordLocked(int32_t propId) const;
+
+    // Requires mLock to be held, either shared or exclusive.
     RecordId getRecordIdLocked(
             const aidl::android::hardware::automotive::vehicle::VehiclePropValue& propValue,
             const Record& record) const;
 
-    ValueResultType readValueLocked(const RecordId& recId, const Record& record) const;
+    ValueResultType readValueLocked(const RecordId& recId, const Record& record) const
+            REQUIRES(record.lock);
 };
 
 }  // namespace vehicle
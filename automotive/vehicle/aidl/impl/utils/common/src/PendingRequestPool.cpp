@@ -33,31 +33,32 @@ namespace {
 
 using ::aidl::android::hardware::automotive::vehicle::StatusCode;
 using ::android::base::Result;
+using ::android::base::ScopedLockAssertion;
 
-// At least check every 1s.
-constexpr int64_t CHECK_TIME_IN_NANO = 1'000'000'000;
+constexpr int64_t ONE_MILLI_IN_NANO = 1'000'000;
+
+size_t getLatencyBucket(int64_t latencyInNano) {
+    size_t bucket = 0;
+    int64_t latencyInMilli = latencyInNano / ONE_MILLI_IN_NANO;
+    while (latencyInMilli > 0 && bucket < PendingRequestPool::LATENCY_BUCKET_COUNT - 1) {
+        latencyInMilli >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
 
 }  // namespace
 
-PendingRequestPool::PendingRequestPool(int64_t timeoutInNano) : mTimeoutInNano(timeoutInNano) {
-    mThread = std::thread([this] {
-        // [this] must be alive within this thread because destructor would wait for this thread
-        // to exit.
-        int64_t sleepTime = std::min(mTimeoutInNano, static_cast<int64_t>(CHECK_TIME_IN_NANO));
-        std::unique_lock<std::mutex> lk(mCvLock);
-        while (!mCv.wait_for(lk, std::chrono::nanoseconds(sleepTime),
-                             [this] { return mThreadStop; })) {
-            checkTimeout();
-        }
-    });
+PendingRequestPool::PendingRequestPool(int64_t timeoutInNano, size_t maxPendingRequestsPerClient)
+    : mTimeoutInNano(timeoutInNano), mMaxPendingRequestsPerClient(maxPendingRequestsPerClient) {
+    // [this] must be alive within this thread because destructor would wait for this thread to
+    // exit.
+    mThread = std::thread([this] { checkTimeoutLoop(); });
 }
 
 PendingRequestPool::~PendingRequestPool() {
     {
-        // Even if the shared variable is atomic, it must be modified under the
-        // mutex in order to correctly publish the modification to the waiting
-        // thread.
-        std::unique_lock<std::mutex> lk(mCvLock);
+        std::scoped_lock<std::mutex> lockGuard(mLock);
         mThreadStop = true;
     }
     mCv.notify_all();
@@ -69,68 +70,76 @@ PendingRequestPool::~PendingRequestPool() {
     {
         std::scoped_lock<std::mutex> lockGuard(mLock);
 
-        for (auto& [_, pendingRequests] : mPendingRequestsByClient) {
-            for (const auto& request : pendingRequests) {
-                (*request.callback)(request.requestIds);
-            }
+        for (const auto& [_, request] : mPendingRequestsByDeadline) {
+            (*request.callback)(request.requestIds);
         }
-        mPendingRequestsByClient.clear();
+        mPendingRequestsByDeadline.clear();
+        mDeadlineKeysByClient.clear();
     }
 }
 
 VhalResult<void> PendingRequestPool::addRequests(
         const void* clientId, const std::unordered_set<int64_t>& requestIds,
         std::shared_ptr<const TimeoutCallbackFunc> callback) {
-    std::scoped_lock<std::mutex> lockGuard(mLock);
-    std::list<PendingRequest>* pendingRequests;
-    size_t pendingRequestCount = 0;
-    if (mPendingRequestsByClient.find(clientId) != mPendingRequestsByClient.end()) {
-        pendingRequests = &mPendingRequestsByClient[clientId];
-        for (const auto& pendingRequest : *pendingRequests) {
-            const auto& pendingRequestIds = pendingRequest.requestIds;
-            for (int64_t requestId : requestIds) {
-                if (pendingRequestIds.find(requestId) != pendingRequestIds.end()) {
-                    return StatusError(StatusCode::INVALID_ARG)
-                           << "duplicate request ID: " << requestId;
-                }
+    bool isEarliestDeadline = false;
+    {
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        auto& deadlineKeys = mDeadlineKeysByClient[clientId];
+        for (int64_t requestId : requestIds) {
+            if (deadlineKeys.find(requestId) != deadlineKeys.end()) {
+                return StatusError(StatusCode::INVALID_ARG)
+                       << "duplicate request ID: " << requestId;
             }
-            pendingRequestCount += pendingRequestIds.size();
         }
-    } else {
-        // Create a new empty list for this client.
-        pendingRequests = &mPendingRequestsByClient[clientId];
-    }
 
-    if (requestIds.size() > MAX_PENDING_REQUEST_PER_CLIENT - pendingRequestCount) {
-        return StatusError(StatusCode::TRY_AGAIN) << "too many pending requests";
-    }
-
-    int64_t currentTime = elapsedRealtimeNano();
-    int64_t timeoutTimestamp = currentTime + mTimeoutInNano;
+        if (requestIds.size() > mMaxPendingRequestsPerClient - deadlineKeys.size()) {
+            mRequestStats.rejectedCount += requestIds.size();
+            if (deadlineKeys.empty()) {
+                mDeadlineKeysByClient.erase(clientId);
+            }
+            return StatusError(StatusCode::TRY_AGAIN) << "too many pending requests";
+        }
 
-    pendingRequests->push_back({
-            .requestIds = std::unordered_set<int64_t>(requestIds.begin(), requestIds.end()),
-            .timeoutTimestamp = timeoutTimestamp,
-            .callback = callback,
-    });
+        int64_t currentTime = elapsedRealtimeNano();
+        DeadlineKey key = {currentTime + mTimeoutInNano, mNextSequence++};
+        for (int64_t requestId : requestIds) {
+            deadlineKeys[requestId] = key;
+        }
+        auto it = mPendingRequestsByDeadline
+                          .emplace(key,
+                                   PendingRequest{
+                                           .clientId = clientId,
+                                           .requestIds = requestIds,
+                                           .addTimestamp = currentTime,
+                                           .callback = callback,
+                                   })
+                          .first;
+        isEarliestDeadline = (it == mPendingRequestsByDeadline.begin());
+    }
 
+    if (isEarliestDeadline) {
+        // The timeout thread needs to wake up earlier for the new requests.
+        mCv.notify_one();
+    }
     return {};
 }
 
 bool PendingRequestPool::isRequestPending(const void* clientId, int64_t requestId) const {
     std::scoped_lock<std::mutex> lockGuard(mLock);
 
-    return isRequestPendingLocked(clientId, requestId);
+    auto it = mDeadlineKeysByClient.find(clientId);
+    if (it == mDeadlineKeysByClient.end()) {
+        return false;
+    }
+    return it->second.find(requestId) != it->second.end();
 }
 
 size_t PendingRequestPool::countPendingRequests() const {
     std::scoped_lock<std::mutex> lockGuard(mLock);
 
     size_t count = 0;
-    for (const auto& [clientId, requests] : mPendingRequestsByClient) {
-        for (const auto& request : requests) {
-            count += request.requestIds.size();
-        }
+    for (const auto& [_, deadlineKeys] : mDeadlineKeysByClient) {
+        count += deadlineKeys.size();
     }
     return count;
 }
@@ -138,65 +147,72 @@ size_t PendingRequestPool::countPendingRequests() const {
 size_t PendingRequestPool::countPendingRequests(const void* clientId) const {
     std::scoped_lock<std::mutex> lockGuard(mLock);
 
-    auto it = mPendingRequestsByClient.find(clientId);
-    if (it == mPendingRequestsByClient.end()) {
+    auto it = mDeadlineKeysByClient.find(clientId);
+    if (it == mDeadlineKeysByClient.end()) {
         return 0;
     }
+    return it->second.size();
+}
 
-    size_t count = 0;
-    for (const auto& pendingRequest : it->second) {
-        count += pendingRequest.requestIds.size();
-    }
+PendingRequestPool::RequestStats PendingRequestPool::getRequestStats() const {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
 
-    return count;
+    return mRequestStats;
 }
 
-bool PendingRequestPool::isRequestPendingLocked(const void* clientId, int64_t requestId) const {
-    auto it = mPendingRequestsByClient.find(clientId);
-    if (it == mPendingRequestsByClient.end()) {
-        return false;
-    }
-    for (const auto& pendingRequest : it->second) {
-        const auto& requestIds = pendingRequest.requestIds;
-        if (requestIds.find(requestId) != requestIds.end()) {
-            return true;
+void PendingRequestPool::checkTimeoutLoop() {
+    std::unique_lock<std::mutex> uniqueLock(mLock);
+    while (true) {
+        ScopedLockAssertion lockAssertion(mLock);
+        if (mThreadStop) {
+            return;
+        }
+        if (mPendingRequestsByDeadline.empty()) {
+            mCv.wait(uniqueLock);
+            continue;
         }
-    }
-    return false;
-}
-
-void PendingRequestPool::checkTimeout() {
-    std::vector<PendingRequest> timeoutRequests;
-    {
-        std::scoped_lock<std::mutex> lockGuard(mLock);
 
         int64_t currentTime = elapsedRealtimeNano();
+        int64_t nextTimeout = mPendingRequestsByDeadline.begin()->first.first;
+        if (nextTimeout >= currentTime) {
+            mCv.wait_for(uniqueLock, std::chrono::nanoseconds(nextTimeout - currentTime + 1));
+            continue;
+        }
 
-        std::vector<const void*> clientsWithEmptyRequests;
-
-        for (auto& [clientId, pendingRequests] : mPendingRequestsByClient) {
-            auto it = pendingRequests.begin();
-            while (it != pendingRequests.end()) {
-                if (it->timeoutTimestamp >= currentTime) {
-                    break;
-                }
-                timeoutRequests.push_back(std::move(*it));
-                it = pendingRequests.erase(it);
-            }
+        std::vector<PendingRequest> timeoutRequests = takeTimeoutRequestsLocked(currentTime);
 
-            if (pendingRequests.empty()) {
-                clientsWithEmptyRequests.push_back(clientId);
-            }
+        // Call the callback outside the lock.
+        uniqueLock.unlock();
+        for (const auto& request : timeoutRequests) {
+            (*request.callback)(request.requestIds);
         }
+        uniqueLock.lock();
+    }
+}
 
-        for (const void* clientId : clientsWithEmptyRequests) {
-            mPendingRequestsByClient.erase(clientId);
-        }
+std::vector<PendingRequestPool::PendingRequest> PendingRequestPool::takeTimeoutRequestsLocked(
+        int64_t currentTime) {
+    std::vector<PendingRequest> timeoutRequests;
+    auto it = mPendingRequestsByDeadline.begin();
+    while (it != mPendingRequestsByDeadline.end() && it->first.first < currentTime) {
+        removeRequestIdsLocked(it->second);
+        mRequestStats.timeoutCount += it->second.requestIds.size();
+        timeoutRequests.push_back(std::move(it->second));
+        it = mPendingRequestsByDeadline.erase(it);
     }
+    return timeoutRequests;
+}
 
-    // Call the callback outside the lock.
-    for (const auto& request : timeoutRequests) {
-        (*request.callback)(request.requestIds);
+void PendingRequestPool::removeRequestIdsLocked(const PendingRequest& request) {
+    auto it = mDeadlineKeysByClient.find(request.clientId);
+    if (it == mDeadlineKeysByClient.end()) {
+        return;
+    }
+    for (int64_t requestId : request.requestIds) {
+        it->second.erase(requestId);
+    }
+    if (it->second.empty()) {
+        mDeadlineKeysByClient.erase(it);
     }
 }
 
@@ -206,27 +222,35 @@ std::unordered_set<int64_t> PendingRequestPool::tryFinishRequests(
 
     std::unordered_set<int64_t> foundIds;
 
-    if (mPendingRequestsByClient.find(clientId) == mPendingRequestsByClient.end()) {
+    auto clientIt = mDeadlineKeysByClient.find(clientId);
+    if (clientIt == mDeadlineKeysByClient.end()) {
         return foundIds;
     }
 
-    auto& pendingRequests = mPendingRequestsByClient[clientId];
-    auto it = pendingRequests.begin();
-    while (it != pendingRequests.end()) {
-        auto& pendingRequestIds = it->requestIds;
-        for (int64_t requestId : requestIds) {
-            auto idIt = pendingRequestIds.find(requestId);
-            if (idIt == pendingRequestIds.end()) {
-                continue;
-            }
-            pendingRequestIds.erase(idIt);
-            foundIds.insert(requestId);
+    auto& deadlineKeys = clientIt->second;
+    int64_t currentTime = elapsedRealtimeNano();
+    for (int64_t requestId : requestIds) {
+        auto keyIt = deadlineKeys.find(requestId);
+        if (keyIt == deadlineKeys.end()) {
+            continue;
         }
-        if (pendingRequestIds.empty()) {
-            it = pendingRequests.erase(it);
+        auto requestIt = mPendingRequestsByDeadline.find(keyIt->second);
+        deadlineKeys.erase(keyIt);
+        foundIds.insert(requestId);
+        if (requestIt == mPendingRequestsByDeadline.end()) {
             continue;
         }
-        it++;
+
+        PendingRequest& request = requestIt->second;
+        request.requestIds.erase(requestId);
+        mRequestStats.latencyHistogram[getLatencyBucket(currentTime - request.addTimestamp)]++;
+        mRequestStats.finishedCount++;
+        if (request.requestIds.empty()) {
+            mPendingRequestsByDeadline.erase(requestIt);
+        }
+    }
+    if (deadlineKeys.empty()) {
+        mDeadlineKeysByClient.erase(clientIt);
     }
 
     return foundIds;
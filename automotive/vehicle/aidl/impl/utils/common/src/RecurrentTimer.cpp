@@ -22,6 +22,8 @@
 #include <inttypes.h>
 #include <math.h>
 
+#include <algorithm>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -29,7 +31,28 @@ namespace vehicle {
 
 using ::android::base::ScopedLockAssertion;
 
-RecurrentTimer::RecurrentTimer() {
+namespace {
+
+// Rounds up the time to the tick that contains it.
+int64_t toTick(int64_t timeInNano, int64_t tickInNano) {
+    return (timeInNano + tickInNano - 1) / tickInNano;
+}
+
+// Rotates the bits right so that bit 'shift' becomes bit 0.
+uint64_t rotateRight(uint64_t bits, int64_t shift) {
+    return (bits >> shift) | (bits << ((64 - shift) & 63));
+}
+
+}  // namespace
+
+RecurrentTimer::RecurrentTimer(size_t workerThreadCount) {
+    {
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        mCurrentTick = uptimeNanos() / kTickInNano;
+    }
+    for (size_t i = 0; i < workerThreadCount; i++) {
+        mWorkerThreads.emplace_back(&RecurrentTimer::workerLoop, this);
+    }
     mThread = std::thread(&RecurrentTimer::loop, this);
 }
 
@@ -42,6 +65,14 @@ RecurrentTimer::~RecurrentTimer() {
     if (mThread.joinable()) {
         mThread.join();
     }
+    {
+        std::scoped_lock<std::mutex> lockGuard(mWorkLock);
+        mWorkerStopRequested = true;
+    }
+    mWorkCond.notify_all();
+    for (auto& thread : mWorkerThreads) {
+        thread.join();
+    }
 }
 
 void RecurrentTimer::registerTimerCallback(int64_t intervalInNano,
@@ -49,73 +80,163 @@ void RecurrentTimer::registerTimerCallback(int64_t intervalInNano,
     {
         std::scoped_lock<std::mutex> lockGuard(mLock);
 
-        // Aligns the nextTime to multiply of interval.
-        int64_t nextTime = ceil(uptimeNanos() / intervalInNano) * intervalInNano;
+        int64_t now = uptimeNanos();
+        if (mCallbacks.empty()) {
+            // The wheel is empty, so we could skip the ticks the timer thread has not processed
+            // while it was idle.
+            mCurrentTick = now / kTickInNano;
+        }
 
-        std::unique_ptr<CallbackInfo> info = std::make_unique<CallbackInfo>();
-        info->callback = callback;
-        info->interval = intervalInNano;
-        info->nextTime = nextTime;
+        // Aligns the nextTime to multiply of interval.
+        int64_t nextTime = ceil(now / intervalInNano) * intervalInNano;
 
         auto it = mCallbacks.find(callback);
         if (it != mCallbacks.end()) {
             ALOGI("Replacing an existing timer callback with a new interval, current: %" PRId64
                   " ns, new: %" PRId64 " ns",
                   it->second->interval, intervalInNano);
-            markOutdatedLocked(it->second);
+            unlinkLocked(it->second.get());
+        } else {
+            it = mCallbacks.emplace(callback, std::make_unique<CallbackInfo>()).first;
         }
-        mCallbacks[callback] = info.get();
-        mCallbackQueue.push_back(std::move(info));
-        // Insert the last element into the heap.
-        std::push_heap(mCallbackQueue.begin(), mCallbackQueue.end(), CallbackInfo::cmp);
+
+        CallbackInfo* info = it->second.get();
+        info->callback = callback;
+        info->interval = intervalInNano;
+        info->nextTime = nextTime;
+        info->expireTick = toTick(nextTime, kTickInNano);
+        linkLocked(info);
+        mUpdateCount++;
     }
     mCond.notify_one();
 }
 
 void RecurrentTimer::unregisterTimerCallback(std::shared_ptr<RecurrentTimer::Callback> callback) {
-    {
-        std::scoped_lock<std::mutex> lockGuard(mLock);
+    std::scoped_lock<std::mutex> lockGuard(mLock);
 
-        auto it = mCallbacks.find(callback);
-        if (it == mCallbacks.end()) {
-            ALOGE("No event found to unregister");
-            return;
-        }
+    auto it = mCallbacks.find(callback);
+    if (it == mCallbacks.end()) {
+        ALOGE("No event found to unregister");
+        return;
+    }
+
+    unlinkLocked(it->second.get());
+    mCallbacks.erase(it);
+    // No need to wake up the timer thread, at worst it would wake up once for nothing.
+}
 
-        markOutdatedLocked(it->second);
-        mCallbacks.erase(it);
+void RecurrentTimer::linkLocked(RecurrentTimer::CallbackInfo* info) {
+    // Callbacks that are already due are run in the next tick to process.
+    int64_t expireTick = std::max(info->expireTick, mCurrentTick);
+    int64_t delta = expireTick - mCurrentTick;
+    int64_t level = 0;
+    while (level < kLevels - 1 && delta >= (int64_t(1) << (kSlotBits * (level + 1)))) {
+        level++;
     }
+    if (level == kLevels - 1 && delta >= (int64_t(1) << (kSlotBits * kLevels))) {
+        // Too far away, put it in the farthest slot, it would be moved to the right slot when it
+        // is cascaded.
+        expireTick = mCurrentTick + (int64_t(1) << (kSlotBits * kLevels)) - 1;
+    }
+    int64_t slot = (expireTick >> (kSlotBits * level)) & kSlotMask;
 
-    mCond.notify_one();
+    info->level = level;
+    info->slot = slot;
+    info->prev = nullptr;
+    info->next = mSlots[level][slot];
+    if (info->next != nullptr) {
+        info->next->prev = info;
+    }
+    mSlots[level][slot] = info;
+    mOccupiedSlots[level] |= uint64_t(1) << slot;
+}
+
+void RecurrentTimer::unlinkLocked(RecurrentTimer::CallbackInfo* info) {
+    if (info->prev != nullptr) {
+        info->prev->next = info->next;
+    } else {
+        mSlots[info->level][info->slot] = info->next;
+    }
+    if (info->next != nullptr) {
+        info->next->prev = info->prev;
+    }
+    info->prev = nullptr;
+    info->next = nullptr;
+    if (mSlots[info->level][info->slot] == nullptr) {
+        mOccupiedSlots[info->level] &= ~(uint64_t(1) << info->slot);
+    }
 }
 
-void RecurrentTimer::markOutdatedLocked(RecurrentTimer::CallbackInfo* info) {
-    info->outdated = true;
-    info->callback = nullptr;
-    // Make sure the first element is always valid.
-    removeInvalidCallbackLocked();
+RecurrentTimer::CallbackInfo* RecurrentTimer::takeSlotLocked(int64_t level, int64_t slot) {
+    CallbackInfo* head = mSlots[level][slot];
+    mSlots[level][slot] = nullptr;
+    mOccupiedSlots[level] &= ~(uint64_t(1) << slot);
+    return head;
+}
+
+void RecurrentTimer::cascadeLocked() {
+    for (int64_t level = 1; level < kLevels; level++) {
+        int64_t levelShift = kSlotBits * level;
+        if ((mCurrentTick & ((int64_t(1) << levelShift) - 1)) != 0) {
+            // Not at the start of a slot for this level, so not for the higher levels either.
+            break;
+        }
+        CallbackInfo* info = takeSlotLocked(level, (mCurrentTick >> levelShift) & kSlotMask);
+        while (info != nullptr) {
+            CallbackInfo* next = info->next;
+            linkLocked(info);
+            info = next;
+        }
+    }
 }
 
-void RecurrentTimer::removeInvalidCallbackLocked() {
-    while (mCallbackQueue.size() != 0 && mCallbackQueue[0]->outdated) {
-        std::pop_heap(mCallbackQueue.begin(), mCallbackQueue.end(), CallbackInfo::cmp);
-        mCallbackQueue.pop_back();
+int64_t RecurrentTimer::getNextEventTickLocked() {
+    int64_t nextTick = INT64_MAX;
+    for (int64_t level = 0; level < kLevels; level++) {
+        if (mOccupiedSlots[level] == 0) {
+            continue;
+        }
+        int64_t levelShift = kSlotBits * level;
+        int64_t levelTick = mCurrentTick >> levelShift;
+        uint64_t occupied = rotateRight(mOccupiedSlots[level], levelTick & kSlotMask);
+        if (level > 0 && (mCurrentTick & ((int64_t(1) << levelShift) - 1)) != 0) {
+            // The current slot for this level has already been cascaded, so anything in it is
+            // due one full round later.
+            occupied &= ~uint64_t(1);
+        }
+        int64_t distance = occupied == 0 ? kSlotsPerLevel : __builtin_ctzll(occupied);
+        int64_t eventTick = level == 0 ? mCurrentTick + distance : (levelTick + distance)
+                                                                           << levelShift;
+        nextTick = std::min(nextTick, eventTick);
     }
+    return nextTick;
 }
 
-std::shared_ptr<RecurrentTimer::Callback> RecurrentTimer::getNextCallbackLocked(int64_t now) {
-    std::pop_heap(mCallbackQueue.begin(), mCallbackQueue.end(), CallbackInfo::cmp);
-    auto& callbackInfo = mCallbackQueue[mCallbackQueue.size() - 1];
-    auto nextCallback = callbackInfo->callback;
-    // intervalCount is the number of interval we have to advance until we pass now.
-    size_t intervalCount = (now - callbackInfo->nextTime) / callbackInfo->interval + 1;
-    callbackInfo->nextTime += intervalCount * callbackInfo->interval;
-    std::push_heap(mCallbackQueue.begin(), mCallbackQueue.end(), CallbackInfo::cmp);
+void RecurrentTimer::advanceLocked(int64_t now,
+                                   std::vector<std::shared_ptr<Callback>>* callbacksToRun) {
+    int64_t nowTick = now / kTickInNano;
+    while (mCurrentTick <= nowTick) {
+        if (mOccupiedSlots[0] == 0 && (mCurrentTick & kSlotMask) != 0) {
+            // Nothing to run until the next cascade, skip the idle ticks.
+            mCurrentTick = std::min((mCurrentTick | kSlotMask) + 1, nowTick + 1);
+            continue;
+        }
 
-    // Make sure the first element is always valid.
-    removeInvalidCallbackLocked();
+        cascadeLocked();
 
-    return nextCallback;
+        CallbackInfo* info = takeSlotLocked(0, mCurrentTick & kSlotMask);
+        while (info != nullptr) {
+            CallbackInfo* next = info->next;
+            callbacksToRun->push_back(info->callback);
+            // intervalCount is the number of interval we have to advance until we pass now.
+            int64_t intervalCount = (now - info->nextTime) / info->interval + 1;
+            info->nextTime += intervalCount * info->interval;
+            info->expireTick = toTick(info->nextTime, kTickInNano);
+            linkLocked(info);
+            info = next;
+        }
+        mCurrentTick++;
+    }
 }
 
 void RecurrentTimer::loop() {
@@ -127,53 +248,78 @@ void RecurrentTimer::loop() {
             // Wait until the timer exits or we have at least one recurrent callback.
             mCond.wait(uniqueLock, [this] {
                 ScopedLockAssertion lockAssertion(mLock);
-                return mStopRequested || mCallbackQueue.size() != 0;
+                return mStopRequested || !mCallbacks.empty();
             });
 
-            int64_t interval;
             if (mStopRequested) {
                 return;
             }
-            // The first element is the nearest next event.
-            int64_t nextTime = mCallbackQueue[0]->nextTime;
-            int64_t now = uptimeNanos();
 
+            int64_t interval = 0;
+            int64_t nextTime = getNextEventTickLocked() * kTickInNano;
+            int64_t now = uptimeNanos();
             if (nextTime > now) {
                 interval = nextTime - now;
-            } else {
-                interval = 0;
             }
 
-            // Wait for the next event or the timer exits.
-            if (mCond.wait_for(uniqueLock, std::chrono::nanoseconds(interval), [this] {
-                    ScopedLockAssertion lockAssertion(mLock);
-                    return mStopRequested;
-                })) {
-                return;
+            // Wait for the next event, a new callback or the timer exits.
+            uint64_t updateCount = mUpdateCount;
+            if (mCond.wait_for(uniqueLock, std::chrono::nanoseconds(interval),
+                               [this, updateCount] {
+                                   ScopedLockAssertion lockAssertion(mLock);
+                                   return mStopRequested || mUpdateCount != updateCount;
+                               })) {
+                if (mStopRequested) {
+                    return;
+                }
+                // A new callback is registered, recalculate the time to wait.
+                continue;
             }
 
-            now = uptimeNanos();
             callbacksToRun.clear();
-            while (mCallbackQueue.size() > 0) {
-                int64_t nextTime = mCallbackQueue[0]->nextTime;
-                if (nextTime > now) {
-                    break;
-                }
+            advanceLocked(uptimeNanos(), &callbacksToRun);
+        }
 
-                callbacksToRun.push_back(getNextCallbackLocked(now));
+        if (mWorkerThreads.empty()) {
+            // Do not execute the callback while holding the lock.
+            for (size_t i = 0; i < callbacksToRun.size(); i++) {
+                (*callbacksToRun[i])();
             }
+            continue;
         }
 
-        // Do not execute the callback while holding the lock.
-        for (size_t i = 0; i < callbacksToRun.size(); i++) {
-            (*callbacksToRun[i])();
+        {
+            std::scoped_lock<std::mutex> lockGuard(mWorkLock);
+            mPendingWork.insert(mPendingWork.end(), callbacksToRun.begin(), callbacksToRun.end());
         }
+        mWorkCond.notify_all();
     }
 }
 
-bool RecurrentTimer::CallbackInfo::cmp(const std::unique_ptr<RecurrentTimer::CallbackInfo>& lhs,
-                                       const std::unique_ptr<RecurrentTimer::CallbackInfo>& rhs) {
-    return lhs->nextTime > rhs->nextTime;
+void RecurrentTimer::workerLoop() {
+    std::vector<std::shared_ptr<Callback>> callbacksToRun;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> uniqueLock(mWorkLock);
+            ScopedLockAssertion lockAssertion(mWorkLock);
+            mWorkCond.wait(uniqueLock, [this] {
+                ScopedLockAssertion lockAssertion(mWorkLock);
+                return mWorkerStopRequested || !mPendingWork.empty();
+            });
+            if (mWorkerStopRequested) {
+                return;
+            }
+            // Take a share of the pending work and leave the rest to the other workers.
+            size_t count = std::max(mPendingWork.size() / mWorkerThreads.size(), size_t(1));
+            callbacksToRun.assign(mPendingWork.end() - count, mPendingWork.end());
+            mPendingWork.resize(mPendingWork.size() - count);
+        }
+
+        for (size_t i = 0; i < callbacksToRun.size(); i++) {
+            (*callbacksToRun[i])();
+        }
+        callbacksToRun.clear();
+    }
 }
 
 }  // namespace vehicle
@@ -33,6 +33,94 @@ using ::aidl::android::hardware::automotive::vehicle::VehicleProperty;
 using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyType;
 using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
 
+namespace {
+
+// All the property types that could be recycled.
+constexpr VehiclePropertyType kRecyclableTypes[] = {
+        VehiclePropertyType::BOOLEAN,   VehiclePropertyType::INT32,
+        VehiclePropertyType::INT32_VEC, VehiclePropertyType::INT64,
+        VehiclePropertyType::INT64_VEC, VehiclePropertyType::FLOAT,
+        VehiclePropertyType::FLOAT_VEC, VehiclePropertyType::BYTES,
+};
+
+constexpr size_t kRecyclableTypeCount = sizeof(kRecyclableTypes) / sizeof(kRecyclableTypes[0]);
+
+// Returns the index of the type in kRecyclableTypes, or kRecyclableTypeCount if the type is not
+// recyclable.
+size_t getRecyclableTypeIndex(VehiclePropertyType type) {
+    switch (type) {
+        case VehiclePropertyType::BOOLEAN:
+            return 0;
+        case VehiclePropertyType::INT32:
+            return 1;
+        case VehiclePropertyType::INT32_VEC:
+            return 2;
+        case VehiclePropertyType::INT64:
+            return 3;
+        case VehiclePropertyType::INT64_VEC:
+            return 4;
+        case VehiclePropertyType::FLOAT:
+            return 5;
+        case VehiclePropertyType::FLOAT_VEC:
+            return 6;
+        case VehiclePropertyType::BYTES:
+            return 7;
+        default:
+            return kRecyclableTypeCount;
+    }
+}
+
+void resizeRawValue(RawPropValues* value, VehiclePropertyType type, size_t vectorSize) {
+    switch (type) {
+        case VehiclePropertyType::BOOLEAN:
+            [[fallthrough]];
+        case VehiclePropertyType::INT32:
+            [[fallthrough]];
+        case VehiclePropertyType::INT32_VEC:
+            value->int32Values.resize(vectorSize);
+            break;
+        case VehiclePropertyType::INT64:
+            [[fallthrough]];
+        case VehiclePropertyType::INT64_VEC:
+            value->int64Values.resize(vectorSize);
+            break;
+        case VehiclePropertyType::FLOAT:
+            [[fallthrough]];
+        case VehiclePropertyType::FLOAT_VEC:
+            value->floatValues.resize(vectorSize);
+            break;
+        case VehiclePropertyType::BYTES:
+            value->byteValues.resize(vectorSize);
+            break;
+        default:
+            break;
+    }
+}
+
+}  // namespace
+
+VehiclePropValuePool::VehiclePropValuePool(size_t maxRecyclableVectorSize,
+                                           size_t maxPoolObjectsSize)
+    : mMaxRecyclableVectorSize(maxRecyclableVectorSize),
+      mMaxPoolObjectsSize(maxPoolObjectsSize),
+      mSizeClassCount(getSizeClass(maxRecyclableVectorSize) + 1) {
+    for (VehiclePropertyType type : kRecyclableTypes) {
+        for (size_t sizeClass = 0; sizeClass < mSizeClassCount; sizeClass++) {
+            mValueTypePools.push_back(std::make_unique<InternalPool>(
+                    type, static_cast<size_t>(1) << sizeClass, mMaxPoolObjectsSize,
+                    getVehiclePropValueSize));
+        }
+    }
+}
+
+size_t VehiclePropValuePool::getSizeClass(size_t vectorSize) {
+    size_t sizeClass = 0;
+    while ((static_cast<size_t>(1) << sizeClass) < vectorSize) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtain(VehiclePropertyType type) {
     if (isComplexType(type)) {
         return obtain(type, 0);
@@ -103,19 +191,16 @@ VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainComplex() {
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainRecyclable(
         VehiclePropertyType type, size_t vectorSize) {
-    std::scoped_lock<std::mutex> lock(mLock);
     assert(vectorSize > 0);
 
-    // VehiclePropertyType is not overlapping with vectorSize.
-    int32_t key = static_cast<int32_t>(type) | static_cast<int32_t>(vectorSize);
-    auto it = mValueTypePools.find(key);
-
-    if (it == mValueTypePools.end()) {
-        auto newPool(std::make_unique<InternalPool>(type, vectorSize, mMaxPoolObjectsSize,
-                                                    getVehiclePropValueSize));
-        it = mValueTypePools.emplace(key, std::move(newPool)).first;
+    size_t typeIndex = getRecyclableTypeIndex(type);
+    if (typeIndex == kRecyclableTypeCount) {
+        return obtainDisposable(type, vectorSize);
     }
-    return it->second->obtain();
+    size_t index = typeIndex * mSizeClassCount + getSizeClass(vectorSize);
+    auto value = mValueTypePools[index]->obtain();
+    resizeRawValue(&value->value, type, vectorSize);
+    return value;
 }
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainBoolean(bool value) {
@@ -137,7 +222,7 @@ void VehiclePropValuePool::InternalPool::recycle(VehiclePropValue* o) {
     if (!check(&o->value)) {
         ALOGE("Discarding value for prop 0x%x because it contains "
               "data that is not consistent with this pool. "
-              "Expected type: %d, vector size: %zu",
+              "Expected type: %d, vector size up to: %zu",
               o->prop, toInt(mPropType), mVectorSize);
         delete o;
     } else {
@@ -55,28 +55,20 @@ size_t VehiclePropertyStore::RecordIdHash::operator()(RecordId const& recordId)
 }
 
 VehiclePropertyStore::~VehiclePropertyStore() {
-    std::scoped_lock<std::mutex> lockGuard(mLock);
+    std::unique_lock<std::shared_mutex> lockGuard(mLock);
 
     // Recycling record requires mValuePool, so need to recycle them before destroying mValuePool.
     mRecordsByPropId.clear();
     mValuePool.reset();
 }
 
-const VehiclePropertyStore::Record* VehiclePropertyStore::getRecordLocked(int32_t propId) const
-        REQUIRES(mLock) {
+VehiclePropertyStore::Record* VehiclePropertyStore::getRecordLocked(int32_t propId) const {
     auto RecordIt = mRecordsByPropId.find(propId);
-    return RecordIt == mRecordsByPropId.end() ? nullptr : &RecordIt->second;
-}
-
-VehiclePropertyStore::Record* VehiclePropertyStore::getRecordLocked(int32_t propId)
-        REQUIRES(mLock) {
-    auto RecordIt = mRecordsByPropId.find(propId);
-    return RecordIt == mRecordsByPropId.end() ? nullptr : &RecordIt->second;
+    return RecordIt == mRecordsByPropId.end() ? nullptr : RecordIt->second.get();
 }
 
 VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordIdLocked(
-        const VehiclePropValue& propValue, const VehiclePropertyStore::Record& record) const
-        REQUIRES(mLock) {
+        const VehiclePropValue& propValue, const VehiclePropertyStore::Record& record) const {
     VehiclePropertyStore::RecordId recId{
             .area = isGlobalProp(propValue.prop) ? 0 : propValue.areaId, .token = 0};
 
@@ -87,7 +79,7 @@ VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordIdLocked(
 }
 
 VhalResult<VehiclePropValuePool::RecyclableType> VehiclePropertyStore::readValueLocked(
-        const RecordId& recId, const Record& record) const REQUIRES(mLock) {
+        const RecordId& recId, const Record& record) const REQUIRES(record.lock) {
     if (auto it = record.values.find(recId); it != record.values.end()) {
         return mValuePool->obtain(*(it->second));
     }
@@ -97,18 +89,28 @@ VhalResult<VehiclePropValuePool::RecyclableType> VehiclePropertyStore::readValue
 
 void VehiclePropertyStore::registerProperty(const VehiclePropConfig& config,
                                             VehiclePropertyStore::TokenFunction tokenFunc) {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::unique_lock<std::shared_mutex> g(mLock);
+
+    if (Record* record = getRecordLocked(config.prop); record != nullptr) {
+        // Nobody else could hold the record lock while we are holding mLock exclusively, but we
+        // still need to lock it to modify the values.
+        std::scoped_lock<std::mutex> recordGuard(record->lock);
+        record->propConfig = config;
+        record->tokenFunction = tokenFunc;
+        record->values.clear();
+        return;
+    }
 
-    mRecordsByPropId[config.prop] = Record{
-            .propConfig = config,
-            .tokenFunction = tokenFunc,
-    };
+    auto record = std::make_unique<Record>();
+    record->propConfig = config;
+    record->tokenFunction = tokenFunc;
+    mRecordsByPropId[config.prop] = std::move(record);
 }
 
 VhalResult<void> VehiclePropertyStore::writeValue(VehiclePropValuePool::RecyclableType propValue,
                                                   bool updateStatus,
                                                   VehiclePropertyStore::EventMode eventMode) {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::shared_lock<std::shared_mutex> g(mLock);
 
     int32_t propId = propValue->prop;
 
@@ -123,6 +125,10 @@ VhalResult<void> VehiclePropertyStore::writeValue(VehiclePropValuePool::Recyclab
     }
 
     VehiclePropertyStore::RecordId recId = getRecordIdLocked(*propValue, *record);
+
+    // The callback is invoked while holding the record lock so that events for the same property
+    // are delivered in the same order as they are written.
+    std::scoped_lock<std::mutex> recordGuard(record->lock);
     bool valueUpdated = true;
     if (auto it = record->values.find(recId); it != record->values.end()) {
         const VehiclePropValue* valueToUpdate = it->second.get();
@@ -145,20 +151,21 @@ VhalResult<void> VehiclePropertyStore::writeValue(VehiclePropValuePool::Recyclab
         propValue->status = VehiclePropertyStatus::AVAILABLE;
     }
 
-    record->values[recId] = std::move(propValue);
+    VehiclePropValuePool::RecyclableType& storedValue = record->values[recId];
+    storedValue = std::move(propValue);
 
     if (eventMode == EventMode::NEVER) {
         return {};
     }
 
     if ((eventMode == EventMode::ALWAYS || valueUpdated) && mOnValueChangeCallback != nullptr) {
-        mOnValueChangeCallback(*(record->values[recId]));
+        mOnValueChangeCallback(*storedValue);
     }
     return {};
 }
 
 void VehiclePropertyStore::removeValue(const VehiclePropValue& propValue) {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::shared_lock<std::shared_mutex> g(mLock);
 
     VehiclePropertyStore::Record* record = getRecordLocked(propValue.prop);
     if (record == nullptr) {
@@ -166,29 +173,32 @@ void VehiclePropertyStore::removeValue(const VehiclePropValue& propValue) {
     }
 
     VehiclePropertyStore::RecordId recId = getRecordIdLocked(propValue, *record);
+    std::scoped_lock<std::mutex> recordGuard(record->lock);
     if (auto it = record->values.find(recId); it != record->values.end()) {
         record->values.erase(it);
     }
 }
 
 void VehiclePropertyStore::removeValuesForProperty(int32_t propId) {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::shared_lock<std::shared_mutex> g(mLock);
 
     VehiclePropertyStore::Record* record = getRecordLocked(propId);
     if (record == nullptr) {
         return;
     }
 
+    std::scoped_lock<std::mutex> recordGuard(record->lock);
     record->values.clear();
 }
 
 std::vector<VehiclePropValuePool::RecyclableType> VehiclePropertyStore::readAllValues() const {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::shared_lock<std::shared_mutex> g(mLock);
 
     std::vector<VehiclePropValuePool::RecyclableType> allValues;
 
     for (auto const& [_, record] : mRecordsByPropId) {
-        for (auto const& [_, value] : record.values) {
+        std::scoped_lock<std::mutex> recordGuard(record->lock);
+        for (auto const& [_, value] : record->values) {
             allValues.push_back(std::move(mValuePool->obtain(*value)));
         }
     }
@@ -198,7 +208,7 @@ std::vector<VehiclePropValuePool::RecyclableType> VehiclePropertyStore::readAllV
 
 VehiclePropertyStore::ValuesResultType VehiclePropertyStore::readValuesForProperty(
         int32_t propId) const {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::shared_lock<std::shared_mutex> g(mLock);
 
     std::vector<VehiclePropValuePool::RecyclableType> values;
 
@@ -207,6 +217,7 @@ VehiclePropertyStore::ValuesResultType VehiclePropertyStore::readValuesForProper
         return StatusError(StatusCode::INVALID_ARG) << "property: " << propId << " not registered";
     }
 
+    std::scoped_lock<std::mutex> recordGuard(record->lock);
     for (auto const& [_, value] : record->values) {
         values.push_back(std::move(mValuePool->obtain(*value)));
     }
@@ -215,7 +226,7 @@ VehiclePropertyStore::ValuesResultType VehiclePropertyStore::readValuesForProper
 
 VehiclePropertyStore::ValueResultType VehiclePropertyStore::readValue(
         const VehiclePropValue& propValue) const {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::shared_lock<std::shared_mutex> g(mLock);
 
     int32_t propId = propValue.prop;
     const VehiclePropertyStore::Record* record = getRecordLocked(propId);
@@ -224,13 +235,14 @@ VehiclePropertyStore::ValueResultType VehiclePropertyStore::readValue(
     }
 
     VehiclePropertyStore::RecordId recId = getRecordIdLocked(propValue, *record);
+    std::scoped_lock<std::mutex> recordGuard(record->lock);
     return readValueLocked(recId, *record);
 }
 
 VehiclePropertyStore::ValueResultType VehiclePropertyStore::readValue(int32_t propId,
                                                                       int32_t areaId,
                                                                       int64_t token) const {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::shared_lock<std::shared_mutex> g(mLock);
 
     const VehiclePropertyStore::Record* record = getRecordLocked(propId);
     if (record == nullptr) {
@@ -238,22 +250,23 @@ VehiclePropertyStore::ValueResultType VehiclePropertyStore::readValue(int32_t pr
     }
 
     VehiclePropertyStore::RecordId recId{.area = isGlobalProp(propId) ? 0 : areaId, .token = token};
+    std::scoped_lock<std::mutex> recordGuard(record->lock);
     return readValueLocked(recId, *record);
 }
 
 std::vector<VehiclePropConfig> VehiclePropertyStore::getAllConfigs() const {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::shared_lock<std::shared_mutex> g(mLock);
 
     std::vector<VehiclePropConfig> configs;
     configs.reserve(mRecordsByPropId.size());
-    for (auto& [_, config] : mRecordsByPropId) {
-        configs.push_back(config.propConfig);
+    for (auto& [_, record] : mRecordsByPropId) {
+        configs.push_back(record->propConfig);
     }
     return configs;
 }
 
 VhalResult<const VehiclePropConfig*> VehiclePropertyStore::getConfig(int32_t propId) const {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::shared_lock<std::shared_mutex> g(mLock);
 
     const VehiclePropertyStore::Record* record = getRecordLocked(propId);
     if (record == nullptr) {
@@ -265,7 +278,7 @@ VhalResult<const VehiclePropConfig*> VehiclePropertyStore::getConfig(int32_t pro
 
 void VehiclePropertyStore::setOnValueChangeCallback(
         const VehiclePropertyStore::OnValueChangeCallback& callback) {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::unique_lock<std::shared_mutex> g(mLock);
 
     mOnValueChangeCallback = callback;
 }
@@ -22,6 +22,8 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <condition_variable>
+#include <mutex>
 #include <unordered_set>
 #include <vector>
 
@@ -268,6 +270,65 @@ TEST_F(PendingRequestPoolTest, testPendingRequestCountLimit) {
     getPool()->tryFinishRequests(reinterpret_cast<const void*>(0), requests);
 }
 
+TEST_F(PendingRequestPoolTest, testCustomPendingRequestCountLimit) {
+    PendingRequestPool pool(getTimeout(), /*maxPendingRequestsPerClient=*/2);
+    auto callback = std::make_shared<PendingRequestPool::TimeoutCallbackFunc>(
+            [](std::unordered_set<int64_t>) {});
+
+    ASSERT_RESULT_OK(pool.addRequests(getTestClientId(), {0, 1}, callback));
+
+    auto result = pool.addRequests(getTestClientId(), {2}, callback);
+    ASSERT_FALSE(result.ok()) << "adding more pending requests than limit must fail";
+    ASSERT_EQ(result.error().code(), StatusCode::TRY_AGAIN);
+    ASSERT_EQ(pool.getRequestStats().rejectedCount, 1u);
+
+    ASSERT_RESULT_OK(pool.addRequests(reinterpret_cast<const void*>(1), {2}, callback))
+            << "the limit must be per client";
+
+    pool.tryFinishRequests(getTestClientId(), {0});
+
+    ASSERT_RESULT_OK(pool.addRequests(getTestClientId(), {2}, callback))
+            << "adding requests must succeed after pending requests are finished";
+
+    pool.tryFinishRequests(getTestClientId(), {1, 2});
+    pool.tryFinishRequests(reinterpret_cast<const void*>(1), {2});
+}
+
+TEST_F(PendingRequestPoolTest, testRequestStats) {
+    std::mutex lock;
+    std::condition_variable cv;
+    std::vector<int64_t> timeoutRequestIds;
+
+    auto callback = std::make_shared<PendingRequestPool::TimeoutCallbackFunc>(
+            [&lock, &cv, &timeoutRequestIds](const std::unordered_set<int64_t>& requests) {
+                {
+                    std::scoped_lock<std::mutex> lockGuard(lock);
+                    for (int64_t request : requests) {
+                        timeoutRequestIds.push_back(request);
+                    }
+                }
+                cv.notify_all();
+            });
+
+    ASSERT_RESULT_OK(getPool()->addRequests(getTestClientId(), {0, 1, 2}, callback));
+    ASSERT_THAT(getPool()->tryFinishRequests(getTestClientId(), {0, 1}),
+                UnorderedElementsAre(0, 1));
+
+    std::unique_lock<std::mutex> uniqueLock(lock);
+    ASSERT_TRUE(cv.wait_for(uniqueLock, 10 * std::chrono::nanoseconds(getTimeout()),
+                            [&timeoutRequestIds] { return !timeoutRequestIds.empty(); }));
+    ASSERT_THAT(timeoutRequestIds, ElementsAre(2));
+
+    auto stats = getPool()->getRequestStats();
+    ASSERT_EQ(stats.finishedCount, 2u);
+    ASSERT_EQ(stats.timeoutCount, 1u);
+    uint64_t histogramCount = 0;
+    for (uint64_t count : stats.latencyHistogram) {
+        histogramCount += count;
+    }
+    ASSERT_EQ(histogramCount, 2u);
+}
+
 }  // namespace vehicle
 }  // namespace automotive
 }  // namespace hardware
@@ -50,7 +50,15 @@ class RecurrentTimerTest : public testing::Test {
 
     size_t countTimerCallbackQueue(RecurrentTimer* timer) {
         std::scoped_lock<std::mutex> lockGuard(timer->mLock);
-        return timer->mCallbackQueue.size();
+        size_t count = 0;
+        for (const auto& level : timer->mSlots) {
+            for (const RecurrentTimer::CallbackInfo* info : level) {
+                for (; info != nullptr; info = info->next) {
+                    count++;
+                }
+            }
+        }
+        return count;
     }
 
   private:
@@ -213,6 +221,76 @@ TEST_F(RecurrentTimerTest, testRegisterCallbackMultipleTimesNoDeadLock) {
     timer.reset();
 }
 
+TEST_F(RecurrentTimerTest, testRegisterLongIntervalCallback) {
+    RecurrentTimer timer;
+    // 0.3s, longer than the range of the first level of the timer wheel.
+    int64_t interval = 300000000;
+
+    auto action = getCallback(0);
+    timer.registerTimerCallback(interval, action);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    timer.unregisterTimerCallback(action);
+
+    // Theoretically trigger 5 times, but check for at least 4 times to be stable.
+    ASSERT_GE(getCalledCallbacks().size(), static_cast<size_t>(4));
+    ASSERT_LE(getCalledCallbacks().size(), static_cast<size_t>(6));
+}
+
+TEST_F(RecurrentTimerTest, testRegisterManyCallbacksSameInterval) {
+    RecurrentTimer timer;
+    // 0.1s
+    int64_t interval = 100000000;
+    size_t callbackCount = 100;
+
+    std::vector<std::shared_ptr<RecurrentTimer::Callback>> actions;
+    for (size_t i = 0; i < callbackCount; i++) {
+        actions.push_back(getCallback(i));
+        timer.registerTimerCallback(interval, actions.back());
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    for (const auto& action : actions) {
+        timer.unregisterTimerCallback(action);
+    }
+
+    // Theoretically trigger 10 times each, but check for at least 9 times to be stable.
+    ASSERT_GE(getCalledCallbacks().size(), callbackCount * 9);
+    ASSERT_EQ(countTimerCallbackQueue(&timer), static_cast<size_t>(0));
+}
+
+TEST_F(RecurrentTimerTest, testRegisterCallbackWithWorkerThreads) {
+    RecurrentTimer timer(/*workerThreadCount=*/4);
+    // 0.05s
+    int64_t interval = 50000000;
+
+    auto action1 = getCallback(1);
+    auto action2 = getCallback(2);
+    timer.registerTimerCallback(interval, action1);
+    timer.registerTimerCallback(interval, action2);
+
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    timer.unregisterTimerCallback(action1);
+    timer.unregisterTimerCallback(action2);
+
+    size_t action1Count = 0;
+    size_t action2Count = 0;
+    for (size_t token : getCalledCallbacks()) {
+        if (token == 1) {
+            action1Count++;
+        }
+        if (token == 2) {
+            action2Count++;
+        }
+    }
+    // Theoretically trigger 20 times, but check for at least 15 times to be stable.
+    ASSERT_GE(action1Count, static_cast<size_t>(15));
+    ASSERT_GE(action2Count, static_cast<size_t>(15));
+}
+
 }  // namespace vehicle
 }  // namespace automotive
 }  // namespace hardware
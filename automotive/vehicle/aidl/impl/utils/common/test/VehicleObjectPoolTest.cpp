@@ -111,6 +111,24 @@ std::vector<TestPropertyTypeInfo> getAllPropertyTypes() {
     };
 }
 
+// Counts the live instances, to check which objects the pools keep.
+struct TestObject {
+    static inline std::atomic<int> sLiveCount = 0;
+
+    TestObject() { sLiveCount++; }
+    ~TestObject() { sLiveCount--; }
+};
+
+class TestObjectPool : public ObjectPool<TestObject> {
+  public:
+    // Each object counts as 1 towards maxPoolObjectsSize.
+    explicit TestObjectPool(size_t maxPoolObjectsSize)
+        : ObjectPool(maxPoolObjectsSize, [](const TestObject&) { return 1; }) {}
+
+  protected:
+    TestObject* createObject() override { return new TestObject(); }
+};
+
 }  // namespace
 
 class VehicleObjectPoolTest : public ::testing::Test {
@@ -357,8 +375,42 @@ TEST_F(VehicleObjectPoolTest, testMultithreaded) {
 
     ASSERT_EQ(mStats->Obtained, static_cast<uint32_t>(T * C * O));
     ASSERT_EQ(mStats->Recycled + mStats->Deleted, static_cast<uint32_t>(T * C * O));
-    // Created less than obtained in one cycle.
-    ASSERT_LE(mStats->Created, static_cast<uint32_t>(T * O));
+    // Created less than obtained in one cycle, plus the objects that might be left in the other
+    // thread's local cache for each of the two types.
+    ASSERT_LE(mStats->Created,
+              static_cast<uint32_t>(T * (O + 2 * ObjectPool<VehiclePropValue>::kLocalCacheSize)));
+}
+
+TEST_F(VehicleObjectPoolTest, testObtainSmallerVectorFromSameSizeClass) {
+    auto value = mValuePool->obtain(VehiclePropertyType::INT32_VEC, 4);
+    void* raw = value.get();
+    value.reset();
+
+    // Vector size 3 and 4 are in the same size class, so the recycled object should be reused.
+    auto newValue = mValuePool->obtain(VehiclePropertyType::INT32_VEC, 3);
+
+    ASSERT_EQ(newValue.get(), raw);
+    ASSERT_EQ(newValue->value.int32Values.size(), 3u);
+    ASSERT_EQ(mStats->Created, 1u);
+}
+
+TEST_F(VehicleObjectPoolTest, testRecycleInAnotherThread) {
+    const int C = 100;
+    const int O = 100;
+
+    for (int i = 0; i < C; i++) {
+        std::vector<recyclable_ptr<VehiclePropValue>> vec;
+        for (int j = 0; j < O; j++) {
+            vec.push_back(mValuePool->obtain(VehiclePropertyType::INT32));
+        }
+        // Objects recycled by the other thread should be moved to the shared pool and be reused
+        // by this thread.
+        std::thread t([&vec] { vec.clear(); });
+        t.join();
+    }
+
+    ASSERT_EQ(mStats->Obtained, static_cast<uint32_t>(C * O));
+    ASSERT_LT(mStats->Created, static_cast<uint32_t>(C * O));
 }
 
 TEST_F(VehicleObjectPoolTest, testMemoryLimitation) {
@@ -375,6 +427,71 @@ TEST_F(VehicleObjectPoolTest, testMemoryLimitation) {
                                       "values are in the pool";
 }
 
+TEST(ObjectPoolTest, testLocalCacheCountsTowardsLimit) {
+    {
+        TestObjectPool pool(/*maxPoolObjectsSize=*/3);
+        std::vector<recyclable_ptr<TestObject>> objects;
+        for (int i = 0; i < 10; i++) {
+            objects.push_back(pool.obtain());
+        }
+        objects.clear();
+
+        // Only 3 objects fit in the pool, even though they all fit in this thread's cache.
+        ASSERT_EQ(TestObject::sLiveCount, 3);
+    }
+
+    ASSERT_EQ(TestObject::sLiveCount, 0);
+}
+
+TEST(ObjectPoolTest, testDropLocalCacheOfDestroyedPool) {
+    auto pool = std::make_unique<TestObjectPool>(/*maxPoolObjectsSize=*/10);
+    // Cached by this thread.
+    pool->obtain().reset();
+    ASSERT_EQ(TestObject::sLiveCount, 1);
+
+    std::thread t([&pool] { pool.reset(); });
+    t.join();
+
+    // This thread drops its cache for the destroyed pool once it uses another pool.
+    TestObjectPool otherPool(/*maxPoolObjectsSize=*/10);
+    auto object = otherPool.obtain();
+    ASSERT_EQ(TestObject::sLiveCount, 1);
+}
+
+TEST(ObjectPoolTest, testLocalCacheReturnedOnThreadExit) {
+    TestObjectPool pool(/*maxPoolObjectsSize=*/10);
+    TestObject* raw = nullptr;
+
+    std::thread t([&pool, &raw] {
+        auto object = pool.obtain();
+        raw = object.get();
+    });
+    t.join();
+
+    // The object cached by the exited thread is back in the shared pool.
+    auto object = pool.obtain();
+    ASSERT_EQ(object.get(), raw);
+    ASSERT_EQ(TestObject::sLiveCount, 1);
+}
+
+TEST(ObjectPoolTest, testLocalCachesForManyPools) {
+    // More pools than the size classes of a few VehiclePropValuePools.
+    constexpr size_t kPoolCount = 256;
+    std::vector<std::unique_ptr<TestObjectPool>> pools;
+    std::vector<TestObject*> raws;
+    for (size_t i = 0; i < kPoolCount; i++) {
+        pools.push_back(std::make_unique<TestObjectPool>(/*maxPoolObjectsSize=*/10));
+        auto object = pools.back()->obtain();
+        raws.push_back(object.get());
+    }
+
+    // Every pool still has its cache, the cached objects are reused.
+    for (size_t i = 0; i < kPoolCount; i++) {
+        ASSERT_EQ(pools[i]->obtain().get(), raws[i]);
+    }
+    ASSERT_EQ(TestObject::sLiveCount, static_cast<int>(kPoolCount));
+}
+
 }  // namespace vehicle
 }  // namespace automotive
 }  // namespace hardware
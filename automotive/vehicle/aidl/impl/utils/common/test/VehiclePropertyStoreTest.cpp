@@ -21,6 +21,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <thread>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -509,6 +512,67 @@ TEST_F(VehiclePropertyStoreTest, testPropertyChangeCallbackForceNoUpdate) {
     ASSERT_EQ(updatedValue.prop, INVALID_PROP_ID);
 }
 
+TEST_F(VehiclePropertyStoreTest, testRegisterPropertyAgainKeepsConfigPointer) {
+    VhalResult<const VehiclePropConfig*> result =
+            mStore->getConfig(toInt(VehicleProperty::INFO_FUEL_CAPACITY));
+    ASSERT_RESULT_OK(result);
+    const VehiclePropConfig* configPtr = result.value();
+    ASSERT_RESULT_OK(mStore->writeValue(mValuePool->obtain(VehiclePropValue{
+            .prop = toInt(VehicleProperty::INFO_FUEL_CAPACITY),
+            .value = {.floatValues = {1.0}},
+    })));
+
+    VehiclePropConfig newConfig = mConfigFuelCapacity;
+    newConfig.configString = "new config";
+    mStore->registerProperty(newConfig);
+
+    ASSERT_EQ(*configPtr, newConfig);
+    auto readResult = mStore->readValue(toInt(VehicleProperty::INFO_FUEL_CAPACITY));
+    ASSERT_FALSE(readResult.ok()) << "values must be cleared when a property is registered again";
+    ASSERT_EQ(readResult.error().code(), StatusCode::NOT_AVAILABLE);
+}
+
+TEST_F(VehiclePropertyStoreTest, testConcurrentWriteAndRead) {
+    constexpr int32_t kNumIterations = 1000;
+    std::vector<int32_t> areaIds = {WHEEL_FRONT_LEFT, WHEEL_FRONT_RIGHT, WHEEL_REAR_LEFT,
+                                    WHEEL_REAR_RIGHT};
+    std::atomic<int32_t> callbackCount = 0;
+    mStore->setOnValueChangeCallback([&callbackCount](const VehiclePropValue&) { callbackCount++; });
+
+    std::vector<std::thread> threads;
+    for (int32_t areaId : areaIds) {
+        threads.emplace_back([this, areaId] {
+            for (int32_t i = 0; i < kNumIterations; i++) {
+                VehiclePropValue value = {
+                        .timestamp = i,
+                        .areaId = areaId,
+                        .prop = toInt(VehicleProperty::TIRE_PRESSURE),
+                        .value = {.floatValues = {static_cast<float>(i)}},
+                };
+                ASSERT_RESULT_OK(mStore->writeValue(mValuePool->obtain(value)));
+            }
+        });
+        threads.emplace_back([this, areaId] {
+            for (int32_t i = 0; i < kNumIterations; i++) {
+                // The value might not be written yet, we only care that this does not crash.
+                mStore->readValue(toInt(VehicleProperty::TIRE_PRESSURE), areaId);
+                mStore->readValue(toInt(VehicleProperty::INFO_FUEL_CAPACITY));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(callbackCount, static_cast<int32_t>(areaIds.size()) * kNumIterations);
+    for (int32_t areaId : areaIds) {
+        auto result = mStore->readValue(toInt(VehicleProperty::TIRE_PRESSURE), areaId);
+        ASSERT_RESULT_OK(result);
+        ASSERT_EQ(result.value()->value.floatValues,
+                  std::vector<float>({static_cast<float>(kNumIterations - 1)}));
+    }
+}
+
 }  // namespace vehicle
 }  // namespace automotive
 }  // namespace hardware
@@ -21,6 +21,7 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <atomic>
 #include <thread>
 #include <vector>
@@ -762,6 +763,72 @@ TEST(VehicleUtilsTest, testConcurrentQueueDeactivateNotifyWaitingThread) {
     t.join();
 }
 
+TEST(VehicleUtilsTest, testConcurrentQueueFlushToBuffer) {
+    ConcurrentQueue<int> queue;
+    std::vector<int> buffer = {0};
+
+    queue.push(1);
+    queue.push(2);
+    queue.flush(&buffer);
+
+    ASSERT_EQ(buffer, std::vector<int>({1, 2}));
+
+    queue.push(3);
+    queue.flush(&buffer);
+
+    ASSERT_EQ(buffer, std::vector<int>({3}));
+}
+
+TEST(VehicleUtilsTest, testConcurrentQueueOverflowKeepsOrder) {
+    ConcurrentQueue<int> queue(/*capacity=*/4);
+
+    // Nobody is consuming, push must not block once the ring buffer is full.
+    for (int i = 0; i < 10; i++) {
+        int value = i;
+        queue.push(std::move(value));
+    }
+
+    ASSERT_TRUE(queue.waitForItems());
+    ASSERT_EQ(queue.flush(), std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+
+    queue.push(10);
+
+    ASSERT_EQ(queue.flush(), std::vector<int>({10}));
+}
+
+TEST(VehicleUtilsTest, testConcurrentQueueFullQueue) {
+    // A small queue so that the producers overflow the ring buffer.
+    ConcurrentQueue<int> queue(/*capacity=*/4);
+    std::vector<int> results;
+    std::vector<std::thread> producers;
+    for (int i = 0; i < 4; i++) {
+        producers.emplace_back([&queue, i]() {
+            for (int j = 0; j < 1000; j++) {
+                int value = i;
+                queue.push(std::move(value));
+            }
+        });
+    }
+    std::thread consumer([&queue, &results]() {
+        std::vector<int> buffer;
+        while (results.size() < 4000) {
+            queue.waitForItems();
+            queue.flush(&buffer);
+            results.insert(results.end(), buffer.begin(), buffer.end());
+        }
+    });
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    consumer.join();
+
+    EXPECT_EQ(results.size(), static_cast<size_t>(4000));
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(std::count(results.begin(), results.end(), i), 1000);
+    }
+}
+
 TEST(VehicleUtilsTest, testVhalError) {
     VhalResult<void> result = Error<VhalError>(StatusCode::INVALID_ARG) << "error message";
 
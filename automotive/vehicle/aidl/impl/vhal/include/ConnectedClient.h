@@ -25,8 +25,13 @@
 
 #include <aidl/android/hardware/automotive/vehicle/IVehicleCallback.h>
 #include <android-base/result.h>
+#include <android-base/thread_annotations.h>
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -130,6 +135,63 @@ class SubscriptionClient final : public ConnectedClient {
             std::vector<aidl::android::hardware::automotive::vehicle::GetValueResult> results);
 };
 
+// A thread-safe class that batches the property change events for subscription clients.
+//
+// Events for the same client that arrive within {@code batchingWindowInNano} of the first pending
+// event are delivered together through one {@code onPropertyEvent} call, which reduces the number
+// of binder transactions and shared memory files when many continuous properties update at once.
+// If the batching window is 0, events are delivered immediately on the caller thread and no value
+// is dropped.
+//
+// Within one batch, for the properties in {@code droppablePropIds} (e.g. continuous properties),
+// only the latest value for each [propId, areaId] is delivered. Events for the other properties
+// are never dropped because each of them might be meaningful, e.g. HW_KEY_INPUT.
+class SubscriptionEventBatcher final {
+  public:
+    using CallbackType = ConnectedClient::CallbackType;
+
+    SubscriptionEventBatcher(int64_t batchingWindowInNano,
+                             std::unordered_set<int32_t> droppablePropIds);
+
+    // Delivers all the pending events before returning.
+    ~SubscriptionEventBatcher();
+
+    // Adds the updated values to the batch for the client.
+    void addUpdatedValues(
+            const CallbackType& callback,
+            std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&&
+                    updatedValues);
+
+    // Delivers all the pending events now, on the caller thread.
+    void flush();
+
+  private:
+    struct Batch {
+        CallbackType callback;
+        std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue> values;
+        // The index in 'values' for each droppable [propId, areaId] in this batch.
+        std::unordered_map<PropIdAreaId, size_t, PropIdAreaIdHash> indexByPropIdAreaId;
+    };
+
+    const int64_t mBatchingWindowInNano;
+    const std::unordered_set<int32_t> mDroppablePropIds;
+
+    // Held while delivering batches so that a flush does not overtake the batching thread.
+    std::mutex mSendLock;
+    std::mutex mLock;
+    std::condition_variable mCond;
+    bool mStopRequested GUARDED_BY(mLock) = false;
+    std::unordered_map<const AIBinder*, Batch> mBatchByClient GUARDED_BY(mLock);
+    std::thread mThread;
+
+    // Adds the values to the batch, replacing the superseded values.
+    void addToBatch(
+            Batch* batch,
+            std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&& values);
+
+    void loop();
+};
+
 }  // namespace vehicle
 }  // namespace automotive
 }  // namespace hardware
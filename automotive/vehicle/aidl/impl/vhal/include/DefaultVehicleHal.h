@@ -47,7 +47,10 @@ class DefaultVehicleHal final : public aidl::android::hardware::automotive::vehi
     using CallbackType =
             std::shared_ptr<aidl::android::hardware::automotive::vehicle::IVehicleCallback>;
 
-    explicit DefaultVehicleHal(std::unique_ptr<IVehicleHardware> hardware);
+    // If eventBatchingWindowInNano is not 0, property change events for the same client that
+    // happen within the window are delivered together. If it is 0, events are delivered as is.
+    explicit DefaultVehicleHal(std::unique_ptr<IVehicleHardware> hardware,
+                               int64_t eventBatchingWindowInNano = 0);
 
     ~DefaultVehicleHal();
 
@@ -177,6 +180,8 @@ class DefaultVehicleHal final : public aidl::android::hardware::automotive::vehi
     std::shared_ptr<PendingRequestPool> mPendingRequestPool;
     // SubscriptionManager is thread-safe.
     std::shared_ptr<SubscriptionManager> mSubscriptionManager;
+    // SubscriptionEventBatcher is thread-safe.
+    std::shared_ptr<SubscriptionEventBatcher> mEventBatcher;
 
     std::mutex mLock;
     std::unordered_map<const AIBinder*, std::unique_ptr<OnBinderDiedContext>> mOnBinderDiedContexts
@@ -250,11 +255,13 @@ class DefaultVehicleHal final : public aidl::android::hardware::automotive::vehi
 
     static void onPropertyChangeEvent(
             std::weak_ptr<SubscriptionManager> subscriptionManager,
+            std::weak_ptr<SubscriptionEventBatcher> eventBatcher,
             const std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&
                     updatedValues);
 
     static void checkHealth(IVehicleHardware* hardware,
-                            std::weak_ptr<SubscriptionManager> subscriptionManager);
+                            std::weak_ptr<SubscriptionManager> subscriptionManager,
+                            std::weak_ptr<SubscriptionEventBatcher> eventBatcher);
 
     static void onBinderDied(void* cookie);
 
@@ -89,15 +89,25 @@ class SubscriptionManager final {
     // Returns ok if all the properties for the client are unsubscribed.
     VhalResult<void> unsubscribe(ClientIdType client);
 
-    // For a list of updated properties, returns a map that maps clients subscribing to
-    // the updated properties to a list of updated values. This would only return on-change property
-    // clients that should be informed for the given updated values.
-    std::unordered_map<
+    // For each client subscribing to a batch of updated values, the values it should be informed
+    // of. Indexed by the clients of the current subscriptions, a client that is not informed of any
+    // of the values has no values and a null callback.
+    using SubscribedClients = std::vector<std::pair<
             CallbackType,
-            std::vector<const aidl::android::hardware::automotive::vehicle::VehiclePropValue*>>
-    getSubscribedClients(
+            std::vector<const aidl::android::hardware::automotive::vehicle::VehiclePropValue*>>>;
+
+    // For a list of updated properties, fills clients with the clients subscribing to the updated
+    // properties and the updated values for each of them. This would only return on-change
+    // property clients that should be informed for the given updated values.
+    // clients is meant to be reused across calls, its buffers are kept so that dispatching a batch
+    // does not allocate once they have grown. The caller should reset the callbacks and clear the
+    // values once dispatched, so that the clients and updatedValues are not referenced until the
+    // next call.
+    // This does not take mLock, it reads from the latest snapshot of the dispatch table.
+    void getSubscribedClients(
             const std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&
-                    updatedValues);
+                    updatedValues,
+            SubscribedClients* clients);
 
     // Checks whether the sample rate is valid.
     static bool checkSampleRateHz(float sampleRateHz);
@@ -106,8 +116,20 @@ class SubscriptionManager final {
     // Friend class for testing.
     friend class DefaultVehicleHalTest;
 
+    // An immutable snapshot that maps each [propId, areaId] to the list of subscribed clients.
+    struct DispatchTable {
+        std::vector<CallbackType> clients;
+        // The indexes in clients of the clients subscribing to each [propId, areaId].
+        std::unordered_map<PropIdAreaId, std::vector<size_t>, PropIdAreaIdHash> clientIndexes;
+    };
+
     IVehicleHardware* mVehicleHardware;
 
+    // The dispatch table used by getSubscribedClients. It is rebuilt from mClientsByPropIdArea
+    // each time the subscriptions change, and must be accessed through std::atomic_load and
+    // std::atomic_store.
+    std::shared_ptr<const DispatchTable> mDispatchTable;
+
     mutable std::mutex mLock;
     std::unordered_map<PropIdAreaId, std::unordered_map<ClientIdType, CallbackType>,
                        PropIdAreaIdHash>
@@ -117,6 +139,18 @@ class SubscriptionManager final {
     std::unordered_map<PropIdAreaId, ContSubConfigs, PropIdAreaIdHash> mContSubConfigsByPropIdArea
             GUARDED_BY(mLock);
 
+    VhalResult<void> subscribeLocked(
+            const CallbackType& callback,
+            const std::vector<aidl::android::hardware::automotive::vehicle::SubscribeOptions>&
+                    options,
+            bool isContinuousProperty) REQUIRES(mLock);
+    VhalResult<void> unsubscribeLocked(ClientIdType client, const std::vector<int32_t>& propIds)
+            REQUIRES(mLock);
+    VhalResult<void> unsubscribeLocked(ClientIdType client) REQUIRES(mLock);
+
+    // Rebuilds the dispatch table from mClientsByPropIdArea and publishes it.
+    void refreshDispatchTableLocked() REQUIRES(mLock);
+
     VhalResult<void> addContinuousSubscriberLocked(const ClientIdType& clientId,
                                                    const PropIdAreaId& propIdAreaId,
                                                    float sampleRateHz) REQUIRES(mLock);
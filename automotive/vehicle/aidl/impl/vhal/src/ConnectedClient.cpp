@@ -22,6 +22,7 @@
 #include <utils/Log.h>
 
 #include <inttypes.h>
+#include <chrono>
 #include <unordered_set>
 #include <vector>
 
@@ -41,6 +42,7 @@ using ::aidl::android::hardware::automotive::vehicle::StatusCode;
 using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
 using ::aidl::android::hardware::automotive::vehicle::VehiclePropValues;
 using ::android::base::Result;
+using ::android::base::ScopedLockAssertion;
 using ::ndk::ScopedAStatus;
 
 // A function to call the specific callback based on results type.
@@ -344,6 +346,119 @@ void SubscriptionClient::onGetValueResults(const void* clientId,
     sendUpdatedValues(callback, std::move(propValues));
 }
 
+SubscriptionEventBatcher::SubscriptionEventBatcher(int64_t batchingWindowInNano,
+                                                   std::unordered_set<int32_t> droppablePropIds)
+    : mBatchingWindowInNano(batchingWindowInNano), mDroppablePropIds(std::move(droppablePropIds)) {
+    if (mBatchingWindowInNano > 0) {
+        mThread = std::thread([this] { loop(); });
+    }
+}
+
+SubscriptionEventBatcher::~SubscriptionEventBatcher() {
+    {
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        mStopRequested = true;
+    }
+    mCond.notify_one();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void SubscriptionEventBatcher::addToBatch(SubscriptionEventBatcher::Batch* batch,
+                                          std::vector<VehiclePropValue>&& values) {
+    for (auto& value : values) {
+        if (mDroppablePropIds.find(value.prop) == mDroppablePropIds.end()) {
+            batch->values.push_back(std::move(value));
+            continue;
+        }
+        PropIdAreaId propIdAreaId = {
+                .propId = value.prop,
+                .areaId = value.areaId,
+        };
+        auto it = batch->indexByPropIdAreaId.find(propIdAreaId);
+        if (it == batch->indexByPropIdAreaId.end()) {
+            batch->indexByPropIdAreaId[propIdAreaId] = batch->values.size();
+            batch->values.push_back(std::move(value));
+            continue;
+        }
+        VehiclePropValue& supersededValue = batch->values[it->second];
+        if (supersededValue.timestamp <= value.timestamp) {
+            supersededValue = std::move(value);
+        }
+    }
+}
+
+void SubscriptionEventBatcher::addUpdatedValues(const CallbackType& callback,
+                                                std::vector<VehiclePropValue>&& updatedValues) {
+    if (updatedValues.empty()) {
+        return;
+    }
+
+    if (mBatchingWindowInNano <= 0) {
+        // Batching is disabled, deliver every value as is.
+        SubscriptionClient::sendUpdatedValues(callback, std::move(updatedValues));
+        return;
+    }
+
+    bool isFirstPendingBatch = false;
+    {
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        isFirstPendingBatch = mBatchByClient.empty();
+        Batch& batch = mBatchByClient[callback->asBinder().get()];
+        if (batch.callback == nullptr) {
+            batch.callback = callback;
+        }
+        addToBatch(&batch, std::move(updatedValues));
+    }
+    if (isFirstPendingBatch) {
+        mCond.notify_one();
+    }
+}
+
+void SubscriptionEventBatcher::flush() {
+    std::scoped_lock<std::mutex> sendLockGuard(mSendLock);
+    std::unordered_map<const AIBinder*, Batch> batchesToSend;
+    {
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        batchesToSend = std::move(mBatchByClient);
+        mBatchByClient.clear();
+    }
+
+    // Do not call the binder callback while holding the lock.
+    for (auto& [_, batch] : batchesToSend) {
+        SubscriptionClient::sendUpdatedValues(batch.callback, std::move(batch.values));
+    }
+}
+
+void SubscriptionEventBatcher::loop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> uniqueLock(mLock);
+            ScopedLockAssertion lockAssertion(mLock);
+            mCond.wait(uniqueLock, [this] {
+                ScopedLockAssertion lockAssertion(mLock);
+                return mStopRequested || !mBatchByClient.empty();
+            });
+            if (!mStopRequested) {
+                // Wait for the batching window to collect more events. The window starts from the
+                // first pending event.
+                mCond.wait_for(uniqueLock, std::chrono::nanoseconds(mBatchingWindowInNano), [this] {
+                    ScopedLockAssertion lockAssertion(mLock);
+                    return mStopRequested;
+                });
+            }
+        }
+
+        flush();
+
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        if (mStopRequested && mBatchByClient.empty()) {
+            return;
+        }
+    }
+}
+
 }  // namespace vehicle
 }  // namespace automotive
 }  // namespace hardware
@@ -21,6 +21,7 @@
 
 #include <LargeParcelableBase.h>
 #include <VehicleHalTypes.h>
+#include <VehicleObjectPool.h>
 #include <VehicleUtils.h>
 
 #include <android-base/result.h>
@@ -31,6 +32,7 @@
 #include <utils/SystemClock.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
 #include <inttypes.h>
 #include <set>
 #include <unordered_set>
@@ -125,7 +127,8 @@ size_t DefaultVehicleHal::SubscriptionClients::countClients() {
     return mClients.size();
 }
 
-DefaultVehicleHal::DefaultVehicleHal(std::unique_ptr<IVehicleHardware> vehicleHardware)
+DefaultVehicleHal::DefaultVehicleHal(std::unique_ptr<IVehicleHardware> vehicleHardware,
+                                     int64_t eventBatchingWindowInNano)
     : mVehicleHardware(std::move(vehicleHardware)),
       mPendingRequestPool(std::make_shared<PendingRequestPool>(TIMEOUT_IN_NANO)) {
     if (!getAllPropConfigsFromHardware()) {
@@ -138,17 +141,30 @@ DefaultVehicleHal::DefaultVehicleHal(std::unique_ptr<IVehicleHardware> vehicleHa
     IVehicleHardware* vehicleHardwarePtr = mVehicleHardware.get();
     mSubscriptionManager = std::make_shared<SubscriptionManager>(vehicleHardwarePtr);
 
+    // Only the latest value of a continuous property in a batch is useful to the client.
+    std::unordered_set<int32_t> continuousPropIds;
+    for (const auto& [propId, config] : mConfigsByPropId) {
+        if (config.changeMode == VehiclePropertyChangeMode::CONTINUOUS) {
+            continuousPropIds.insert(propId);
+        }
+    }
+    mEventBatcher = std::make_shared<SubscriptionEventBatcher>(eventBatchingWindowInNano,
+                                                               std::move(continuousPropIds));
+
     std::weak_ptr<SubscriptionManager> subscriptionManagerCopy = mSubscriptionManager;
+    std::weak_ptr<SubscriptionEventBatcher> eventBatcherCopy = mEventBatcher;
     mVehicleHardware->registerOnPropertyChangeEvent(
             std::make_unique<IVehicleHardware::PropertyChangeCallback>(
-                    [subscriptionManagerCopy](std::vector<VehiclePropValue> updatedValues) {
-                        onPropertyChangeEvent(subscriptionManagerCopy, updatedValues);
+                    [subscriptionManagerCopy,
+                     eventBatcherCopy](std::vector<VehiclePropValue> updatedValues) {
+                        onPropertyChangeEvent(subscriptionManagerCopy, eventBatcherCopy,
+                                              updatedValues);
                     }));
 
     // Register heartbeat event.
     mRecurrentAction = std::make_shared<std::function<void()>>(
-            [vehicleHardwarePtr, subscriptionManagerCopy]() {
-                checkHealth(vehicleHardwarePtr, subscriptionManagerCopy);
+            [vehicleHardwarePtr, subscriptionManagerCopy, eventBatcherCopy]() {
+                checkHealth(vehicleHardwarePtr, subscriptionManagerCopy, eventBatcherCopy);
             });
     mRecurrentTimer.registerTimerCallback(HEART_BEAT_INTERVAL_IN_NANO, mRecurrentAction);
 
@@ -173,24 +189,38 @@ DefaultVehicleHal::~DefaultVehicleHal() {
     // mSubscriptionManager uses pointer to mVehicleHardware, so it has to be destroyed before
     // mVehicleHardware.
     mSubscriptionManager.reset();
+    // Delivers the pending events and stops the batching thread.
+    mEventBatcher.reset();
     mVehicleHardware.reset();
 }
 
 void DefaultVehicleHal::onPropertyChangeEvent(
         std::weak_ptr<SubscriptionManager> subscriptionManager,
+        std::weak_ptr<SubscriptionEventBatcher> eventBatcher,
         const std::vector<VehiclePropValue>& updatedValues) {
     auto manager = subscriptionManager.lock();
-    if (manager == nullptr) {
+    auto batcher = eventBatcher.lock();
+    if (manager == nullptr || batcher == nullptr) {
         ALOGW("the SubscriptionManager is destroyed, DefaultVehicleHal is ending");
         return;
     }
-    auto updatedValuesByClients = manager->getSubscribedClients(updatedValues);
-    for (const auto& [callback, valuePtrs] : updatedValuesByClients) {
+    // Reused for each batch of events delivered on this thread.
+    thread_local SubscriptionManager::SubscribedClients updatedValuesByClients;
+    manager->getSubscribedClients(updatedValues, &updatedValuesByClients);
+    for (auto& [callback, valuePtrs] : updatedValuesByClients) {
+        if (valuePtrs.empty()) {
+            continue;
+        }
         std::vector<VehiclePropValue> values;
+        values.reserve(valuePtrs.size());
         for (const VehiclePropValue* valuePtr : valuePtrs) {
             values.push_back(*valuePtr);
         }
-        SubscriptionClient::sendUpdatedValues(callback, std::move(values));
+        batcher->addUpdatedValues(callback, std::move(values));
+        // Do not keep the client or pointers to updatedValues alive until the next batch, only the
+        // capacity of the buffer.
+        callback.reset();
+        valuePtrs.clear();
     }
 }
 
@@ -263,8 +293,10 @@ void DefaultVehicleHal::onBinderUnlinkedWithContext(const AIBinder* clientId) {
 }
 
 void DefaultVehicleHal::onBinderDiedUnlinkedHandler() {
+    std::vector<BinderDiedUnlinkedEvent> events;
     while (mBinderEvents.waitForItems()) {
-        for (BinderDiedUnlinkedEvent& event : mBinderEvents.flush()) {
+        mBinderEvents.flush(&events);
+        for (BinderDiedUnlinkedEvent& event : events) {
             if (event.forOnBinderDied) {
                 onBinderDiedWithContext(event.clientId);
             } else {
@@ -756,7 +788,8 @@ VhalResult<void> DefaultVehicleHal::checkReadPermission(const VehiclePropValue&
 }
 
 void DefaultVehicleHal::checkHealth(IVehicleHardware* vehicleHardware,
-                                    std::weak_ptr<SubscriptionManager> subscriptionManager) {
+                                    std::weak_ptr<SubscriptionManager> subscriptionManager,
+                                    std::weak_ptr<SubscriptionEventBatcher> eventBatcher) {
     StatusCode status = vehicleHardware->checkHealth();
     if (status != StatusCode::OK) {
         ALOGE("VHAL check health returns non-okay status");
@@ -768,7 +801,7 @@ void DefaultVehicleHal::checkHealth(IVehicleHardware* vehicleHardware,
             .status = VehiclePropertyStatus::AVAILABLE,
             .value.int64Values = {uptimeMillis()},
     }};
-    onPropertyChangeEvent(subscriptionManager, values);
+    onPropertyChangeEvent(subscriptionManager, eventBatcher, values);
     return;
 }
 
@@ -822,6 +855,33 @@ binder_status_t DefaultVehicleHal::dump(int fd, const char** args, uint32_t numA
         dprintf(fd, "Currently have %zu subscription clients\n",
                 mSubscriptionClients->countClients());
     }
+    const PoolStats* poolStats = PoolStats::instance();
+    uint32_t obtained = poolStats->Obtained.load(std::memory_order_relaxed);
+    uint32_t created = poolStats->Created.load(std::memory_order_relaxed);
+    dprintf(fd,
+            "VehiclePropValuePool: obtained: %" PRIu32 ", hit: %" PRIu32 ", miss: %" PRIu32
+            ", recycled: %" PRIu32 ", deleted: %" PRIu32 "\n",
+            obtained, obtained - std::min(obtained, created), created,
+            poolStats->Recycled.load(std::memory_order_relaxed),
+            poolStats->Deleted.load(std::memory_order_relaxed));
+    PendingRequestPool::RequestStats requestStats = mPendingRequestPool->getRequestStats();
+    dprintf(fd,
+            "Pending requests: %zu, finished: %" PRIu64 ", timeout: %" PRIu64
+            ", rejected: %" PRIu64 "\n",
+            mPendingRequestPool->countPendingRequests(), requestStats.finishedCount,
+            requestStats.timeoutCount, requestStats.rejectedCount);
+    dprintf(fd, "Request latency histogram (ms):");
+    for (size_t i = 0; i < requestStats.latencyHistogram.size(); i++) {
+        int64_t upperBoundInMs = static_cast<int64_t>(1) << i;
+        if (i == requestStats.latencyHistogram.size() - 1) {
+            dprintf(fd, " >=%" PRId64 ": %" PRIu64, upperBoundInMs / 2,
+                    requestStats.latencyHistogram[i]);
+        } else {
+            dprintf(fd, " <%" PRId64 ": %" PRIu64, upperBoundInMs,
+                    requestStats.latencyHistogram[i]);
+        }
+    }
+    dprintf(fd, "\n");
     return STATUS_OK;
 }
 
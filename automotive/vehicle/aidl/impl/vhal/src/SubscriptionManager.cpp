@@ -22,6 +22,8 @@
 
 #include <inttypes.h>
 
+#include <memory>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -43,13 +45,14 @@ using ::android::base::StringPrintf;
 using ::ndk::ScopedAStatus;
 
 SubscriptionManager::SubscriptionManager(IVehicleHardware* vehicleHardware)
-    : mVehicleHardware(vehicleHardware) {}
+    : mVehicleHardware(vehicleHardware), mDispatchTable(std::make_shared<const DispatchTable>()) {}
 
 SubscriptionManager::~SubscriptionManager() {
     std::scoped_lock<std::mutex> lockGuard(mLock);
 
     mClientsByPropIdArea.clear();
     mSubscribedPropsByClient.clear();
+    refreshDispatchTableLocked();
 }
 
 bool SubscriptionManager::checkSampleRateHz(float sampleRateHz) {
@@ -131,11 +134,57 @@ VhalResult<void> SubscriptionManager::updateContSubConfigs(const PropIdAreaId& p
     return {};
 }
 
+void SubscriptionManager::refreshDispatchTableLocked() {
+    auto table = std::make_shared<DispatchTable>();
+    std::unordered_map<ClientIdType, size_t> indexByClient;
+    table->clientIndexes.reserve(mClientsByPropIdArea.size());
+    for (const auto& [propIdAreaId, clients] : mClientsByPropIdArea) {
+        std::vector<size_t>& indexes = table->clientIndexes[propIdAreaId];
+        indexes.reserve(clients.size());
+        for (const auto& [clientId, callback] : clients) {
+            auto [it, inserted] = indexByClient.try_emplace(clientId, table->clients.size());
+            if (inserted) {
+                table->clients.push_back(callback);
+            }
+            indexes.push_back(it->second);
+        }
+    }
+    std::atomic_store(&mDispatchTable, std::shared_ptr<const DispatchTable>(std::move(table)));
+}
+
 VhalResult<void> SubscriptionManager::subscribe(const std::shared_ptr<IVehicleCallback>& callback,
                                                 const std::vector<SubscribeOptions>& options,
                                                 bool isContinuousProperty) {
     std::scoped_lock<std::mutex> lockGuard(mLock);
 
+    auto result = subscribeLocked(callback, options, isContinuousProperty);
+    // Part of the properties might be subscribed even if there is an error.
+    refreshDispatchTableLocked();
+    return result;
+}
+
+VhalResult<void> SubscriptionManager::unsubscribe(SubscriptionManager::ClientIdType clientId,
+                                                  const std::vector<int32_t>& propIds) {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+
+    auto result = unsubscribeLocked(clientId, propIds);
+    // Part of the properties might be unsubscribed even if there is an error.
+    refreshDispatchTableLocked();
+    return result;
+}
+
+VhalResult<void> SubscriptionManager::unsubscribe(SubscriptionManager::ClientIdType clientId) {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+
+    auto result = unsubscribeLocked(clientId);
+    // Part of the properties might be unsubscribed even if there is an error.
+    refreshDispatchTableLocked();
+    return result;
+}
+
+VhalResult<void> SubscriptionManager::subscribeLocked(
+        const std::shared_ptr<IVehicleCallback>& callback,
+        const std::vector<SubscribeOptions>& options, bool isContinuousProperty) {
     for (const auto& option : options) {
         float sampleRateHz = option.sampleRate;
 
@@ -177,10 +226,8 @@ VhalResult<void> SubscriptionManager::subscribe(const std::shared_ptr<IVehicleCa
     return {};
 }
 
-VhalResult<void> SubscriptionManager::unsubscribe(SubscriptionManager::ClientIdType clientId,
-                                                  const std::vector<int32_t>& propIds) {
-    std::scoped_lock<std::mutex> lockGuard(mLock);
-
+VhalResult<void> SubscriptionManager::unsubscribeLocked(SubscriptionManager::ClientIdType clientId,
+                                                        const std::vector<int32_t>& propIds) {
     if (mSubscribedPropsByClient.find(clientId) == mSubscribedPropsByClient.end()) {
         return StatusError(StatusCode::INVALID_ARG)
                << "No property was subscribed for the callback";
@@ -223,9 +270,8 @@ VhalResult<void> SubscriptionManager::unsubscribe(SubscriptionManager::ClientIdT
     return {};
 }
 
-VhalResult<void> SubscriptionManager::unsubscribe(SubscriptionManager::ClientIdType clientId) {
-    std::scoped_lock<std::mutex> lockGuard(mLock);
-
+VhalResult<void> SubscriptionManager::unsubscribeLocked(
+        SubscriptionManager::ClientIdType clientId) {
     if (mSubscribedPropsByClient.find(clientId) == mSubscribedPropsByClient.end()) {
         return StatusError(StatusCode::INVALID_ARG) << "No property was subscribed for this client";
     }
@@ -247,26 +293,39 @@ VhalResult<void> SubscriptionManager::unsubscribe(SubscriptionManager::ClientIdT
     return {};
 }
 
-std::unordered_map<std::shared_ptr<IVehicleCallback>, std::vector<const VehiclePropValue*>>
-SubscriptionManager::getSubscribedClients(const std::vector<VehiclePropValue>& updatedValues) {
-    std::scoped_lock<std::mutex> lockGuard(mLock);
-    std::unordered_map<std::shared_ptr<IVehicleCallback>, std::vector<const VehiclePropValue*>>
-            clients;
+void SubscriptionManager::getSubscribedClients(const std::vector<VehiclePropValue>& updatedValues,
+                                               SubscribedClients* clients) {
+    // Holding a reference to the snapshot keeps it alive even if the subscriptions change
+    // concurrently.
+    std::shared_ptr<const DispatchTable> table = std::atomic_load(&mDispatchTable);
+    clients->resize(table->clients.size());
+    for (auto& [_, values] : *clients) {
+        values.clear();
+    }
 
     for (const auto& value : updatedValues) {
-        PropIdAreaId propIdAreaId{
+        auto it = table->clientIndexes.find(PropIdAreaId{
                 .propId = value.prop,
                 .areaId = value.areaId,
-        };
-        if (mClientsByPropIdArea.find(propIdAreaId) == mClientsByPropIdArea.end()) {
+        });
+        if (it == table->clientIndexes.end()) {
             continue;
         }
 
-        for (const auto& [_, client] : mClientsByPropIdArea[propIdAreaId]) {
-            clients[client].push_back(&value);
+        for (size_t index : it->second) {
+            auto& [callback, values] = (*clients)[index];
+            if (values.empty()) {
+                callback = table->clients[index];
+            }
+            values.push_back(&value);
+        }
+    }
+    // Release the callbacks of the clients from the previous call that are not informed this time.
+    for (auto& [callback, values] : *clients) {
+        if (values.empty()) {
+            callback.reset();
         }
     }
-    return clients;
 }
 
 bool SubscriptionManager::isEmpty() {
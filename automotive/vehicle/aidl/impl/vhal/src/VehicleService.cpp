@@ -19,13 +19,27 @@
 #include <DefaultVehicleHal.h>
 #include <FakeVehicleHardware.h>
 
+#include <android-base/properties.h>
 #include <android/binder_manager.h>
 #include <android/binder_process.h>
 #include <utils/Log.h>
 
+#include <inttypes.h>
+
+using ::android::base::GetIntProperty;
 using ::android::hardware::automotive::vehicle::DefaultVehicleHal;
 using ::android::hardware::automotive::vehicle::fake::FakeVehicleHardware;
 
+namespace {
+
+// The window in which property change events for the same client are delivered together. Off by
+// default, since batching delays every event by up to the window, e.g. HW_KEY_INPUT.
+constexpr char EVENT_BATCHING_WINDOW_PROPERTY[] = "ro.vendor.vhal.event_batching_window_ms";
+constexpr int64_t DEFAULT_EVENT_BATCHING_WINDOW_IN_MS = 0;
+constexpr int64_t MAX_EVENT_BATCHING_WINDOW_IN_MS = 1000;
+
+}  // namespace
+
 int main(int /* argc */, char* /* argv */[]) {
     ALOGI("Starting thread pool...");
     if (!ABinderProcess_setThreadPoolMaxThreadCount(4)) {
@@ -34,9 +48,14 @@ int main(int /* argc */, char* /* argv */[]) {
     }
     ABinderProcess_startThreadPool();
 
+    int64_t eventBatchingWindowInMs =
+            GetIntProperty(EVENT_BATCHING_WINDOW_PROPERTY, DEFAULT_EVENT_BATCHING_WINDOW_IN_MS,
+                           /*min=*/static_cast<int64_t>(0), MAX_EVENT_BATCHING_WINDOW_IN_MS);
+    ALOGI("Event batching window: %" PRId64 "ms", eventBatchingWindowInMs);
+
     std::unique_ptr<FakeVehicleHardware> hardware = std::make_unique<FakeVehicleHardware>();
-    std::shared_ptr<DefaultVehicleHal> vhal =
-            ::ndk::SharedRefBase::make<DefaultVehicleHal>(std::move(hardware));
+    std::shared_ptr<DefaultVehicleHal> vhal = ::ndk::SharedRefBase::make<DefaultVehicleHal>(
+            std::move(hardware), eventBatchingWindowInMs * 1'000'000);
 
     ALOGI("Registering as service...");
     binder_exception_t err = AServiceManager_addService(
@@ -24,10 +24,18 @@ using ::android::hardware::automotive::vehicle::DefaultVehicleHal;
 using ::android::hardware::automotive::vehicle::fake::FakeVehicleHardware;
 using ::ndk::SharedRefBase;
 
+namespace {
+
+// Covers the event batching thread, which the service runs when a window is configured. 10ms.
+constexpr int64_t EVENT_BATCHING_WINDOW_IN_NANO = 10'000'000;
+
+}  // namespace
+
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
     std::unique_ptr<FakeVehicleHardware> hardware = std::make_unique<FakeVehicleHardware>();
     std::shared_ptr<DefaultVehicleHal> vhal =
-            ::ndk::SharedRefBase::make<DefaultVehicleHal>(std::move(hardware));
+            ::ndk::SharedRefBase::make<DefaultVehicleHal>(std::move(hardware),
+                                                          EVENT_BATCHING_WINDOW_IN_NANO);
 
     fuzzService(vhal->asBinder().get(), FuzzedDataProvider(data, size));
 
@@ -214,6 +214,119 @@ TEST_F(ConnectedClientTest, testSetValuesGetResultCallback) {
     ASSERT_EQ(maybeSetValueResults.value().payloads, results);
 }
 
+TEST_F(ConnectedClientTest, testEventBatcherPassesThroughWithoutWindow) {
+    SubscriptionEventBatcher batcher(/*batchingWindowInNano=*/0, {/*droppablePropIds=*/0});
+    std::vector<VehiclePropValue> values = {
+            {
+                    .timestamp = 1,
+                    .prop = 0,
+            },
+            {
+                    .timestamp = 2,
+                    .prop = 0,
+            },
+    };
+
+    batcher.addUpdatedValues(getCallbackClient(), std::vector<VehiclePropValue>(values));
+
+    auto maybeEvents = getCallback()->nextOnPropertyEventResults();
+    ASSERT_TRUE(maybeEvents.has_value());
+    ASSERT_EQ(maybeEvents.value().payloads, values);
+}
+
+TEST_F(ConnectedClientTest, testEventBatcherDropsSupersededValues) {
+    {
+        // 10s, the events are delivered when the batcher is destroyed.
+        SubscriptionEventBatcher batcher(/*batchingWindowInNano=*/10'000'000'000,
+                                         {/*droppablePropIds=*/0});
+
+        batcher.addUpdatedValues(getCallbackClient(), {
+                                                              {
+                                                                      .timestamp = 1,
+                                                                      .prop = 0,
+                                                              },
+                                                              {
+                                                                      .timestamp = 1,
+                                                                      .prop = 1,
+                                                              },
+                                                      });
+        batcher.addUpdatedValues(getCallbackClient(), {
+                                                              {
+                                                                      .timestamp = 2,
+                                                                      .prop = 0,
+                                                              },
+                                                              {
+                                                                      .timestamp = 2,
+                                                                      .prop = 1,
+                                                              },
+                                                      });
+    }
+
+    auto maybeEvents = getCallback()->nextOnPropertyEventResults();
+    ASSERT_TRUE(maybeEvents.has_value());
+    std::vector<VehiclePropValue> expectedValues = {
+            {
+                    .timestamp = 2,
+                    .prop = 0,
+            },
+            {
+                    .timestamp = 1,
+                    .prop = 1,
+            },
+            {
+                    .timestamp = 2,
+                    .prop = 1,
+            },
+    };
+    ASSERT_EQ(maybeEvents.value().payloads, expectedValues);
+}
+
+TEST_F(ConnectedClientTest, testEventBatcherBatchesEventsInWindow) {
+    // 10s, the events are delivered by flush().
+    SubscriptionEventBatcher batcher(/*batchingWindowInNano=*/10'000'000'000,
+                                     /*droppablePropIds=*/{});
+
+    batcher.addUpdatedValues(getCallbackClient(), {{
+                                                          .prop = 0,
+                                                  }});
+    batcher.addUpdatedValues(getCallbackClient(), {{
+                                                          .prop = 1,
+                                                  }});
+
+    ASSERT_EQ(getCallback()->countOnPropertyEventResults(), static_cast<size_t>(0));
+
+    batcher.flush();
+
+    ASSERT_EQ(getCallback()->countOnPropertyEventResults(), static_cast<size_t>(1));
+    auto maybeEvents = getCallback()->nextOnPropertyEventResults();
+    ASSERT_TRUE(maybeEvents.has_value());
+    ASSERT_EQ(maybeEvents.value().payloads, std::vector<VehiclePropValue>({
+                                                    {
+                                                            .prop = 0,
+                                                    },
+                                                    {
+                                                            .prop = 1,
+                                                    },
+                                            }));
+
+    // Nothing is left for the batching thread.
+    batcher.flush();
+    ASSERT_EQ(getCallback()->countOnPropertyEventResults(), static_cast<size_t>(0));
+}
+
+TEST_F(ConnectedClientTest, testEventBatcherDeliversPendingEventsOnDestroy) {
+    {
+        // 10s.
+        SubscriptionEventBatcher batcher(/*batchingWindowInNano=*/10'000'000'000,
+                                         /*droppablePropIds=*/{});
+        batcher.addUpdatedValues(getCallbackClient(), {{
+                                                              .prop = 0,
+                                                      }});
+    }
+
+    ASSERT_EQ(getCallback()->countOnPropertyEventResults(), static_cast<size_t>(1));
+}
+
 }  // namespace vehicle
 }  // namespace automotive
 }  // namespace hardware
@@ -1631,6 +1631,11 @@ TEST_F(DefaultVehicleHalTest, testDumpCallerShouldDump) {
     std::string msg(buf);
 
     ASSERT_THAT(msg, ContainsRegex(buffer + "\nVehicle HAL State: \n"));
+    ASSERT_THAT(msg, ContainsRegex("VehiclePropValuePool: obtained: [0-9]+, hit: [0-9]+, "
+                                   "miss: [0-9]+, recycled: [0-9]+, deleted: [0-9]+"));
+    ASSERT_THAT(msg, ContainsRegex("Pending requests: [0-9]+, finished: [0-9]+, "
+                                   "timeout: [0-9]+, rejected: [0-9]+"));
+    ASSERT_THAT(msg, ContainsRegex("Request latency histogram \\(ms\\): <1: [0-9]+"));
 }
 
 TEST_F(DefaultVehicleHalTest, testDumpCallerShouldNotDump) {
@@ -25,11 +25,13 @@
 #include <gtest/gtest.h>
 
 #include <float.h>
+#include <atomic>
 #include <chrono>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace android {
@@ -114,6 +116,26 @@ class SubscriptionManagerTest : public testing::Test {
 
     void clearEvents() { return getCallback()->clearEvents(); }
 
+    std::unordered_map<std::shared_ptr<IVehicleCallback>, std::vector<const VehiclePropValue*>>
+    getSubscribedClients(const std::vector<VehiclePropValue>& updatedValues) {
+        SubscriptionManager::SubscribedClients clients;
+        getManager()->getSubscribedClients(updatedValues, &clients);
+        return toMap(clients);
+    }
+
+    static std::unordered_map<std::shared_ptr<IVehicleCallback>,
+                              std::vector<const VehiclePropValue*>>
+    toMap(const SubscriptionManager::SubscribedClients& clients) {
+        std::unordered_map<std::shared_ptr<IVehicleCallback>, std::vector<const VehiclePropValue*>>
+                clientMap;
+        for (const auto& [callback, values] : clients) {
+            if (!values.empty()) {
+                clientMap[callback] = values;
+            }
+        }
+        return clientMap;
+    }
+
   private:
     std::unique_ptr<SubscriptionManager> mManager;
     std::shared_ptr<PropertyCallback> mCallback;
@@ -389,7 +411,7 @@ TEST_F(SubscriptionManagerTest, testSubscribeOnchange) {
                     .areaId = 1,
             },
     };
-    auto clients = getManager()->getSubscribedClients(updatedValues);
+    auto clients = getSubscribedClients(updatedValues);
 
     ASSERT_THAT(clients[client1],
                 WhenSorted(ElementsAre(&updatedValues[0], &updatedValues[1], &updatedValues[2])));
@@ -413,8 +435,7 @@ TEST_F(SubscriptionManagerTest, testSubscribeInvalidOption) {
 
     auto result = getManager()->subscribe(getCallbackClient(), options, true);
     ASSERT_FALSE(result.ok()) << "subscribe with invalid sample rate must fail";
-    ASSERT_TRUE(getManager()
-                        ->getSubscribedClients({{
+    ASSERT_TRUE(getSubscribedClients({{
                                                         .prop = 0,
                                                         .areaId = 0,
                                                 },
@@ -442,8 +463,7 @@ TEST_F(SubscriptionManagerTest, testSubscribeNoAreaIds) {
 
     auto result = getManager()->subscribe(getCallbackClient(), options, true);
     ASSERT_FALSE(result.ok()) << "subscribe with invalid sample rate must fail";
-    ASSERT_TRUE(getManager()
-                        ->getSubscribedClients({{
+    ASSERT_TRUE(getSubscribedClients({{
                                 .prop = 1,
                                 .areaId = 0,
                         }})
@@ -480,11 +500,76 @@ TEST_F(SubscriptionManagerTest, testUnsubscribeOnchange) {
                     .areaId = 0,
             },
     };
-    auto clients = getManager()->getSubscribedClients(updatedValues);
+    auto clients = getSubscribedClients(updatedValues);
 
     ASSERT_THAT(clients[getCallbackClient()], ElementsAre(&updatedValues[1]));
 }
 
+TEST_F(SubscriptionManagerTest, testGetSubscribedClientsWhileSubscribing) {
+    std::vector<SubscribeOptions> options = {{
+            .propId = 0,
+            .areaIds = {0},
+    }};
+    std::vector<VehiclePropValue> updatedValues = {{
+            .prop = 0,
+            .areaId = 0,
+    }};
+    std::atomic<bool> stop = false;
+
+    std::thread eventThread([this, &updatedValues, &stop] {
+        SubscriptionManager::SubscribedClients clients;
+        while (!stop) {
+            getManager()->getSubscribedClients(updatedValues, &clients);
+            // The client is either subscribed or not, it must never see a partial state.
+            auto clientMap = toMap(clients);
+            if (!clientMap.empty()) {
+                EXPECT_THAT(clientMap[getCallbackClient()], ElementsAre(&updatedValues[0]));
+            }
+        }
+    });
+
+    // Only EXPECT_* until the event thread is joined.
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_TRUE(getManager()->subscribe(getCallbackClient(), options, false).ok());
+        EXPECT_FALSE(getSubscribedClients(updatedValues).empty());
+        EXPECT_TRUE(getManager()->unsubscribe(getCallbackClient()->asBinder().get()).ok());
+        EXPECT_TRUE(getSubscribedClients(updatedValues).empty());
+    }
+
+    stop = true;
+    eventThread.join();
+}
+
+TEST_F(SubscriptionManagerTest, testGetSubscribedClientsReusesBuffer) {
+    std::vector<SubscribeOptions> options = {{
+            .propId = 0,
+            .areaIds = {0},
+    }};
+    ASSERT_TRUE(getManager()->subscribe(getCallbackClient(), options, false).ok());
+    std::vector<VehiclePropValue> updatedValues = {{
+            .prop = 0,
+            .areaId = 0,
+    }};
+    std::vector<VehiclePropValue> otherValues = {{
+            .prop = 1,
+            .areaId = 0,
+    }};
+    SubscriptionManager::SubscribedClients clients;
+
+    getManager()->getSubscribedClients(updatedValues, &clients);
+    ASSERT_THAT(toMap(clients)[getCallbackClient()], ElementsAre(&updatedValues[0]));
+
+    // The client is not informed of the next batch, its callback must not be kept.
+    getManager()->getSubscribedClients(otherValues, &clients);
+    ASSERT_TRUE(toMap(clients).empty());
+    for (const auto& [callback, values] : clients) {
+        ASSERT_EQ(callback, nullptr);
+    }
+
+    getManager()->getSubscribedClients(updatedValues, &clients);
+    ASSERT_THAT(toMap(clients)[getCallbackClient()], ElementsAre(&updatedValues[0]));
+}
+
 TEST_F(SubscriptionManagerTest, testCheckSampleRateHzValid) {
     ASSERT_TRUE(SubscriptionManager::checkSampleRateHz(1.0));
 }
@@ -15,6 +15,7 @@
  */
 
 #include <sys/types.h>
+#include <unistd.h>
 #define LOG_TAG "BTAudioSessionAidl"
 
 #include <android-base/logging.h>
@@ -23,6 +24,8 @@
 
 #include "BluetoothAudioSession.h"
 
+#include <algorithm>
+
 namespace aidl {
 namespace android {
 namespace hardware {
@@ -32,11 +35,15 @@ namespace audio {
 static constexpr int kFmqSendTimeoutMs = 1000;  // 1000 ms timeout for sending
 static constexpr int kFmqReceiveTimeoutMs =
     1000;                               // 1000 ms timeout for receiving
-static constexpr int kWritePollMs = 1;  // polled non-blocking interval
-static constexpr int kReadPollMs = 1;   // polled non-blocking interval
+// Until the peer is seen using the event flag, it may be polling the FMQ
+// without waking us up, so waits are limited to this interval.
+static constexpr auto kPeerPollInterval = std::chrono::milliseconds(1);
+// Same event flag bits as the blocking calls of the FMQ library.
+static constexpr uint32_t kFmqNotEmpty = 1 << 0;
+static constexpr uint32_t kFmqNotFull = 1 << 1;
 
 BluetoothAudioSession::BluetoothAudioSession(const SessionType& session_type)
-    : session_type_(session_type), stack_iface_(nullptr), data_mq_(nullptr) {}
+    : session_type_(session_type), stack_iface_(nullptr) {}
 
 /***
  *
@@ -153,7 +160,7 @@ bool BluetoothAudioSession::IsSessionReady() {
        session_type_ ==
            SessionType::LE_AUDIO_BROADCAST_HARDWARE_OFFLOAD_ENCODING_DATAPATH ||
        session_type_ == SessionType::A2DP_HARDWARE_OFFLOAD_DECODING_DATAPATH ||
-       (data_mq_ != nullptr && data_mq_->isValid()));
+       data_path_ != nullptr);
   return stack_iface_ != nullptr && is_mq_valid && audio_config_ != nullptr;
 }
 
@@ -254,21 +261,88 @@ void BluetoothAudioSession::StopStream() {
  ***/
 
 bool BluetoothAudioSession::UpdateDataPath(const DataMQDesc* mq_desc) {
-  if (mq_desc == nullptr) {
-    // usecase of reset by nullptr
-    data_mq_ = nullptr;
-    return true;
+  std::shared_ptr<DataPath> data_path;
+  if (mq_desc != nullptr) {
+    std::unique_ptr<DataMQ> temp_mq;
+    temp_mq.reset(new DataMQ(*mq_desc));
+    if (temp_mq && temp_mq->isValid()) {
+      data_path = std::make_shared<DataPath>(std::move(temp_mq));
+    }
+  }
+  std::shared_ptr<DataPath> old_data_path;
+  {
+    std::lock_guard<std::mutex> guard(data_path_mutex_);
+    old_data_path = std::move(data_path_);
+    data_path_ = data_path;
+  }
+  // The transfers in progress still hold the old data path, make them return.
+  if (old_data_path != nullptr) {
+    old_data_path->Close();
+  }
+  // usecase of reset by nullptr
+  return mq_desc == nullptr || data_path != nullptr;
+}
+
+std::shared_ptr<BluetoothAudioSession::DataPath>
+BluetoothAudioSession::GetDataPath() {
+  std::lock_guard<std::mutex> guard(data_path_mutex_);
+  return data_path_;
+}
+
+BluetoothAudioSession::DataPath::DataPath(std::unique_ptr<DataMQ> data_mq)
+    : mq(std::move(data_mq)) {
+  if (mq->getEventFlagWord() == nullptr) {
+    LOG(INFO) << __func__ << " - FMQ has no event flag, polling the data path";
+  } else if (::android::hardware::EventFlag::createEventFlag(
+                 mq->getEventFlagWord(), &event_flag) != ::android::OK) {
+    LOG(WARNING) << __func__ << " - failed to create the FMQ event flag";
+    event_flag = nullptr;
   }
-  std::unique_ptr<DataMQ> temp_mq;
-  temp_mq.reset(new DataMQ(*mq_desc));
-  if (!temp_mq || !temp_mq->isValid()) {
-    data_mq_ = nullptr;
+}
+
+BluetoothAudioSession::DataPath::~DataPath() {
+  if (event_flag != nullptr) {
+    ::android::hardware::EventFlag::deleteEventFlag(&event_flag);
+  }
+}
+
+bool BluetoothAudioSession::DataPath::Wait(
+    uint32_t bits, std::chrono::steady_clock::time_point deadline) {
+  auto timeout = deadline - std::chrono::steady_clock::now();
+  if (timeout <= std::chrono::steady_clock::duration::zero()) {
     return false;
   }
-  data_mq_ = std::move(temp_mq);
+  if (!peer_wakes) {
+    timeout = std::min<std::chrono::steady_clock::duration>(timeout,
+                                                            kPeerPollInterval);
+  }
+  if (event_flag == nullptr) {
+    usleep(std::chrono::duration_cast<std::chrono::microseconds>(timeout)
+               .count());
+    return true;
+  }
+  uint32_t state = 0;
+  if (event_flag->wait(
+          bits, &state,
+          std::chrono::duration_cast<std::chrono::nanoseconds>(timeout)
+              .count()) == ::android::OK &&
+      (state & bits) != 0) {
+    peer_wakes = true;
+  }
   return true;
 }
 
+void BluetoothAudioSession::DataPath::Wake(uint32_t bits) {
+  if (event_flag != nullptr) {
+    event_flag->wake(bits);
+  }
+}
+
+void BluetoothAudioSession::DataPath::Close() {
+  closed = true;
+  Wake(kFmqNotEmpty | kFmqNotFull);
+}
+
 bool BluetoothAudioSession::UpdateAudioConfig(
     const AudioConfiguration& audio_config) {
   bool is_software_session =
@@ -340,20 +414,18 @@ size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
   if (buffer == nullptr || bytes <= 0) {
     return 0;
   }
+  std::shared_ptr<DataPath> data_path = GetDataPath();
+  if (data_path == nullptr) {
+    return 0;
+  }
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(kFmqSendTimeoutMs);
   size_t total_written = 0;
-  int timeout_ms = kFmqSendTimeoutMs;
-  do {
-    std::unique_lock<std::recursive_mutex> lock(mutex_);
-    if (!IsSessionReady()) {
-      break;
-    }
-    size_t num_bytes_to_write = data_mq_->availableToWrite();
+  while (total_written < bytes && !data_path->closed) {
+    size_t num_bytes_to_write = std::min(data_path->mq->availableToWrite(),
+                                         bytes - total_written);
     if (num_bytes_to_write) {
-      if (num_bytes_to_write > (bytes - total_written)) {
-        num_bytes_to_write = bytes - total_written;
-      }
-
-      if (!data_mq_->write(
+      if (!data_path->mq->write(
               static_cast<const MQDataType*>(buffer) + total_written,
               num_bytes_to_write)) {
         LOG(ERROR) << "FMQ datapath writing " << total_written << "/" << bytes
@@ -361,16 +433,13 @@ size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
         return total_written;
       }
       total_written += num_bytes_to_write;
-    } else if (timeout_ms >= kWritePollMs) {
-      lock.unlock();
-      usleep(kWritePollMs * 1000);
-      timeout_ms -= kWritePollMs;
-    } else {
+      data_path->Wake(kFmqNotEmpty);
+    } else if (!data_path->Wait(kFmqNotFull, deadline)) {
       LOG(DEBUG) << "Data " << total_written << "/" << bytes << " overflow "
-                 << (kFmqSendTimeoutMs - timeout_ms) << " ms";
+                 << kFmqSendTimeoutMs << " ms";
       return total_written;
     }
-  } while (total_written < bytes);
+  }
   return total_written;
 }
 
@@ -378,36 +447,31 @@ size_t BluetoothAudioSession::InReadPcmData(void* buffer, size_t bytes) {
   if (buffer == nullptr || bytes <= 0) {
     return 0;
   }
+  std::shared_ptr<DataPath> data_path = GetDataPath();
+  if (data_path == nullptr) {
+    return 0;
+  }
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(kFmqReceiveTimeoutMs);
   size_t total_read = 0;
-  int timeout_ms = kFmqReceiveTimeoutMs;
-  do {
-    std::unique_lock<std::recursive_mutex> lock(mutex_);
-    if (!IsSessionReady()) {
-      break;
-    }
-    size_t num_bytes_to_read = data_mq_->availableToRead();
+  while (total_read < bytes && !data_path->closed) {
+    size_t num_bytes_to_read =
+        std::min(data_path->mq->availableToRead(), bytes - total_read);
     if (num_bytes_to_read) {
-      if (num_bytes_to_read > (bytes - total_read)) {
-        num_bytes_to_read = bytes - total_read;
-      }
-      if (!data_mq_->read(static_cast<MQDataType*>(buffer) + total_read,
-                          num_bytes_to_read)) {
+      if (!data_path->mq->read(static_cast<MQDataType*>(buffer) + total_read,
+                               num_bytes_to_read)) {
         LOG(ERROR) << "FMQ datapath reading " << total_read << "/" << bytes
                    << " failed";
         return total_read;
       }
       total_read += num_bytes_to_read;
-    } else if (timeout_ms >= kReadPollMs) {
-      lock.unlock();
-      usleep(kReadPollMs * 1000);
-      timeout_ms -= kReadPollMs;
-      continue;
-    } else {
+      data_path->Wake(kFmqNotFull);
+    } else if (!data_path->Wait(kFmqNotEmpty, deadline)) {
       LOG(DEBUG) << "Data " << total_read << "/" << bytes << " overflow "
-                 << (kFmqReceiveTimeoutMs - timeout_ms) << " ms";
+                 << kFmqReceiveTimeoutMs << " ms";
       return total_read;
     }
-  } while (total_read < bytes);
+  }
   return total_read;
 }
 
@@ -23,8 +23,11 @@
 #include <aidl/android/hardware/bluetooth/audio/LatencyMode.h>
 #include <aidl/android/hardware/bluetooth/audio/SessionType.h>
 #include <fmq/AidlMessageQueue.h>
+#include <fmq/EventFlag.h>
 #include <hardware/audio.h>
 
+#include <atomic>
+#include <chrono>
 #include <mutex>
 #include <unordered_map>
 #include <vector>
@@ -187,23 +190,52 @@ class BluetoothAudioSession {
   std::vector<LatencyMode> GetSupportedLatencyModes();
   void SetLatencyMode(const LatencyMode& latency_mode);
 
-  // The control function writes stream to FMQ
+  // The control function writes stream to FMQ. It blocks on the FMQ event flag
+  // while the queue is full and never takes the control path lock.
   size_t OutWritePcmData(const void* buffer, size_t bytes);
-  // The control function read stream from FMQ
+  // The control function read stream from FMQ. It blocks on the FMQ event flag
+  // while the queue is empty and never takes the control path lock.
   size_t InReadPcmData(void* buffer, size_t bytes);
 
   // Return if IBluetoothAudioProviderFactory implementation existed
   static bool IsAidlAvailable();
 
  private:
+  /***
+   * The FMQ of a software session and its event flag. The PCM methods hold a
+   * reference to it while transferring, so replacing or ending the data path
+   * only has to close it, and the transfers never wait for mutex_.
+   ***/
+  struct DataPath {
+    explicit DataPath(std::unique_ptr<DataMQ> data_mq);
+    ~DataPath();
+    // Waits until the peer sets one of the bits, the data path is closed or
+    // the deadline is reached. Returns false once the deadline is reached.
+    bool Wait(uint32_t bits, std::chrono::steady_clock::time_point deadline);
+    void Wake(uint32_t bits);
+    // Wakes up the transfers and makes them return.
+    void Close();
+
+    std::unique_ptr<DataMQ> mq;
+    ::android::hardware::EventFlag* event_flag = nullptr;
+    std::atomic<bool> closed = false;
+    // Set once the peer has been seen waking us up through the event flag.
+    // Until then, waits are sliced to keep up with peers polling the FMQ.
+    std::atomic<bool> peer_wakes = false;
+  };
+
+  std::shared_ptr<DataPath> GetDataPath();
+
   // using recursive_mutex to allow hwbinder to re-enter again.
   std::recursive_mutex mutex_;
   SessionType session_type_;
 
   // audio control path to use for both software and offloading
   std::shared_ptr<IBluetoothAudioPort> stack_iface_;
-  // audio data path (FMQ) for software encoding
-  std::unique_ptr<DataMQ> data_mq_;
+  // audio data path (FMQ) for software encoding, only replaced while holding
+  // both mutex_ and data_path_mutex_
+  std::mutex data_path_mutex_;
+  std::shared_ptr<DataPath> data_path_;
   // audio data configuration for both software and offloading
   std::unique_ptr<AudioConfiguration> audio_config_;
   std::vector<LatencyMode> latency_modes_;
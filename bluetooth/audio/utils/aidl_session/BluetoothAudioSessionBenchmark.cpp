@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <aidl/android/hardware/bluetooth/audio/BnBluetoothAudioPort.h>
+#include <benchmark/benchmark.h>
+
+#include "BluetoothAudioSession.h"
+
+using ::aidl::android::hardware::bluetooth::audio::AudioConfiguration;
+using ::aidl::android::hardware::bluetooth::audio::BluetoothAudioSession;
+using ::aidl::android::hardware::bluetooth::audio::BnBluetoothAudioPort;
+using ::aidl::android::hardware::bluetooth::audio::ChannelMode;
+using ::aidl::android::hardware::bluetooth::audio::DataMQ;
+using ::aidl::android::hardware::bluetooth::audio::LatencyMode;
+using ::aidl::android::hardware::bluetooth::audio::PcmConfiguration;
+using ::aidl::android::hardware::bluetooth::audio::PresentationPosition;
+using ::aidl::android::hardware::bluetooth::audio::SessionType;
+using ::aidl::android::hardware::bluetooth::audio::SinkMetadata;
+using ::aidl::android::hardware::bluetooth::audio::SourceMetadata;
+using ::android::hardware::EventFlag;
+
+/**
+ * Writes PCM through BluetoothAudioSession::OutWritePcmData() to a fake
+ * provider in the same process, which consumes the FMQ the way a software
+ * encoder of the Bluetooth stack does: two 10 ms packets every 20 ms. Run
+ * with:
+ *
+ *   atest BluetoothAudioSessionBenchmark
+ *
+ * range(0) selects how the fake provider consumes the FMQ: 0 polls it without
+ * touching the event flag, 1 blocks on the event flag and wakes the writer.
+ * The "p50_us" and "p99_us" counters are the time from writing a packet to
+ * the provider reading it, "cpu_ms_per_audio_s" is the CPU time of the
+ * process for one second of audio.
+ */
+
+namespace {
+
+constexpr int kSampleRate = 48000;
+constexpr size_t kFrameSize = 2 * sizeof(int16_t);
+constexpr size_t kPacketBytes = kSampleRate / 100 * kFrameSize;
+constexpr size_t kPacketsPerTick = 2;
+constexpr int64_t kTickNs = 20000000;
+// Enough for one tick, the writer blocks between the ticks.
+constexpr size_t kDataMqSize = kPacketBytes * kPacketsPerTick;
+constexpr size_t kPacketsPerIteration = 50;
+constexpr uint32_t kFmqNotEmpty = 1 << 0;
+constexpr uint32_t kFmqNotFull = 1 << 1;
+
+int64_t getTimeNs(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+class FakeBluetoothAudioPort : public BnBluetoothAudioPort {
+ public:
+  ndk::ScopedAStatus getPresentationPosition(PresentationPosition*) override {
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus startStream(bool) override {
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus suspendStream() override {
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus stopStream() override { return ndk::ScopedAStatus::ok(); }
+  ndk::ScopedAStatus updateSourceMetadata(const SourceMetadata&) override {
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus updateSinkMetadata(const SinkMetadata&) override {
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus setLatencyMode(LatencyMode) override {
+    return ndk::ScopedAStatus::ok();
+  }
+};
+
+// The provider end of the data path, consuming packets on a fixed tick.
+class FakeProvider {
+ public:
+  explicit FakeProvider(bool use_event_flag)
+      : mq_(kDataMqSize, /* EventFlag */ true),
+        use_event_flag_(use_event_flag) {
+    EventFlag::createEventFlag(mq_.getEventFlagWord(), &event_flag_);
+  }
+  ~FakeProvider() {
+    Stop();
+    EventFlag::deleteEventFlag(&event_flag_);
+  }
+
+  DataMQ& GetMq() { return mq_; }
+
+  void Start(size_t packet_count) {
+    latencies_ns_.clear();
+    stop_requested_ = false;
+    thread_ = std::thread(&FakeProvider::Run, this, packet_count);
+  }
+  // Returns once the packets already written are read, or right away if the
+  // writer gave up and no more packets are coming.
+  void Stop() {
+    stop_requested_ = true;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+  std::vector<int64_t>& GetLatencies() { return latencies_ns_; }
+
+ private:
+  bool ReadPacket(int8_t* packet) {
+    if (use_event_flag_) {
+      return mq_.readBlocking(packet, kPacketBytes, kFmqNotFull, kFmqNotEmpty,
+                              kTickNs, event_flag_);
+    }
+    while (mq_.availableToRead() < kPacketBytes) {
+      if (stop_requested_) {
+        return false;
+      }
+      usleep(1000);
+    }
+    return mq_.read(packet, kPacketBytes);
+  }
+
+  void Run(size_t packet_count) {
+    std::vector<int8_t> packet(kPacketBytes);
+    int64_t tick_ns = getTimeNs(CLOCK_MONOTONIC);
+    for (size_t read = 0; read < packet_count;) {
+      for (size_t i = 0; i < kPacketsPerTick && read < packet_count; i++) {
+        if (!ReadPacket(packet.data())) {
+          return;
+        }
+        int64_t written_ns;
+        memcpy(&written_ns, packet.data(), sizeof(written_ns));
+        latencies_ns_.push_back(getTimeNs(CLOCK_MONOTONIC) - written_ns);
+        read++;
+      }
+      tick_ns += kTickNs;
+      struct timespec ts = {.tv_sec = static_cast<time_t>(tick_ns / 1000000000),
+                            .tv_nsec = static_cast<long>(tick_ns % 1000000000)};
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    }
+  }
+
+  DataMQ mq_;
+  const bool use_event_flag_;
+  EventFlag* event_flag_ = nullptr;
+  std::atomic<bool> stop_requested_ = false;
+  std::thread thread_;
+  std::vector<int64_t> latencies_ns_;
+};
+
+}  // namespace
+
+static void BM_OutWritePcmData(benchmark::State& state) {
+  FakeProvider provider(state.range(0) != 0);
+  auto session = std::make_shared<BluetoothAudioSession>(
+      SessionType::A2DP_SOFTWARE_ENCODING_DATAPATH);
+  PcmConfiguration pcm_config{.sampleRateHz = kSampleRate,
+                              .channelMode = ChannelMode::STEREO,
+                              .bitsPerSample = 16,
+                              .dataIntervalUs = 10000};
+  auto desc = provider.GetMq().dupeDesc();
+  session->OnSessionStarted(ndk::SharedRefBase::make<FakeBluetoothAudioPort>(),
+                            &desc, AudioConfiguration(pcm_config), {});
+  if (!session->IsSessionReady()) {
+    state.SkipWithError("failed to start the session");
+    return;
+  }
+
+  std::vector<int8_t> packet(kPacketBytes);
+  std::vector<int64_t> latencies_ns;
+  int64_t cpu_ns = 0;
+  for (auto _ : state) {
+    const int64_t cpu_start_ns = getTimeNs(CLOCK_PROCESS_CPUTIME_ID);
+    provider.Start(kPacketsPerIteration);
+    for (size_t i = 0; i < kPacketsPerIteration; i++) {
+      const int64_t now_ns = getTimeNs(CLOCK_MONOTONIC);
+      memcpy(packet.data(), &now_ns, sizeof(now_ns));
+      if (session->OutWritePcmData(packet.data(), packet.size()) !=
+          packet.size()) {
+        state.SkipWithError("FMQ write timed out");
+        break;
+      }
+    }
+    provider.Stop();
+    cpu_ns += getTimeNs(CLOCK_PROCESS_CPUTIME_ID) - cpu_start_ns;
+    auto& latencies = provider.GetLatencies();
+    latencies_ns.insert(latencies_ns.end(), latencies.begin(), latencies.end());
+  }
+  session->OnSessionEnded();
+
+  if (latencies_ns.empty()) {
+    return;
+  }
+  std::sort(latencies_ns.begin(), latencies_ns.end());
+  auto percentile_us = [&latencies_ns](size_t p) {
+    return latencies_ns[(latencies_ns.size() - 1) * p / 100] / 1000.0;
+  };
+  state.counters["p50_us"] = percentile_us(50);
+  state.counters["p99_us"] = percentile_us(99);
+  const double audio_s =
+      static_cast<double>(latencies_ns.size() * kPacketBytes) /
+      (kSampleRate * kFrameSize);
+  state.counters["cpu_ms_per_audio_s"] = cpu_ns / 1e6 / audio_s;
+}
+
+BENCHMARK(BM_OutWritePcmData)->Arg(0)->Arg(1)->Iterations(4)->UseRealTime();
+
+BENCHMARK_MAIN();
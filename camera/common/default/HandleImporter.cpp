@@ -38,8 +38,30 @@ using MapperErrorV4 = android::hardware::graphics::mapper::V4_0::Error;
 using IMapperV3 = android::hardware::graphics::mapper::V3_0::IMapper;
 using IMapperV4 = android::hardware::graphics::mapper::V4_0::IMapper;
 
+struct HandleImporter::BufferLayout {
+    size_t numPlanes = 0;
+    uint32_t firstPlaneStride = 0;
+    // Offsets from the locked address, -1 if the buffer has no such component
+    int64_t yOffset = -1;
+    int64_t cbOffset = -1;
+    int64_t crOffset = -1;
+    uint32_t yStride = 0;
+    uint32_t cStride = 0;
+    uint32_t chromaStep = 0;
+};
+
 HandleImporter::HandleImporter() : mInitialized(false) {}
 
+bool HandleImporter::initialize() {
+    if (mInitialized.load(std::memory_order_acquire)) {
+        return true;
+    }
+
+    Mutex::Autolock lock(mInitLock);
+    initializeLocked();
+    return mInitialized.load(std::memory_order_relaxed);
+}
+
 void HandleImporter::initializeLocked() {
     if (mInitialized) {
         return;
@@ -47,13 +69,13 @@ void HandleImporter::initializeLocked() {
 
     mMapperV4 = IMapperV4::getService();
     if (mMapperV4 != nullptr) {
-        mInitialized = true;
+        mInitialized.store(true, std::memory_order_release);
         return;
     }
 
     mMapperV3 = IMapperV3::getService();
     if (mMapperV3 != nullptr) {
-        mInitialized = true;
+        mInitialized.store(true, std::memory_order_release);
         return;
     }
 
@@ -63,11 +85,12 @@ void HandleImporter::initializeLocked() {
         return;
     }
 
-    mInitialized = true;
+    mInitialized.store(true, std::memory_order_release);
     return;
 }
 
 void HandleImporter::cleanup() {
+    Mutex::Autolock lock(mInitLock);
     mMapperV4.clear();
     mMapperV3.clear();
     mMapperV2.clear();
@@ -176,6 +199,77 @@ std::vector<PlaneLayout> getPlaneLayouts(const sp<IMapperV4> mapper, buffer_hand
     return planeLayouts;
 }
 
+std::shared_ptr<const HandleImporter::BufferLayout> HandleImporter::queryBufferLayout(
+        const sp<IMapperV4>& mapper, buffer_handle_t buf) {
+    std::vector<PlaneLayout> planeLayouts = getPlaneLayouts(mapper, buf);
+    if (planeLayouts.empty()) {
+        return nullptr;
+    }
+
+    auto layout = std::make_shared<BufferLayout>();
+    layout->numPlanes = planeLayouts.size();
+    layout->firstPlaneStride = planeLayouts[0].strideInBytes;
+    for (const auto& planeLayout : planeLayouts) {
+        for (const auto& planeLayoutComponent : planeLayout.components) {
+            const auto& type = planeLayoutComponent.type;
+
+            if (!gralloc4::isStandardPlaneLayoutComponentType(type)) {
+                continue;
+            }
+
+            const int64_t offset =
+                    planeLayout.offsetInBytes + planeLayoutComponent.offsetInBits / 8;
+
+            switch (static_cast<PlaneLayoutComponentType>(type.value)) {
+                case PlaneLayoutComponentType::Y:
+                    layout->yOffset = offset;
+                    layout->yStride = planeLayout.strideInBytes;
+                    break;
+                case PlaneLayoutComponentType::CB:
+                    layout->cbOffset = offset;
+                    layout->cStride = planeLayout.strideInBytes;
+                    layout->chromaStep = planeLayout.sampleIncrementInBits / 8;
+                    break;
+                case PlaneLayoutComponentType::CR:
+                    layout->crOffset = offset;
+                    layout->cStride = planeLayout.strideInBytes;
+                    layout->chromaStep = planeLayout.sampleIncrementInBits / 8;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    return layout;
+}
+
+std::shared_ptr<const HandleImporter::BufferLayout> HandleImporter::getBufferLayout(
+        const sp<IMapperV4>& mapper, buffer_handle_t buf) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mLayoutsLock);
+        auto it = mLayouts.find(buf);
+        if (it == mLayouts.end()) {
+            // Not imported here, its lifetime is unknown so don't cache it
+            lock.unlock();
+            return queryBufferLayout(mapper, buf);
+        }
+        if (it->second != nullptr) {
+            return it->second;
+        }
+    }
+
+    // Queried without the lock, a concurrent query of the same buffer gets the same result
+    std::shared_ptr<const BufferLayout> layout = queryBufferLayout(mapper, buf);
+    if (layout != nullptr) {
+        std::unique_lock<std::shared_mutex> lock(mLayoutsLock);
+        auto it = mLayouts.find(buf);
+        if (it != mLayouts.end()) {
+            it->second = layout;
+        }
+    }
+    return layout;
+}
+
 template <>
 YCbCrLayout HandleImporter::lockYCbCrInternal<IMapperV4, MapperErrorV4>(
         const sp<IMapperV4> mapper, buffer_handle_t& buf, uint64_t cpuUsage,
@@ -200,38 +294,25 @@ YCbCrLayout HandleImporter::lockYCbCrInternal<IMapperV4, MapperErrorV4>(
         return layout;
     }
 
-    std::vector<PlaneLayout> planeLayouts = getPlaneLayouts(mapper, buf);
-    for (const auto& planeLayout : planeLayouts) {
-        for (const auto& planeLayoutComponent : planeLayout.components) {
-            const auto& type = planeLayoutComponent.type;
-
-            if (!gralloc4::isStandardPlaneLayoutComponentType(type)) {
-                continue;
-            }
-
-            uint8_t* data = reinterpret_cast<uint8_t*>(mapped);
-            data += planeLayout.offsetInBytes;
-            data += planeLayoutComponent.offsetInBits / 8;
+    std::shared_ptr<const BufferLayout> bufferLayout = getBufferLayout(mapper, buf);
+    if (bufferLayout == nullptr) {
+        return layout;
+    }
 
-            switch (static_cast<PlaneLayoutComponentType>(type.value)) {
-                case PlaneLayoutComponentType::Y:
-                    layout.y = data;
-                    layout.yStride = planeLayout.strideInBytes;
-                    break;
-                case PlaneLayoutComponentType::CB:
-                    layout.cb = data;
-                    layout.cStride = planeLayout.strideInBytes;
-                    layout.chromaStep = planeLayout.sampleIncrementInBits / 8;
-                    break;
-                case PlaneLayoutComponentType::CR:
-                    layout.cr = data;
-                    layout.cStride = planeLayout.strideInBytes;
-                    layout.chromaStep = planeLayout.sampleIncrementInBits / 8;
-                    break;
-                default:
-                    break;
-            }
-        }
+    uint8_t* data = reinterpret_cast<uint8_t*>(mapped);
+    if (bufferLayout->yOffset >= 0) {
+        layout.y = data + bufferLayout->yOffset;
+        layout.yStride = bufferLayout->yStride;
+    }
+    if (bufferLayout->cbOffset >= 0) {
+        layout.cb = data + bufferLayout->cbOffset;
+    }
+    if (bufferLayout->crOffset >= 0) {
+        layout.cr = data + bufferLayout->crOffset;
+    }
+    if (bufferLayout->cbOffset >= 0 || bufferLayout->crOffset >= 0) {
+        layout.cStride = bufferLayout->cStride;
+        layout.chromaStep = bufferLayout->chromaStep;
     }
 
     return layout;
@@ -272,13 +353,15 @@ bool HandleImporter::importBuffer(buffer_handle_t& handle) {
         return true;
     }
 
-    Mutex::Autolock lock(mLock);
-    if (!mInitialized) {
-        initializeLocked();
-    }
+    initialize();
 
     if (mMapperV4 != nullptr) {
-        return importBufferInternal<IMapperV4, MapperErrorV4>(mMapperV4, handle);
+        if (!importBufferInternal<IMapperV4, MapperErrorV4>(mMapperV4, handle)) {
+            return false;
+        }
+        std::unique_lock<std::shared_mutex> lock(mLayoutsLock);
+        mLayouts[handle] = nullptr;
+        return true;
     }
 
     if (mMapperV3 != nullptr) {
@@ -298,12 +381,13 @@ void HandleImporter::freeBuffer(buffer_handle_t handle) {
         return;
     }
 
-    Mutex::Autolock lock(mLock);
-    if (!mInitialized) {
-        initializeLocked();
-    }
+    initialize();
 
     if (mMapperV4 != nullptr) {
+        {
+            std::unique_lock<std::shared_mutex> lock(mLayoutsLock);
+            mLayouts.erase(handle);
+        }
         auto ret = mMapperV4->freeBuffer(const_cast<native_handle_t*>(handle));
         if (!ret.isOk()) {
             ALOGE("%s: mapper freeBuffer failed: %s", __FUNCTION__, ret.description().c_str());
@@ -351,11 +435,7 @@ void* HandleImporter::lock(buffer_handle_t& buf, uint64_t cpuUsage, size_t size)
 
 void* HandleImporter::lock(buffer_handle_t& buf, uint64_t cpuUsage,
                            const IMapper::Rect& accessRegion) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
-    }
+    initialize();
 
     void* ret = nullptr;
 
@@ -411,11 +491,7 @@ void* HandleImporter::lock(buffer_handle_t& buf, uint64_t cpuUsage,
 
 YCbCrLayout HandleImporter::lockYCbCr(buffer_handle_t& buf, uint64_t cpuUsage,
                                       const IMapper::Rect& accessRegion) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
-    }
+    initialize();
 
     if (mMapperV4 != nullptr) {
         return lockYCbCrInternal<IMapperV4, MapperErrorV4>(mMapperV4, buf, cpuUsage, accessRegion);
@@ -438,20 +514,17 @@ status_t HandleImporter::getMonoPlanarStrideBytes(buffer_handle_t& buf, uint32_t
         return BAD_VALUE;
     }
 
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
-    }
+    initialize();
 
     if (mMapperV4 != nullptr) {
-        std::vector<PlaneLayout> planeLayouts = getPlaneLayouts(mMapperV4, buf);
-        if (planeLayouts.size() != 1) {
-            ALOGE("%s: Unexpected number of planes %zu!", __FUNCTION__, planeLayouts.size());
+        std::shared_ptr<const BufferLayout> bufferLayout = getBufferLayout(mMapperV4, buf);
+        if (bufferLayout == nullptr || bufferLayout->numPlanes != 1) {
+            ALOGE("%s: Unexpected number of planes %zu!", __FUNCTION__,
+                  bufferLayout != nullptr ? bufferLayout->numPlanes : 0);
             return BAD_VALUE;
         }
 
-        *stride = planeLayouts[0].strideInBytes;
+        *stride = bufferLayout->firstPlaneStride;
     } else {
         ALOGE("%s: mMapperV4 is null! Query not supported!", __FUNCTION__);
         return NO_INIT;
@@ -476,11 +549,7 @@ int HandleImporter::unlock(buffer_handle_t& buf) {
 }
 
 bool HandleImporter::isSmpte2086Present(const buffer_handle_t& buf) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
-    }
+    initialize();
 
     if (mMapperV4 != nullptr) {
         return isMetadataPesent(mMapperV4, buf, gralloc4::MetadataType_Smpte2086);
@@ -492,11 +561,7 @@ bool HandleImporter::isSmpte2086Present(const buffer_handle_t& buf) {
 }
 
 bool HandleImporter::isSmpte2094_10Present(const buffer_handle_t& buf) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
-    }
+    initialize();
 
     if (mMapperV4 != nullptr) {
         return isMetadataPesent(mMapperV4, buf, gralloc4::MetadataType_Smpte2094_10);
@@ -508,11 +573,7 @@ bool HandleImporter::isSmpte2094_10Present(const buffer_handle_t& buf) {
 }
 
 bool HandleImporter::isSmpte2094_40Present(const buffer_handle_t& buf) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
-    }
+    initialize();
 
     if (mMapperV4 != nullptr) {
         return isMetadataPesent(mMapperV4, buf, gralloc4::MetadataType_Smpte2094_40);
@@ -22,6 +22,10 @@
 #include <android/hardware/graphics/mapper/4.0/IMapper.h>
 #include <cutils/native_handle.h>
 #include <utils/Mutex.h>
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
 
 using android::hardware::graphics::mapper::V2_0::IMapper;
 using android::hardware::graphics::mapper::V2_0::YCbCrLayout;
@@ -33,6 +37,10 @@ namespace common {
 namespace helper {
 
 // Borrowed from graphics HAL. Use this until gralloc mapper HAL is working
+//
+// Thread safe. Buffers are locked and unlocked without serializing on a global lock, and the
+// plane layouts of the buffers imported with importBuffer are queried once and cached until
+// freeBuffer.
 class HandleImporter {
   public:
     HandleImporter();
@@ -66,9 +74,20 @@ class HandleImporter {
     bool isSmpte2094_40Present(const buffer_handle_t& buf);
 
   private:
+    // Plane offsets and strides of a buffer, from its gralloc4 PlaneLayouts
+    struct BufferLayout;
+
+    // Returns false if no mapper is available
+    bool initialize();
     void initializeLocked();
     void cleanup();
 
+    // Cached for the imported buffers. Returns nullptr if the layout can't be queried.
+    std::shared_ptr<const BufferLayout> getBufferLayout(
+            const sp<graphics::mapper::V4_0::IMapper>& mapper, buffer_handle_t buf);
+    static std::shared_ptr<const BufferLayout> queryBufferLayout(
+            const sp<graphics::mapper::V4_0::IMapper>& mapper, buffer_handle_t buf);
+
     template <class M, class E>
     bool importBufferInternal(const sp<M> mapper, buffer_handle_t& handle);
     template <class M, class E>
@@ -77,11 +96,17 @@ class HandleImporter {
     template <class M, class E>
     int unlockInternal(const sp<M> mapper, buffer_handle_t& buf);
 
-    Mutex mLock;
-    bool mInitialized;
+    // Only protects the mapper initialization, the mappers don't change once mInitialized is
+    // set
+    Mutex mInitLock;
+    std::atomic<bool> mInitialized;
     sp<IMapper> mMapperV2;
     sp<graphics::mapper::V3_0::IMapper> mMapperV3;
     sp<graphics::mapper::V4_0::IMapper> mMapperV4;
+
+    std::shared_mutex mLayoutsLock;  // protects mLayouts
+    // Imported buffer -> layout, null until the buffer is first locked
+    std::unordered_map<buffer_handle_t, std::shared_ptr<const BufferLayout>> mLayouts;
 };
 
 }  // namespace helper
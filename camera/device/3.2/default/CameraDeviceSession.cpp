@@ -267,10 +267,59 @@ void CameraDeviceSession::overrideResultForPrecaptureCancelLocked(
     }
 }
 
+buffer_handle_t* CameraDeviceSession::CirculatingBuffers::find(uint64_t bufId) {
+    for (size_t i = 0; i < mBufIds.size(); i++) {
+        if (mBufIds[i] == bufId) {
+            return mHandles[i].get();
+        }
+    }
+    return nullptr;
+}
+
+buffer_handle_t* CameraDeviceSession::CirculatingBuffers::add(
+        uint64_t bufId, buffer_handle_t importedBuf) {
+    mBufIds.push_back(bufId);
+    mHandles.push_back(std::make_unique<buffer_handle_t>(importedBuf));
+    return mHandles.back().get();
+}
+
+buffer_handle_t CameraDeviceSession::CirculatingBuffers::remove(uint64_t bufId) {
+    for (size_t i = 0; i < mBufIds.size(); i++) {
+        if (mBufIds[i] == bufId) {
+            buffer_handle_t buf = *mHandles[i];
+            // The order doesn't matter, and the other handles don't move
+            mBufIds[i] = mBufIds.back();
+            mBufIds.pop_back();
+            mHandles[i] = std::move(mHandles.back());
+            mHandles.pop_back();
+            return buf;
+        }
+    }
+    return nullptr;
+}
+
+void CameraDeviceSession::CirculatingBuffers::reserve(size_t numBuffers) {
+    mBufIds.reserve(numBuffers);
+    mHandles.reserve(numBuffers);
+}
+
+void CameraDeviceSession::CirculatingBuffers::clear() {
+    mBufIds.clear();
+    mHandles.clear();
+}
+
 Status CameraDeviceSession::importBuffer(int32_t streamId,
         uint64_t bufId, buffer_handle_t buf,
         /*out*/buffer_handle_t** outBufPtr,
         bool allowEmptyBuf) {
+    Mutex::Autolock _l(mInflightLock);
+    return importBufferLocked(streamId, bufId, buf, outBufPtr, allowEmptyBuf);
+}
+
+Status CameraDeviceSession::importBufferLocked(int32_t streamId,
+        uint64_t bufId, buffer_handle_t buf,
+        /*out*/buffer_handle_t** outBufPtr,
+        bool allowEmptyBuf) {
 
     if (buf == nullptr && bufId == BUFFER_ID_NO_BUFFER) {
         if (allowEmptyBuf) {
@@ -282,20 +331,19 @@ Status CameraDeviceSession::importBuffer(int32_t streamId,
         }
     }
 
-    Mutex::Autolock _l(mInflightLock);
     CirculatingBuffers& cbs = mCirculatingBuffers[streamId];
-    if (cbs.count(bufId) == 0) {
+    buffer_handle_t* cachedBuf = cbs.find(bufId);
+    if (cachedBuf == nullptr) {
         // Register a newly seen buffer
         buffer_handle_t importedBuf = buf;
         sHandleImporter.importBuffer(importedBuf);
         if (importedBuf == nullptr) {
             ALOGE("%s: output buffer for stream %d is invalid!", __FUNCTION__, streamId);
             return Status::INTERNAL_ERROR;
-        } else {
-            cbs[bufId] = importedBuf;
         }
+        cachedBuf = cbs.add(bufId, importedBuf);
     }
-    *outBufPtr = &cbs[bufId];
+    *outBufPtr = cachedBuf;
     return Status::OK;
 }
 
@@ -315,59 +363,44 @@ Status CameraDeviceSession::importRequestImpl(
             request.inputBuffer.bufferId != 0);
     size_t numOutputBufs = request.outputBuffers.size();
     size_t numBufs = numOutputBufs + (hasInputBuf ? 1 : 0);
-    // Validate all I/O buffers
-    hidl_vec<buffer_handle_t> allBufs;
-    hidl_vec<uint64_t> allBufIds;
-    allBufs.resize(numBufs);
-    allBufIds.resize(numBufs);
     allBufPtrs.resize(numBufs);
     allFences.resize(numBufs);
-    std::vector<int32_t> streamIds(numBufs);
 
-    for (size_t i = 0; i < numOutputBufs; i++) {
-        allBufs[i] = request.outputBuffers[i].buffer.getNativeHandle();
-        allBufIds[i] = request.outputBuffers[i].bufferId;
-        allBufPtrs[i] = &allBufs[i];
-        streamIds[i] = request.outputBuffers[i].streamId;
-    }
-    if (hasInputBuf) {
-        allBufs[numOutputBufs] = request.inputBuffer.buffer.getNativeHandle();
-        allBufIds[numOutputBufs] = request.inputBuffer.bufferId;
-        allBufPtrs[numOutputBufs] = &allBufs[numOutputBufs];
-        streamIds[numOutputBufs] = request.inputBuffer.streamId;
-    }
+    // The input buffer, if any, comes after the output buffers
+    auto getStreamBuffer = [&](size_t i) -> const StreamBuffer& {
+        return i < numOutputBufs ? request.outputBuffers[i] : request.inputBuffer;
+    };
 
-    for (size_t i = 0; i < numBufs; i++) {
-        Status st = importBuffer(
-                streamIds[i], allBufIds[i], allBufs[i], &allBufPtrs[i],
-                // Disallow empty buf for input stream, otherwise follow
-                // the allowEmptyBuf argument.
-                (hasInputBuf && i == numOutputBufs) ? false : allowEmptyBuf);
-        if (st != Status::OK) {
-            // Detailed error logs printed in importBuffer
-            return st;
+    // Validate all I/O buffers, under a single lock for the whole request
+    {
+        Mutex::Autolock _l(mInflightLock);
+        for (size_t i = 0; i < numBufs; i++) {
+            const StreamBuffer& streamBuf = getStreamBuffer(i);
+            Status st = importBufferLocked(
+                    streamBuf.streamId, streamBuf.bufferId, streamBuf.buffer.getNativeHandle(),
+                    &allBufPtrs[i],
+                    // Disallow empty buf for input stream, otherwise follow
+                    // the allowEmptyBuf argument.
+                    (hasInputBuf && i == numOutputBufs) ? false : allowEmptyBuf);
+            if (st != Status::OK) {
+                // Detailed error logs printed in importBuffer
+                return st;
+            }
         }
     }
 
-    // All buffers are imported. Now validate output buffer acquire fences
-    for (size_t i = 0; i < numOutputBufs; i++) {
-        if (!sHandleImporter.importFence(
-                request.outputBuffers[i].acquireFence, allFences[i])) {
-            ALOGE("%s: output buffer %zu acquire fence is invalid", __FUNCTION__, i);
+    // All buffers are imported. Now validate the acquire fences, the lock is not needed
+    for (size_t i = 0; i < numBufs; i++) {
+        if (!sHandleImporter.importFence(getStreamBuffer(i).acquireFence, allFences[i])) {
+            if (i < numOutputBufs) {
+                ALOGE("%s: output buffer %zu acquire fence is invalid", __FUNCTION__, i);
+            } else {
+                ALOGE("%s: input buffer acquire fence is invalid", __FUNCTION__);
+            }
             cleanupInflightFences(allFences, i);
             return Status::INTERNAL_ERROR;
         }
     }
-
-    // Validate input buffer acquire fences
-    if (hasInputBuf) {
-        if (!sHandleImporter.importFence(
-                request.inputBuffer.acquireFence, allFences[numOutputBufs])) {
-            ALOGE("%s: input buffer acquire fence is invalid", __FUNCTION__);
-            cleanupInflightFences(allFences, numOutputBufs);
-            return Status::INTERNAL_ERROR;
-        }
-    }
     return Status::OK;
 }
 
@@ -1005,6 +1038,8 @@ void CameraDeviceSession::postProcessConfigurationLocked(
         }
     }
     mResultBatcher.setBatchedStreams(mVideoStreamIds);
+
+    reserveCirculatingBuffersLocked();
 }
 
 
@@ -1099,13 +1134,23 @@ Return<void> CameraDeviceSession::configureStreams(
 
 // Needs to get called after acquiring 'mInflightLock'
 void CameraDeviceSession::cleanupBuffersLocked(int id) {
-    for (auto& pair : mCirculatingBuffers.at(id)) {
-        sHandleImporter.freeBuffer(pair.second);
+    for (auto& buf : mCirculatingBuffers.at(id).handles()) {
+        sHandleImporter.freeBuffer(*buf);
     }
     mCirculatingBuffers[id].clear();
     mCirculatingBuffers.erase(id);
 }
 
+// Needs to get called after acquiring 'mInflightLock'
+void CameraDeviceSession::reserveCirculatingBuffersLocked() {
+    for (auto& pair : mCirculatingBuffers) {
+        auto streamIt = mStreamMap.find(pair.first);
+        if (streamIt != mStreamMap.end()) {
+            pair.second.reserve(streamIt->second.max_buffers);
+        }
+    }
+}
+
 void CameraDeviceSession::updateBufferCaches(const hidl_vec<BufferCache>& cachesToRemove) {
     Mutex::Autolock _l(mInflightLock);
     for (auto& cache : cachesToRemove) {
@@ -1114,11 +1159,9 @@ void CameraDeviceSession::updateBufferCaches(const hidl_vec<BufferCache>& caches
             // The stream could have been removed
             continue;
         }
-        CirculatingBuffers& cbs = cbsIt->second;
-        auto it = cbs.find(cache.bufferId);
-        if (it != cbs.end()) {
-            sHandleImporter.freeBuffer(it->second);
-            cbs.erase(it);
+        buffer_handle_t buf = cbsIt->second.remove(cache.bufferId);
+        if (buf != nullptr) {
+            sHandleImporter.freeBuffer(buf);
         } else {
             ALOGE("%s: stream %d buffer %" PRIu64 " is not cached",
                     __FUNCTION__, cache.streamId, cache.bufferId);
@@ -1329,8 +1372,8 @@ Return<void> CameraDeviceSession::close()  {
         Mutex::Autolock _l(mInflightLock);
         for(auto& pair : mCirculatingBuffers) {
             CirculatingBuffers& buffers = pair.second;
-            for (auto& p2 : buffers) {
-                sHandleImporter.freeBuffer(p2.second);
+            for (auto& buf : buffers.handles()) {
+                sHandleImporter.freeBuffer(*buf);
             }
             buffers.clear();
         }
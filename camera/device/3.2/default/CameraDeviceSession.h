@@ -25,7 +25,9 @@
 #include <include/convert.h>
 #include <deque>
 #include <map>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 #include "CameraMetadata.h"
 #include "HandleImporter.h"
 #include "hardware/camera3.h"
@@ -167,7 +169,26 @@ protected:
     // value: imported buffer_handle_t
     // Buffer will be imported during process_capture_request and will be freed
     // when the its stream is deleted or camera device session is closed
-    typedef std::unordered_map<uint64_t, buffer_handle_t> CirculatingBuffers;
+    //
+    // A stream circulates a handful of buffers, so their ids are kept in a flat array reserved
+    // for the stream max_buffers and scanned linearly, which is cheaper than hashing them for
+    // every buffer of every request. The handles are allocated separately as the HAL keeps
+    // pointers to them while the buffers are in flight.
+    class CirculatingBuffers {
+    public:
+        // Returns nullptr if bufId is not cached
+        buffer_handle_t* find(uint64_t bufId);
+        buffer_handle_t* add(uint64_t bufId, buffer_handle_t importedBuf);
+        // Returns the removed handle, nullptr if bufId is not cached
+        buffer_handle_t remove(uint64_t bufId);
+        void reserve(size_t numBuffers);
+        void clear();
+        const std::vector<std::unique_ptr<buffer_handle_t>>& handles() const { return mHandles; }
+
+    private:
+        std::vector<uint64_t> mBufIds;
+        std::vector<std::unique_ptr<buffer_handle_t>> mHandles; // same order as mBufIds
+    };
     // Stream ID -> circulating buffers map
     std::map<int, CirculatingBuffers> mCirculatingBuffers;
 
@@ -320,11 +341,20 @@ protected:
             /*out*/buffer_handle_t** outBufPtr,
             bool allowEmptyBuf);
 
+    // Needs to get called after acquiring 'mInflightLock'
+    Status importBufferLocked(int32_t streamId,
+            uint64_t bufId, buffer_handle_t buf,
+            /*out*/buffer_handle_t** outBufPtr,
+            bool allowEmptyBuf);
+
     static void cleanupInflightFences(
             hidl_vec<int>& allFences, size_t numFences);
 
     void cleanupBuffersLocked(int id);
 
+    // Sizes the circulating buffer tables of the configured streams for their max_buffers
+    void reserveCirculatingBuffersLocked();
+
     void updateBufferCaches(const hidl_vec<BufferCache>& cachesToRemove);
 
     android_dataspace mapToLegacyDataspace(
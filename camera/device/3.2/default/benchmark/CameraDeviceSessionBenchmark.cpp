@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <vector>
+
+#define LOG_TAG "CamDevSessionBenchmark"
+#include <CameraDeviceSession.h>
+#include <android/hardware_buffer.h>
+#include <benchmark/benchmark.h>
+#include <hardware/camera3.h>
+#include <log/log.h>
+#include <system/camera_metadata.h>
+
+using ::android::sp;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::camera::common::V1_0::Status;
+using ::android::hardware::camera::device::V3_2::BufferCache;
+using ::android::hardware::camera::device::V3_2::BufferStatus;
+using ::android::hardware::camera::device::V3_2::CameraMetadata;
+using ::android::hardware::camera::device::V3_2::CaptureRequest;
+using ::android::hardware::camera::device::V3_2::CaptureResult;
+using ::android::hardware::camera::device::V3_2::HalStreamConfiguration;
+using ::android::hardware::camera::device::V3_2::ICameraDeviceCallback;
+using ::android::hardware::camera::device::V3_2::NotifyMsg;
+using ::android::hardware::camera::device::V3_2::Stream;
+using ::android::hardware::camera::device::V3_2::StreamBuffer;
+using ::android::hardware::camera::device::V3_2::StreamConfiguration;
+using ::android::hardware::camera::device::V3_2::StreamConfigurationMode;
+using ::android::hardware::camera::device::V3_2::StreamRotation;
+using ::android::hardware::camera::device::V3_2::StreamType;
+using ::android::hardware::camera::device::V3_2::implementation::CameraDeviceSession;
+using ::android::hardware::graphics::common::V1_0::BufferUsage;
+using ::android::hardware::graphics::common::V1_0::Dataspace;
+using ::android::hardware::graphics::common::V1_0::PixelFormat;
+
+/**
+ * Replays a 240 fps high speed recording through CameraDeviceSession::processCaptureRequest on
+ * top of a fake camera3 device that returns every buffer from inside process_capture_request,
+ * so that only the session's request and result bookkeeping is measured. Imports real gralloc
+ * buffers, so runs on a device:
+ *
+ *   atest CameraDeviceSessionBenchmark
+ *
+ * range(0) is the number of output streams, a preview stream plus up to two video streams. Each
+ * stream circulates kBuffersPerStream buffers that are all imported before timing starts, as
+ * they would be once a recording has warmed up. items_per_second is the number of requests the
+ * session can turn around; at 240 fps the session has about 4.2ms per request.
+ */
+
+namespace {
+
+constexpr uint32_t kBuffersPerStream = 8;
+constexpr uint32_t kWidth = 1280;
+constexpr uint32_t kHeight = 720;
+
+struct FakeCamera3Device {
+    camera3_device_t device;
+    camera3_device_ops_t ops;
+    const camera3_callback_ops_t* callbacks;
+};
+
+FakeCamera3Device* getFake(const camera3_device_t* device) {
+    return static_cast<FakeCamera3Device*>(device->priv);
+}
+
+int fakeInitialize(const camera3_device_t* device, const camera3_callback_ops_t* callbacks) {
+    getFake(device)->callbacks = callbacks;
+    return 0;
+}
+
+int fakeConfigureStreams(const camera3_device_t*, camera3_stream_configuration_t* streamList) {
+    for (uint32_t i = 0; i < streamList->num_streams; i++) {
+        camera3_stream_t* stream = streamList->streams[i];
+        stream->max_buffers = kBuffersPerStream;
+        stream->usage |= GRALLOC_USAGE_HW_CAMERA_WRITE;
+    }
+    return 0;
+}
+
+int fakeProcessCaptureRequest(const camera3_device_t* device, camera3_capture_request_t* request) {
+    const camera3_callback_ops_t* callbacks = getFake(device)->callbacks;
+
+    camera3_notify_msg_t shutter{};
+    shutter.type = CAMERA3_MSG_SHUTTER;
+    shutter.message.shutter.frame_number = request->frame_number;
+    shutter.message.shutter.timestamp = request->frame_number;
+    callbacks->notify(callbacks, &shutter);
+
+    std::vector<camera3_stream_buffer_t> buffers(request->output_buffers,
+                                                 request->output_buffers +
+                                                         request->num_output_buffers);
+    for (auto& buffer : buffers) {
+        buffer.status = CAMERA3_BUFFER_STATUS_OK;
+        buffer.acquire_fence = -1;
+        buffer.release_fence = -1;
+    }
+    camera3_capture_result_t result{};
+    result.frame_number = request->frame_number;
+    result.num_output_buffers = buffers.size();
+    result.output_buffers = buffers.data();
+    callbacks->process_capture_result(callbacks, &result);
+    return 0;
+}
+
+int fakeClose(hw_device_t*) {
+    return 0;
+}
+
+class FakeCamera3 {
+  public:
+    FakeCamera3() {
+        mFake.ops = {};
+        mFake.ops.initialize = fakeInitialize;
+        mFake.ops.configure_streams = fakeConfigureStreams;
+        mFake.ops.process_capture_request = fakeProcessCaptureRequest;
+        mFake.device = {};
+        mFake.device.common.tag = HARDWARE_DEVICE_TAG;
+        mFake.device.common.version = CAMERA_DEVICE_API_VERSION_3_2;
+        mFake.device.common.close = fakeClose;
+        mFake.device.ops = &mFake.ops;
+        mFake.device.priv = &mFake;
+        mFake.callbacks = nullptr;
+    }
+
+    camera3_device_t* device() { return &mFake.device; }
+
+  private:
+    FakeCamera3Device mFake;
+};
+
+class Callback : public ICameraDeviceCallback {
+  public:
+    Return<void> processCaptureResult(const hidl_vec<CaptureResult>& results) override {
+        for (const auto& result : results) {
+            mBuffers += result.outputBuffers.size();
+        }
+        return Void();
+    }
+
+    Return<void> notify(const hidl_vec<NotifyMsg>&) override { return Void(); }
+
+    size_t buffers() const { return mBuffers; }
+
+  private:
+    std::atomic<size_t> mBuffers = 0;
+};
+
+CameraMetadata makeSettings(camera_metadata_t** metadata) {
+    *metadata = allocate_camera_metadata(/*entry_capacity*/ 1, /*data_capacity*/ 0);
+    uint8_t aeMode = ANDROID_CONTROL_AE_MODE_ON;
+    add_camera_metadata_entry(*metadata, ANDROID_CONTROL_AE_MODE, &aeMode, 1);
+    CameraMetadata settings;
+    settings.setToExternal(reinterpret_cast<uint8_t*>(*metadata),
+                           get_camera_metadata_size(*metadata));
+    return settings;
+}
+
+static void BM_ProcessCaptureRequest(benchmark::State& state) {
+    const size_t numStreams = state.range(0);
+
+    camera_metadata_t* deviceInfo = allocate_camera_metadata(/*entry_capacity*/ 1,
+                                                             /*data_capacity*/ 0);
+    int32_t partialResultCount = 1;
+    add_camera_metadata_entry(deviceInfo, ANDROID_REQUEST_PARTIAL_RESULT_COUNT,
+                              &partialResultCount, 1);
+
+    FakeCamera3 hal;
+    sp<Callback> callback = new Callback();
+    sp<CameraDeviceSession> session = new CameraDeviceSession(hal.device(), deviceInfo, callback);
+    free_camera_metadata(deviceInfo);
+    if (session->isInitFailed()) {
+        state.SkipWithError("Failed to initialize the session");
+        return;
+    }
+
+    StreamConfiguration config;
+    config.operationMode = StreamConfigurationMode::CONSTRAINED_HIGH_SPEED_MODE;
+    config.streams.resize(numStreams);
+    for (size_t i = 0; i < numStreams; i++) {
+        Stream& stream = config.streams[i];
+        stream.id = i;
+        stream.streamType = StreamType::OUTPUT;
+        stream.width = kWidth;
+        stream.height = kHeight;
+        stream.format = PixelFormat::IMPLEMENTATION_DEFINED;
+        stream.usage = (i == 0) ? BufferUsage::GPU_TEXTURE : BufferUsage::VIDEO_ENCODER;
+        stream.dataSpace = 0;
+        stream.rotation = StreamRotation::ROTATION_0;
+    }
+    Status configStatus = Status::INTERNAL_ERROR;
+    session->configureStreams(config, [&](Status s, const HalStreamConfiguration&) {
+        configStatus = s;
+    });
+    if (configStatus != Status::OK) {
+        state.SkipWithError("Failed to configure streams");
+        return;
+    }
+
+    std::vector<AHardwareBuffer*> buffers;
+    AHardwareBuffer_Desc desc = {
+            .width = kWidth,
+            .height = kHeight,
+            .layers = 1,
+            .format = AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420,
+            .usage = AHARDWAREBUFFER_USAGE_CPU_READ_RARELY |
+                     AHARDWAREBUFFER_USAGE_CPU_WRITE_RARELY,
+    };
+    for (size_t i = 0; i < numStreams * kBuffersPerStream; i++) {
+        AHardwareBuffer* buffer = nullptr;
+        if (AHardwareBuffer_allocate(&desc, &buffer) != 0) {
+            break;
+        }
+        buffers.push_back(buffer);
+    }
+
+    camera_metadata_t* settingsMetadata = nullptr;
+    CameraMetadata settings = makeSettings(&settingsMetadata);
+    hidl_vec<BufferCache> noCachesToRemove;
+    hidl_vec<CaptureRequest> requests(1);
+    CaptureRequest& request = requests[0];
+    request.fmqSettingsSize = 0;
+    request.inputBuffer.streamId = -1;
+    request.inputBuffer.bufferId = 0;
+    request.outputBuffers.resize(numStreams);
+
+    uint32_t frameNumber = 0;
+    bool failed = buffers.size() != numStreams * kBuffersPerStream;
+    auto submit = [&](bool firstUse) {
+        uint64_t bufferId = frameNumber % kBuffersPerStream + 1;
+        request.frameNumber = frameNumber++;
+        for (size_t i = 0; i < numStreams; i++) {
+            StreamBuffer& buffer = request.outputBuffers[i];
+            buffer.streamId = i;
+            buffer.bufferId = bufferId;
+            buffer.buffer = firstUse ? hidl_handle(AHardwareBuffer_getNativeHandle(
+                                               buffers[i * kBuffersPerStream + bufferId - 1]))
+                                     : hidl_handle();
+            buffer.status = BufferStatus::OK;
+        }
+        session->processCaptureRequest(requests, noCachesToRemove,
+                                       [&](Status s, uint32_t) { failed |= s != Status::OK; });
+    };
+
+    // Import every buffer and send the settings once, then replay the steady state.
+    for (uint32_t i = 0; !failed && i < kBuffersPerStream; i++) {
+        request.settings = (i == 0) ? settings : CameraMetadata();
+        submit(/*firstUse*/ true);
+    }
+    request.settings = CameraMetadata();
+
+    for (auto _ : state) {
+        if (failed) {
+            state.SkipWithError("Failed to process a capture request");
+            break;
+        }
+        submit(/*firstUse*/ false);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["buffers"] = callback->buffers();
+
+    session->close();
+    session.clear();
+    free_camera_metadata(settingsMetadata);
+    for (AHardwareBuffer* buffer : buffers) {
+        AHardwareBuffer_release(buffer);
+    }
+}
+BENCHMARK(BM_ProcessCaptureRequest)->DenseRange(1, 3);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -283,6 +283,8 @@ void CameraDeviceSession::postProcessConfigurationLocked_3_4(
         }
     }
     mResultBatcher_3_4.setBatchedStreams(mVideoStreamIds);
+
+    reserveCirculatingBuffersLocked();
 }
 
 void CameraDeviceSession::postProcessConfigurationFailureLocked_3_4(
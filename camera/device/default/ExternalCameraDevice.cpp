@@ -51,8 +51,12 @@ const std::regex kDevicePathRE("/dev/video([0-9]+)");
 std::string ExternalCameraDevice::kDeviceVersion = "1.1";
 
 ExternalCameraDevice::ExternalCameraDevice(const std::string& devicePath,
-                                           const ExternalCameraConfig& config)
-    : mCameraId("-1"), mDevicePath(devicePath), mCfg(config) {
+                                           const ExternalCameraConfig& config,
+                                           FrameSourceFactory frameSourceFactory)
+    : mCameraId("-1"),
+      mDevicePath(devicePath),
+      mFrameSourceFactory(std::move(frameSourceFactory)),
+      mCfg(config) {
     std::smatch sm;
     if (std::regex_match(mDevicePath, sm, kDevicePathRE)) {
         mCameraId = std::to_string(mCfg.cameraIdOffset + std::stoi(sm[1]));
@@ -131,24 +135,24 @@ ndk::ScopedAStatus ExternalCameraDevice::open(
     }
 
     int numAttempt = 0;
-    unique_fd fd(::open(mDevicePath.c_str(), O_RDWR));
-    while (fd.get() < 0 && numAttempt < MAX_RETRY) {
+    std::unique_ptr<FrameSource> frameSource = mFrameSourceFactory(mDevicePath);
+    while (frameSource == nullptr && numAttempt < MAX_RETRY) {
         // Previous retry attempts failed. Retry opening the device at most MAX_RETRY times
         ALOGW("%s: v4l2 device %s open failed, wait 33ms and try again", __FUNCTION__,
               mDevicePath.c_str());
         usleep(OPEN_RETRY_SLEEP_US);  // sleep and try again
-        fd.reset(::open(mDevicePath.c_str(), O_RDWR));
+        frameSource = mFrameSourceFactory(mDevicePath);
         numAttempt++;
     }
 
-    if (fd.get() < 0) {
+    if (frameSource == nullptr) {
         ALOGE("%s: v4l2 device open %s failed: %s", __FUNCTION__, mDevicePath.c_str(),
               strerror(errno));
         return fromStatus(Status::INTERNAL_ERROR);
     }
 
     session = createSession(in_callback, mCfg, mSupportedFormats, mCroppingType,
-                            mCameraCharacteristics, mCameraId, std::move(fd));
+                            mCameraCharacteristics, mCameraId, std::move(frameSource));
     if (session == nullptr) {
         ALOGE("%s: camera device session allocation failed", __FUNCTION__);
         return fromStatus(Status::INTERNAL_ERROR);
@@ -185,9 +189,9 @@ std::shared_ptr<ExternalCameraDeviceSession> ExternalCameraDevice::createSession
         const std::shared_ptr<ICameraDeviceCallback>& cb, const ExternalCameraConfig& cfg,
         const std::vector<SupportedV4L2Format>& sortedFormats, const CroppingType& croppingType,
         const common::V1_0::helper::CameraMetadata& chars, const std::string& cameraId,
-        unique_fd v4l2Fd) {
+        std::unique_ptr<FrameSource> frameSource) {
     return ndk::SharedRefBase::make<ExternalCameraDeviceSession>(
-            cb, cfg, sortedFormats, croppingType, chars, cameraId, std::move(v4l2Fd));
+            cb, cfg, sortedFormats, croppingType, chars, cameraId, std::move(frameSource));
 }
 
 bool ExternalCameraDevice::isInitFailed() {
@@ -207,13 +211,13 @@ bool ExternalCameraDevice::isInitFailedLocked() {
     return mInitFailed;
 }
 
-void ExternalCameraDevice::initSupportedFormatsLocked(int fd) {
-    std::vector<SupportedV4L2Format> horizontalFmts =
-            getCandidateSupportedFormatsLocked(fd, HORIZONTAL, mCfg.fpsLimits, mCfg.depthFpsLimits,
-                                               mCfg.minStreamSize, mCfg.depthEnabled);
-    std::vector<SupportedV4L2Format> verticalFmts =
-            getCandidateSupportedFormatsLocked(fd, VERTICAL, mCfg.fpsLimits, mCfg.depthFpsLimits,
-                                               mCfg.minStreamSize, mCfg.depthEnabled);
+void ExternalCameraDevice::initSupportedFormatsLocked(FrameSource& source) {
+    std::vector<SupportedV4L2Format> horizontalFmts = getCandidateSupportedFormatsLocked(
+            source, HORIZONTAL, mCfg.fpsLimits, mCfg.depthFpsLimits, mCfg.minStreamSize,
+            mCfg.depthEnabled);
+    std::vector<SupportedV4L2Format> verticalFmts = getCandidateSupportedFormatsLocked(
+            source, VERTICAL, mCfg.fpsLimits, mCfg.depthFpsLimits, mCfg.minStreamSize,
+            mCfg.depthEnabled);
 
     size_t horiSize = horizontalFmts.size();
     size_t vertSize = verticalFmts.size();
@@ -270,8 +274,8 @@ status_t ExternalCameraDevice::initCameraCharacteristics() {
     }
 
     // init camera characteristics
-    unique_fd fd(::open(mDevicePath.c_str(), O_RDWR));
-    if (fd.get() < 0) {
+    std::unique_ptr<FrameSource> frameSource = mFrameSourceFactory(mDevicePath);
+    if (frameSource == nullptr) {
         ALOGE("%s: v4l2 device open %s failed", __FUNCTION__, mDevicePath.c_str());
         return DEAD_OBJECT;
     }
@@ -284,14 +288,14 @@ status_t ExternalCameraDevice::initCameraCharacteristics() {
         return ret;
     }
 
-    ret = initCameraControlsCharsKeys(fd.get(), &mCameraCharacteristics);
+    ret = initCameraControlsCharsKeys(*frameSource, &mCameraCharacteristics);
     if (ret != OK) {
         ALOGE("%s: init camera control characteristics key failed: errorno %d", __FUNCTION__, ret);
         mCameraCharacteristics.clear();
         return ret;
     }
 
-    ret = initOutputCharsKeys(fd.get(), &mCameraCharacteristics);
+    ret = initOutputCharsKeys(*frameSource, &mCameraCharacteristics);
     if (ret != OK) {
         ALOGE("%s: init output characteristics key failed: errorno %d", __FUNCTION__, ret);
         mCameraCharacteristics.clear();
@@ -576,7 +580,7 @@ status_t ExternalCameraDevice::initDefaultCharsKeys(
 }
 
 status_t ExternalCameraDevice::initCameraControlsCharsKeys(
-        int, ::android::hardware::camera::common::V1_0::helper::CameraMetadata* metadata) {
+        FrameSource&, ::android::hardware::camera::common::V1_0::helper::CameraMetadata* metadata) {
     // android.sensor.info.sensitivityRange   -> V4L2_CID_ISO_SENSITIVITY
     // android.sensor.info.exposureTimeRange  -> V4L2_CID_EXPOSURE_ABSOLUTE
     // android.sensor.info.maxFrameDuration   -> TBD
@@ -617,8 +621,9 @@ status_t ExternalCameraDevice::initCameraControlsCharsKeys(
 }
 
 status_t ExternalCameraDevice::initOutputCharsKeys(
-        int fd, ::android::hardware::camera::common::V1_0::helper::CameraMetadata* metadata) {
-    initSupportedFormatsLocked(fd);
+        FrameSource& source,
+        ::android::hardware::camera::common::V1_0::helper::CameraMetadata* metadata) {
+    initSupportedFormatsLocked(source);
     if (mSupportedFormats.empty()) {
         ALOGE("%s: Init supported format list failed", __FUNCTION__);
         return UNKNOWN_ERROR;
@@ -800,7 +805,7 @@ status_t ExternalCameraDevice::calculateMinFps(
 #undef ARRAY_SIZE
 #undef UPDATE
 
-void ExternalCameraDevice::getFrameRateList(int fd, double fpsUpperBound,
+void ExternalCameraDevice::getFrameRateList(FrameSource& source, double fpsUpperBound,
                                             SupportedV4L2Format* format) {
     format->frameRates.clear();
 
@@ -812,7 +817,7 @@ void ExternalCameraDevice::getFrameRateList(int fd, double fpsUpperBound,
     };
 
     for (frameInterval.index = 0;
-         TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &frameInterval)) == 0;
+         TEMP_FAILURE_RETRY(source.ioctl(VIDIOC_ENUM_FRAMEINTERVALS, &frameInterval)) == 0;
          ++frameInterval.index) {
         if (frameInterval.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
             if (frameInterval.discrete.numerator != 0) {
@@ -841,7 +846,7 @@ void ExternalCameraDevice::getFrameRateList(int fd, double fpsUpperBound,
 }
 
 void ExternalCameraDevice::updateFpsBounds(
-        int fd, CroppingType cropType,
+        FrameSource& source, CroppingType cropType,
         const std::vector<ExternalCameraConfig::FpsLimitation>& fpsLimits,
         SupportedV4L2Format format, std::vector<SupportedV4L2Format>& outFmts) {
     double fpsUpperBound = -1.0;
@@ -862,14 +867,14 @@ void ExternalCameraDevice::updateFpsBounds(
         return;
     }
 
-    getFrameRateList(fd, fpsUpperBound, &format);
+    getFrameRateList(source, fpsUpperBound, &format);
     if (!format.frameRates.empty()) {
         outFmts.push_back(format);
     }
 }
 
 std::vector<SupportedV4L2Format> ExternalCameraDevice::getCandidateSupportedFormatsLocked(
-        int fd, CroppingType cropType,
+        FrameSource& source, CroppingType cropType,
         const std::vector<ExternalCameraConfig::FpsLimitation>& fpsLimits,
         const std::vector<ExternalCameraConfig::FpsLimitation>& depthFpsLimits,
         const Size& minStreamSize, bool depthEnabled) {
@@ -879,7 +884,7 @@ std::vector<SupportedV4L2Format> ExternalCameraDevice::getCandidateSupportedForm
     };
     int ret = 0;
     while (ret == 0) {
-        ret = TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc));
+        ret = TEMP_FAILURE_RETRY(source.ioctl(VIDIOC_ENUM_FMT, &fmtdesc));
         ALOGV("index:%d,ret:%d, format:%c%c%c%c", fmtdesc.index, ret, fmtdesc.pixelformat & 0xFF,
               (fmtdesc.pixelformat >> 8) & 0xFF, (fmtdesc.pixelformat >> 16) & 0xFF,
               (fmtdesc.pixelformat >> 24) & 0xFF);
@@ -898,7 +903,7 @@ std::vector<SupportedV4L2Format> ExternalCameraDevice::getCandidateSupportedForm
 
         // Found supported format
         v4l2_frmsizeenum frameSize{.index = 0, .pixel_format = fmtdesc.pixelformat};
-        for (; TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frameSize)) == 0;
+        for (; TEMP_FAILURE_RETRY(source.ioctl(VIDIOC_ENUM_FRAMESIZES, &frameSize)) == 0;
              ++frameSize.index) {
             if (frameSize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
                 ALOGV("index:%d, format:%c%c%c%c, w %d, h %d", frameSize.index,
@@ -924,9 +929,9 @@ std::vector<SupportedV4L2Format> ExternalCameraDevice::getCandidateSupportedForm
                         .fourcc = fmtdesc.pixelformat};
 
                 if (format.fourcc == V4L2_PIX_FMT_Z16 && depthEnabled) {
-                    updateFpsBounds(fd, cropType, depthFpsLimits, format, outFmts);
+                    updateFpsBounds(source, cropType, depthFpsLimits, format, outFmts);
                 } else {
-                    updateFpsBounds(fd, cropType, fpsLimits, format, outFmts);
+                    updateFpsBounds(source, cropType, fpsLimits, format, outFmts);
                 }
             }
         }
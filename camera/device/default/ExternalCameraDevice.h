@@ -43,7 +43,9 @@ class ExternalCameraDevice : public BnCameraDevice {
     // be multiple CameraDevice trying to access the same physical camera.  Also, provider will have
     // to keep track of all CameraDevice objects in order to notify CameraDevice when the underlying
     // camera is detached.
-    ExternalCameraDevice(const std::string& devicePath, const ExternalCameraConfig& config);
+    // The V4L2 node is opened with frameSourceFactory, which can emulate it for benchmarks.
+    ExternalCameraDevice(const std::string& devicePath, const ExternalCameraConfig& config,
+                         FrameSourceFactory frameSourceFactory = V4l2FrameSource::open);
     ~ExternalCameraDevice() override;
 
     ndk::ScopedAStatus getCameraCharacteristics(CameraMetadata* _aidl_return) override;
@@ -75,12 +77,12 @@ class ExternalCameraDevice : public BnCameraDevice {
             const std::shared_ptr<ICameraDeviceCallback>&, const ExternalCameraConfig& cfg,
             const std::vector<SupportedV4L2Format>& sortedFormats, const CroppingType& croppingType,
             const common::V1_0::helper::CameraMetadata& chars, const std::string& cameraId,
-            unique_fd v4l2Fd);
+            std::unique_ptr<FrameSource> frameSource);
 
     bool isInitFailedLocked();
 
-    // Init supported w/h/format/fps in mSupportedFormats. Caller still owns fd
-    void initSupportedFormatsLocked(int fd);
+    // Init supported w/h/format/fps in mSupportedFormats
+    void initSupportedFormatsLocked(FrameSource& source);
 
     // Calls into virtual member function. Do not use it in constructor
     status_t initCameraCharacteristics();
@@ -90,12 +92,14 @@ class ExternalCameraDevice : public BnCameraDevice {
     // Init non-device dependent keys
     virtual status_t initDefaultCharsKeys(
             ::android::hardware::camera::common::V1_0::helper::CameraMetadata*);
-    // Init camera control chars keys. Caller still owns fd
+    // Init camera control chars keys
     status_t initCameraControlsCharsKeys(
-            int fd, ::android::hardware::camera::common::V1_0::helper::CameraMetadata*);
-    // Init camera output configuration related keys.  Caller still owns fd
+            FrameSource& source,
+            ::android::hardware::camera::common::V1_0::helper::CameraMetadata*);
+    // Init camera output configuration related keys
     status_t initOutputCharsKeys(
-            int fd, ::android::hardware::camera::common::V1_0::helper::CameraMetadata*);
+            FrameSource& source,
+            ::android::hardware::camera::common::V1_0::helper::CameraMetadata*);
 
     // Helper function for initOutputCharskeys
     template <size_t SIZE>
@@ -106,16 +110,17 @@ class ExternalCameraDevice : public BnCameraDevice {
 
     status_t calculateMinFps(::android::hardware::camera::common::V1_0::helper::CameraMetadata*);
 
-    static void getFrameRateList(int fd, double fpsUpperBound, SupportedV4L2Format* format);
+    static void getFrameRateList(FrameSource& source, double fpsUpperBound,
+                                 SupportedV4L2Format* format);
 
-    static void updateFpsBounds(int fd, CroppingType cropType,
+    static void updateFpsBounds(FrameSource& source, CroppingType cropType,
                                 const std::vector<ExternalCameraConfig::FpsLimitation>& fpsLimits,
                                 SupportedV4L2Format format,
                                 std::vector<SupportedV4L2Format>& outFmts);
 
     // Get candidate supported formats list of input cropping type.
     static std::vector<SupportedV4L2Format> getCandidateSupportedFormatsLocked(
-            int fd, CroppingType cropType,
+            FrameSource& source, CroppingType cropType,
             const std::vector<ExternalCameraConfig::FpsLimitation>& fpsLimits,
             const std::vector<ExternalCameraConfig::FpsLimitation>& depthFpsLimits,
             const Size& minStreamSize, bool depthEnabled);
@@ -128,6 +133,7 @@ class ExternalCameraDevice : public BnCameraDevice {
     bool mInitFailed = false;
     std::string mCameraId;
     std::string mDevicePath;
+    const FrameSourceFactory mFrameSourceFactory;
     const ExternalCameraConfig& mCfg;
     std::vector<SupportedV4L2Format> mSupportedFormats;
     CroppingType mCroppingType;
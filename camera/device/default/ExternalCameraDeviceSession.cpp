@@ -20,6 +20,7 @@
 
 #include "ExternalCameraDeviceSession.h"
 
+#include <BufferAllocator/BufferAllocator.h>
 #include <Exif.h>
 #include <ExternalCameraOfflineSession.h>
 #include <aidl/android/hardware/camera/device/CameraBlob.h>
@@ -37,6 +38,7 @@
 #include <linux/videodev2.h>
 #include <sync/sync.h>
 #include <utils/Trace.h>
+#include <algorithm>
 #include <deque>
 
 #define HAVE_JPEG  // required for libyuv.h to export MJPEG decode APIs
@@ -89,6 +91,11 @@ bool tryLock(std::mutex& mutex) {
     return locked;
 }
 
+BufferAllocator& getDmaBufAllocator() {
+    static BufferAllocator allocator;
+    return allocator;
+}
+
 }  // anonymous namespace
 
 using ::aidl::android::hardware::camera::device::BufferRequestStatus;
@@ -114,14 +121,14 @@ ExternalCameraDeviceSession::ExternalCameraDeviceSession(
         const std::shared_ptr<ICameraDeviceCallback>& callback, const ExternalCameraConfig& cfg,
         const std::vector<SupportedV4L2Format>& sortedFormats, const CroppingType& croppingType,
         const common::V1_0::helper::CameraMetadata& chars, const std::string& cameraId,
-        unique_fd v4l2Fd)
+        std::shared_ptr<FrameSource> frameSource)
     : mCallback(callback),
       mCfg(cfg),
       mCameraCharacteristics(chars),
       mSupportedFormats(sortedFormats),
       mCroppingType(croppingType),
       mCameraId(cameraId),
-      mV4l2Fd(std::move(v4l2Fd)),
+      mFrameSource(std::move(frameSource)),
       mMaxThumbResolution(getMaxThumbResolution()),
       mMaxJpegResolution(getMaxJpegResolution()) {}
 
@@ -140,13 +147,13 @@ Size ExternalCameraDeviceSession::getMaxJpegResolution() const {
 }
 
 bool ExternalCameraDeviceSession::initialize() {
-    if (mV4l2Fd.get() < 0) {
-        ALOGE("%s: invalid v4l2 device fd %d!", __FUNCTION__, mV4l2Fd.get());
+    if (mFrameSource == nullptr) {
+        ALOGE("%s: no v4l2 frame source!", __FUNCTION__);
         return true;
     }
 
     struct v4l2_capability capability;
-    int ret = ioctl(mV4l2Fd.get(), VIDIOC_QUERYCAP, &capability);
+    int ret = mFrameSource->ioctl(VIDIOC_QUERYCAP, &capability);
     std::string make, model;
     if (ret < 0) {
         ALOGW("%s v4l2 QUERYCAP failed", __FUNCTION__);
@@ -656,6 +663,7 @@ Status ExternalCameraDeviceSession::processOneCaptureRequest(const CaptureReques
         halBuf.bufPtr = allBufPtrs[i];
         halBuf.acquireFence = allFences[i];
         halBuf.fenceTimeout = false;
+        halBuf.pending = false;
     }
     {
         std::lock_guard<std::mutex> lk(mInflightFramesLock);
@@ -1059,7 +1067,7 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(const SupportedV4L2Fo
     {
         int numAttempt = 0;
         do {
-            ret = TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_S_FMT, &fmt));
+            ret = TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_S_FMT, &fmt));
             if (numAttempt == MAX_RETRY) {
                 break;
             }
@@ -1126,15 +1134,26 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(const SupportedV4L2Fo
 
     uint32_t v4lBufferCount = (fps >= kDefaultFps) ? mCfg.numVideoBuffers : mCfg.numStillBuffers;
 
-    // VIDIOC_REQBUFS: create buffers
+    // VIDIOC_REQBUFS: create buffers. DMABUF ones are allocated here and only imported by the
+    // driver, so they are mapped once instead of on every frame.
     v4l2_requestbuffers req_buffers{};
     req_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req_buffers.memory = V4L2_MEMORY_MMAP;
+    req_buffers.memory = mCfg.dmaBufCapture ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP;
     req_buffers.count = v4lBufferCount;
-    if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_REQBUFS, &req_buffers)) < 0) {
+    if (req_buffers.memory == V4L2_MEMORY_DMABUF &&
+        (TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_REQBUFS, &req_buffers)) < 0 ||
+         allocateV4l2DmaBuffersLocked(req_buffers.count, bufferSize) != 0)) {
+        ALOGW("%s: DMABUF capture not available, falling back to MMAP", __FUNCTION__);
+        mV4l2DmaBuffers.clear();
+        req_buffers.memory = V4L2_MEMORY_MMAP;
+        req_buffers.count = v4lBufferCount;
+    }
+    if (req_buffers.memory == V4L2_MEMORY_MMAP &&
+        TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_REQBUFS, &req_buffers)) < 0) {
         ALOGE("%s: VIDIOC_REQBUFS failed: %s", __FUNCTION__, strerror(errno));
         return -errno;
     }
+    mV4l2Memory = req_buffers.memory;
 
     // Driver can indeed return more buffer if it needs more to operate
     if (req_buffers.count < v4lBufferCount) {
@@ -1147,15 +1166,16 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(const SupportedV4L2Fo
     // VIDIOC_QBUF: send buffer to driver
     mV4L2BufferCount = req_buffers.count;
     for (uint32_t i = 0; i < req_buffers.count; i++) {
-        v4l2_buffer buffer = {
-                .index = i, .type = V4L2_BUF_TYPE_VIDEO_CAPTURE, .memory = V4L2_MEMORY_MMAP};
+        v4l2_buffer buffer{};
+        prepareV4l2Buffer(i, &buffer);
 
-        if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QUERYBUF, &buffer)) < 0) {
+        if (mV4l2Memory == V4L2_MEMORY_MMAP &&
+            TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_QUERYBUF, &buffer)) < 0) {
             ALOGE("%s: QUERYBUF %d failed: %s", __FUNCTION__, i, strerror(errno));
             return -errno;
         }
 
-        if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QBUF, &buffer)) < 0) {
+        if (TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_QBUF, &buffer)) < 0) {
             ALOGE("%s: QBUF %d failed: %s", __FUNCTION__, i, strerror(errno));
             return -errno;
         }
@@ -1166,7 +1186,7 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(const SupportedV4L2Fo
         v4l2_buf_type capture_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         int numAttempt = 0;
         do {
-            ret = TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_STREAMON, &capture_type));
+            ret = TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_STREAMON, &capture_type));
             if (numAttempt == MAX_RETRY) {
                 break;
             }
@@ -1186,24 +1206,58 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(const SupportedV4L2Fo
     for (int i = 0; i < kBadFramesAfterStreamOn; i++) {
         v4l2_buffer buffer{};
         buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buffer.memory = V4L2_MEMORY_MMAP;
-        if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_DQBUF, &buffer)) < 0) {
+        buffer.memory = mV4l2Memory;
+        if (TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_DQBUF, &buffer)) < 0) {
             ALOGE("%s: DQBUF fails: %s", __FUNCTION__, strerror(errno));
             return -errno;
         }
 
-        if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QBUF, &buffer)) < 0) {
+        prepareV4l2Buffer(buffer.index, &buffer);
+        if (TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_QBUF, &buffer)) < 0) {
             ALOGE("%s: QBUF index %d fails: %s", __FUNCTION__, buffer.index, strerror(errno));
             return -errno;
         }
     }
 
-    ALOGI("%s: start V4L2 streaming %dx%d@%ffps", __FUNCTION__, v4l2Fmt.width, v4l2Fmt.height, fps);
+    ALOGI("%s: start V4L2 streaming %dx%d@%ffps into %s buffers", __FUNCTION__, v4l2Fmt.width,
+          v4l2Fmt.height, fps, mV4l2Memory == V4L2_MEMORY_DMABUF ? "DMABUF" : "MMAP");
     mV4l2StreamingFmt = v4l2Fmt;
     mV4l2Streaming = true;
     return OK;
 }
 
+int ExternalCameraDeviceSession::allocateV4l2DmaBuffersLocked(uint32_t count,
+                                                              uint32_t bufferSize) {
+    ATRACE_CALL();
+    mV4l2DmaBuffers.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        int fd = getDmaBufAllocator().Alloc(kDmabufSystemHeapName, bufferSize);
+        if (fd < 0) {
+            ALOGE("%s: allocating %u bytes from the DMA-BUF heap failed: %s", __FUNCTION__,
+                  bufferSize, strerror(-fd));
+            mV4l2DmaBuffers.clear();
+            return fd;
+        }
+        auto dmaBuffer = V4L2DmaBuffer::create(::android::base::unique_fd(fd), bufferSize);
+        if (dmaBuffer == nullptr) {
+            mV4l2DmaBuffers.clear();
+            return -ENOMEM;
+        }
+        mV4l2DmaBuffers.push_back(std::move(dmaBuffer));
+    }
+    return OK;
+}
+
+void ExternalCameraDeviceSession::prepareV4l2Buffer(uint32_t index, v4l2_buffer* buffer) const {
+    buffer->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer->memory = mV4l2Memory;
+    buffer->index = index;
+    if (mV4l2Memory == V4L2_MEMORY_DMABUF) {
+        buffer->m.fd = mV4l2DmaBuffers[index]->getFd();
+        buffer->length = mV4l2DmaBuffers[index]->getSize();
+    }
+}
+
 std::unique_ptr<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(nsecs_t* shutterTs) {
     ATRACE_CALL();
     std::unique_ptr<V4L2Frame> ret = nullptr;
@@ -1225,8 +1279,8 @@ std::unique_ptr<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(n
     ATRACE_BEGIN("VIDIOC_DQBUF");
     v4l2_buffer buffer{};
     buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buffer.memory = V4L2_MEMORY_MMAP;
-    if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_DQBUF, &buffer)) < 0) {
+    buffer.memory = mV4l2Memory;
+    if (TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_DQBUF, &buffer)) < 0) {
         ALOGE("%s: DQBUF fails: %s", __FUNCTION__, strerror(errno));
         return ret;
     }
@@ -1262,8 +1316,14 @@ std::unique_ptr<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(n
         mNumDequeuedV4l2Buffers++;
     }
 
+    if (mV4l2Memory == V4L2_MEMORY_DMABUF) {
+        // Read in place from the mapping made at allocation
+        return std::make_unique<V4L2Frame>(mV4l2StreamingFmt.width, mV4l2StreamingFmt.height,
+                                           mV4l2StreamingFmt.fourcc, buffer.index,
+                                           mV4l2DmaBuffers[buffer.index], buffer.bytesused);
+    }
     return std::make_unique<V4L2Frame>(mV4l2StreamingFmt.width, mV4l2StreamingFmt.height,
-                                       mV4l2StreamingFmt.fourcc, buffer.index, mV4l2Fd.get(),
+                                       mV4l2StreamingFmt.fourcc, buffer.index, mFrameSource,
                                        buffer.bytesused, buffer.m.offset);
 }
 
@@ -1272,10 +1332,8 @@ void ExternalCameraDeviceSession::enqueueV4l2Frame(const std::shared_ptr<V4L2Fra
     frame->unmap();
     ATRACE_BEGIN("VIDIOC_QBUF");
     v4l2_buffer buffer{};
-    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buffer.memory = V4L2_MEMORY_MMAP;
-    buffer.index = frame->mBufferIndex;
-    if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QBUF, &buffer)) < 0) {
+    prepareV4l2Buffer(frame->mBufferIndex, &buffer);
+    if (TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_QBUF, &buffer)) < 0) {
         ALOGE("%s: QBUF index %d fails: %s", __FUNCTION__, frame->mBufferIndex, strerror(errno));
         return;
     }
@@ -1434,8 +1492,8 @@ void ExternalCameraDeviceSession::close(bool callerIsDtor) {
             }
         }
         v4l2StreamOffLocked();
-        ALOGV("%s: closing V4L2 camera FD %d", __FUNCTION__, mV4l2Fd.get());
-        mV4l2Fd.reset();
+        ALOGV("%s: closing V4L2 camera FD %d", __FUNCTION__, mFrameSource->getFd());
+        mFrameSource.reset();
         mClosed = true;
     }
 }
@@ -1467,7 +1525,7 @@ int ExternalCameraDeviceSession::v4l2StreamOffLocked() {
 
     // VIDIOC_STREAMOFF
     v4l2_buf_type capture_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_STREAMOFF, &capture_type)) < 0) {
+    if (TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_STREAMOFF, &capture_type)) < 0) {
         ALOGE("%s: STREAMOFF failed: %s", __FUNCTION__, strerror(errno));
         return -errno;
     }
@@ -1475,12 +1533,14 @@ int ExternalCameraDeviceSession::v4l2StreamOffLocked() {
     // VIDIOC_REQBUFS: clear buffers
     v4l2_requestbuffers req_buffers{};
     req_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req_buffers.memory = V4L2_MEMORY_MMAP;
+    req_buffers.memory = mV4l2Memory;
     req_buffers.count = 0;
-    if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_REQBUFS, &req_buffers)) < 0) {
+    if (TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_REQBUFS, &req_buffers)) < 0) {
         ALOGE("%s: REQBUFS failed: %s", __FUNCTION__, strerror(errno));
         return -errno;
     }
+    // No longer referenced by the driver
+    mV4l2DmaBuffers.clear();
 
     mV4l2Streaming = false;
     return OK;
@@ -1490,7 +1550,7 @@ int ExternalCameraDeviceSession::setV4l2FpsLocked(double fps) {
     // VIDIOC_G_PARM/VIDIOC_S_PARM: set fps
     v4l2_streamparm streamparm = {.type = V4L2_BUF_TYPE_VIDEO_CAPTURE};
     // The following line checks that the driver knows about framerate get/set.
-    int ret = TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_G_PARM, &streamparm));
+    int ret = TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_G_PARM, &streamparm));
     if (ret != 0) {
         if (errno == -EINVAL) {
             ALOGW("%s: device does not support VIDIOC_G_PARM", __FUNCTION__);
@@ -1508,7 +1568,7 @@ int ExternalCameraDeviceSession::setV4l2FpsLocked(double fps) {
     streamparm.parm.capture.timeperframe.numerator = kFrameRatePrecision;
     streamparm.parm.capture.timeperframe.denominator = (fps * kFrameRatePrecision);
 
-    if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_S_PARM, &streamparm)) < 0) {
+    if (TEMP_FAILURE_RETRY(mFrameSource->ioctl(VIDIOC_S_PARM, &streamparm)) < 0) {
         ALOGE("%s: failed to set framerate to %f: %s", __FUNCTION__, fps, strerror(errno));
         return -1;
     }
@@ -1793,6 +1853,48 @@ Status ExternalCameraDeviceSession::processCaptureRequestError(
     return Status::OK;
 }
 
+StreamBuffer ExternalCameraDeviceSession::toStreamBuffer(int32_t frameNumber,
+                                                         const HalStreamBuffer& halBuf) {
+    StreamBuffer buffer;
+    buffer.streamId = halBuf.streamId;
+    buffer.bufferId = halBuf.bufferId;
+    if (halBuf.fenceTimeout) {
+        buffer.status = BufferStatus::ERROR;
+        notifyError(frameNumber, halBuf.streamId, ErrorCode::ERROR_BUFFER);
+    } else {
+        buffer.status = BufferStatus::OK;
+    }
+    if (halBuf.acquireFence >= 0) {
+        native_handle_t* handle = native_handle_create(/*numFds*/ 1, /*numInts*/ 0);
+        handle->data[0] = halBuf.acquireFence;
+        buffer.releaseFence = ::android::makeToAidl(handle);
+    }
+    return buffer;
+}
+
+Status ExternalCameraDeviceSession::processCaptureBufferResult(int32_t frameNumber,
+                                                               HalStreamBuffer& buffer) {
+    ATRACE_CALL();
+    // The metadata went with the rest of the request, this result only holds the buffer
+    std::vector<CaptureResult> results(1);
+    CaptureResult& result = results[0];
+    result.frameNumber = frameNumber;
+    result.partialResult = 0;
+    result.inputBuffer.streamId = -1;
+    result.outputBuffers.push_back(toStreamBuffer(frameNumber, buffer));
+
+    // update inflight records
+    {
+        std::lock_guard<std::mutex> lk(mInflightFramesLock);
+        mInflightFrames.erase(frameNumber);
+    }
+
+    // Callback into framework
+    invokeProcessCaptureResultCallback(results, /* tryWriteFmq */ false);
+    freeReleaseFences(results);
+    return Status::OK;
+}
+
 Status ExternalCameraDeviceSession::processCaptureResult(std::shared_ptr<HalRequest>& req) {
     ATRACE_CALL();
     // Return V4L2 buffer to V4L2 buffer queue
@@ -1808,27 +1910,13 @@ Status ExternalCameraDeviceSession::processCaptureResult(std::shared_ptr<HalRequ
     result.frameNumber = req->frameNumber;
     result.partialResult = 1;
     result.inputBuffer.streamId = -1;
-    result.outputBuffers.resize(req->buffers.size());
-    for (size_t i = 0; i < req->buffers.size(); i++) {
-        result.outputBuffers[i].streamId = req->buffers[i].streamId;
-        result.outputBuffers[i].bufferId = req->buffers[i].bufferId;
-        if (req->buffers[i].fenceTimeout) {
-            result.outputBuffers[i].status = BufferStatus::ERROR;
-            if (req->buffers[i].acquireFence >= 0) {
-                native_handle_t* handle = native_handle_create(/*numFds*/ 1, /*numInts*/ 0);
-                handle->data[0] = req->buffers[i].acquireFence;
-                result.outputBuffers[i].releaseFence = ::android::makeToAidl(handle);
-            }
-            notifyError(req->frameNumber, req->buffers[i].streamId, ErrorCode::ERROR_BUFFER);
-        } else {
-            result.outputBuffers[i].status = BufferStatus::OK;
-            // TODO: refactor
-            if (req->buffers[i].acquireFence >= 0) {
-                native_handle_t* handle = native_handle_create(/*numFds*/ 1, /*numInts*/ 0);
-                handle->data[0] = req->buffers[i].acquireFence;
-                result.outputBuffers[i].releaseFence = ::android::makeToAidl(handle);
-            }
+    bool hasPendingBuffers = false;
+    for (auto& halBuf : req->buffers) {
+        if (halBuf.pending) {
+            hasPendingBuffers = true;
+            continue;
         }
+        result.outputBuffers.push_back(toStreamBuffer(req->frameNumber, halBuf));
     }
 
     // Fill capture result metadata
@@ -1838,7 +1926,7 @@ Status ExternalCameraDeviceSession::processCaptureResult(std::shared_ptr<HalRequ
     req->setting.unlock(rawResult);
 
     // update inflight records
-    {
+    if (!hasPendingBuffers) {
         std::lock_guard<std::mutex> lk(mInflightFramesLock);
         mInflightFrames.erase(req->frameNumber);
     }
@@ -1927,7 +2015,7 @@ binder_status_t ExternalCameraDeviceSession::dump(int fd, const char** /*args*/,
     }
 
     dprintf(fd, "External camera %s V4L2 FD %d, cropping type %s, %s\n", mCameraId.c_str(),
-            mV4l2Fd.get(), (mCroppingType == VERTICAL) ? "vertical" : "horizontal",
+            mFrameSource->getFd(), (mCroppingType == VERTICAL) ? "vertical" : "horizontal",
             streaming ? "streaming" : "not streaming");
 
     if (streaming) {
@@ -2136,10 +2224,43 @@ ExternalCameraDeviceSession::OutputThread::OutputThread(
     : mParent(parent),
       mCroppingType(ct),
       mCameraCharacteristics(chars),
-      mBufferRequestThread(bufReqThread) {}
+      mBufferRequestThread(bufReqThread),
+      mJpegEncodeThread(std::make_unique<JpegEncodeThread>(this)) {}
 
 ExternalCameraDeviceSession::OutputThread::~OutputThread() {}
 
+namespace {
+// Whether the crop of a frame for an output is at least as large as the output
+bool fitsInFrame(CroppingType ct, const Size& frameSz, const Size& outSz) {
+    IMapper::Rect crop;
+    return getCropRect(ct, frameSz, outSz, &crop) == 0 && crop.width >= outSz.width &&
+           crop.height >= outSz.height;
+}
+
+const char* const kStageNames[] = {"MJPGtoI420",    "waitAcquireFence", "cropAndScaleLocked",
+                                   "formatConvert", "encodeJpeg",       "shutterToJpeg",
+                                   "processRequest"};
+}  // anonymous namespace
+
+void ExternalCameraDeviceSession::OutputThread::StageTiming::record(nsecs_t durationNs) {
+    count++;
+    totalNs += durationNs;
+    int64_t max = maxNs;
+    while (durationNs > max && !maxNs.compare_exchange_weak(max, durationNs)) {
+    }
+}
+
+ExternalCameraDeviceSession::OutputThread::ScopedStage::ScopedStage(OutputThread* thread,
+                                                                    Stage stage)
+    : mTiming(thread->mStageTimings[stage]), mStartNs(systemTime(SYSTEM_TIME_MONOTONIC)) {
+    ATRACE_BEGIN(kStageNames[stage]);
+}
+
+ExternalCameraDeviceSession::OutputThread::ScopedStage::~ScopedStage() {
+    ATRACE_END();
+    mTiming.record(systemTime(SYSTEM_TIME_MONOTONIC) - mStartNs);
+}
+
 Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
         const Size& v4lSize, const Size& thumbSize, const std::vector<Stream>& streams,
         uint32_t blobBufferSize) {
@@ -2212,6 +2333,37 @@ Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
         }
     }
 
+    // Allocating frames for scaled MJPEG decoding, when the scaled frame keeps even dimensions
+    // and a stream other than depth fits in it
+    for (int denom : {2, 4, 8}) {
+        Size decodeSz{v4lSize.width / denom, v4lSize.height / denom};
+        bool useful = false;
+        if (v4lSize.width % (2 * denom) == 0 && v4lSize.height % (2 * denom) == 0) {
+            for (const auto& stream : streams) {
+                if (stream.format != PixelFormat::Y16 &&
+                    fitsInFrame(mCroppingType, decodeSz, {stream.width, stream.height})) {
+                    useful = true;
+                    break;
+                }
+            }
+        }
+        if (!useful) {
+            mYu12ScaledDecodeFrames.erase(denom);
+            continue;
+        }
+        auto& frame = mYu12ScaledDecodeFrames[denom];
+        if (frame == nullptr || frame->mWidth != decodeSz.width ||
+            frame->mHeight != decodeSz.height) {
+            frame = std::make_shared<AllocatedFrame>(decodeSz.width, decodeSz.height);
+            int ret = frame->allocate();
+            if (ret != 0) {
+                ALOGE("%s: allocating 1/%d scaled YU12 frame failed!", __FUNCTION__, denom);
+                return Status::INTERNAL_ERROR;
+            }
+        }
+    }
+    mDecodedFrame = mYu12Frame;
+
     // Allocate mute test pattern frame
     mMuteTestPatternFrame.resize(mYu12Frame->mWidth * mYu12Frame->mHeight * 3);
 
@@ -2249,6 +2401,9 @@ void ExternalCameraDeviceSession::OutputThread::flush() {
 
     ALOGV("%s: flushing inflight requests", __FUNCTION__);
     lk.unlock();
+    if (!mJpegEncodeThread->waitForIdle(std::chrono::seconds(kFlushWaitTimeoutSec))) {
+        ALOGE("%s: wait for JPEG encoding finish timeout!", __FUNCTION__);
+    }
     for (const auto& req : reqs) {
         parent->processCaptureRequestError(req);
     }
@@ -2266,6 +2421,15 @@ void ExternalCameraDeviceSession::OutputThread::dump(int fd) {
         dprintf(fd, "%d, ", req->frameNumber);
     }
     dprintf(fd, "\n");
+    dprintf(fd, "OutputThread stage timing (count, avg us, max us):\n");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const StageTiming& timing = mStageTimings[i];
+        const uint64_t count = timing.count;
+        dprintf(fd, "  %s: %" PRIu64 ", %" PRId64 ", %" PRId64 "\n", kStageNames[i], count,
+                count > 0 ? static_cast<int64_t>(timing.totalNs / count / 1000) : 0,
+                static_cast<int64_t>(timing.maxNs / 1000));
+    }
+    mJpegEncodeThread->dump(fd);
 }
 
 void ExternalCameraDeviceSession::OutputThread::setExifMakeModel(const std::string& make,
@@ -2294,6 +2458,9 @@ ExternalCameraDeviceSession::OutputThread::switchToOffline() {
         }
     }
     lk.unlock();
+    if (!mJpegEncodeThread->waitForIdle(std::chrono::seconds(kFlushWaitTimeoutSec))) {
+        ALOGE("%s: wait for JPEG encoding finish timeout!", __FUNCTION__);
+    }
     clearIntermediateBuffers();
     ALOGV("%s: returning %zu request for offline processing", __FUNCTION__, reqs.size());
     return reqs;
@@ -2391,18 +2558,21 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         return 0;
     }
 
-    auto it = mScaledYu12Frames.find(outSz);
     std::shared_ptr<AllocatedFrame> scaledYu12Buf;
-    if (it != mScaledYu12Frames.end()) {
-        scaledYu12Buf = it->second;
-    } else {
-        it = mIntermediateBuffers.find(outSz);
-        if (it == mIntermediateBuffers.end()) {
-            ALOGE("%s: failed to find intermediate buffer size %dx%d", __FUNCTION__, outSz.width,
-                  outSz.height);
-            return -1;
+    {
+        std::lock_guard<std::mutex> scaledLk(mScaledYu12FramesLock);
+        auto it = mScaledYu12Frames.find(outSz);
+        if (it != mScaledYu12Frames.end()) {
+            scaledYu12Buf = it->second;
+        } else {
+            it = mIntermediateBuffers.find(outSz);
+            if (it == mIntermediateBuffers.end()) {
+                ALOGE("%s: failed to find intermediate buffer size %dx%d", __FUNCTION__,
+                      outSz.width, outSz.height);
+                return -1;
+            }
+            scaledYu12Buf = it->second;
         }
-        scaledYu12Buf = it->second;
     }
     // Scale
     YCbCrLayout outLayout;
@@ -2429,6 +2599,7 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
     }
 
     *out = outLayout;
+    std::lock_guard<std::mutex> scaledLk(mScaledYu12FramesLock);
     mScaledYu12Frames.insert({outSz, scaledYu12Buf});
     return 0;
 }
@@ -2559,6 +2730,18 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleThumbLocked(
 int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
         HalStreamBuffer& halBuf, const common::V1_0::helper::CameraMetadata& setting) {
     ATRACE_CALL();
+    JpegJob job;
+    int ret = prepareJpegLocked(halBuf, setting, /*copyFrames*/ false, &job);
+    if (ret != 0) {
+        return ret;
+    }
+    return encodeJpeg(job, halBuf);
+}
+
+int ExternalCameraDeviceSession::OutputThread::prepareJpegLocked(
+        const HalStreamBuffer& halBuf, const common::V1_0::helper::CameraMetadata& setting,
+        bool copyFrames, JpegJob* job) {
+    ATRACE_CALL();
     int ret;
     auto lfail = [&](auto... args) {
         ALOGE(args...);
@@ -2575,62 +2758,51 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
           static_cast<uint64_t>(halBuf.bufferId), halBuf.width, halBuf.height);
     ALOGV("%s: HAL buffer fmt: %x usage: %" PRIx64 " ptr: %p", __FUNCTION__, halBuf.format,
           static_cast<uint64_t>(halBuf.usage), halBuf.bufPtr);
-    ALOGV("%s: YV12 buffer %d x %d", __FUNCTION__, mYu12Frame->mWidth, mYu12Frame->mHeight);
+    ALOGV("%s: YV12 buffer %d x %d", __FUNCTION__, mDecodedFrame->mWidth, mDecodedFrame->mHeight);
 
-    int jpegQuality, thumbQuality;
-    Size thumbSize;
-    bool outputThumbnail = true;
+    job->outputThumbnail = true;
 
     if (setting.exists(ANDROID_JPEG_QUALITY)) {
         camera_metadata_ro_entry entry = setting.find(ANDROID_JPEG_QUALITY);
-        jpegQuality = entry.data.u8[0];
+        job->jpegQuality = entry.data.u8[0];
     } else {
         return lfail("%s: ANDROID_JPEG_QUALITY not set", __FUNCTION__);
     }
 
     if (setting.exists(ANDROID_JPEG_THUMBNAIL_QUALITY)) {
         camera_metadata_ro_entry entry = setting.find(ANDROID_JPEG_THUMBNAIL_QUALITY);
-        thumbQuality = entry.data.u8[0];
+        job->thumbQuality = entry.data.u8[0];
     } else {
         return lfail("%s: ANDROID_JPEG_THUMBNAIL_QUALITY not set", __FUNCTION__);
     }
 
     if (setting.exists(ANDROID_JPEG_THUMBNAIL_SIZE)) {
         camera_metadata_ro_entry entry = setting.find(ANDROID_JPEG_THUMBNAIL_SIZE);
-        thumbSize = Size{.width = entry.data.i32[0], .height = entry.data.i32[1]};
-        if (thumbSize.width == 0 && thumbSize.height == 0) {
-            outputThumbnail = false;
+        job->thumbSize = Size{.width = entry.data.i32[0], .height = entry.data.i32[1]};
+        if (job->thumbSize.width == 0 && job->thumbSize.height == 0) {
+            job->outputThumbnail = false;
         }
     } else {
         return lfail("%s: ANDROID_JPEG_THUMBNAIL_SIZE not set", __FUNCTION__);
     }
 
-    /* Cropped and scaled YU12 buffer for main and thumbnail */
-    YCbCrLayout yu12Main;
-    Size jpegSize{halBuf.width, halBuf.height};
+    job->jpegSize = Size{halBuf.width, halBuf.height};
 
-    /* Compute temporary buffer sizes accounting for the following:
-     * thumbnail can't exceed APP1 size of 64K
+    /* Compute the main image buffer size accounting for the following:
      * main image needs to hold APP1, headers, and at most a poorly
      * compressed image */
-    const ssize_t maxThumbCodeSize = 64 * 1024;
-    const ssize_t maxJpegCodeSize =
-            mBlobBufferSize == 0 ? parent->getJpegBufferSize(jpegSize.width, jpegSize.height)
-                                 : mBlobBufferSize;
+    job->maxJpegCodeSize = mBlobBufferSize == 0 ? parent->getJpegBufferSize(job->jpegSize.width,
+                                                                             job->jpegSize.height)
+                                                : mBlobBufferSize;
 
     /* Check that getJpegBufferSize did not return an error */
-    if (maxJpegCodeSize < 0) {
-        return lfail("%s: getJpegBufferSize returned %zd", __FUNCTION__, maxJpegCodeSize);
+    if (job->maxJpegCodeSize < 0) {
+        return lfail("%s: getJpegBufferSize returned %zd", __FUNCTION__, job->maxJpegCodeSize);
     }
 
-    /* Hold actual thumbnail and main image code sizes */
-    size_t thumbCodeSize = 0, jpegCodeSize = 0;
-    /* Temporary thumbnail code buffer */
-    std::vector<uint8_t> thumbCode(outputThumbnail ? maxThumbCodeSize : 0);
-
-    YCbCrLayout yu12Thumb;
-    if (outputThumbnail) {
-        ret = cropAndScaleThumbLocked(mYu12Frame, thumbSize, &yu12Thumb);
+    /* Cropped and scaled YU12 buffer for thumbnail and main */
+    if (job->outputThumbnail) {
+        ret = cropAndScaleThumbLocked(mDecodedFrame, job->thumbSize, &job->thumb);
 
         if (ret != 0) {
             return lfail("%s: crop and scale thumbnail failed!", __FUNCTION__);
@@ -2638,15 +2810,63 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     }
 
     /* Scale and crop main jpeg */
-    ret = cropAndScaleLocked(mYu12Frame, jpegSize, &yu12Main);
+    ret = cropAndScaleLocked(mDecodedFrame, job->jpegSize, &job->main);
 
     if (ret != 0) {
         return lfail("%s: crop and scale main failed!", __FUNCTION__);
     }
 
+    job->settings = setting;
+    if (!copyFrames) {
+        return 0;
+    }
+
+    /* The intermediate buffers are reused by the next request, copy the
+     * images for the encode thread */
+    auto copyFrame = [&](const YCbCrLayout& in, const Size& sz,
+                         std::shared_ptr<AllocatedFrame>* outFrame, YCbCrLayout* out) {
+        *outFrame = mJpegEncodeThread->acquireFrame(sz);
+        if (*outFrame == nullptr || (*outFrame)->getLayout(out) != 0) {
+            return -1;
+        }
+        return libyuv::I420Copy(
+                static_cast<uint8_t*>(in.y), in.yStride, static_cast<uint8_t*>(in.cb), in.cStride,
+                static_cast<uint8_t*>(in.cr), in.cStride, static_cast<uint8_t*>(out->y),
+                out->yStride, static_cast<uint8_t*>(out->cb), out->cStride,
+                static_cast<uint8_t*>(out->cr), out->cStride, sz.width, sz.height);
+    };
+    if (job->outputThumbnail &&
+        copyFrame(job->thumb, job->thumbSize, &job->thumbFrame, &job->thumb) != 0) {
+        return lfail("%s: copying thumbnail failed!", __FUNCTION__);
+    }
+    if (copyFrame(job->main, job->jpegSize, &job->mainFrame, &job->main) != 0) {
+        return lfail("%s: copying main image failed!", __FUNCTION__);
+    }
+    return 0;
+}
+
+int ExternalCameraDeviceSession::OutputThread::encodeJpeg(const JpegJob& job,
+                                                          HalStreamBuffer& halBuf) {
+    ATRACE_CALL();
+    int ret;
+    auto lfail = [&](auto... args) {
+        ALOGE(args...);
+
+        return 1;
+    };
+
+    /* Compute temporary buffer sizes accounting for the following:
+     * thumbnail can't exceed APP1 size of 64K */
+    const ssize_t maxThumbCodeSize = 64 * 1024;
+
+    /* Hold actual thumbnail and main image code sizes */
+    size_t thumbCodeSize = 0, jpegCodeSize = 0;
+    /* Temporary thumbnail code buffer */
+    std::vector<uint8_t> thumbCode(job.outputThumbnail ? maxThumbCodeSize : 0);
+
     /* Encode the thumbnail image */
-    if (outputThumbnail) {
-        ret = encodeJpegYU12(thumbSize, yu12Thumb, thumbQuality, 0, 0, &thumbCode[0],
+    if (job.outputThumbnail) {
+        ret = encodeJpegYU12(job.thumbSize, job.thumb, job.thumbQuality, 0, 0, &thumbCode[0],
                              maxThumbCodeSize, thumbCodeSize);
 
         if (ret != 0) {
@@ -2657,18 +2877,18 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     /* Combine camera characteristics with request settings to form EXIF
      * metadata */
     common::V1_0::helper::CameraMetadata meta(mCameraCharacteristics);
-    meta.append(setting);
+    meta.append(job.settings);
 
     /* Generate EXIF object */
     std::unique_ptr<ExifUtils> utils(ExifUtils::create());
     /* Make sure it's initialized */
     utils->initialize();
 
-    utils->setFromMetadata(meta, jpegSize.width, jpegSize.height);
+    utils->setFromMetadata(meta, job.jpegSize.width, job.jpegSize.height);
     utils->setMake(mExifMake);
     utils->setModel(mExifModel);
 
-    ret = utils->generateApp1(outputThumbnail ? &thumbCode[0] : nullptr, thumbCodeSize);
+    ret = utils->generateApp1(job.outputThumbnail ? &thumbCode[0] : nullptr, thumbCodeSize);
 
     if (!ret) {
         return lfail("%s: generating APP1 failed", __FUNCTION__);
@@ -2680,21 +2900,21 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
 
     /* Lock the HAL jpeg code buffer */
     void* bufPtr = sHandleImporter.lock(*(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage),
-                                        maxJpegCodeSize);
+                                        job.maxJpegCodeSize);
 
     if (!bufPtr) {
-        return lfail("%s: could not lock %zu bytes", __FUNCTION__, maxJpegCodeSize);
+        return lfail("%s: could not lock %zu bytes", __FUNCTION__, job.maxJpegCodeSize);
     }
 
     /* Encode the main jpeg image */
-    ret = encodeJpegYU12(jpegSize, yu12Main, jpegQuality, exifData, exifDataSize, bufPtr,
-                         maxJpegCodeSize, jpegCodeSize);
+    ret = encodeJpegYU12(job.jpegSize, job.main, job.jpegQuality, exifData, exifDataSize, bufPtr,
+                         job.maxJpegCodeSize, jpegCodeSize);
 
     /* TODO: Not sure this belongs here, maybe better to pass jpegCodeSize out
      * and do this when returning buffer to parent */
     CameraBlob blob{CameraBlobId::JPEG, static_cast<int32_t>(jpegCodeSize)};
-    void* blobDst = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(bufPtr) + maxJpegCodeSize -
-                                            sizeof(CameraBlob));
+    void* blobDst = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(bufPtr) +
+                                            job.maxJpegCodeSize - sizeof(CameraBlob));
     memcpy(blobDst, &blob, sizeof(CameraBlob));
 
     /* Unlock the HAL jpeg code buffer */
@@ -2708,15 +2928,256 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
         return lfail("%s: encodeJpegYU12 failed with %d", __FUNCTION__, ret);
     }
 
-    ALOGV("%s: encoded JPEG (ret:%d) with Q:%d max size: %zu", __FUNCTION__, ret, jpegQuality,
-          maxJpegCodeSize);
+    ALOGV("%s: encoded JPEG (ret:%d) with Q:%d max size: %zu", __FUNCTION__, ret, job.jpegQuality,
+          job.maxJpegCodeSize);
 
     return 0;
 }
 
+void ExternalCameraDeviceSession::OutputThread::completeJpegJob(JpegJob& job) {
+    int ret;
+    {
+        ScopedStage stage(this, STAGE_JPEG);
+        ret = encodeJpeg(job, job.buffer);
+    }
+    if (ret != 0) {
+        // Only this buffer is lost, return it with an error status
+        ALOGE("%s: encoding JPEG of frame %d failed with %d", __FUNCTION__, job.frameNumber, ret);
+        job.buffer.fenceTimeout = true;
+    }
+    job.buffer.pending = false;
+    mStageTimings[STAGE_SHUTTER_TO_JPEG].record(systemTime(SYSTEM_TIME_MONOTONIC) - job.shutterTs);
+
+    auto parent = mParent.lock();
+    if (parent == nullptr) {
+        ALOGE("%s: session has been disconnected!", __FUNCTION__);
+        return;
+    }
+    Status st = parent->processCaptureBufferResult(job.frameNumber, job.buffer);
+    if (st != Status::OK) {
+        ALOGE("%s: failed to return JPEG buffer of frame %d", __FUNCTION__, job.frameNumber);
+    }
+}
+
+int ExternalCameraDeviceSession::OutputThread::getDecodeScaleDenomLocked(
+        const std::shared_ptr<HalRequest>& req) {
+    for (auto it = mYu12ScaledDecodeFrames.rbegin(); it != mYu12ScaledDecodeFrames.rend(); it++) {
+        const Size decodeSz{it->second->mWidth, it->second->mHeight};
+        bool fits = true;
+        for (const auto& halBuf : req->buffers) {
+            if (!fitsInFrame(mCroppingType, decodeSz, {halBuf.width, halBuf.height})) {
+                fits = false;
+                break;
+            }
+            if (halBuf.format == PixelFormat::BLOB) {
+                camera_metadata_ro_entry entry = req->setting.find(ANDROID_JPEG_THUMBNAIL_SIZE);
+                if (entry.count == 2 &&
+                    !fitsInFrame(mCroppingType, decodeSz, {entry.data.i32[0], entry.data.i32[1]})) {
+                    fits = false;
+                    break;
+                }
+            }
+        }
+        if (fits) {
+            return it->first;
+        }
+    }
+    return 1;
+}
+
+int ExternalCameraDeviceSession::OutputThread::decodeMjpegLocked(uint8_t* inData,
+                                                                 size_t inDataSize,
+                                                                 int scaleDenom) {
+    ScopedStage stage(this, STAGE_DECODE);
+    auto it = mYu12ScaledDecodeFrames.find(scaleDenom);
+    if (it != mYu12ScaledDecodeFrames.end()) {
+        YCbCrLayout layout;
+        if (it->second->getLayout(&layout) == 0 &&
+            decodeMjpegScaled(inData, inDataSize, scaleDenom,
+                              {it->second->mWidth, it->second->mHeight}, layout) == 0) {
+            mDecodedFrame = it->second;
+            return 0;
+        }
+        // libjpeg only handles the usual chroma subsamplings, let libyuv try the full frame
+        ALOGV("%s: 1/%d scaled decode failed, decoding the full frame", __FUNCTION__, scaleDenom);
+    }
+    mDecodedFrame = mYu12Frame;
+    return libyuv::MJPGToI420(inData, inDataSize, static_cast<uint8_t*>(mYu12FrameLayout.y),
+                              mYu12FrameLayout.yStride, static_cast<uint8_t*>(mYu12FrameLayout.cb),
+                              mYu12FrameLayout.cStride, static_cast<uint8_t*>(mYu12FrameLayout.cr),
+                              mYu12FrameLayout.cStride, mYu12Frame->mWidth, mYu12Frame->mHeight,
+                              mYu12Frame->mWidth, mYu12Frame->mHeight);
+}
+
+int ExternalCameraDeviceSession::OutputThread::processOutputBufferLocked(
+        const std::shared_ptr<HalRequest>& req, HalStreamBuffer& halBuf, uint8_t* inData,
+        size_t inDataSize) {
+    const int kSyncWaitTimeoutMs = 500;
+    if (*(halBuf.bufPtr) == nullptr) {
+        ALOGW("%s: buffer for stream %d missing", __FUNCTION__, halBuf.streamId);
+        halBuf.fenceTimeout = true;
+    } else if (halBuf.acquireFence >= 0) {
+        ScopedStage stage(this, STAGE_FENCE_WAIT);
+        int ret = sync_wait(halBuf.acquireFence, kSyncWaitTimeoutMs);
+        if (ret) {
+            halBuf.fenceTimeout = true;
+        } else {
+            ::close(halBuf.acquireFence);
+            halBuf.acquireFence = -1;
+        }
+    }
+
+    if (halBuf.fenceTimeout) {
+        return 0;
+    }
+
+    // Gralloc lockYCbCr the buffer
+    switch (halBuf.format) {
+        case PixelFormat::BLOB: {
+            // Only crop and scale here, the buffer is returned once encoded
+            auto job = std::make_unique<JpegJob>();
+            int ret = prepareJpegLocked(halBuf, req->setting, /*copyFrames*/ true, job.get());
+            if (ret != 0) {
+                ALOGE("%s: prepareJpegLocked failed with %d", __FUNCTION__, ret);
+                return ret;
+            }
+            job->frameNumber = req->frameNumber;
+            job->shutterTs = req->shutterTs;
+            job->buffer = halBuf;
+            halBuf.pending = true;
+            std::lock_guard<std::mutex> lk(mJpegJobsLock);
+            mJpegJobs.push_back(std::move(job));
+        } break;
+        case PixelFormat::Y16: {
+            void* outLayout = sHandleImporter.lock(
+                    *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), inDataSize);
+
+            std::memcpy(outLayout, inData, inDataSize);
+
+            int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+            if (relFence >= 0) {
+                halBuf.acquireFence = relFence;
+            }
+        } break;
+        case PixelFormat::YCBCR_420_888:
+        case PixelFormat::YV12: {
+            IMapper::Rect outRect{0, 0, static_cast<int32_t>(halBuf.width),
+                                  static_cast<int32_t>(halBuf.height)};
+            YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
+                    *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), outRect);
+            ALOGV("%s: outLayout y %p cb %p cr %p y_str %d c_str %d c_step %d", __FUNCTION__,
+                  outLayout.y, outLayout.cb, outLayout.cr, outLayout.yStride, outLayout.cStride,
+                  outLayout.chromaStep);
+
+            Size sz{halBuf.width, halBuf.height};
+            if (mDirectDecodeDenom != 0) {
+                bool decoded = false;
+                if (outLayout.chromaStep == 1) {
+                    ScopedStage stage(this, STAGE_DECODE);
+                    decoded = decodeMjpegScaled(inData, inDataSize, mDirectDecodeDenom, sz,
+                                                outLayout) == 0;
+                }
+                // Semi-planar output or unusual subsampling, use the intermediate buffers
+                bool failed = false;
+                if (!decoded && decodeMjpegLocked(inData, inDataSize, mDirectDecodeDenom) != 0) {
+                    // For some webcam, the first few V4L2 frames might be malformed...
+                    ALOGE("%s: Convert V4L2 frame to YU12 failed!", __FUNCTION__);
+                    halBuf.fenceTimeout = true;
+                    failed = true;
+                }
+                if (decoded || failed) {
+                    int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+                    if (relFence >= 0) {
+                        halBuf.acquireFence = relFence;
+                    }
+                    return 0;
+                }
+            }
+
+            // Convert to output buffer size/format
+            uint32_t outputFourcc = getFourCcFromLayout(outLayout);
+            ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__, outputFourcc & 0xFF,
+                  (outputFourcc >> 8) & 0xFF, (outputFourcc >> 16) & 0xFF,
+                  (outputFourcc >> 24) & 0xFF);
+
+            YCbCrLayout cropAndScaled;
+            int ret;
+            {
+                ScopedStage stage(this, STAGE_CROP_AND_SCALE);
+                ret = cropAndScaleLocked(mDecodedFrame, sz, &cropAndScaled);
+            }
+            if (ret != 0) {
+                ALOGE("%s: crop and scale failed!", __FUNCTION__);
+                sHandleImporter.unlock(*(halBuf.bufPtr));
+                return ret;
+            }
+
+            {
+                ScopedStage stage(this, STAGE_FORMAT_CONVERT);
+                ret = formatConvert(cropAndScaled, outLayout, sz, outputFourcc);
+            }
+            if (ret != 0) {
+                ALOGE("%s: format conversion failed!", __FUNCTION__);
+                sHandleImporter.unlock(*(halBuf.bufPtr));
+                return ret;
+            }
+            int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+            if (relFence >= 0) {
+                halBuf.acquireFence = relFence;
+            }
+        } break;
+        default:
+            ALOGE("%s: unknown output format %x", __FUNCTION__, halBuf.format);
+            return -EINVAL;
+    }
+    return 0;
+}
+
+bool ExternalCameraDeviceSession::OutputThread::processOutputBuffersLocked(
+        const std::shared_ptr<HalRequest>& req, uint8_t* inData, size_t inDataSize) {
+    // Buffers of the same size share an intermediate scaled frame, so they are processed in
+    // sequence by the same task. The thumbnail frame is only used by the single BLOB stream.
+    std::vector<std::vector<HalStreamBuffer*>> sizeGroups;
+    for (auto& halBuf : req->buffers) {
+        auto group = std::find_if(sizeGroups.begin(), sizeGroups.end(), [&](const auto& g) {
+            return g[0]->width == halBuf.width && g[0]->height == halBuf.height;
+        });
+        if (group == sizeGroups.end()) {
+            sizeGroups.push_back({&halBuf});
+        } else {
+            group->push_back(&halBuf);
+        }
+    }
+
+    std::atomic<bool> failed = false;
+    std::vector<std::function<void()>> tasks;
+    for (const auto& group : sizeGroups) {
+        tasks.push_back([&, group] {
+            for (HalStreamBuffer* halBuf : group) {
+                if (failed || processOutputBufferLocked(req, *halBuf, inData, inDataSize) != 0) {
+                    failed = true;
+                    return;
+                }
+            }
+        });
+    }
+
+    if (tasks.size() == 1) {
+        tasks[0]();
+    } else if (tasks.size() > 1) {
+        if (mWorkerPool == nullptr) {
+            mWorkerPool = std::make_unique<WorkerPool>(kNumBufferWorkers);
+        }
+        mWorkerPool->run(tasks);
+    }
+    return !failed;
+}
+
 void ExternalCameraDeviceSession::OutputThread::clearIntermediateBuffers() {
     std::lock_guard<std::mutex> lk(mBufferLock);
     mYu12Frame.reset();
+    mYu12ScaledDecodeFrames.clear();
+    mDecodedFrame.reset();
     mYu12ThumbFrame.reset();
     mIntermediateBuffers.clear();
     mMuteTestPatternFrame.clear();
@@ -2794,11 +3255,13 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         }
     }
 
-    // TODO: in some special case maybe we can decode jpg directly to gralloc output?
+    const nsecs_t requestStartNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    mDecodedFrame = mYu12Frame;
+    mDirectDecodeDenom = 0;
     if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG) {
-        ATRACE_BEGIN("MJPGtoI420");
         res = 0;
         if (mCameraMuted) {
+            ScopedStage stage(this, STAGE_DECODE);
             res = libyuv::ConvertToI420(
                     mMuteTestPatternFrame.data(), mMuteTestPatternFrame.size(),
                     static_cast<uint8_t*>(mYu12FrameLayout.y), mYu12FrameLayout.yStride,
@@ -2807,14 +3270,20 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
                     mYu12Frame->mWidth, mYu12Frame->mHeight, mYu12Frame->mWidth,
                     mYu12Frame->mHeight, libyuv::kRotate0, libyuv::FOURCC_RAW);
         } else {
-            res = libyuv::MJPGToI420(
-                    inData, inDataSize, static_cast<uint8_t*>(mYu12FrameLayout.y),
-                    mYu12FrameLayout.yStride, static_cast<uint8_t*>(mYu12FrameLayout.cb),
-                    mYu12FrameLayout.cStride, static_cast<uint8_t*>(mYu12FrameLayout.cr),
-                    mYu12FrameLayout.cStride, mYu12Frame->mWidth, mYu12Frame->mHeight,
-                    mYu12Frame->mWidth, mYu12Frame->mHeight);
+            // Decode only the pixels the outputs need
+            const int scaleDenom = getDecodeScaleDenomLocked(req);
+            const Size decodeSz{mYu12Frame->mWidth / scaleDenom,
+                                mYu12Frame->mHeight / scaleDenom};
+            if (req->buffers.size() == 1 &&
+                (req->buffers[0].format == PixelFormat::YCBCR_420_888 ||
+                 req->buffers[0].format == PixelFormat::YV12) &&
+                Size{req->buffers[0].width, req->buffers[0].height} == decodeSz) {
+                // Decoded when processing the output buffer
+                mDirectDecodeDenom = scaleDenom;
+            } else {
+                res = decodeMjpegLocked(inData, inDataSize, scaleDenom);
+            }
         }
-        ATRACE_END();
 
         if (res != 0) {
             // For some webcam, the first few V4L2 frames might be malformed...
@@ -2840,91 +3309,15 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
     }
 
     ALOGV("%s processing new request", __FUNCTION__);
-    const int kSyncWaitTimeoutMs = 500;
-    for (auto& halBuf : req->buffers) {
-        if (*(halBuf.bufPtr) == nullptr) {
-            ALOGW("%s: buffer for stream %d missing", __FUNCTION__, halBuf.streamId);
-            halBuf.fenceTimeout = true;
-        } else if (halBuf.acquireFence >= 0) {
-            int ret = sync_wait(halBuf.acquireFence, kSyncWaitTimeoutMs);
-            if (ret) {
-                halBuf.fenceTimeout = true;
-            } else {
-                ::close(halBuf.acquireFence);
-                halBuf.acquireFence = -1;
-            }
-        }
-
-        if (halBuf.fenceTimeout) {
-            continue;
-        }
-
-        // Gralloc lockYCbCr the buffer
-        switch (halBuf.format) {
-            case PixelFormat::BLOB: {
-                int ret = createJpegLocked(halBuf, req->setting);
-
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: createJpegLocked failed with %d", __FUNCTION__, ret);
-                }
-            } break;
-            case PixelFormat::Y16: {
-                void* outLayout = sHandleImporter.lock(
-                        *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), inDataSize);
-
-                std::memcpy(outLayout, inData, inDataSize);
-
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
-            } break;
-            case PixelFormat::YCBCR_420_888:
-            case PixelFormat::YV12: {
-                IMapper::Rect outRect{0, 0, static_cast<int32_t>(halBuf.width),
-                                      static_cast<int32_t>(halBuf.height)};
-                YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
-                        *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), outRect);
-                ALOGV("%s: outLayout y %p cb %p cr %p y_str %d c_str %d c_step %d", __FUNCTION__,
-                      outLayout.y, outLayout.cb, outLayout.cr, outLayout.yStride, outLayout.cStride,
-                      outLayout.chromaStep);
-
-                // Convert to output buffer size/format
-                uint32_t outputFourcc = getFourCcFromLayout(outLayout);
-                ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__, outputFourcc & 0xFF,
-                      (outputFourcc >> 8) & 0xFF, (outputFourcc >> 16) & 0xFF,
-                      (outputFourcc >> 24) & 0xFF);
-
-                YCbCrLayout cropAndScaled;
-                ATRACE_BEGIN("cropAndScaleLocked");
-                int ret = cropAndScaleLocked(mYu12Frame, Size{halBuf.width, halBuf.height},
-                                             &cropAndScaled);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: crop and scale failed!", __FUNCTION__);
-                }
-
-                Size sz{halBuf.width, halBuf.height};
-                ATRACE_BEGIN("formatConvert");
-                ret = formatConvert(cropAndScaled, outLayout, sz, outputFourcc);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: format conversion failed!", __FUNCTION__);
-                }
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
-            } break;
-            default:
-                lk.unlock();
-                return onDeviceError("%s: unknown output format %x", __FUNCTION__, halBuf.format);
-        }
-    }  // for each buffer
+    if (!processOutputBuffersLocked(req, inData, inDataSize)) {
+        mScaledYu12Frames.clear();
+        mJpegJobs.clear();
+        lk.unlock();
+        return onDeviceError("%s: failed to process output buffers!", __FUNCTION__);
+    }
     mScaledYu12Frames.clear();
+    std::vector<std::unique_ptr<JpegJob>> jpegJobs = std::move(mJpegJobs);
+    mJpegJobs.clear();
 
     // Don't hold the lock while calling back to parent
     lk.unlock();
@@ -2932,10 +3325,114 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
     if (st != Status::OK) {
         return onDeviceError("%s: failed to process capture result!", __FUNCTION__);
     }
+    // Submitted after the shutter and the rest of the request are returned, the BLOB buffers
+    // must not be returned before them
+    for (auto& job : jpegJobs) {
+        mJpegEncodeThread->submit(std::move(job));
+    }
+    mStageTimings[STAGE_REQUEST].record(systemTime(SYSTEM_TIME_MONOTONIC) - requestStartNs);
     signalRequestDone();
     return true;
 }
 
+ExternalCameraDeviceSession::OutputThread::JpegEncodeThread::JpegEncodeThread(
+        OutputThread* outputThread)
+    : mOutputThread(outputThread) {}
+
+ExternalCameraDeviceSession::OutputThread::JpegEncodeThread::~JpegEncodeThread() {
+    // Join before the members used by threadLoop are destroyed
+    requestExitAndWait();
+    if (!mJobs.empty()) {
+        ALOGE("%s: dropping %zu JPEG jobs, the output thread was not flushed", __FUNCTION__,
+              mJobs.size());
+    }
+}
+
+void ExternalCameraDeviceSession::OutputThread::JpegEncodeThread::submit(
+        std::unique_ptr<JpegJob> job) {
+    ATRACE_CALL();
+    std::unique_lock<std::mutex> lk(mLock);
+    if (!mStarted) {
+        run();
+        mStarted = true;
+    }
+    mDoneCond.wait(lk, [this] { return mJobs.size() + (mEncoding ? 1 : 0) < kMaxPendingJobs; });
+    mJobs.push_back(std::move(job));
+    lk.unlock();
+    mJobCond.notify_one();
+}
+
+std::shared_ptr<AllocatedFrame>
+ExternalCameraDeviceSession::OutputThread::JpegEncodeThread::acquireFrame(const Size& size) {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        for (auto it = mFreeFrames.begin(); it != mFreeFrames.end(); it++) {
+            if ((*it)->mWidth == size.width && (*it)->mHeight == size.height) {
+                std::shared_ptr<AllocatedFrame> frame = std::move(*it);
+                mFreeFrames.erase(it);
+                return frame;
+            }
+        }
+    }
+    auto frame = std::make_shared<AllocatedFrame>(size.width, size.height);
+    if (frame->allocate() != 0) {
+        ALOGE("%s: allocating %dx%d JPEG input frame failed!", __FUNCTION__, size.width,
+              size.height);
+        return nullptr;
+    }
+    return frame;
+}
+
+bool ExternalCameraDeviceSession::OutputThread::JpegEncodeThread::waitForIdle(
+        std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lk(mLock);
+    return mDoneCond.wait_for(lk, timeout, [this] { return mJobs.empty() && !mEncoding; });
+}
+
+void ExternalCameraDeviceSession::OutputThread::JpegEncodeThread::dump(int fd) {
+    std::lock_guard<std::mutex> lk(mLock);
+    dprintf(fd, "JpegEncodeThread %s, pending frame: ", mEncoding ? "encoding" : "idle");
+    for (const auto& job : mJobs) {
+        dprintf(fd, "%d, ", job->frameNumber);
+    }
+    dprintf(fd, "\n");
+}
+
+bool ExternalCameraDeviceSession::OutputThread::JpegEncodeThread::threadLoop() {
+    std::unique_ptr<JpegJob> job;
+    {
+        std::unique_lock<std::mutex> lk(mLock);
+        if (mJobs.empty()) {
+            // Wake up regularly to check exitPending()
+            mJobCond.wait_for(lk, std::chrono::milliseconds(kReqWaitTimeoutMs));
+            if (mJobs.empty()) {
+                return true;
+            }
+        }
+        job = std::move(mJobs.front());
+        mJobs.pop_front();
+        mEncoding = true;
+    }
+
+    mOutputThread->completeJpegJob(*job);
+
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mEncoding = false;
+        // Keep the frames for the next captures, they are usually the same sizes
+        for (const auto& frame : {job->mainFrame, job->thumbFrame}) {
+            if (frame != nullptr) {
+                mFreeFrames.push_back(frame);
+            }
+        }
+        while (mFreeFrames.size() > 2 * kMaxPendingJobs) {
+            mFreeFrames.erase(mFreeFrames.begin());
+        }
+    }
+    mDoneCond.notify_all();
+    return true;
+}
+
 // End ExternalCameraDeviceSession::OutputThread functions
 
 }  // namespace implementation
@@ -18,6 +18,7 @@
 #define HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_EXTERNALCAMERADEVICESESSION_H_
 
 #include <ExternalCameraUtils.h>
+#include <FrameSource.h>
 #include <SimpleThread.h>
 #include <aidl/android/hardware/camera/common/Status.h>
 #include <aidl/android/hardware/camera/device/BnCameraDeviceSession.h>
@@ -26,6 +27,8 @@
 #include <android-base/unique_fd.h>
 #include <fmq/AidlMessageQueue.h>
 #include <utils/Thread.h>
+#include <atomic>
+#include <chrono>
 #include <deque>
 #include <list>
 
@@ -47,6 +50,7 @@ using ::aidl::android::hardware::camera::device::ICameraDeviceCallback;
 using ::aidl::android::hardware::camera::device::ICameraOfflineSession;
 using ::aidl::android::hardware::camera::device::RequestTemplate;
 using ::aidl::android::hardware::camera::device::Stream;
+using ::aidl::android::hardware::camera::device::StreamBuffer;
 using ::aidl::android::hardware::camera::device::StreamConfiguration;
 using ::aidl::android::hardware::common::fmq::MQDescriptor;
 using ::aidl::android::hardware::common::fmq::SynchronizedReadWrite;
@@ -64,7 +68,8 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
                                 const std::vector<SupportedV4L2Format>& sortedFormats,
                                 const CroppingType& croppingType,
                                 const common::V1_0::helper::CameraMetadata& chars,
-                                const std::string& cameraId, unique_fd v4l2Fd);
+                                const std::string& cameraId,
+                                std::shared_ptr<FrameSource> frameSource);
     ~ExternalCameraDeviceSession() override;
 
     // Caller must use this method to check if CameraDeviceSession ctor failed
@@ -106,6 +111,8 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
                                       std::vector<CaptureResult>* results) override;
 
     Status processCaptureResult(std::shared_ptr<HalRequest>& ptr) override;
+
+    Status processCaptureBufferResult(int32_t frameNumber, HalStreamBuffer& buffer) override;
     ssize_t getJpegBufferSize(int32_t width, int32_t height) const override;
 
     // Called by CameraDevice to dump active device states
@@ -181,6 +188,92 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
         static const int kFlushWaitTimeoutSec = 3;  // 3 sec
         static const int kReqWaitTimeoutMs = 33;    // 33ms
         static const int kReqWaitTimesMax = 90;     // 33ms * 90 ~= 3 sec
+        // Threads processing output buffers along with the output thread. With at most
+        // kMaxProcessedStream + kMaxStallStream outputs, every output size gets a thread.
+        static constexpr size_t kNumBufferWorkers = 2;
+
+        // Stages of the processing of a request, timed for dump()
+        enum Stage {
+            STAGE_DECODE,
+            STAGE_FENCE_WAIT,
+            STAGE_CROP_AND_SCALE,
+            STAGE_FORMAT_CONVERT,
+            STAGE_JPEG,
+            STAGE_SHUTTER_TO_JPEG,
+            STAGE_REQUEST,
+            STAGE_COUNT
+        };
+
+        struct StageTiming {
+            std::atomic<uint64_t> count = 0;
+            std::atomic<int64_t> totalNs = 0;
+            std::atomic<int64_t> maxNs = 0;
+
+            void record(nsecs_t durationNs);
+        };
+
+        // The inputs of a JPEG encode, prepared by prepareJpegLocked
+        struct JpegJob {
+            int32_t frameNumber;
+            nsecs_t shutterTs;
+            // Only used for asynchronous encoding, the synchronous one encodes to the request
+            // buffer directly
+            HalStreamBuffer buffer;
+            common::V1_0::helper::CameraMetadata settings;
+            Size jpegSize;
+            YCbCrLayout main;
+            int jpegQuality;
+            ssize_t maxJpegCodeSize;
+            bool outputThumbnail;
+            Size thumbSize;
+            YCbCrLayout thumb;
+            int thumbQuality;
+            // Own the main and thumbnail images when they are copies of the intermediate buffers
+            std::shared_ptr<AllocatedFrame> mainFrame;
+            std::shared_ptr<AllocatedFrame> thumbFrame;
+        };
+
+        // Encodes JPEGs off the output thread so that preview frames don't wait for still
+        // captures. Each BLOB buffer is returned as soon as encoded, after the rest of its request.
+        class JpegEncodeThread : public SimpleThread {
+          public:
+            explicit JpegEncodeThread(OutputThread* outputThread);
+            ~JpegEncodeThread();
+
+            // Queues a job, blocking while kMaxPendingJobs jobs are pending. Starts the thread on
+            // the first job.
+            void submit(std::unique_ptr<JpegJob> job);
+            // Returns a frame for a job, reusing the frames of completed jobs
+            std::shared_ptr<AllocatedFrame> acquireFrame(const Size& size);
+            // Waits until all the submitted jobs are completed, returns false on timeout
+            bool waitForIdle(std::chrono::milliseconds timeout);
+            void dump(int fd);
+            bool threadLoop() override;
+
+          private:
+            // Caps the frame copies held by the encoder, and the preview frames a burst delays
+            static const size_t kMaxPendingJobs = 2;
+
+            OutputThread* const mOutputThread;
+            std::mutex mLock;
+            std::condition_variable mJobCond;   // signaled when a job is submitted
+            std::condition_variable mDoneCond;  // signaled when a job is completed
+            std::deque<std::unique_ptr<JpegJob>> mJobs;
+            bool mEncoding = false;
+            bool mStarted = false;
+            std::vector<std::shared_ptr<AllocatedFrame>> mFreeFrames;
+        };
+
+        // Traces a stage and adds its duration to the stage timing when going out of scope
+        class ScopedStage {
+          public:
+            ScopedStage(OutputThread* thread, Stage stage);
+            ~ScopedStage();
+
+          private:
+            StageTiming& mTiming;
+            const nsecs_t mStartNs;
+        };
 
         // Methods to request output buffer in parallel
         int requestBufferStart(const std::vector<HalStreamBuffer>&);
@@ -199,6 +292,34 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
         int createJpegLocked(HalStreamBuffer& halBuf,
                              const common::V1_0::helper::CameraMetadata& settings);
 
+        // Crops and scales the main and thumbnail images of a JPEG, into frames of
+        // mJpegEncodeThread when copyFrames is set so they outlive the intermediate buffers
+        int prepareJpegLocked(const HalStreamBuffer& halBuf,
+                              const common::V1_0::helper::CameraMetadata& settings,
+                              bool copyFrames, JpegJob* job);
+        int encodeJpeg(const JpegJob& job, HalStreamBuffer& halBuf);
+        // Called on the JPEG encode thread
+        void completeJpegJob(JpegJob& job);
+
+        // Returns the largest libjpeg scale denominator (1, 2, 4 or 8) which still leaves every
+        // output of the request at least as large as the cropped decoded frame
+        int getDecodeScaleDenomLocked(const std::shared_ptr<HalRequest>& req);
+
+        // Decodes the input frame into mYu12Frame, or into a smaller frame of
+        // mYu12ScaledDecodeFrames when scaleDenom is not 1, and points mDecodedFrame to it
+        int decodeMjpegLocked(uint8_t* inData, size_t inDataSize, int scaleDenom);
+
+        // Waits for the acquire fence of the buffer and fills it from the input frame. Buffers of
+        // different sizes can be processed concurrently, with mBufferLock held by the caller.
+        int processOutputBufferLocked(const std::shared_ptr<HalRequest>& req,
+                                      HalStreamBuffer& halBuf, uint8_t* inData,
+                                      size_t inDataSize);
+
+        // Processes all the output buffers of a request, in parallel on mWorkerPool when the
+        // request has outputs of different sizes. Returns false if any buffer failed.
+        bool processOutputBuffersLocked(const std::shared_ptr<HalRequest>& req, uint8_t* inData,
+                                        size_t inDataSize);
+
         void clearIntermediateBuffers();
 
         const std::weak_ptr<OutputThreadInterface> mParent;
@@ -214,13 +335,23 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
         uint32_t mProcessingFrameNumber = 0;
 
         // V4L2 frameIn
-        // (MJPG decode)-> mYu12Frame
+        // (MJPG decode)-> mYu12Frame, or a frame of mYu12ScaledDecodeFrames
         // (Scale)-> mScaledYu12Frames
         // (Format convert) -> output gralloc frames
+        // A request with a single output the size of a (scaled) decode skips the intermediate
+        // buffers and is decoded straight into the output buffer.
         mutable std::mutex mBufferLock;  // Protect access to intermediate buffers
         std::shared_ptr<AllocatedFrame> mYu12Frame;
+        // Frames decoded at 1/2, 1/4 or 1/8 of mYu12Frame size by libjpeg DCT scaling, keyed by
+        // the scale denominator. Only allocated when a configured stream fits in them.
+        std::map<int, std::shared_ptr<AllocatedFrame>> mYu12ScaledDecodeFrames;
+        // The frame holding the decoded input of the request being processed
+        std::shared_ptr<AllocatedFrame> mDecodedFrame;
+        // Non zero when the output buffer of the request is decoded into directly, at this scale
+        int mDirectDecodeDenom = 0;
         std::shared_ptr<AllocatedFrame> mYu12ThumbFrame;
         std::unordered_map<Size, std::shared_ptr<AllocatedFrame>, SizeHasher> mIntermediateBuffers;
+        std::mutex mScaledYu12FramesLock;  // Protect mScaledYu12Frames from the buffer workers
         std::unordered_map<Size, std::shared_ptr<AllocatedFrame>, SizeHasher> mScaledYu12Frames;
         YCbCrLayout mYu12FrameLayout;
         YCbCrLayout mYu12ThumbFrameLayout;
@@ -233,6 +364,15 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
         std::string mExifModel;
 
         const std::shared_ptr<BufferRequestThread> mBufferRequestThread;
+
+        // Created on the first request with outputs of more than one size
+        std::unique_ptr<WorkerPool> mWorkerPool;
+        StageTiming mStageTimings[STAGE_COUNT];
+        // The JPEG jobs of the request being processed, submitted once its result is returned
+        std::mutex mJpegJobsLock;
+        std::vector<std::unique_ptr<JpegJob>> mJpegJobs;
+        // Declared last as it uses the members above until joined on destruction
+        const std::unique_ptr<JpegEncodeThread> mJpegEncodeThread;
     };
 
   private:
@@ -249,6 +389,10 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
     status_t fillCaptureResult(common::V1_0::helper::CameraMetadata& md, nsecs_t timestamp);
     int configureV4l2StreamLocked(const SupportedV4L2Format& fmt, double fps = 0.0);
     int v4l2StreamOffLocked();
+    // Allocates the V4L2_MEMORY_DMABUF capture buffers into mV4l2DmaBuffers
+    int allocateV4l2DmaBuffersLocked(uint32_t count, uint32_t bufferSize);
+    // Fills the v4l2_buffer to queue buffer 'index' with VIDIOC_QBUF
+    void prepareV4l2Buffer(uint32_t index, v4l2_buffer* buffer) const;
 
     int setV4l2FpsLocked(double fps);
 
@@ -280,6 +424,8 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
 
     Status processOneCaptureRequest(const CaptureRequest& request);
     void notifyShutter(int32_t frameNumber, nsecs_t shutterTs);
+    // Notifies ERROR_BUFFER for a failed buffer
+    StreamBuffer toStreamBuffer(int32_t frameNumber, const HalStreamBuffer& halBuf);
 
     void invokeProcessCaptureResultCallback(std::vector<CaptureResult>& results, bool tryWriteFmq);
     Size getMaxJpegResolution() const;
@@ -320,8 +466,9 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
     const std::string mCameraId;
 
     // Not protected by mLock, this is almost a const.
-    // Setup in constructor, reset in close() after OutputThread is joined
-    unique_fd mV4l2Fd;
+    // Setup in constructor, reset in close() after OutputThread is joined. Shared with the
+    // dequeued V4L2Frames which map its buffers.
+    std::shared_ptr<FrameSource> mFrameSource;
 
     // device is closed either
     //    - closed by user
@@ -337,6 +484,11 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
     SupportedV4L2Format mV4l2StreamingFmt;
     double mV4l2StreamingFps = 0.0;
     size_t mV4L2BufferCount = 0;
+    // V4L2_MEMORY_DMABUF if mCfg.dmaBufCapture and the driver supports it, V4L2_MEMORY_MMAP
+    // otherwise. Like the buffers below, only changes while no V4L2 buffer is dequeued.
+    uint32_t mV4l2Memory = V4L2_MEMORY_MMAP;
+    // Indexed by V4L2 buffer index, empty when capturing into MMAP buffers
+    std::vector<std::shared_ptr<V4L2DmaBuffer>> mV4l2DmaBuffers;
 
     static const int kBufferWaitTimeoutSec = 3;  // TODO: handle long exposure (or not allowing)
     std::mutex mV4l2BufferLock;                  // protect the buffer count and condition below
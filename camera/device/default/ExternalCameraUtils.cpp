@@ -18,11 +18,16 @@
 // #define LOG_NDEBUG 0
 
 #include "ExternalCameraUtils.h"
+#include "FrameSource.h"
 
 #include <aidlcommonsupport/NativeHandle.h>
 #include <jpeglib.h>
+#include <linux/dma-buf.h>
 #include <linux/videodev2.h>
 #include <log/log.h>
+#include <setjmp.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <algorithm>
 #include <cinttypes>
 #include <cmath>
@@ -168,10 +173,17 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
         ret.orientation = orientation->IntAttribute("degree", /*Default*/ kDefaultOrientation);
     }
 
+    XMLElement* dmaBufCapture = deviceCfg->FirstChildElement("DmaBufCapture");
+    if (dmaBufCapture == nullptr) {
+        ALOGI("%s: DMA-BUF capture is not enabled", __FUNCTION__);
+    } else {
+        ret.dmaBufCapture = dmaBufCapture->BoolAttribute("enabled", false);
+    }
+
     ALOGI("%s: external camera cfg loaded: maxJpgBufSize %d,"
-          " num video buffers %d, num still buffers %d, orientation %d",
+          " num video buffers %d, num still buffers %d, orientation %d, dmabuf capture %d",
           __FUNCTION__, ret.maxJpegBufSize, ret.numVideoBuffers, ret.numStillBuffers,
-          ret.orientation);
+          ret.orientation, ret.dmaBufCapture);
     for (const auto& limit : ret.fpsLimits) {
         ALOGI("%s: fpsLimitList: %dx%d@%f", __FUNCTION__, limit.size.width, limit.size.height,
               limit.fpsUpperBound);
@@ -220,7 +232,8 @@ ExternalCameraConfig::ExternalCameraConfig()
       numVideoBuffers(kDefaultNumVideoBuffer),
       numStillBuffers(kDefaultNumStillBuffer),
       depthEnabled(false),
-      orientation(kDefaultOrientation) {
+      orientation(kDefaultOrientation),
+      dmaBufCapture(false) {
     fpsLimits.push_back({/* size */ {/* width */ 640, /* height */ 480}, /* fpsUpperBound */ 30.0});
     fpsLimits.push_back({/* size */ {/* width */ 1280, /* height */ 720}, /* fpsUpperBound */ 7.5});
     fpsLimits.push_back(
@@ -242,9 +255,56 @@ Frame::Frame(uint32_t width, uint32_t height, uint32_t fourcc)
     : mWidth(width), mHeight(height), mFourcc(fourcc) {}
 Frame::~Frame() {}
 
-V4L2Frame::V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx, int fd, uint32_t dataSize,
-                     uint64_t offset)
-    : Frame(w, h, fourcc), mBufferIndex(bufIdx), mFd(fd), mDataSize(dataSize), mOffset(offset) {}
+std::shared_ptr<V4L2DmaBuffer> V4L2DmaBuffer::create(::android::base::unique_fd fd, size_t size) {
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (addr == MAP_FAILED) {
+        ALOGE("%s: DMA-BUF %d map failed: %s", __FUNCTION__, fd.get(), strerror(errno));
+        return nullptr;
+    }
+    return std::shared_ptr<V4L2DmaBuffer>(
+            new V4L2DmaBuffer(std::move(fd), size, static_cast<uint8_t*>(addr)));
+}
+
+V4L2DmaBuffer::V4L2DmaBuffer(::android::base::unique_fd fd, size_t size, uint8_t* data)
+    : mFd(std::move(fd)), mSize(size), mData(data) {}
+
+V4L2DmaBuffer::~V4L2DmaBuffer() {
+    munmap(mData, mSize);
+}
+
+int V4L2DmaBuffer::beginCpuRead() {
+    dma_buf_sync sync = {.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ};
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), DMA_BUF_IOCTL_SYNC, &sync)) < 0) {
+        ALOGE("%s: DMA-BUF %d sync failed: %s", __FUNCTION__, mFd.get(), strerror(errno));
+        return -errno;
+    }
+    return 0;
+}
+
+int V4L2DmaBuffer::endCpuRead() {
+    dma_buf_sync sync = {.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ};
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), DMA_BUF_IOCTL_SYNC, &sync)) < 0) {
+        ALOGE("%s: DMA-BUF %d sync failed: %s", __FUNCTION__, mFd.get(), strerror(errno));
+        return -errno;
+    }
+    return 0;
+}
+
+V4L2Frame::V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx,
+                     std::shared_ptr<FrameSource> source, uint32_t dataSize, uint64_t offset)
+    : Frame(w, h, fourcc),
+      mBufferIndex(bufIdx),
+      mSource(std::move(source)),
+      mDataSize(dataSize),
+      mOffset(offset) {}
+
+V4L2Frame::V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx,
+                     std::shared_ptr<V4L2DmaBuffer> dmaBuffer, uint32_t dataSize)
+    : Frame(w, h, fourcc),
+      mBufferIndex(bufIdx),
+      mDmaBuffer(std::move(dmaBuffer)),
+      mDataSize(dataSize),
+      mOffset(0) {}
 
 V4L2Frame::~V4L2Frame() {
     unmap();
@@ -263,17 +323,25 @@ int V4L2Frame::map(uint8_t** data, size_t* dataSize) {
 
     std::lock_guard<std::mutex> lk(mLock);
     if (!mMapped) {
-        void* addr = mmap(nullptr, mDataSize, PROT_READ, MAP_SHARED, mFd, mOffset);
-        if (addr == MAP_FAILED) {
-            ALOGE("%s: V4L2 buffer map failed: %s", __FUNCTION__, strerror(errno));
-            return -EINVAL;
+        if (mDmaBuffer != nullptr) {
+            if (mDmaBuffer->beginCpuRead() != 0) {
+                return -EINVAL;
+            }
+            mData = mDmaBuffer->getData();
+        } else {
+            void* addr = mSource->mmap(mDataSize, mOffset);
+            if (addr == MAP_FAILED) {
+                ALOGE("%s: V4L2 buffer map failed: %s", __FUNCTION__, strerror(errno));
+                return -EINVAL;
+            }
+            mData = static_cast<uint8_t*>(addr);
         }
-        mData = static_cast<uint8_t*>(addr);
         mMapped = true;
     }
     *data = mData;
     *dataSize = mDataSize;
-    ALOGV("%s: V4L map FD %d, data %p size %zu", __FUNCTION__, mFd, mData, mDataSize);
+    ALOGV("%s: V4L map FD %d, data %p size %zu", __FUNCTION__,
+          mDmaBuffer != nullptr ? mDmaBuffer->getFd() : mSource->getFd(), mData, mDataSize);
     return 0;
 }
 
@@ -281,7 +349,10 @@ int V4L2Frame::unmap() {
     std::lock_guard<std::mutex> lk(mLock);
     if (mMapped) {
         ALOGV("%s: V4L unmap data %p size %zu", __FUNCTION__, mData, mDataSize);
-        if (munmap(mData, mDataSize) != 0) {
+        if (mDmaBuffer != nullptr) {
+            // Stays mapped for the next frames
+            mDmaBuffer->endCpuRead();
+        } else if (mSource->munmap(mData, mDataSize) != 0) {
             ALOGE("%s: V4L2 buffer unmap failed: %s", __FUNCTION__, strerror(errno));
             return -EINVAL;
         }
@@ -728,6 +799,152 @@ int encodeJpegYU12(const Size& inSz, const YCbCrLayout& inLayout, int jpegQualit
     return 0;
 }
 
+int decodeMjpegScaled(const uint8_t* in, size_t inSize, int scaleDenom, const Size& outSz,
+                      const YCbCrLayout& out) {
+    if (out.chromaStep != 1) {
+        ALOGE("%s: chroma step %d is not supported", __FUNCTION__, out.chromaStep);
+        return -1;
+    }
+
+    /* Unlike encodeJpegYU12 we can't let libjpeg carry on after an error: the
+     * frames of some webcams are corrupted, so error_exit jumps back here */
+    struct ErrorMgr {
+        jpeg_error_mgr mgr;
+        jmp_buf jmp;
+    } err;
+    jpeg_decompress_struct cinfo = {};
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.output_message = [](j_common_ptr cinfo) {
+        char buffer[JMSG_LENGTH_MAX];
+        (*cinfo->err->format_message)(cinfo, buffer);
+        ALOGE("libjpeg error: %s", buffer);
+    };
+    err.mgr.error_exit = [](j_common_ptr cinfo) {
+        (*cinfo->err->output_message)(cinfo);
+        longjmp(reinterpret_cast<ErrorMgr*>(cinfo->err)->jmp, 1);
+    };
+
+    /* Declared before setjmp so no destructor is skipped by longjmp */
+    std::vector<uint8_t> bands[3];
+    std::vector<JSAMPROW> bandRows[3];
+
+    jpeg_create_decompress(&cinfo);
+    if (setjmp(err.jmp)) {
+        jpeg_destroy_decompress(&cinfo);
+        return -1;
+    }
+    jpeg_mem_src(&cinfo, const_cast<uint8_t*>(in), inSize);
+    jpeg_read_header(&cinfo, TRUE);
+
+    /* Raw data mode hands out the planes at their native subsampling, the
+     * luma and 4:2:0 chroma rows can be copied as is */
+    const jpeg_component_info* comps = cinfo.comp_info;
+    if (cinfo.num_components != 3 || comps[0].h_samp_factor != 2 ||
+        (comps[0].v_samp_factor != 1 && comps[0].v_samp_factor != 2) ||
+        comps[1].h_samp_factor != 1 || comps[1].v_samp_factor != 1 ||
+        comps[2].h_samp_factor != 1 || comps[2].v_samp_factor != 1) {
+        ALOGV("%s: unsupported JPEG subsampling", __FUNCTION__);
+        jpeg_destroy_decompress(&cinfo);
+        return -1;
+    }
+
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scaleDenom;
+    cinfo.raw_data_out = TRUE;
+    cinfo.dct_method = JDCT_IFAST;
+    jpeg_start_decompress(&cinfo);
+    if (cinfo.output_width != static_cast<JDIMENSION>(outSz.width) ||
+        cinfo.output_height != static_cast<JDIMENSION>(outSz.height)) {
+        ALOGE("%s: 1/%d of the %dx%d frame is %dx%d, expected %dx%d", __FUNCTION__, scaleDenom,
+              cinfo.image_width, cinfo.image_height, cinfo.output_width, cinfo.output_height,
+              outSz.width, outSz.height);
+        jpeg_destroy_decompress(&cinfo);
+        return -1;
+    }
+
+#if JPEG_LIB_VERSION >= 70
+#define DCT_SCALED_SIZE(comp) ((comp).DCT_v_scaled_size)
+    const int minDctSize = cinfo.min_DCT_v_scaled_size;
+#else
+#define DCT_SCALED_SIZE(comp) ((comp).DCT_scaled_size)
+    const int minDctSize = cinfo.min_DCT_scaled_size;
+#endif
+    /* jpeg_read_raw_data returns one row of MCUs at a time. When scaling,
+     * libjpeg may upsample the chroma in the IDCT, so its block size can be
+     * twice the luma one */
+    const int bandHeight = cinfo.max_v_samp_factor * minDctSize;
+    JSAMPARRAY planes[3];
+    int bandRowCount[3];
+    int hStep[3];
+    int vStep[3];
+    for (int c = 0; c < 3; c++) {
+        const int dctSize = DCT_SCALED_SIZE(comps[c]);
+        const size_t width = comps[c].width_in_blocks * dctSize;
+        bandRowCount[c] = comps[c].v_samp_factor * dctSize;
+        bands[c].resize(width * bandRowCount[c]);
+        bandRows[c].resize(bandRowCount[c]);
+        for (int r = 0; r < bandRowCount[c]; r++) {
+            bandRows[c][r] = bands[c].data() + r * width;
+        }
+        planes[c] = bandRows[c].data();
+        /* Chroma samples per YUV420 chroma sample, 1 or 2 */
+        hStep[c] = 2 * comps[c].h_samp_factor * dctSize / (cinfo.max_h_samp_factor * minDctSize);
+        vStep[c] = 2 * bandRowCount[c] / bandHeight;
+    }
+#undef DCT_SCALED_SIZE
+
+    const int32_t cWidth = (outSz.width + 1) / 2;
+    const int32_t cHeight = (outSz.height + 1) / 2;
+    uint8_t* const outPlanes[3] = {static_cast<uint8_t*>(out.y), static_cast<uint8_t*>(out.cb),
+                                   static_cast<uint8_t*>(out.cr)};
+    for (int32_t band = 0; cinfo.output_scanline < cinfo.output_height; band++) {
+        const int32_t y0 = cinfo.output_scanline;
+        if (jpeg_read_raw_data(&cinfo, planes, bandHeight) != static_cast<JDIMENSION>(bandHeight)) {
+            ALOGE("%s: failed to decode rows %d-%d", __FUNCTION__, y0, y0 + bandHeight - 1);
+            jpeg_destroy_decompress(&cinfo);
+            return -1;
+        }
+
+        for (int32_t r = 0; r < bandHeight && y0 + r < outSz.height; r++) {
+            std::memcpy(outPlanes[0] + (y0 + r) * out.yStride, planes[0][r], outSz.width);
+        }
+        for (int c = 1; c < 3; c++) {
+            /* Rows are averaged in pairs when vStep is 2, a pair can span two
+             * bands when scaling 4:2:2 by 1/8 */
+            for (int32_t r = 0; r < bandRowCount[c]; r++) {
+                const int32_t row = band * bandRowCount[c] + r;
+                if (row / vStep[c] >= cHeight) {
+                    break;
+                }
+                uint8_t* dst = outPlanes[c] + (row / vStep[c]) * out.cStride;
+                const uint8_t* src = planes[c][r];
+                const bool average = row % vStep[c] != 0;
+                if (hStep[c] == 1 && !average) {
+                    std::memcpy(dst, src, cWidth);
+                } else if (hStep[c] == 1) {
+                    for (int32_t x = 0; x < cWidth; x++) {
+                        dst[x] = (dst[x] + src[x] + 1) >> 1;
+                    }
+                } else if (!average) {
+                    for (int32_t x = 0; x < cWidth; x++) {
+                        dst[x] = (src[2 * x] + src[2 * x + 1] + 1) >> 1;
+                    }
+                } else {
+                    for (int32_t x = 0; x < cWidth; x++) {
+                        dst[x] = (2 * dst[x] + src[2 * x] + src[2 * x + 1] + 2) >> 2;
+                    }
+                }
+            }
+        }
+    }
+
+    /* Everything we need is decoded, skip reading up to the EOI marker as
+     * some webcams send truncated frames */
+    jpeg_abort_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return 0;
+}
+
 Size getMaxThumbnailResolution(const common::V1_0::helper::CameraMetadata& chars) {
     Size thumbSize{0, 0};
     camera_metadata_ro_entry entry = chars.find(ANDROID_JPEG_AVAILABLE_THUMBNAIL_SIZES);
@@ -853,6 +1070,60 @@ int AllocatedV4L2Frame::getData(uint8_t** outData, size_t* dataSize) {
     return 0;
 }
 
+WorkerPool::WorkerPool(size_t threadCount) {
+    for (size_t i = 0; i < threadCount; i++) {
+        mThreads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mExit = true;
+    }
+    mTaskCond.notify_all();
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::run(const std::vector<std::function<void()>>& tasks) {
+    std::unique_lock<std::mutex> lk(mLock);
+    mTasks = &tasks;
+    mNextTask = 0;
+    if (tasks.size() > 1) {
+        mTaskCond.notify_all();
+    }
+    while (runNextTaskLocked(lk)) {
+    }
+    mDoneCond.wait(lk, [this] { return mRunningTasks == 0; });
+    mTasks = nullptr;
+}
+
+void WorkerPool::workerLoop() {
+    std::unique_lock<std::mutex> lk(mLock);
+    while (!mExit) {
+        if (!runNextTaskLocked(lk)) {
+            mTaskCond.wait(lk);
+        }
+    }
+}
+
+bool WorkerPool::runNextTaskLocked(std::unique_lock<std::mutex>& lk) {
+    if (mTasks == nullptr || mNextTask >= mTasks->size()) {
+        return false;
+    }
+    const auto& task = (*mTasks)[mNextTask++];
+    mRunningTasks++;
+    lk.unlock();
+    task();
+    lk.lock();
+    if (--mRunningTasks == 0 && mNextTask >= mTasks->size()) {
+        mDoneCond.notify_all();
+    }
+    return true;
+}
+
 }  // namespace implementation
 }  // namespace device
 }  // namespace camera
@@ -25,7 +25,12 @@
 #include <aidl/android/hardware/camera/device/NotifyMsg.h>
 #include <aidl/android/hardware/graphics/common/BufferUsage.h>
 #include <aidl/android/hardware/graphics/common/PixelFormat.h>
+#include <android-base/unique_fd.h>
 #include <tinyxml2.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -101,6 +106,12 @@ struct ExternalCameraConfig {
     // The value of android.sensor.orientation
     int32_t orientation;
 
+    // Capture into DMA-BUF heap buffers (V4L2_MEMORY_DMABUF) instead of driver allocated
+    // (V4L2_MEMORY_MMAP) ones. Falls back to MMAP if the driver or the heap does not support it.
+    // Frames are still read by the CPU the same way, this only maps each buffer once instead of
+    // for every frame, with a DMA_BUF_IOCTL_SYNC around each read.
+    bool dmaBufCapture;
+
   private:
     ExternalCameraConfig();
     static bool updateFpsList(tinyxml2::XMLElement* fpsList, std::vector<FpsLimitation>& fpsLimits);
@@ -128,6 +139,8 @@ struct SupportedV4L2Format {
     std::vector<FrameRate> frameRates;
 };
 
+class FrameSource;
+
 // A Base class with basic information about a frame
 struct Frame : public std::enable_shared_from_this<Frame> {
   public:
@@ -141,12 +154,39 @@ struct Frame : public std::enable_shared_from_this<Frame> {
     virtual int getData(uint8_t** outData, size_t* dataSize) = 0;
 };
 
+// A V4L2_MEMORY_DMABUF capture buffer, mapped once for its whole lifetime so the frames
+// captured into it are read in place.
+class V4L2DmaBuffer {
+  public:
+    // Returns nullptr if mapping 'fd' fails
+    static std::shared_ptr<V4L2DmaBuffer> create(::android::base::unique_fd fd, size_t size);
+    ~V4L2DmaBuffer();
+
+    int getFd() const { return mFd.get(); }
+    size_t getSize() const { return mSize; }
+    uint8_t* getData() const { return mData; }
+
+    // Bracket the CPU reads of a captured frame (DMA_BUF_IOCTL_SYNC)
+    int beginCpuRead();
+    int endCpuRead();
+
+  private:
+    V4L2DmaBuffer(::android::base::unique_fd fd, size_t size, uint8_t* data);
+
+    const ::android::base::unique_fd mFd;
+    const size_t mSize;
+    uint8_t* const mData;
+};
+
 // A class provide access to a dequeued V4L2 frame buffer (mostly in MJPG format)
 // Also contains necessary information to enqueue the buffer back to V4L2 buffer queue
 class V4L2Frame : public Frame {
   public:
-    V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx, int fd, uint32_t dataSize,
-              uint64_t offset);
+    V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx,
+              std::shared_ptr<FrameSource> source, uint32_t dataSize, uint64_t offset);
+    // A frame captured into a V4L2_MEMORY_DMABUF buffer
+    V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx,
+              std::shared_ptr<V4L2DmaBuffer> dmaBuffer, uint32_t dataSize);
     virtual ~V4L2Frame();
 
     virtual int getData(uint8_t** outData, size_t* dataSize) override;
@@ -157,7 +197,8 @@ class V4L2Frame : public Frame {
 
   private:
     std::mutex mLock;
-    const int mFd;  // used for mmap but doesn't claim ownership
+    const std::shared_ptr<FrameSource> mSource;  // used for mmap
+    const std::shared_ptr<V4L2DmaBuffer> mDmaBuffer;  // mapped already, null for MMAP frames
     const size_t mDataSize;
     const uint64_t mOffset;  // used for mmap
     uint8_t* mData = nullptr;
@@ -203,6 +244,9 @@ struct HalStreamBuffer {
     buffer_handle_t* bufPtr;
     int acquireFence;
     bool fenceTimeout;
+    // Returned with processCaptureBufferResult after the rest of the request, e.g. a JPEG still
+    // being encoded when the other outputs are ready
+    bool pending;
 };
 
 struct HalRequest {
@@ -245,6 +289,13 @@ int encodeJpegYU12(const Size& inSz, const YCbCrLayout& inLayout, int jpegQualit
                    const void* app1Buffer, size_t app1Size, void* out, size_t maxOutSize,
                    size_t& actualCodeSize);
 
+// Decodes a MJPEG frame to planar YUV420 scaled down by 1/scaleDenom (1, 2, 4 or 8) in the DCT
+// domain, skipping the pixels a downscale would drop. outSz must be the frame size divided by
+// scaleDenom and out must have a chroma step of 1. Returns non-zero for corrupted frames and for
+// chroma subsamplings other than the 4:2:0 and 4:2:2 of UVC cameras.
+int decodeMjpegScaled(const uint8_t* in, size_t inSize, int scaleDenom, const Size& outSz,
+                      const YCbCrLayout& out);
+
 Size getMaxThumbnailResolution(const common::V1_0::helper::CameraMetadata&);
 
 void freeReleaseFences(std::vector<CaptureResult>&);
@@ -274,9 +325,17 @@ struct OutputThreadInterface {
         return processCaptureRequestError(reqs, nullptr, nullptr);
     }
 
+    // Pending buffers of the request are skipped, the request stays inflight until they are
+    // returned with processCaptureBufferResult
     virtual aidl::android::hardware::camera::common::Status processCaptureResult(
             std::shared_ptr<HalRequest>&) = 0;
 
+    // Only needed by parents of an OutputThread which returns buffers as pending
+    virtual aidl::android::hardware::camera::common::Status processCaptureBufferResult(
+            int32_t /*frameNumber*/, HalStreamBuffer& /*buffer*/) {
+        return aidl::android::hardware::camera::common::Status::OPERATION_NOT_SUPPORTED;
+    }
+
     virtual ssize_t getJpegBufferSize(int32_t width, int32_t height) const = 0;
 };
 
@@ -291,6 +350,33 @@ class AllocatedV4L2Frame : public Frame {
     std::vector<uint8_t> mData;
 };
 
+// A fixed set of threads running the tasks of a batch in parallel. The calling thread takes part
+// in the work, so a pool of N threads runs up to N + 1 tasks at a time.
+class WorkerPool {
+  public:
+    explicit WorkerPool(size_t threadCount);
+    ~WorkerPool();
+
+    // Runs all the tasks and returns once they have all completed. Must not be called
+    // concurrently.
+    void run(const std::vector<std::function<void()>>& tasks);
+
+  private:
+    void workerLoop();
+    // Runs the next pending task of the batch, returns false if there is none. Called with
+    // mLock held, which is released while the task runs.
+    bool runNextTaskLocked(std::unique_lock<std::mutex>& lk);
+
+    std::mutex mLock;
+    std::condition_variable mTaskCond;
+    std::condition_variable mDoneCond;
+    const std::vector<std::function<void()>>* mTasks = nullptr;  // guarded by mLock
+    size_t mNextTask = 0;                                         // guarded by mLock
+    size_t mRunningTasks = 0;                                     // guarded by mLock
+    bool mExit = false;                                           // guarded by mLock
+    std::vector<std::thread> mThreads;
+};
+
 }  // namespace implementation
 }  // namespace device
 }  // namespace camera
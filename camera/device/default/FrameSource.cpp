@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameSource.h"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace implementation {
+
+using ::android::base::unique_fd;
+
+std::unique_ptr<FrameSource> V4l2FrameSource::open(const std::string& devicePath) {
+    unique_fd fd(::open(devicePath.c_str(), O_RDWR));
+    if (fd.get() < 0) {
+        return nullptr;
+    }
+    return std::make_unique<V4l2FrameSource>(std::move(fd));
+}
+
+V4l2FrameSource::V4l2FrameSource(unique_fd fd) : mFd(std::move(fd)) {}
+
+int V4l2FrameSource::ioctl(unsigned long request, void* arg) {
+    return ::ioctl(mFd.get(), request, arg);
+}
+
+void* V4l2FrameSource::mmap(size_t length, off_t offset) {
+    return ::mmap(nullptr, length, PROT_READ, MAP_SHARED, mFd.get(), offset);
+}
+
+int V4l2FrameSource::munmap(void* addr, size_t length) {
+    return ::munmap(addr, length);
+}
+
+}  // namespace implementation
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_FRAMESOURCE_H_
+#define HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_FRAMESOURCE_H_
+
+#include <android-base/unique_fd.h>
+#include <linux/videodev2.h>
+#include <sys/types.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace implementation {
+
+// The V4L2 capture node a camera device streams from. The device and its session only talk to it
+// through the V4L2 ioctls and the mmap of the capture buffers, so a node can be emulated.
+class FrameSource {
+  public:
+    virtual ~FrameSource() {}
+
+    // Same contract as ioctl(2) on the node: returns -1 and sets errno on failure
+    virtual int ioctl(unsigned long request, void* arg) = 0;
+    // Maps the buffer at the offset returned by VIDIOC_QUERYBUF, same contract as mmap(2)
+    virtual void* mmap(size_t length, off_t offset) = 0;
+    virtual int munmap(void* addr, size_t length) = 0;
+    // Only used for logging, -1 if not backed by a file descriptor
+    virtual int getFd() const { return -1; }
+};
+
+// Opens the frame source of a V4L2 device path, returns nullptr and sets errno on failure
+using FrameSourceFactory = std::function<std::unique_ptr<FrameSource>(const std::string&)>;
+
+// A /dev/video* node
+class V4l2FrameSource : public FrameSource {
+  public:
+    static std::unique_ptr<FrameSource> open(const std::string& devicePath);
+
+    explicit V4l2FrameSource(::android::base::unique_fd fd);
+
+    int ioctl(unsigned long request, void* arg) override;
+    void* mmap(size_t length, off_t offset) override;
+    int munmap(void* addr, size_t length) override;
+    int getFd() const override { return mFd.get(); }
+
+  private:
+    const ::android::base::unique_fd mFd;
+};
+
+}  // namespace implementation
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
+
+#endif  // HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_FRAMESOURCE_H_
@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#define LOG_TAG "ExtCamBenchmark"
+#include <ExternalCameraDevice.h>
+#include <FrameSource.h>
+#include <SyntheticFrameSource.h>
+#include <aidl/android/hardware/camera/device/BnCameraDeviceCallback.h>
+#include <aidlcommonsupport/NativeHandle.h>
+#include <android/hardware_buffer.h>
+#include <benchmark/benchmark.h>
+#include <log/log.h>
+#include <system/camera_metadata.h>
+
+using ::aidl::android::hardware::camera::device::BnCameraDeviceCallback;
+using ::aidl::android::hardware::camera::device::BufferCache;
+using ::aidl::android::hardware::camera::device::BufferRequest;
+using ::aidl::android::hardware::camera::device::BufferRequestStatus;
+using ::aidl::android::hardware::camera::device::BufferStatus;
+using ::aidl::android::hardware::camera::device::CameraMetadata;
+using ::aidl::android::hardware::camera::device::CaptureRequest;
+using ::aidl::android::hardware::camera::device::CaptureResult;
+using ::aidl::android::hardware::camera::device::HalStream;
+using ::aidl::android::hardware::camera::device::ICameraDeviceSession;
+using ::aidl::android::hardware::camera::device::NotifyMsg;
+using ::aidl::android::hardware::camera::device::RequestTemplate;
+using ::aidl::android::hardware::camera::device::Stream;
+using ::aidl::android::hardware::camera::device::StreamBuffer;
+using ::aidl::android::hardware::camera::device::StreamBufferRet;
+using ::aidl::android::hardware::camera::device::StreamConfiguration;
+using ::aidl::android::hardware::camera::device::StreamConfigurationMode;
+using ::aidl::android::hardware::camera::device::StreamRotation;
+using ::aidl::android::hardware::camera::device::StreamType;
+using ::aidl::android::hardware::graphics::common::BufferUsage;
+using ::aidl::android::hardware::graphics::common::Dataspace;
+using ::aidl::android::hardware::graphics::common::PixelFormat;
+using ::android::hardware::camera::device::implementation::ExternalCameraDevice;
+using ::android::hardware::camera::device::implementation::FrameSource;
+using ::android::hardware::camera::device::implementation::SyntheticFrameSource;
+using ::android::hardware::camera::external::common::ExternalCameraConfig;
+
+/**
+ * Runs the external camera HAL end to end on a SyntheticFrameSource instead of a webcam: opens a
+ * session, configures a set of streams and keeps kRequestsInFlight capture requests in flight.
+ * Needs gralloc, so runs on a device:
+ *
+ *   atest ExternalCameraBenchmark
+ *
+ * range(0) selects the streams: 0 is a 720p preview, 1 adds a 1080p video stream and 2 a 1080p
+ * JPEG stream to it. range(1) is the frame rate of the source, 30 paces the requests like a
+ * webcam and 120 measures how fast the pipeline can go. range(2) is 1 to capture into DMA-BUF
+ * heap buffers instead of MMAP ones.
+ *
+ * items_per_second is the sustained frame rate, the "p50_ms" and "p99_ms" counters are the time
+ * from sending a request to receiving its last buffer, and the "<stage>_us" counters are the
+ * average stage durations reported by the session dump. "dropped" counts the source frames lost
+ * while no V4L2 buffer was queued.
+ */
+
+namespace {
+
+constexpr char kDevicePath[] = "/dev/video99";
+constexpr size_t kRequestsInFlight = 4;
+constexpr size_t kRequestsPerIteration = 30;
+constexpr auto kResultTimeout = std::chrono::seconds(5);
+
+struct StreamSpec {
+    int32_t width;
+    int32_t height;
+    PixelFormat format;
+};
+
+const std::vector<std::vector<StreamSpec>> kStreamSets = {
+        {{1280, 720, PixelFormat::YCBCR_420_888}},
+        {{1280, 720, PixelFormat::YCBCR_420_888}, {1920, 1080, PixelFormat::YCBCR_420_888}},
+        {{1280, 720, PixelFormat::YCBCR_420_888}, {1920, 1080, PixelFormat::BLOB}},
+};
+
+// The device keeps a reference to its config
+const ExternalCameraConfig& getConfig(bool dmaBufCapture) {
+    static const std::vector<ExternalCameraConfig> configs = [] {
+        ExternalCameraConfig c = ExternalCameraConfig::loadFromCfg();
+        // Allow every size at the rates of the source
+        c.fpsLimits = {{{3840, 2160}, 240.0}};
+        c.minStreamSize = {0, 0};
+        c.dmaBufCapture = false;
+        std::vector<ExternalCameraConfig> ret(2, c);
+        ret[1].dmaBufCapture = true;
+        return ret;
+    }();
+    return configs[dmaBufCapture];
+}
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+// Collects the results, and the buffers the HAL returns for the next requests.
+class ResultCollector : public BnCameraDeviceCallback {
+  public:
+    ndk::ScopedAStatus notify(const std::vector<NotifyMsg>& msgs) override {
+        std::lock_guard<std::mutex> lk(mLock);
+        for (const auto& msg : msgs) {
+            if (msg.getTag() == NotifyMsg::Tag::error) {
+                mErrors++;
+            }
+        }
+        return ndk::ScopedAStatus::ok();
+    }
+
+    ndk::ScopedAStatus processCaptureResult(const std::vector<CaptureResult>& results) override {
+        const int64_t now = nowNs();
+        std::lock_guard<std::mutex> lk(mLock);
+        for (const auto& result : results) {
+            for (const auto& buffer : result.outputBuffers) {
+                if (buffer.status != BufferStatus::OK) {
+                    mErrors++;
+                }
+                mFreeBuffers[buffer.streamId].push_back(buffer.bufferId);
+            }
+            auto it = mPending.find(result.frameNumber);
+            if (it == mPending.end() || result.outputBuffers.empty()) {
+                continue;
+            }
+            it->second.remaining -= result.outputBuffers.size();
+            if (it->second.remaining == 0) {
+                mLatenciesNs.push_back(now - it->second.submitNs);
+                mPending.erase(it);
+            }
+        }
+        mCond.notify_all();
+        return ndk::ScopedAStatus::ok();
+    }
+
+    ndk::ScopedAStatus requestStreamBuffers(const std::vector<BufferRequest>&,
+                                            std::vector<StreamBufferRet>*,
+                                            BufferRequestStatus* status) override {
+        // Buffers are always sent with the requests
+        *status = BufferRequestStatus::FAILED_UNKNOWN;
+        return ndk::ScopedAStatus::ok();
+    }
+
+    ndk::ScopedAStatus returnStreamBuffers(const std::vector<StreamBuffer>&) override {
+        return ndk::ScopedAStatus::ok();
+    }
+
+    void addBuffer(int32_t streamId, int64_t bufferId) {
+        std::lock_guard<std::mutex> lk(mLock);
+        mFreeBuffers[streamId].push_back(bufferId);
+    }
+
+    // Waits for a free buffer of each stream and fewer than kRequestsInFlight pending requests,
+    // then takes the buffers for frameNumber. Returns false on timeout.
+    bool startRequest(int32_t frameNumber, const std::vector<int32_t>& streamIds,
+                      std::vector<int64_t>* bufferIds) {
+        std::unique_lock<std::mutex> lk(mLock);
+        bool ready = mCond.wait_for(lk, kResultTimeout, [&] {
+            return mPending.size() < kRequestsInFlight &&
+                   std::all_of(streamIds.begin(), streamIds.end(),
+                               [&](int32_t id) { return !mFreeBuffers[id].empty(); });
+        });
+        if (!ready) {
+            return false;
+        }
+        bufferIds->clear();
+        for (int32_t id : streamIds) {
+            bufferIds->push_back(mFreeBuffers[id].front());
+            mFreeBuffers[id].erase(mFreeBuffers[id].begin());
+        }
+        mPending[frameNumber] = {nowNs(), streamIds.size()};
+        return true;
+    }
+
+    bool waitForIdle() {
+        std::unique_lock<std::mutex> lk(mLock);
+        return mCond.wait_for(lk, kResultTimeout, [&] { return mPending.empty(); });
+    }
+
+    std::vector<int64_t> takeLatencies() {
+        std::lock_guard<std::mutex> lk(mLock);
+        return std::move(mLatenciesNs);
+    }
+
+    size_t getErrorCount() {
+        std::lock_guard<std::mutex> lk(mLock);
+        return mErrors;
+    }
+
+  private:
+    struct Pending {
+        int64_t submitNs;
+        size_t remaining;
+    };
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::map<int32_t, Pending> mPending;
+    std::map<int32_t, std::vector<int64_t>> mFreeBuffers;
+    std::vector<int64_t> mLatenciesNs;
+    size_t mErrors = 0;
+};
+
+int32_t getJpegMaxSize(const CameraMetadata& chars) {
+    auto metadata = reinterpret_cast<const camera_metadata_t*>(chars.metadata.data());
+    camera_metadata_ro_entry entry;
+    if (find_camera_metadata_ro_entry(metadata, ANDROID_JPEG_MAX_SIZE, &entry) != 0 ||
+        entry.count != 1) {
+        return 0;
+    }
+    return entry.data.i32[0];
+}
+
+// Adds the average stage durations printed by the session dump as counters.
+void addStageCounters(const std::shared_ptr<ICameraDeviceSession>& session,
+                      benchmark::State& state) {
+    FILE* file = tmpfile();
+    if (file == nullptr) {
+        return;
+    }
+    session->dump(fileno(file), nullptr, 0);
+    rewind(file);
+    char line[256];
+    bool inStages = false;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        if (strstr(line, "stage timing") != nullptr) {
+            inStages = true;
+            continue;
+        }
+        char name[64];
+        unsigned long long count;
+        long long avgUs, maxUs;
+        if (!inStages || sscanf(line, " %63[^:]: %llu, %lld, %lld", name, &count, &avgUs,
+                                &maxUs) != 4) {
+            inStages = false;
+            continue;
+        }
+        if (count > 0) {
+            state.counters[std::string(name) + "_us"] = avgUs;
+        }
+    }
+    fclose(file);
+}
+
+}  // namespace
+
+static void BM_Capture(benchmark::State& state) {
+    const std::vector<StreamSpec>& streamSet = kStreamSets[state.range(0)];
+    SyntheticFrameSource::Config sourceConfig;
+    sourceConfig.sizes = {{1920, 1080}, {1280, 720}, {640, 480}};
+    sourceConfig.fps = state.range(1);
+    // The device opens the source once for its characteristics, then once per session
+    SyntheticFrameSource* source = nullptr;
+    auto factory = [&](const std::string&) -> std::unique_ptr<FrameSource> {
+        auto s = std::make_unique<SyntheticFrameSource>(sourceConfig);
+        source = s.get();
+        return s;
+    };
+    auto device = ndk::SharedRefBase::make<ExternalCameraDevice>(
+            kDevicePath, getConfig(state.range(2)), factory);
+
+    CameraMetadata chars;
+    auto collector = ndk::SharedRefBase::make<ResultCollector>();
+    std::shared_ptr<ICameraDeviceSession> session;
+    if (!device->getCameraCharacteristics(&chars).isOk() ||
+        !device->open(collector, &session).isOk()) {
+        state.SkipWithError("failed to open the camera");
+        return;
+    }
+
+    StreamConfiguration config;
+    config.operationMode = StreamConfigurationMode::NORMAL_MODE;
+    for (size_t i = 0; i < streamSet.size(); i++) {
+        const StreamSpec& spec = streamSet[i];
+        const bool isBlob = spec.format == PixelFormat::BLOB;
+        Stream stream;
+        stream.id = i;
+        stream.streamType = StreamType::OUTPUT;
+        stream.width = spec.width;
+        stream.height = spec.height;
+        stream.format = spec.format;
+        stream.usage = isBlob ? BufferUsage::CPU_READ_OFTEN : BufferUsage::GPU_TEXTURE;
+        stream.dataSpace = isBlob ? Dataspace::JFIF : Dataspace::UNKNOWN;
+        stream.rotation = StreamRotation::ROTATION_0;
+        stream.bufferSize = isBlob ? getJpegMaxSize(chars) : 0;
+        stream.groupId = -1;
+        config.streams.push_back(stream);
+    }
+    std::vector<HalStream> halStreams;
+    CameraMetadata settings;
+    if (!session->configureStreams(config, &halStreams).isOk() ||
+        halStreams.size() != streamSet.size() ||
+        !session->constructDefaultRequestSettings(RequestTemplate::PREVIEW, &settings).isOk()) {
+        session->close();
+        state.SkipWithError("failed to configure the streams");
+        return;
+    }
+
+    // kRequestsInFlight buffers per stream, identified by their index + 1
+    std::vector<int32_t> streamIds;
+    std::vector<std::vector<AHardwareBuffer*>> buffers(streamSet.size());
+    bool allocated = true;
+    for (size_t i = 0; i < streamSet.size(); i++) {
+        const Stream& stream = config.streams[i];
+        const bool isBlob = stream.format == PixelFormat::BLOB;
+        AHardwareBuffer_Desc desc = {
+                .width = static_cast<uint32_t>(isBlob ? stream.bufferSize : stream.width),
+                .height = static_cast<uint32_t>(isBlob ? 1 : stream.height),
+                .layers = 1,
+                .format = isBlob ? AHARDWAREBUFFER_FORMAT_BLOB
+                                 : AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420,
+                .usage = static_cast<uint64_t>(halStreams[i].producerUsage) |
+                         static_cast<uint64_t>(stream.usage),
+        };
+        streamIds.push_back(stream.id);
+        for (size_t j = 0; j < kRequestsInFlight && allocated; j++) {
+            AHardwareBuffer* buffer = nullptr;
+            allocated = AHardwareBuffer_allocate(&desc, &buffer) == 0;
+            if (allocated) {
+                buffers[i].push_back(buffer);
+                collector->addBuffer(stream.id, j + 1);
+            }
+        }
+    }
+
+    int32_t frameNumber = 0;
+    std::vector<std::vector<bool>> sent(streamSet.size(), std::vector<bool>(kRequestsInFlight));
+    std::vector<int64_t> bufferIds;
+    bool failed = !allocated;
+    for (auto _ : state) {
+        for (size_t i = 0; i < kRequestsPerIteration && !failed; i++, frameNumber++) {
+            if (!collector->startRequest(frameNumber, streamIds, &bufferIds)) {
+                failed = true;
+                break;
+            }
+            CaptureRequest request;
+            request.frameNumber = frameNumber;
+            if (frameNumber == 0) {
+                request.settings = settings;
+            }
+            request.inputBuffer.streamId = -1;
+            for (size_t s = 0; s < streamIds.size(); s++) {
+                StreamBuffer buffer;
+                buffer.streamId = streamIds[s];
+                buffer.bufferId = bufferIds[s];
+                buffer.status = BufferStatus::OK;
+                // Like the framework, only send a buffer the first time the HAL sees it
+                if (!sent[s][bufferIds[s] - 1]) {
+                    buffer.buffer = ::android::dupToAidl(
+                            AHardwareBuffer_getNativeHandle(buffers[s][bufferIds[s] - 1]));
+                    sent[s][bufferIds[s] - 1] = true;
+                }
+                request.outputBuffers.push_back(std::move(buffer));
+            }
+            int32_t numProcessed = 0;
+            std::vector<CaptureRequest> requests;
+            requests.push_back(std::move(request));
+            if (!session->processCaptureRequest(requests, std::vector<BufferCache>(),
+                                                &numProcessed)
+                         .isOk() ||
+                numProcessed != 1) {
+                failed = true;
+            }
+        }
+        if (failed || !collector->waitForIdle()) {
+            failed = true;
+            break;
+        }
+    }
+    if (failed) {
+        state.SkipWithError("capture request failed or timed out");
+    }
+
+    std::vector<int64_t> latencies = collector->takeLatencies();
+    if (!failed && !latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        auto percentileMs = [&latencies](size_t p) {
+            return latencies[(latencies.size() - 1) * p / 100] / 1e6;
+        };
+        state.counters["p50_ms"] = percentileMs(50);
+        state.counters["p99_ms"] = percentileMs(99);
+        state.counters["errors"] = collector->getErrorCount();
+        state.counters["dropped"] = source != nullptr ? source->getDroppedFrameCount() : 0;
+        state.SetItemsProcessed(latencies.size());
+        addStageCounters(session, state);
+    }
+
+    session->close();
+    for (auto& streamBuffers : buffers) {
+        for (AHardwareBuffer* buffer : streamBuffers) {
+            AHardwareBuffer_release(buffer);
+        }
+    }
+}
+
+BENCHMARK(BM_Capture)
+        ->ArgsProduct({{0, 1, 2}, {30, 120}, {0, 1}})
+        ->Iterations(4)
+        ->UseRealTime();
+
+BENCHMARK_MAIN();
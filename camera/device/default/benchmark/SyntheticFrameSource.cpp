@@ -0,0 +1,498 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ExtCamSynthSrc"
+// #define LOG_NDEBUG 0
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+#include <log/log.h>
+#include <utils/Trace.h>
+
+#include "SyntheticFrameSource.h"
+
+#include <android-base/file.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace implementation {
+
+using ::android::hardware::camera::external::common::Size;
+
+namespace {
+// Same bound as ExternalCameraDeviceSession::kMaxBytesPerPixel, the largest image size a UVC
+// webcam would report for MJPEG
+constexpr uint32_t kMaxBytesPerPixel = 2;
+constexpr uint32_t kMaxBuffers = 32;
+constexpr size_t kBufferAlignment = 4096;
+constexpr uint32_t kFrameRatePrecision = 10000;
+
+// Returns the length of the JPEG image at the start of data and its size, or 0 if data doesn't
+// start with a complete baseline or progressive JPEG image
+size_t parseJpeg(const uint8_t* data, size_t size, Size* imageSize) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return 0;
+    }
+    *imageSize = {0, 0};
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) {
+            return 0;
+        }
+        const uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            // Fill byte
+            pos++;
+            continue;
+        }
+        if (marker == 0xD9) {
+            return imageSize->width > 0 ? pos + 2 : 0;
+        }
+        const size_t segmentSize = (data[pos + 2] << 8) | data[pos + 3];
+        if (segmentSize < 2 || pos + 2 + segmentSize > size) {
+            return 0;
+        }
+        // SOFn, except DHT, JPG and DAC which share the range
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 &&
+            marker != 0xCC && segmentSize >= 7) {
+            imageSize->height = (data[pos + 5] << 8) | data[pos + 6];
+            imageSize->width = (data[pos + 7] << 8) | data[pos + 8];
+        }
+        pos += 2 + segmentSize;
+        if (marker == 0xDA) {
+            // Skip the entropy coded data up to the next marker, 0xFF is followed by 0x00 in the
+            // data and restart markers are part of it
+            while (pos + 1 < size &&
+                   (data[pos] != 0xFF || data[pos + 1] == 0x00 ||
+                    (data[pos + 1] >= 0xD0 && data[pos + 1] <= 0xD7))) {
+                pos++;
+            }
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
+SyntheticFrameSource::SyntheticFrameSource(const Config& config)
+    : mConfig(config), mSize(config.sizes.empty() ? Size{0, 0} : config.sizes[0]),
+      mFps(config.fps) {
+    if (mConfig.framesPath.empty()) {
+        return;
+    }
+    std::string content;
+    if (!::android::base::ReadFileToString(mConfig.framesPath, &content)) {
+        ALOGE("%s: cannot read %s: %s", __FUNCTION__, mConfig.framesPath.c_str(), strerror(errno));
+        return;
+    }
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(content.data());
+    size_t pos = 0;
+    while (pos < content.size()) {
+        Size size;
+        const size_t length = parseJpeg(data + pos, content.size() - pos, &size);
+        if (length == 0) {
+            ALOGE("%s: invalid JPEG image at offset %zu of %s", __FUNCTION__, pos,
+                  mConfig.framesPath.c_str());
+            break;
+        }
+        if (length > kMaxBytesPerPixel * size.width * size.height) {
+            ALOGW("%s: skipping %zu bytes %dx%d image", __FUNCTION__, length, size.width,
+                  size.height);
+        } else {
+            mFileFrames[{size.width, size.height}].emplace_back(data + pos, data + pos + length);
+        }
+        pos += length;
+    }
+    ALOGV("%s: read %zu frame sizes from %s", __FUNCTION__, mFileFrames.size(),
+          mConfig.framesPath.c_str());
+}
+
+SyntheticFrameSource::~SyntheticFrameSource() {}
+
+uint64_t SyntheticFrameSource::getDroppedFrameCount() {
+    std::lock_guard<std::mutex> lk(mLock);
+    return mDroppedFrames;
+}
+
+bool SyntheticFrameSource::isSupportedSize(uint32_t width, uint32_t height) const {
+    return std::any_of(mConfig.sizes.begin(), mConfig.sizes.end(), [&](const Size& size) {
+        return size.width == static_cast<int32_t>(width) &&
+               size.height == static_cast<int32_t>(height);
+    });
+}
+
+SyntheticFrameSource::FrameList SyntheticFrameSource::generateFrames(const Size& size) const {
+    FrameList frames;
+    AllocatedFrame frame(size.width, size.height);
+    YCbCrLayout layout;
+    if (frame.allocate(&layout) != 0) {
+        ALOGE("%s: allocating %dx%d frame failed", __FUNCTION__, size.width, size.height);
+        return frames;
+    }
+    uint8_t* y = static_cast<uint8_t*>(layout.y);
+    uint8_t* cb = static_cast<uint8_t*>(layout.cb);
+    uint8_t* cr = static_cast<uint8_t*>(layout.cr);
+    const size_t maxCodeSize = kMaxBytesPerPixel * size.width * size.height;
+    uint32_t noise = 1;
+    for (uint32_t i = 0; i < mConfig.numGeneratedFrames; i++) {
+        // Gradients with a bar moving across the frames, and some noise so the images don't
+        // compress much better than camera images
+        const int32_t barX = size.width * i / mConfig.numGeneratedFrames;
+        for (int32_t row = 0; row < size.height; row++) {
+            uint8_t* line = y + row * layout.yStride;
+            for (int32_t col = 0; col < size.width; col++) {
+                noise = noise * 1103515245 + 12345;
+                const bool onBar = col >= barX && col < barX + size.width / 16;
+                line[col] = onBar ? 235 : ((col + row) * 192 / (size.width + size.height) + 16 +
+                                           ((noise >> 16) & 0xF));
+            }
+        }
+        for (int32_t row = 0; row < size.height / 2; row++) {
+            for (int32_t col = 0; col < size.width / 2; col++) {
+                cb[row * layout.cStride + col] = 64 + col * 128 / (size.width / 2);
+                cr[row * layout.cStride + col] = 64 + (row + i * 4) * 128 / (size.height / 2) % 128;
+            }
+        }
+
+        std::vector<uint8_t> code(maxCodeSize);
+        size_t codeSize = 0;
+        if (encodeJpegYU12(size, layout, mConfig.jpegQuality, nullptr, 0, code.data(), code.size(),
+                           codeSize) != 0 ||
+            codeSize == 0) {
+            ALOGE("%s: encoding %dx%d frame failed", __FUNCTION__, size.width, size.height);
+            return {};
+        }
+        code.resize(codeSize);
+        frames.push_back(std::move(code));
+    }
+    return frames;
+}
+
+const SyntheticFrameSource::FrameList* SyntheticFrameSource::getFramesLocked() {
+    auto it = mFileFrames.find({mSize.width, mSize.height});
+    if (it != mFileFrames.end()) {
+        return &it->second;
+    }
+    auto& frames = mGeneratedFrames[{mSize.width, mSize.height}];
+    if (frames.empty()) {
+        ATRACE_NAME("generateFrames");
+        frames = generateFrames(mSize);
+    }
+    return frames.empty() ? nullptr : &frames;
+}
+
+int SyntheticFrameSource::dequeueBuffer(v4l2_buffer* buffer) {
+    std::unique_lock<std::mutex> lk(mLock);
+    mQueueCond.wait(lk, [this] { return !mStreaming || !mQueuedBuffers.empty(); });
+    if (!mStreaming || buffer->memory != mMemory) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const nsecs_t period = static_cast<nsecs_t>(1e9 / mFps);
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (now > mNextFrameNs + period) {
+        // The frames due while no buffer was queued are lost, like on a real camera
+        const nsecs_t missed = (now - mNextFrameNs) / period;
+        mDroppedFrames += missed;
+        mSequence += missed;
+        mNextFrameNs += missed * period;
+    }
+    const nsecs_t frameNs = mNextFrameNs;
+    mNextFrameNs += period;
+
+    const uint32_t index = mQueuedBuffers.front();
+    mQueuedBuffers.pop_front();
+    Buffer& buf = mBuffers[index];
+    buf.queued = false;
+    const FrameList* frames = getFramesLocked();
+    const uint32_t sequence = mSequence++;
+    uint32_t flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+    if (frames == nullptr) {
+        buf.bytesUsed = 0;
+        flags |= V4L2_BUF_FLAG_ERROR;
+    } else {
+        const auto& frame = (*frames)[sequence % frames->size()];
+        if (mMemory == V4L2_MEMORY_DMABUF) {
+            // Written through a mapping of the application buffer, like a DMA would
+            buf.bytesUsed = std::min(frame.size(), buf.dmaBufLength);
+            void* addr = ::mmap(nullptr, buf.dmaBufLength, PROT_WRITE, MAP_SHARED, buf.dmaBufFd, 0);
+            if (addr == MAP_FAILED) {
+                ALOGE("%s: mapping DMA-BUF %d failed: %s", __FUNCTION__, buf.dmaBufFd,
+                      strerror(errno));
+                buf.bytesUsed = 0;
+                flags |= V4L2_BUF_FLAG_ERROR;
+            } else {
+                memcpy(addr, frame.data(), buf.bytesUsed);
+                ::munmap(addr, buf.dmaBufLength);
+            }
+        } else {
+            buf.bytesUsed = std::min(frame.size(), buf.data.size());
+            memcpy(buf.data.data(), frame.data(), buf.bytesUsed);
+        }
+    }
+    const uint32_t bytesUsed = buf.bytesUsed;
+    const size_t offset = index * mBufferStride;
+    const int dmaBufFd = buf.dmaBufFd;
+    const uint32_t memory = mMemory;
+    lk.unlock();
+
+    // Hand the frame over at its capture time
+    if (frameNs > now) {
+        struct timespec ts = {.tv_sec = static_cast<time_t>(frameNs / 1000000000),
+                              .tv_nsec = static_cast<long>(frameNs % 1000000000)};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    }
+
+    buffer->index = index;
+    buffer->bytesused = bytesUsed;
+    buffer->flags = flags;
+    buffer->field = V4L2_FIELD_NONE;
+    buffer->timestamp.tv_sec = frameNs / 1000000000;
+    buffer->timestamp.tv_usec = (frameNs % 1000000000) / 1000;
+    buffer->sequence = sequence;
+    if (memory == V4L2_MEMORY_DMABUF) {
+        buffer->m.fd = dmaBufFd;
+    } else {
+        buffer->m.offset = offset;
+    }
+    return 0;
+}
+
+int SyntheticFrameSource::ioctl(unsigned long request, void* arg) {
+    if (request == VIDIOC_DQBUF) {
+        // Blocks until the next frame, so not under the lock
+        v4l2_buffer* buffer = static_cast<v4l2_buffer*>(arg);
+        if (buffer->type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+            errno = EINVAL;
+            return -1;
+        }
+        return dequeueBuffer(buffer);
+    }
+
+    std::lock_guard<std::mutex> lk(mLock);
+    switch (request) {
+        case VIDIOC_QUERYCAP: {
+            v4l2_capability* cap = static_cast<v4l2_capability*>(arg);
+            memset(cap, 0, sizeof(*cap));
+            strncpy(reinterpret_cast<char*>(cap->driver), "synthetic", sizeof(cap->driver) - 1);
+            strncpy(reinterpret_cast<char*>(cap->card), "Synthetic camera", sizeof(cap->card) - 1);
+            strncpy(reinterpret_cast<char*>(cap->bus_info), "synthetic",
+                    sizeof(cap->bus_info) - 1);
+            cap->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+            cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
+            return 0;
+        }
+        case VIDIOC_ENUM_FMT: {
+            v4l2_fmtdesc* desc = static_cast<v4l2_fmtdesc*>(arg);
+            if (desc->type != V4L2_BUF_TYPE_VIDEO_CAPTURE || desc->index != 0) {
+                break;
+            }
+            desc->flags = V4L2_FMT_FLAG_COMPRESSED;
+            desc->pixelformat = V4L2_PIX_FMT_MJPEG;
+            strncpy(reinterpret_cast<char*>(desc->description), "Motion-JPEG",
+                    sizeof(desc->description) - 1);
+            return 0;
+        }
+        case VIDIOC_ENUM_FRAMESIZES: {
+            v4l2_frmsizeenum* frameSize = static_cast<v4l2_frmsizeenum*>(arg);
+            if (frameSize->pixel_format != V4L2_PIX_FMT_MJPEG ||
+                frameSize->index >= mConfig.sizes.size()) {
+                break;
+            }
+            frameSize->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+            frameSize->discrete.width = mConfig.sizes[frameSize->index].width;
+            frameSize->discrete.height = mConfig.sizes[frameSize->index].height;
+            return 0;
+        }
+        case VIDIOC_ENUM_FRAMEINTERVALS: {
+            v4l2_frmivalenum* interval = static_cast<v4l2_frmivalenum*>(arg);
+            if (interval->pixel_format != V4L2_PIX_FMT_MJPEG || interval->index != 0 ||
+                !isSupportedSize(interval->width, interval->height)) {
+                break;
+            }
+            interval->type = V4L2_FRMIVAL_TYPE_DISCRETE;
+            interval->discrete.numerator = kFrameRatePrecision;
+            interval->discrete.denominator =
+                    static_cast<uint32_t>(mConfig.fps * kFrameRatePrecision);
+            return 0;
+        }
+        case VIDIOC_G_FMT:
+        case VIDIOC_S_FMT: {
+            v4l2_format* format = static_cast<v4l2_format*>(arg);
+            if (format->type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+                break;
+            }
+            if (request == VIDIOC_S_FMT) {
+                if (!mBuffers.empty()) {
+                    errno = EBUSY;
+                    return -1;
+                }
+                // Like drivers, adjust to a supported format instead of failing
+                if (isSupportedSize(format->fmt.pix.width, format->fmt.pix.height)) {
+                    mSize = Size{static_cast<int32_t>(format->fmt.pix.width),
+                                 static_cast<int32_t>(format->fmt.pix.height)};
+                }
+            }
+            format->fmt.pix.width = mSize.width;
+            format->fmt.pix.height = mSize.height;
+            format->fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+            format->fmt.pix.field = V4L2_FIELD_NONE;
+            format->fmt.pix.bytesperline = 0;
+            format->fmt.pix.sizeimage = kMaxBytesPerPixel * mSize.width * mSize.height;
+            format->fmt.pix.colorspace = V4L2_COLORSPACE_JPEG;
+            return 0;
+        }
+        case VIDIOC_G_PARM:
+        case VIDIOC_S_PARM: {
+            v4l2_streamparm* param = static_cast<v4l2_streamparm*>(arg);
+            if (param->type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+                break;
+            }
+            v4l2_fract& timePerFrame = param->parm.capture.timeperframe;
+            if (request == VIDIOC_S_PARM) {
+                // Any rate up to the configured one
+                mFps = mConfig.fps;
+                if (timePerFrame.numerator != 0 && timePerFrame.denominator != 0) {
+                    mFps = std::min(mFps, static_cast<double>(timePerFrame.denominator) /
+                                                  timePerFrame.numerator);
+                }
+            }
+            memset(&param->parm.capture, 0, sizeof(param->parm.capture));
+            param->parm.capture.capability = V4L2_CAP_TIMEPERFRAME;
+            timePerFrame.numerator = kFrameRatePrecision;
+            timePerFrame.denominator = static_cast<uint32_t>(mFps * kFrameRatePrecision);
+            return 0;
+        }
+        case VIDIOC_REQBUFS: {
+            v4l2_requestbuffers* req = static_cast<v4l2_requestbuffers*>(arg);
+            if (req->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+                (req->memory != V4L2_MEMORY_MMAP && req->memory != V4L2_MEMORY_DMABUF)) {
+                break;
+            }
+            if (mStreaming) {
+                errno = EBUSY;
+                return -1;
+            }
+            const size_t imageSize = kMaxBytesPerPixel * mSize.width * mSize.height;
+            mBufferStride =
+                    (imageSize + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment;
+            mMemory = req->memory;
+            mBuffers.clear();
+            mQueuedBuffers.clear();
+            req->count = std::min(req->count, kMaxBuffers);
+            mBuffers.resize(req->count);
+            if (mMemory == V4L2_MEMORY_MMAP) {
+                for (auto& buf : mBuffers) {
+                    buf.data.resize(imageSize);
+                }
+            }
+            return 0;
+        }
+        case VIDIOC_QUERYBUF:
+        case VIDIOC_QBUF: {
+            v4l2_buffer* buffer = static_cast<v4l2_buffer*>(arg);
+            if (buffer->type != V4L2_BUF_TYPE_VIDEO_CAPTURE || buffer->memory != mMemory ||
+                buffer->index >= mBuffers.size()) {
+                break;
+            }
+            Buffer& buf = mBuffers[buffer->index];
+            if (request == VIDIOC_QBUF) {
+                if (buf.queued) {
+                    break;
+                }
+                if (mMemory == V4L2_MEMORY_DMABUF) {
+                    // The application keeps the DMA-BUF open while it is queued
+                    if (buffer->m.fd < 0 ||
+                        buffer->length < kMaxBytesPerPixel * mSize.width * mSize.height) {
+                        break;
+                    }
+                    buf.dmaBufFd = buffer->m.fd;
+                    buf.dmaBufLength = buffer->length;
+                }
+                buf.queued = true;
+                mQueuedBuffers.push_back(buffer->index);
+                mQueueCond.notify_all();
+            }
+            if (mMemory == V4L2_MEMORY_DMABUF) {
+                buffer->length = buf.dmaBufLength;
+                buffer->m.fd = buf.dmaBufFd;
+            } else {
+                buffer->length = buf.data.size();
+                buffer->m.offset = buffer->index * mBufferStride;
+            }
+            buffer->flags = buf.queued ? V4L2_BUF_FLAG_QUEUED : 0;
+            return 0;
+        }
+        case VIDIOC_STREAMON:
+        case VIDIOC_STREAMOFF: {
+            if (*static_cast<v4l2_buf_type*>(arg) != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+                break;
+            }
+            if (request == VIDIOC_STREAMON) {
+                if (mBuffers.empty()) {
+                    break;
+                }
+                if (!mStreaming) {
+                    mStreaming = true;
+                    mNextFrameNs = systemTime(SYSTEM_TIME_MONOTONIC) +
+                                   static_cast<nsecs_t>(1e9 / mFps);
+                }
+            } else {
+                // Returns all the buffers to the application
+                mStreaming = false;
+                for (uint32_t index : mQueuedBuffers) {
+                    mBuffers[index].queued = false;
+                }
+                mQueuedBuffers.clear();
+                mQueueCond.notify_all();
+            }
+            return 0;
+        }
+        default:
+            ALOGV("%s: unsupported request 0x%lx", __FUNCTION__, request);
+            errno = ENOTTY;
+            return -1;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+void* SyntheticFrameSource::mmap(size_t length, off_t offset) {
+    std::lock_guard<std::mutex> lk(mLock);
+    if (mMemory != V4L2_MEMORY_MMAP || mBufferStride == 0 || offset % mBufferStride != 0 ||
+        static_cast<size_t>(offset / mBufferStride) >= mBuffers.size() ||
+        length > mBuffers[offset / mBufferStride].data.size()) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    return mBuffers[offset / mBufferStride].data.data();
+}
+
+int SyntheticFrameSource::munmap(void*, size_t) {
+    return 0;
+}
+
+}  // namespace implementation
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
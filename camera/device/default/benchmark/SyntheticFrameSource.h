@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_BENCHMARK_SYNTHETICFRAMESOURCE_H_
+#define HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_BENCHMARK_SYNTHETICFRAMESOURCE_H_
+
+#include <ExternalCameraUtils.h>
+#include <FrameSource.h>
+#include <utils/Timers.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace implementation {
+
+// Emulates a UVC webcam streaming MJPEG at a fixed frame rate, to run the HAL without a camera
+// attached. Frames are read from a file of concatenated JPEG images, or generated: a moving test
+// pattern over noise, encoded once per size when the format is set. Both V4L2_MEMORY_MMAP and
+// V4L2_MEMORY_DMABUF buffers are supported.
+class SyntheticFrameSource : public FrameSource {
+  public:
+    struct Config {
+        // The frame sizes advertised by VIDIOC_ENUM_FRAMESIZES
+        std::vector<external::common::Size> sizes;
+        double fps = 30.0;
+        // Concatenated JPEG images, used for the sizes they match. Other sizes are generated.
+        std::string framesPath;
+        // Number of distinct frames generated per size, streamed in a loop
+        uint32_t numGeneratedFrames = 30;
+        int jpegQuality = 90;
+    };
+
+    explicit SyntheticFrameSource(const Config& config);
+    ~SyntheticFrameSource() override;
+
+    int ioctl(unsigned long request, void* arg) override;
+    void* mmap(size_t length, off_t offset) override;
+    int munmap(void* addr, size_t length) override;
+
+    // Number of frames dropped because no buffer was queued when they were due
+    uint64_t getDroppedFrameCount();
+
+  private:
+    struct Buffer {
+        std::vector<uint8_t> data;
+        uint32_t bytesUsed = 0;
+        bool queued = false;
+        // V4L2_MEMORY_DMABUF: the buffer queued by the application, not owned
+        int dmaBufFd = -1;
+        size_t dmaBufLength = 0;
+    };
+    using FrameList = std::vector<std::vector<uint8_t>>;
+
+    bool isSupportedSize(uint32_t width, uint32_t height) const;
+    // Returns the frames of the current format, loading or generating them on first use
+    const FrameList* getFramesLocked();
+    FrameList generateFrames(const external::common::Size& size) const;
+    int dequeueBuffer(v4l2_buffer* buffer);
+
+    const Config mConfig;
+    // Frames read from Config::framesPath, by size
+    std::map<std::pair<int32_t, int32_t>, FrameList> mFileFrames;
+
+    std::mutex mLock;
+    std::condition_variable mQueueCond;  // signaled on QBUF and STREAMOFF
+    external::common::Size mSize;
+    double mFps;
+    std::map<std::pair<int32_t, int32_t>, FrameList> mGeneratedFrames;
+    uint32_t mMemory = V4L2_MEMORY_MMAP;  // of the buffers requested by VIDIOC_REQBUFS
+    std::vector<Buffer> mBuffers;
+    // Each buffer spans mBufferStride bytes of the fake mmap offset space
+    size_t mBufferStride = 0;
+    std::deque<uint32_t> mQueuedBuffers;
+    bool mStreaming = false;
+    nsecs_t mNextFrameNs = 0;
+    uint32_t mSequence = 0;
+    uint64_t mDroppedFrames = 0;
+};
+
+}  // namespace implementation
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
+
+#endif  // HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_BENCHMARK_SYNTHETICFRAMESOURCE_H_
@@ -107,6 +107,7 @@ Demux::~Demux() {
                 static_cast<int32_t>(Result::INVALID_ARGUMENT));
     }
 
+    updateFilterDispatchTable();
     *_aidl_return = filter;
     return ::ndk::ScopedAStatus::ok();
 }
@@ -184,6 +185,7 @@ Demux::~Demux() {
     mPlaybackFilterIds.clear();
     mRecordFilterIds.clear();
     mFilters.clear();
+    updateFilterDispatchTable();
     mLastUsedFilterId = -1;
     if (mTuner != nullptr) {
         mTuner->removeDemux(mDemuxId);
@@ -271,41 +273,106 @@ Demux::~Demux() {
     mPlaybackFilterIds.erase(filterId);
     mRecordFilterIds.erase(filterId);
     mFilters.erase(filterId);
+    updateFilterDispatchTable();
 
     return ::ndk::ScopedAStatus::ok();
 }
 
-void Demux::startBroadcastTsFilter(vector<int8_t> data) {
-    set<int64_t>::iterator it;
-    uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
-    if (DEBUG_DEMUX) {
-        ALOGW("[Demux] start ts filter pid: %d", pid);
+void Demux::startBroadcastTsFilter(const vector<int8_t>& data) {
+    startBroadcastTsFilter(data.data(), data.size(), data.size());
+}
+
+void Demux::startBroadcastTsFilter(const int8_t* data, size_t size, size_t packetSize) {
+    if (packetSize < 3) {
+        return;
     }
-    for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
-        if (pid == mFilters[*it]->getTpid()) {
-            mFilters[*it]->updateFilterOutput(data);
+
+    std::lock_guard<std::mutex> lock(mDispatchTableLock);
+    // Hand each run of packets sharing the same filter list over in one piece
+    size_t runStart = 0;
+    uint16_t runIndex = NO_PID_FILTERS;
+    size_t offset = 0;
+    for (; offset + packetSize <= size; offset += packetSize) {
+        uint16_t pid = ((data[offset + 1] & 0x1f) << 8) | ((data[offset + 2] & 0xff));
+        if (DEBUG_DEMUX) {
+            ALOGW("[Demux] start ts filter pid: %d", pid);
+        }
+        uint16_t index = mPidFilterIndex[pid];
+        if (index != runIndex) {
+            dispatchToPidFiltersLocked(runIndex, data + runStart, offset - runStart);
+            runStart = offset;
+            runIndex = index;
         }
     }
+    dispatchToPidFiltersLocked(runIndex, data + runStart, offset - runStart);
 }
 
-void Demux::sendFrontendInputToRecord(vector<int8_t> data) {
-    set<int64_t>::iterator it;
+void Demux::dispatchToPidFiltersLocked(uint16_t index, const int8_t* data, size_t size) {
+    if (index == NO_PID_FILTERS || size == 0) {
+        return;
+    }
+    for (const auto& filter : mPidFilters[index]) {
+        filter->updateFilterOutput(data, size);
+    }
+}
+
+void Demux::sendFrontendInputToRecord(const vector<int8_t>& data) {
+    sendFrontendInputToRecord(data.data(), data.size());
+}
+
+void Demux::sendFrontendInputToRecord(const int8_t* data, size_t size) {
     if (DEBUG_DEMUX) {
         ALOGW("[Demux] update record filter output");
     }
-    for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        mFilters[*it]->updateRecordOutput(data);
+    std::lock_guard<std::mutex> lock(mDispatchTableLock);
+    for (const auto& filter : mRecordFilters) {
+        filter->updateRecordOutput(data, size);
     }
 }
 
-void Demux::sendFrontendInputToRecord(vector<int8_t> data, uint16_t pid, uint64_t pts) {
+void Demux::sendFrontendInputToRecord(const vector<int8_t>& data, uint16_t pid, uint64_t pts) {
     sendFrontendInputToRecord(data);
+    std::lock_guard<std::mutex> lock(mDispatchTableLock);
+    for (const auto& filter : mRecordFilters) {
+        if (pid == filter->getTpid()) {
+            filter->updatePts(pts);
+        }
+    }
+}
+
+void Demux::updateFilterDispatchTable() {
+    vector<uint16_t> pidFilterIndex(TS_PID_COUNT, NO_PID_FILTERS);
+    vector<vector<std::shared_ptr<Filter>>> pidFilters;
+    vector<std::shared_ptr<Filter>> recordFilters;
+
     set<int64_t>::iterator it;
+    for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
+        auto filterIt = mFilters.find(*it);
+        if (filterIt == mFilters.end() || filterIt->second->getTpid() >= TS_PID_COUNT) {
+            continue;
+        }
+        uint16_t& index = pidFilterIndex[filterIt->second->getTpid()];
+        if (index == NO_PID_FILTERS) {
+            index = pidFilters.size();
+            pidFilters.emplace_back();
+        }
+        pidFilters[index].push_back(filterIt->second);
+    }
     for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        if (pid == mFilters[*it]->getTpid()) {
-            mFilters[*it]->updatePts(pts);
+        auto filterIt = mFilters.find(*it);
+        if (filterIt != mFilters.end()) {
+            recordFilters.push_back(filterIt->second);
         }
     }
+
+    {
+        std::lock_guard<std::mutex> lock(mDispatchTableLock);
+        mPidFilterIndex.swap(pidFilterIndex);
+        mPidFilters.swap(pidFilters);
+        mRecordFilters.swap(recordFilters);
+    }
+    // The old table is released out of the lock, dropping the last reference to a filter
+    // closes it and calls back into removeFilter().
 }
 
 bool Demux::startBroadcastFilterDispatcher() {
@@ -473,6 +540,7 @@ bool Demux::attachRecordFilter(int64_t filterId) {
 
     mRecordFilterIds.insert(filterId);
     mFilters[filterId]->attachFilterToRecord(mDvrRecord);
+    updateFilterDispatchTable();
 
     return true;
 }
@@ -484,6 +552,7 @@ bool Demux::detachRecordFilter(int64_t filterId) {
 
     mRecordFilterIds.erase(filterId);
     mFilters[filterId]->detachFilterFromRecord();
+    updateFilterDispatchTable();
 
     return true;
 }
@@ -21,8 +21,10 @@
 #include <fmq/AidlMessageQueue.h>
 #include <math.h>
 #include <atomic>
+#include <mutex>
 #include <set>
 #include <thread>
+#include <vector>
 
 #include "Dvr.h"
 #include "Filter.h"
@@ -82,6 +84,11 @@ class Demux : public BnDemux {
     void updateFilterOutput(int64_t filterId, vector<int8_t> data);
     void updateMediaFilterOutput(int64_t filterId, vector<int8_t> data, uint64_t pts);
     uint16_t getFilterTpid(int64_t filterId);
+    /**
+     * Rebuilds the PID dispatch table. Called whenever a filter is opened, configured, removed,
+     * attached to or detached from the record DVR.
+     */
+    void updateFilterDispatchTable();
     void setIsRecording(bool isRecording);
     bool isRecording();
     void startFrontendInputLoop();
@@ -92,10 +99,16 @@ class Demux : public BnDemux {
      * Note that recording filters are not included.
      */
     bool startBroadcastFilterDispatcher();
-    void startBroadcastTsFilter(vector<int8_t> data);
+    void startBroadcastTsFilter(const vector<int8_t>& data);
+    /**
+     * Dispatches a span of contiguous TS packets to the playback filters of each packet's PID.
+     * Consecutive packets of the same PID are handed to their filters in a single write.
+     */
+    void startBroadcastTsFilter(const int8_t* data, size_t size, size_t packetSize);
 
-    void sendFrontendInputToRecord(vector<int8_t> data);
-    void sendFrontendInputToRecord(vector<int8_t> data, uint16_t pid, uint64_t pts);
+    void sendFrontendInputToRecord(const vector<int8_t>& data);
+    void sendFrontendInputToRecord(const int8_t* data, size_t size);
+    void sendFrontendInputToRecord(const vector<int8_t>& data, uint16_t pid, uint64_t pts);
     bool startRecordFilterDispatcher();
 
     void getDemuxInfo(DemuxInfo* demuxInfo);
@@ -129,6 +142,7 @@ class Demux : public BnDemux {
      */
     void deleteEventFlag();
     bool readDataFromMQ();
+    void dispatchToPidFiltersLocked(uint16_t index, const int8_t* data, size_t size);
 
     int32_t mDemuxId = -1;
     int32_t mCiCamId;
@@ -154,6 +168,18 @@ class Demux : public BnDemux {
      */
     std::map<int64_t, std::shared_ptr<Filter>> mFilters;
 
+    /**
+     * TS packet dispatch table, rebuilt from mFilters by updateFilterDispatchTable().
+     * mPidFilterIndex maps each of the 8192 PIDs to its list of playback filters in
+     * mPidFilters, or to NO_PID_FILTERS. mRecordFilters caches the record filters.
+     */
+    static constexpr uint16_t TS_PID_COUNT = 0x2000;
+    static constexpr uint16_t NO_PID_FILTERS = 0xffff;
+    std::mutex mDispatchTableLock;
+    vector<uint16_t> mPidFilterIndex = vector<uint16_t>(TS_PID_COUNT, NO_PID_FILTERS);
+    vector<vector<std::shared_ptr<Filter>>> mPidFilters;
+    vector<std::shared_ptr<Filter>> mRecordFilters;
+
     /**
      * Local reference to the opened Timer Filter instance.
      */
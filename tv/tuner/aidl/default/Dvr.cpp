@@ -266,25 +266,26 @@ PlaybackStatus Dvr::checkPlaybackStatusChange(uint32_t availableToWrite, uint32_
 }
 
 bool Dvr::readPlaybackFMQ(bool isVirtualFrontend, bool isRecording) {
-    // Read playback data from the input FMQ
+    // Read all the complete packets of the playback data from the input FMQ at once
     size_t size = mDvrMQ->availableToRead();
     int64_t playbackPacketSize = mDvrSettings.get<DvrSettings::Tag::playback>().packetSize;
+    if (playbackPacketSize <= 0) {
+        return false;
+    }
+    size -= size % playbackPacketSize;
+    if (size == 0) {
+        return true;
+    }
     vector<int8_t> dataOutputBuffer;
-    dataOutputBuffer.resize(playbackPacketSize);
-    // Dispatch the packet to the PID matching filter output buffer
-    for (int i = 0; i < size / playbackPacketSize; i++) {
-        if (!mDvrMQ->read(dataOutputBuffer.data(), playbackPacketSize)) {
-            return false;
-        }
-        if (isVirtualFrontend) {
-            if (isRecording) {
-                mDemux->sendFrontendInputToRecord(dataOutputBuffer);
-            } else {
-                mDemux->startBroadcastTsFilter(dataOutputBuffer);
-            }
-        } else {
-            startTpidFilter(dataOutputBuffer);
-        }
+    dataOutputBuffer.resize(size);
+    if (!mDvrMQ->read(dataOutputBuffer.data(), size)) {
+        return false;
+    }
+    // Dispatch the packets to the PID matching filter output buffers
+    if (isVirtualFrontend && isRecording) {
+        mDemux->sendFrontendInputToRecord(dataOutputBuffer.data(), size);
+    } else {
+        mDemux->startBroadcastTsFilter(dataOutputBuffer.data(), size, playbackPacketSize);
     }
 
     return true;
@@ -410,19 +411,6 @@ void Dvr::getMetaDataValue(int& index, int8_t* dataOutputBuffer, int& value) {
     }
 }
 
-void Dvr::startTpidFilter(vector<int8_t> data) {
-    map<int64_t, std::shared_ptr<IFilter>>::iterator it;
-    for (it = mFilters.begin(); it != mFilters.end(); it++) {
-        uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
-        if (DEBUG_DVR) {
-            ALOGW("[Dvr] start ts filter pid: %d", pid);
-        }
-        if (pid == mDemux->getFilterTpid(it->first)) {
-            mDemux->updateFilterOutput(it->first, data);
-        }
-    }
-}
-
 bool Dvr::startFilterDispatcher(bool isVirtualFrontend, bool isRecording) {
     if (isVirtualFrontend) {
         if (isRecording) {
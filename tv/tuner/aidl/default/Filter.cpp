@@ -319,6 +319,7 @@ Filter::~Filter() {
     }
 
     mConfigured = true;
+    mDemux->updateFilterDispatchTable();
     return ::ndk::ScopedAStatus::ok();
 }
 
@@ -705,8 +706,12 @@ uint16_t Filter::getTpid() {
 }
 
 void Filter::updateFilterOutput(vector<int8_t>& data) {
+    updateFilterOutput(data.data(), data.size());
+}
+
+void Filter::updateFilterOutput(const int8_t* data, size_t size) {
     std::lock_guard<std::mutex> lock(mFilterOutputLock);
-    mFilterOutput.insert(mFilterOutput.end(), data.begin(), data.end());
+    mFilterOutput.insert(mFilterOutput.end(), data, data + size);
 }
 
 void Filter::updatePts(uint64_t pts) {
@@ -715,8 +720,12 @@ void Filter::updatePts(uint64_t pts) {
 }
 
 void Filter::updateRecordOutput(vector<int8_t>& data) {
+    updateRecordOutput(data.data(), data.size());
+}
+
+void Filter::updateRecordOutput(const int8_t* data, size_t size) {
     std::lock_guard<std::mutex> lock(mRecordFilterOutputLock);
-    mRecordFilterOutput.insert(mRecordFilterOutput.end(), data.begin(), data.end());
+    mRecordFilterOutput.insert(mRecordFilterOutput.end(), data, data + size);
 }
 
 ::ndk::ScopedAStatus Filter::startFilterHandler() {
@@ -137,7 +137,9 @@ class Filter : public BnFilter {
     bool createFilterMQ();
     uint16_t getTpid();
     void updateFilterOutput(vector<int8_t>& data);
+    void updateFilterOutput(const int8_t* data, size_t size);
     void updateRecordOutput(vector<int8_t>& data);
+    void updateRecordOutput(const int8_t* data, size_t size);
     void updatePts(uint64_t pts);
     ::ndk::ScopedAStatus startFilterHandler();
     ::ndk::ScopedAStatus startRecordFilterHandler();